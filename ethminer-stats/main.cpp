@@ -0,0 +1,178 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file main.cpp
+ * Prints the counters a miner publishes with --stats-shm.
+ *
+ * Reads the shared memory segment only, the miner is neither contacted nor
+ * slowed down, however often this runs.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <libdevcore/StatsSegment.h>
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+
+struct Options
+{
+	string name = "ethminer";
+	unsigned watchMs = 0;
+	bool json = false;
+};
+
+void usage()
+{
+	cout
+		<< "Usage ethminer-stats [OPTIONS]" << endl
+		<< "Prints the counters published by ethminer --stats-shm." << endl << endl
+		<< "    --name <name> Shared memory segment to read. (default: ethminer)" << endl
+		<< "    --watch <ms> Print again every ms milliseconds until interrupted." << endl
+		<< "    --json Print one JSON object per line." << endl
+		<< "    -h,--help Show this help message and exit." << endl
+		<< "Exits with 1 when the segment does not exist, 3 when the miner stopped updating it." << endl;
+}
+
+bool parse(int _argc, char** _argv, Options& _o)
+{
+	for (int i = 1; i < _argc; i++)
+	{
+		string const arg = _argv[i];
+		bool const hasValue = i + 1 < _argc;
+		try
+		{
+			if (arg == "--name" && hasValue)
+				_o.name = _argv[++i];
+			else if (arg == "--watch" && hasValue)
+				_o.watchMs = stoul(_argv[++i]);
+			else if (arg == "--json")
+				_o.json = true;
+			else if (arg == "-h" || arg == "--help")
+			{
+				usage();
+				exit(0);
+			}
+			else
+			{
+				cerr << "Invalid argument: " << arg << endl;
+				return false;
+			}
+		}
+		catch (...)
+		{
+			cerr << "Bad " << arg << " option: " << _argv[i] << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+string headerHex(StatsBlock const& _b)
+{
+	ostringstream s;
+	s << "0x" << hex << setfill('0');
+	for (auto c: _b.header)
+		s << setw(2) << (unsigned)c;
+	return s.str();
+}
+
+void printJson(StatsBlock const& _b)
+{
+	cout << "{\"pid\":" << _b.pid << ",\"updated\":" << _b.updatedMs << ",\"uptime\":" << _b.uptimeMs
+		<< ",\"hashrate\":" << _b.hashrate << ",\"accepted\":" << _b.accepted << ",\"acceptedstale\":" << _b.acceptedStale
+		<< ",\"rejected\":" << _b.rejected << ",\"rejectedstale\":" << _b.rejectedStale << ",\"failed\":" << _b.failed
+		<< ",\"epoch\":" << _b.epoch << ",\"height\":" << _b.height << ",\"period\":" << _b.period
+		<< ",\"header\":\"" << headerHex(_b) << "\",\"devices\":[";
+	for (unsigned i = 0; i < _b.devices; i++)
+	{
+		StatsDevice const& d = _b.device[i];
+		cout << (i ? "," : "") << "{\"hashrate\":" << d.hashrate << ",\"temp\":" << d.tempC << ",\"fan\":" << d.fanP
+			<< ",\"power\":" << d.powerMW / 1000.0 << ",\"intensity\":" << d.intensity / 1000.0 << ",\"window\":[";
+		// Oldest first.
+		for (unsigned w = 1; w <= c_statsWindow; w++)
+			cout << (w > 1 ? "," : "") << d.window[(_b.windowHead + w) % c_statsWindow];
+		cout << "]}";
+	}
+	cout << "]}" << endl;
+}
+
+void printText(StatsBlock const& _b)
+{
+	cout << fixed << setprecision(2)
+		<< "pid " << _b.pid << "  up " << _b.uptimeMs / 1000 << "s  " << _b.hashrate / 1e6 << " Mh/s"
+		<< "  [A" << _b.accepted << "+" << _b.acceptedStale << ":R" << _b.rejected << "+" << _b.rejectedStale
+		<< ":F" << _b.failed << "]" << endl
+		<< "job " << headerHex(_b) << "  height " << _b.height << "  epoch " << _b.epoch << "  period " << _b.period << endl;
+	for (unsigned i = 0; i < _b.devices; i++)
+	{
+		StatsDevice const& d = _b.device[i];
+		cout << "gpu/" << i << " " << setw(7) << d.hashrate / 1e6 << " Mh/s  " << d.tempC << "C " << d.fanP << "%"
+			<< setprecision(0) << " " << d.powerMW / 1000.0 << "W  intensity " << d.intensity / 10.0 << "%" << setprecision(2) << endl;
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse(argc, argv, options))
+		return 2;
+
+	unique_ptr<StatsReader> reader = StatsReader::open(options.name);
+	if (!reader)
+	{
+		cerr << "No stats segment " << options.name << ", start the miner with --stats-shm" << endl;
+		return 1;
+	}
+	if (reader->version() != StatsSegment::c_version)
+		cerr << "Segment layout " << reader->version() << ", this reader knows " << StatsSegment::c_version << endl;
+
+	while (true)
+	{
+		StatsBlock b;
+		if (!reader->read(b))
+		{
+			cerr << "The miner keeps the segment busy" << endl;
+			return 3;
+		}
+
+		// The miner updates once per window slot while mining.
+		auto const now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		bool const stale = b.updatedMs + 10 * b.windowMs < (uint64_t)now;
+
+		if (options.json)
+			printJson(b);
+		else
+		{
+			printText(b);
+			if (stale)
+				cout << "not updated for " << (now - b.updatedMs) / 1000 << "s" << endl;
+		}
+		if (!options.watchMs)
+			return stale ? 3 : 0;
+		this_thread::sleep_for(chrono::milliseconds(options.watchMs));
+	}
+}
@@ -22,10 +22,12 @@
  * CLI module for mining.
  */
 
+#include <atomic>
 #include <thread>
 #include <chrono>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <signal.h>
 #include <random>
 
@@ -34,9 +36,12 @@
 #include <boost/optional.hpp>
 
 #include <libethcore/Exceptions.h>
+#include <libdevcore/EventLoop.h>
 #include <libdevcore/SHA3.h>
+#include <libdevcore/Trace.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Farm.h>
+#include <libethcore/SimMiner.h>
 #include <ethminer-buildinfo.h>
 #if ETH_ETHASHCL
 #include <libethash-cl/CLMiner.h>
@@ -44,6 +49,10 @@
 #if ETH_ETHASHCUDA
 #include <libethash-cuda/CUDAMiner.h>
 #endif
+#if ETH_ETHASHCPU
+#include <libethash-cpu/CPUMiner.h>
+#include <libprogpow/ProgPowJit.h>
+#endif
 #include <libpoolprotocols/PoolManager.h>
 #include <libpoolprotocols/stratum/EthStratumClient.h>
 #include <libpoolprotocols/getwork/EthGetworkClient.h>
@@ -54,6 +63,8 @@
 #endif
 #if API_CORE
 #include <libapicore/Api.h>
+#include <libapicore/PushServer.h>
+#include <libapicore/ValidateServer.h>
 #endif
 
 using namespace std;
@@ -79,6 +90,7 @@ inline std::string toJS(unsigned long _n)
 }
 
 bool g_running = false;
+std::atomic<bool> g_reload = {false};
 
 class MinerCLI
 {
@@ -89,7 +101,8 @@ public:
 		Benchmark,
 		Simulation,
 		Farm,
-		Stratum
+		Stratum,
+		ValidateServer
 	};
 
 	MinerCLI() {m_endpoints.resize(k_max_endpoints);}
@@ -100,6 +113,12 @@ public:
 		g_running = false;
 	}
 
+	static void reloadHandler(int sig)
+	{
+		(void)sig;
+		g_reload = true;
+	}
+
 	void deprecated(const string& arg)
 	{
 		cerr << "Warning: " << arg << " is deprecated. Use the -P parameter instead." << endl;
@@ -195,6 +214,24 @@ public:
 				cerr << "Bad " << arg << " option: " << argv[i] << endl;
 				BOOST_THROW_EXCEPTION(BadArgument());
 			}
+		else if (arg == "--pool-probe" && i + 1 < argc)
+			try {
+				m_poolProbe = stoul(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--pool-prefer" && i + 1 < argc)
+			try {
+				m_poolPreferMs = stoul(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
 		else if ((arg == "-S" || arg == "--stratum") && i + 1 < argc)
 		{
 			deprecated(arg);
@@ -321,6 +358,15 @@ public:
 		{
 			m_report_stratum_hashrate = true;
 		}
+		else if (arg == "--loop-threads" && i + 1 < argc)
+			try {
+				EventLoop::setThreads(max(1ul, stoul(argv[++i])));
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
 		else if (arg == "--display-interval" && i + 1 < argc)
 		{
 			try {
@@ -391,6 +437,47 @@ public:
 		{
 			m_api_port = atoi(argv[++i]);
 		}
+		else if (arg == "--api-push-port" && i + 1 < argc)
+			try
+			{
+				m_pushPort = stol(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--api-push-interval" && i + 1 < argc)
+			try
+			{
+				m_pushInterval = stol(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--validate-server" && i + 1 < argc)
+			try
+			{
+				m_validatePort = stol(argv[++i]);
+				m_mode = OperationMode::ValidateServer;
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--validate-threads" && i + 1 < argc)
+			try
+			{
+				m_validateThreads = stol(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
 #endif
 #if ETH_ETHASHCL
 		else if (arg == "--opencl-platform" && i + 1 < argc)
@@ -441,6 +528,8 @@ public:
 				BOOST_THROW_EXCEPTION(BadArgument());
 			}
 		}
+		else if (arg == "--cl-subgroups")
+			m_openclSubgroups = true;
 		else if ( arg == "--cl-global-work"  && i + 1 < argc)
 		{
 			try
@@ -539,6 +628,39 @@ public:
 		else if (arg == "--cuda-noeval")
 			m_cudaNoEval = true;
 #endif
+#if ETH_ETHASHCPU
+		else if (arg == "--cpu-interleave" && i + 1 < argc)
+			try
+			{
+				string k = argv[++i];
+				m_cpuInterleave = k == "auto" ? 0 : stol(k);
+				if (m_cpuInterleave > ProgPow::MAX_INTERLEAVE)
+					throw std::out_of_range(k);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--cpu-jit")
+		{
+			char const* cxx = getenv("CXX");
+			m_cpuJitCompiler = cxx && *cxx ? cxx : "c++";
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				m_cpuJitCompiler = argv[++i];
+		}
+		else if (arg == "--cpu-jit-dir" && i + 1 < argc)
+			m_cpuJitDir = argv[++i];
+#endif
+		else if (arg == "--dag-parallel" && i + 1 < argc)
+			try {
+				m_dagParallel = stol(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
 		else if ((arg == "-L" || arg == "--dag-load-mode") && i + 1 < argc)
 		{
 			string mode = argv[++i];
@@ -555,6 +677,108 @@ public:
 				BOOST_THROW_EXCEPTION(BadArgument());
 			}
 		}
+		else if (arg == "--verify-cache" && i + 1 < argc)
+			try {
+				m_verifyCacheMB = stoul(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--dag-headroom" && i + 1 < argc)
+			try {
+				m_dagHeadroom = stoul(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--gov-temp" && i + 1 < argc)
+			try {
+				m_governor.tempC = stoi(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--gov-power" && i + 1 < argc)
+			try {
+				m_governor.powerW = stod(argv[++i]);
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--gov-floor" && i + 1 < argc)
+			try {
+				unsigned floor = stoul(argv[++i]);
+				if (floor == 0 || floor > 100)
+					throw std::out_of_range("floor");
+				m_governor.floor = floor / 100.0f;
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--trace" && i + 1 < argc)
+			m_tracePath = argv[++i];
+		else if (arg == "--config" && i + 1 < argc)
+		{
+			if (m_inConfig)
+			{
+				cerr << "Bad " << arg << " option: configuration files do not nest" << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+			m_configFile = argv[++i];
+			m_args.assign(argv, argv + argc);
+			if (!loadConfig(m_configFile))
+				BOOST_THROW_EXCEPTION(BadArgument());
+		}
+		else if (arg == "--watchdog" && i + 1 < argc)
+			try {
+				m_watchdog.factor = stof(argv[++i]);
+				if (m_watchdog.factor < 0)
+					throw std::out_of_range("factor");
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--watchdog-min" && i + 1 < argc)
+			try {
+				m_watchdog.minStallMs = stoul(argv[++i]) * 1000;
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		else if (arg == "--stats-shm" && i + 1 < argc)
+			m_statsShm = argv[++i];
+		else if (arg == "--shared-memory")
+			m_sharedMemory = true;
+		else if (arg == "--host-dag-pages" && i + 1 < argc)
+		{
+			if (!HostMemory::parseHugePages(argv[++i], m_hostMemory.hugePages))
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		}
+		else if (arg == "--numa" && i + 1 < argc)
+		{
+			if (!HostMemory::parseNumaPolicy(argv[++i], m_hostMemory.numa))
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
+		}
 		else if (arg == "--benchmark-warmup" && i + 1 < argc)
 			try {
 				m_benchmarkWarmup = stol(argv[++i]);
@@ -583,6 +807,17 @@ public:
 				cerr << "Bad " << arg << " option: " << argv[i] << endl;
 				BOOST_THROW_EXCEPTION(BadArgument());
 			}
+		else if (arg == "--benchmark-farm" && i + 1 < argc)
+			try
+			{
+				m_benchmarkFarm = stol(argv[++i]);
+				m_mode = OperationMode::Benchmark;
+			}
+			catch (...)
+			{
+				cerr << "Bad " << arg << " option: " << argv[i] << endl;
+				BOOST_THROW_EXCEPTION(BadArgument());
+			}
 		else if (arg == "-G" || arg == "--opencl")
 			m_minerType = MinerType::CL;
 		else if (arg == "-U" || arg == "--cuda")
@@ -593,6 +828,8 @@ public:
 		{
 			m_minerType = MinerType::Mixed;
 		}
+		else if (arg == "--cpu")
+			m_minerType = MinerType::CPU;
 		else if (arg == "-M" || arg == "--benchmark")
 		{
 			m_mode = OperationMode::Benchmark;
@@ -658,6 +895,51 @@ public:
 		return true;
 	}
 
+	/// Reads the options of @a _file, in command line syntax, one or more per line.
+	/// Lines starting with '#' are comments.
+	bool loadConfig(string const& _file)
+	{
+		ifstream in(_file);
+		if (!in)
+		{
+			cerr << "Cannot read configuration " << _file << endl;
+			return false;
+		}
+		vector<string> words{_file};
+		string line;
+		while (getline(in, line))
+		{
+			boost::trim(line);
+			if (line.empty() || line[0] == '#')
+				continue;
+			istringstream ss(line);
+			for (string w; ss >> w;)
+				words.push_back(w);
+		}
+
+		vector<char*> argv;
+		for (string& w: words)
+			argv.push_back(&w[0]);
+		int argc = (int)argv.size();
+		bool ok = true;
+		m_inConfig = true;
+		try
+		{
+			for (int i = 1; i < argc && ok; ++i)
+				if (!interpretOption(i, argc, argv.data()))
+				{
+					cerr << "Invalid argument in " << _file << ": " << argv[i] << endl;
+					ok = false;
+				}
+		}
+		catch (BadArgument const&)
+		{
+			ok = false;
+		}
+		m_inConfig = false;
+		return ok;
+	}
+
 	void execute()
 	{
 		if (m_shouldListDevices)
@@ -673,11 +955,33 @@ public:
 			exit(0);
 		}
 
+		if (!m_tracePath.empty())
+			Trace::start(m_tracePath);
+		EthashAux::setItemCacheBudget((size_t)m_verifyCacheMB * 1024 * 1024);
+#if ETH_ETHASHCPU
+		if (!m_cpuJitCompiler.empty())
+			ProgPowJit::configure(m_cpuJitCompiler, m_cpuJitDir, [](string const& _msg) { cnote << _msg; });
+#endif
+		Miner::setDagHeadroom(m_dagHeadroom);
+		EthashAux::setSharedMemory(m_sharedMemory);
+		HostMemory::setPolicy(m_hostMemory);
+
 		auto* build = ethminer_get_buildinfo();
 		minelog << "ethminer version " << build->project_version;
 		minelog << "Build: " << build->system_name << "/" << build->build_type
 			 << "+git." << string(build->git_commit_hash).substr(0, 7);
 
+#if API_CORE
+		if (m_mode == OperationMode::ValidateServer)
+		{
+			// No miners in this mode, the devices are left alone.
+			g_running = true;
+			signal(SIGINT, MinerCLI::signalHandler);
+			signal(SIGTERM, MinerCLI::signalHandler);
+			doValidateServer();
+		}
+#endif
+
 		if (m_minerType == MinerType::CL || m_minerType == MinerType::Mixed)
 		{
 #if ETH_ETHASHCL
@@ -689,6 +993,7 @@ public:
 
 			CLMiner::setCLKernel(m_openclSelectedKernel);
 			CLMiner::setThreadsPerHash(m_openclThreadsPerHash);
+			CLMiner::setSubgroups(m_openclSubgroups);
 
 			if (!CLMiner::configureGPU(
 					m_localWorkSize,
@@ -735,12 +1040,25 @@ public:
 			exit(1);
 #endif
 		}
+		if (m_minerType == MinerType::CPU)
+		{
+#if ETH_ETHASHCPU
+			CPUMiner::configure(m_miningThreads == UINT_MAX ? 0 : m_miningThreads, m_cpuInterleave, m_exit);
+#else
+			cerr << "CPU mining disabled. Configure project build with -DETHASHCPU=ON" << endl;
+			exit(1);
+#endif
+		}
+
+		InitPipeline::configure(m_dagParallel, m_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL);
 
 		g_running = true;
 		signal(SIGINT, MinerCLI::signalHandler);
 		signal(SIGTERM, MinerCLI::signalHandler);
 
-		if (m_mode == OperationMode::Benchmark)
+		if (m_mode == OperationMode::Benchmark && m_benchmarkFarm)
+			doFarmBenchmark(m_benchmarkFarm, m_benchmarkWarmup, m_benchmarkTrial, m_benchmarkTrials);
+		else if (m_mode == OperationMode::Benchmark)
 			doBenchmark(m_minerType, m_benchmarkWarmup, m_benchmarkTrial, m_benchmarkTrials);
 		else if (m_mode == OperationMode::Farm || m_mode == OperationMode::Stratum || m_mode == OperationMode::Simulation) {
 			
@@ -755,6 +1073,9 @@ public:
 			<< "    -F,--farm <url>  (deprecated) Put into mining farm mode with the work server at URL (default: http://127.0.0.1:8545)" << endl
 			<< "    -FF,-FO, --farm-failover, --stratum-failover <url> (deprecated) Failover getwork/stratum URL (default: disabled)" << endl
 			<< "	--farm-retries <n> Number of retries until switch to failover (default: 3)" << endl
+			<< "    --pool-probe <n> Time a connect and subscribe to every pool each n seconds, 0 disables. (default: 0)" << endl
+			<< "    --pool-prefer <n> Move to a healthy pool whose probes answer n ms faster than the active one," << endl
+			<< "        at most every 5 minutes, 0 disables. Probes every 60 seconds unless --pool-probe is given. (default: 0)" << endl
 			<< "	-S, --stratum <host:port>  (deprecated) Put into stratum mode with the stratum server at host:port" << endl
 			<< "	-SF, --stratum-failover <host:port>  (deprecated) Failover stratum server at host:port" << endl
 			<< "    -O, --userpass <username.workername:password> (deprecated) Stratum login credentials" << endl
@@ -772,6 +1093,18 @@ public:
 			<< "    -HWMON [<n>], Displays gpu temp, fan percent and power usage. Note: In linux, the program uses sysfs, which may require running with root privileges." << endl
 			<< "        0: Displays only temp and fan percent (default)" << endl
 			<< "        1: Also displays power usage" << endl
+			<< "    --gov-temp <n> Lower the launch size of a GPU above n degrees C and raise it back once cooler, 0 disables. (default: 0)" << endl
+			<< "    --gov-power <n> The same for a board power above n W. (default: 0)" << endl
+			<< "    --gov-floor <n> Lowest launch size the governor goes to, in percent. (default: 25)" << endl
+			<< "    --trace <file> Write a timeline of startup, DAG, kernel builds and job switches at exit," << endl
+			<< "        in Chrome trace event format for chrome://tracing or Perfetto." << endl
+			<< "    --watchdog <n> A GPU reporting no hashes for n times its usual batch time is kicked, then reinitialised," << endl
+			<< "        then restarted alone, 0 disables. (default: 20)" << endl
+			<< "    --watchdog-min <n> Seconds without hashes never taken for a stall below. (default: 15)" << endl
+			<< "    --config <file> Read options from file, in command line syntax with '#' comment lines. Pools, display," << endl
+			<< "        hardware monitoring and launch sizes are read again on SIGHUP or miner_reload without a restart." << endl
+			<< "    --stats-shm <name> Publish hashrates, shares, job and sensor readings every second in shared memory" << endl
+			<< "        segment name (/dev/shm/name on Linux), read it with ethminer-stats --name name." << endl
 			<< "    --exit Stops the miner whenever an error is encountered" << endl
 			<< "    -SE, --stratum-email <s> Email address used in eth-proxy (optional)" << endl
 			<< "    --farm-recheck <n>  Leave n ms between checks for changed work (default: 500). When using stratum, use a high value (i.e. 2000) to get more stable hashrate output" << endl
@@ -788,22 +1121,38 @@ public:
 			<< "    --benchmark-warmup <seconds>  Set the duration of warmup for the benchmark tests (default: 3)." << endl
 			<< "    --benchmark-trial <seconds>  Set the duration for each trial for the benchmark tests (default: 3)." << endl
 			<< "    --benchmark-trials <n>  Set the number of benchmark trials to run (default: 5)." << endl
+			<< "    --benchmark-farm <n>  Benchmark job switches and stats reads of the farm alone, with <n> simulated miners." << endl
 			<< "Simulation mode:" << endl
 			<< "    -Z [<n>],--simulation [<n>] Mining test mode. Used to validate kernel optimizations. Optionally specify block number." << endl
 			<< "Mining configuration:" << endl
 			<< "    -G,--opencl  When mining use the GPU via OpenCL." << endl
 			<< "    -U,--cuda  When mining use the GPU via CUDA." << endl
+			<< "    --cpu  When mining use the host CPUs, one thread per hardware thread unless limited with -t." << endl
 			<< "    -X,--cuda-opencl Use OpenCL + CUDA in a system with mixed AMD/Nvidia cards. May require setting --opencl-platform 1 or 2. Use --list-devices option to check which platform is your AMD. " << endl
 			<< "    --opencl-platform <n>  When mining using -G/--opencl use OpenCL platform n (default: 0)." << endl
 			<< "    --opencl-device <n>  When mining using -G/--opencl use OpenCL device n (default: 0)." << endl
 			<< "    --opencl-devices <0 1 ..n> Select which OpenCL devices to mine on. Default is to use all" << endl
 			<< "    -t, --mining-threads <n> Limit number of CPU/GPU miners to n (default: use everything available on selected platform)" << endl
 			<< "    --list-devices List the detected OpenCL/CUDA devices and exit. Should be combined with -G, -U, or -X flag" << endl
-			<< "    --display-interval <n> Set mining stats display interval in seconds. (default: every 5 seconds)" << endl			
+			<< "    --display-interval <n> Set mining stats display interval in seconds. (default: every 5 seconds)" << endl
+			<< "    --loop-threads <n> Threads running the timers and pool connections. (default: " << EventLoop::c_defaultThreads << ")" << endl			
 			<< "    -L, --dag-load-mode <mode> DAG generation mode." << endl
 			<< "        parallel    - load DAG on all GPUs at the same time (default)" << endl
 			<< "        sequential  - load DAG on GPUs one after another. Use this when the miner crashes during DAG generation" << endl
 			<< "        single <n>  - generate DAG on device n, then copy to other devices" << endl
+			<< "    --dag-parallel <n> Devices generating or uploading their DAG at the same time, 0 for all. (default: 0)" << endl
+			<< "    --verify-cache <n> Memory in MB for DAG items memoized by host share verification, 0 disables it. (default: 64)" << endl
+			<< "    --dag-headroom <n> Epochs of DAG growth device buffers are reserved for, reused until outgrown. (default: " << Miner::c_defaultDagHeadroom << ")" << endl
+			<< "    --shared-memory Share light caches and host DAGs with other ethminer processes through POSIX shared memory (/dev/shm)" << endl
+			<< "    --host-dag-pages <mode> Page size of DAG copies kept in host memory." << endl
+			<< "        none  - regular pages" << endl
+			<< "        thp   - transparent huge pages (default)" << endl
+			<< "        2m    - 2 MB pages from the hugetlb pool, falls back to thp" << endl
+			<< "        1g    - 1 GB pages from the hugetlb pool, falls back to 2m" << endl
+			<< "    --numa <mode> NUMA placement of host DAG copies." << endl
+			<< "        none        - first touch (default)" << endl
+			<< "        interleave  - spread pages over all nodes" << endl
+			<< "        replicate   - one copy per node, miner threads bound to the node of their device" << endl
 #if ETH_ETHASHCL
 			<< " OpenCL configuration:" << endl
 			<< "    --cl-kernel <n>  Use a different OpenCL kernel (default: use stable kernel)" << endl
@@ -812,6 +1161,8 @@ public:
 			<< "    --cl-local-work Set the OpenCL local work size. Default is " << CLMiner::c_defaultLocalWorkSize << endl
 			<< "    --cl-global-work Set the OpenCL global work size as a multiple of the local work size. Default is " << CLMiner::c_defaultGlobalWorkSizeMultiplier << " * " << CLMiner::c_defaultLocalWorkSize << endl
 			<< "    --cl-parallel-hash <1 2 ..8> Define how many threads to associate per hash. Default=8" << endl
+			<< "    --cl-subgroups Exchange lane values through sub-group shuffles where available instead of local memory" << endl
+			<< "        Check the device with progpow-check --subgroup first" << endl
 #endif
 #if ETH_ETHASHCUDA
 			<< " CUDA configuration:" << endl
@@ -830,9 +1181,25 @@ public:
 			<< "        Use at your own risk! If GPU generates errored results they WILL be forwarded to the pool" << endl
 			<< "        Not recommended at high overclock." << endl
 #endif
+#if ETH_ETHASHCPU
+			<< " CPU configuration:" << endl
+			<< "    --cpu-interleave <n|auto> Hashes kept in flight by each CPU thread to hide DAG load latency, 1 to " << ProgPow::MAX_INTERLEAVE << " (default: auto, tuned on each new epoch)" << endl
+			<< "    --cpu-jit [<compiler>] Build the program of each period for the host with compiler, $CXX or c++ by default," << endl
+			<< "        for the CPU miners and share verification. The interpreter runs until the build is loaded." << endl
+			<< "    --cpu-jit-dir <dir> Where the built programs are kept. Must be owned by this user and not group or world writable. (default: ~/.cache/ethminer)" << endl
+#endif
 #if API_CORE
 			<< " API core configuration:" << endl
 			<< "    --api-port Set the api port, the miner should listen to. Use 0 to disable. Default=0, use negative numbers to run in readonly mode. for example -3333." << endl
+			<< "    --api-push-port <port> Stream telemetry to subscribers on port, one JSON object per line: stats at every" << endl
+			<< "        interval with the hardware readings that changed, share and job events as they happen. (default: 0, off)" << endl
+			<< "    --api-push-interval <ms> Milliseconds between two telemetry samples, at least " << PushServer::c_minInterval << ". (default: 1000)" << endl
+			<< "Share validation mode:" << endl
+			<< "    --validate-server <port> Do not mine, serve JSON-RPC share validation for a pool on port instead." << endl
+			<< "        validator_check {\"shares\": [{\"header\", \"nonce\", \"height\", \"mix\", \"boundary\"}, ...]} returns {\"verdicts\": [...]}" << endl
+			<< "        with one of valid, badmix, lowdifficulty or error per share. validator_stats returns throughput and latency." << endl
+			<< "        validator_warm {\"height\"} builds the light cache of a height ahead of its shares, the next epoch is built unasked." << endl
+			<< "    --validate-threads <n> Threads verifying shares (default: one per hardware thread)" << endl
 #endif
 			;
 	}
@@ -856,11 +1223,16 @@ private:
 		sealers["cuda"] = Farm::SealerDescriptor{
 			&CUDAMiner::instances, [](FarmFace& _farm, unsigned _index){ return new CUDAMiner(_farm, _index); }
 		};
+#endif
+#if ETH_ETHASHCPU
+		sealers["cpu"] = Farm::SealerDescriptor{
+			&CPUMiner::instances, [](FarmFace& _farm, unsigned _index){ return new CPUMiner(_farm, _index); }
+		};
 #endif
 		f.setSealers(sealers);
 		f.onSolutionFound([&](Solution) { return false; });
 
-		string platformInfo = _m == MinerType::CL ? "CL" : "CUDA";
+		string platformInfo = _m == MinerType::CL ? "CL" : _m == MinerType::CPU ? "CPU" : "CUDA";
 		cout << "Benchmarking on platform: " << platformInfo << endl;
 
 		cout << "Preparing DAG for block #" << m_benchmarkBlock << endl;
@@ -870,6 +1242,8 @@ private:
 			f.start("opencl", false);
 		else if (_m == MinerType::CUDA)
 			f.start("cuda", false);
+		else if (_m == MinerType::CPU)
+			f.start("cpu", false);
 
 		WorkPackage current = WorkPackage(genesis);
 		
@@ -909,9 +1283,111 @@ private:
 		else
 			cout << "inner mean: n/a" << endl;
 
+		Trace::stop();
 		exit(0);
 	}
 	
+	/// Times job switches and stats reads of a farm of simulated miners, the devices out of the picture.
+	void doFarmBenchmark(unsigned _miners, unsigned _warmupDuration, unsigned _trialDuration, unsigned _trials)
+	{
+		/// Jobs sent in a burst at the start of each trial.
+		unsigned const c_jobs = 100;
+
+		SimMiner::setNumInstances(_miners);
+		Farm f;
+		map<string, Farm::SealerDescriptor> sealers;
+		sealers["sim"] = Farm::SealerDescriptor{
+			&SimMiner::instances, [](FarmFace& _farm, unsigned _index){ return new SimMiner(_farm, _index); }
+		};
+		f.setSealers(sealers);
+		f.onSolutionFound([&](Solution) { return false; });
+		f.start("sim", false);
+		cout << "Benchmarking the farm with " << SimMiner::instances() << " simulated miners" << endl;
+
+		BlockHeader genesis;
+		genesis.setNumber(m_benchmarkBlock);
+		genesis.setDifficulty(u256(1) << 64);
+		WorkPackage current = WorkPackage(genesis);
+		current.header = h256::random();
+		f.setWork(current);
+		cout << "Warming up..." << endl;
+		this_thread::sleep_for(chrono::seconds(_warmupDuration));
+
+		auto micros = [](chrono::steady_clock::time_point _since) {
+			return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - _since).count();
+		};
+
+		// Stats are read all along, how long they wait shows what the switches hold.
+		atomic<bool> reading = {true};
+		uint64_t reads = 0;
+		uint64_t readUs = 0;
+		uint64_t readMaxUs = 0;
+		thread reader([&]() {
+			while (reading)
+			{
+				auto const start = chrono::steady_clock::now();
+				f.miningProgress();
+				uint64_t const us = micros(start);
+				reads++;
+				readUs += us;
+				readMaxUs = max(readMaxUs, us);
+				this_thread::sleep_for(chrono::milliseconds(1));
+			}
+		});
+
+		for (unsigned i = 1; i <= _trials; ++i)
+		{
+			uint64_t jobUs = 0;
+			uint64_t jobMaxUs = 0;
+			for (unsigned j = 0; j < c_jobs; j++)
+			{
+				current.header = h256::random();
+				auto const start = chrono::steady_clock::now();
+				f.setWork(current);
+				uint64_t const us = micros(start);
+				jobUs += us;
+				jobMaxUs = max(jobMaxUs, us);
+			}
+			this_thread::sleep_for(chrono::seconds(_trialDuration));
+			cout << "Trial " << i << ": setWork " << jobUs / c_jobs << " us mean " << jobMaxUs << " us max, "
+				<< f.miningProgress().rate() << " of " << SimMiner::expectedRate(SimMiner::instances()) << " H/s" << endl;
+		}
+		reading = false;
+		reader.join();
+		cout << "miningProgress: " << (reads ? readUs / reads : 0) << " us mean " << readMaxUs << " us max over " << reads << " reads" << endl;
+
+		f.stop();
+		Trace::stop();
+		exit(0);
+	}
+
+#if API_CORE
+	void doValidateServer()
+	{
+		ShareValidator validator(m_validateThreads);
+		TcpSocketServer conn("0.0.0.0", m_validatePort);
+		ValidateServer server(&conn, JSONRPC_SERVER_V2, validator);
+		if (!server.StartListening())
+		{
+			cwarn << "Cannot listen on port " << m_validatePort;
+			exit(1);
+		}
+		minelog << "Validating shares on port " << m_validatePort << " with " << validator.threads() << " threads";
+
+		while (g_running)
+		{
+			this_thread::sleep_for(chrono::seconds(m_displayInterval));
+			ShareValidatorStats s = validator.stats();
+			minelog << "Shares " << s.shares << " [V" << s.valid << ":M" << s.badMix << ":D" << s.lowDifficulty << ":E" << s.errors << "] "
+				<< fixed << setprecision(1) << s.sharesPerSecond() << " shares/s, batch latency "
+				<< setprecision(2) << s.meanLatencyMs() << " ms mean " << s.maxLatencyUs / 1000.0 << " ms max";
+		}
+
+		server.StopListening();
+		exit(0);
+	}
+#endif
+
 	void doMiner()
 	{
 		map<string, Farm::SealerDescriptor> sealers;
@@ -921,6 +1397,9 @@ private:
 #if ETH_ETHASHCUDA
 		sealers["cuda"] = Farm::SealerDescriptor{&CUDAMiner::instances, [](FarmFace& _farm, unsigned _index){ return new CUDAMiner(_farm, _index); }};
 #endif
+#if ETH_ETHASHCPU
+		sealers["cpu"] = Farm::SealerDescriptor{&CPUMiner::instances, [](FarmFace& _farm, unsigned _index){ return new CPUMiner(_farm, _index); }};
+#endif
 
 		PoolClient *client = nullptr;
 		if (m_mode == OperationMode::Stratum) {
@@ -946,23 +1425,28 @@ private:
 		//sealers, m_minerType
 		Farm f;
 		f.setSealers(sealers);
+		f.setGovernor(m_governor);
+		f.setWatchdog(m_watchdog);
+		if (!m_statsShm.empty() && !f.publishStats(m_statsShm))
+			cwarn << "Stats are not published in shared memory";
 
 		PoolManager mgr(client, f, m_minerType);
 		mgr.setReconnectTries(m_maxFarmRetries);
+		if (m_mode != OperationMode::Simulation)
+			mgr.setProbing(m_poolProbe || !m_poolPreferMs ? m_poolProbe : 60, m_poolPreferMs, m_mode == OperationMode::Stratum);
 
-		if (m_legacyParameters && !m_endpoints[k_secondary_ep_ix].User().empty()) {
-			m_endpoints[k_secondary_ep_ix].User(m_endpoints[k_primary_ep_ix].User());
-			m_endpoints[k_secondary_ep_ix].Pass(m_endpoints[k_primary_ep_ix].Pass());
-		}
-		for (unsigned i = 0; i < k_max_endpoints; i++)
-		{
-			if (m_endpoints[i].Host().empty())
-				break;
-			mgr.addConnection(m_endpoints[i]);
-		}
+		for (PoolConnection& conn: pools())
+			mgr.addConnection(conn);
+		f.onReloadRequest([]() { g_reload = true; });
+#ifdef SIGHUP
+		signal(SIGHUP, MinerCLI::reloadHandler);
+#endif
 
 #if API_CORE
 		Api api(this->m_api_port, f);
+		unique_ptr<PushServer> push;
+		if (m_pushPort)
+			push.reset(new PushServer(m_pushPort, m_pushInterval, f));
 #endif
 
 		// Start PoolManager
@@ -981,14 +1465,123 @@ private:
 			else {
 				minelog << "not-connected";
 			}
-			this_thread::sleep_for(chrono::seconds(m_displayInterval));
+			auto const next = chrono::steady_clock::now() + chrono::seconds(m_displayInterval);
+			while (g_running && chrono::steady_clock::now() < next)
+			{
+				if (g_reload.exchange(false))
+					reload(mgr, f);
+				this_thread::sleep_for(chrono::milliseconds(200));
+			}
 		}
 
 		mgr.stop();
+		logLockProfile();
+		Trace::stop();
 
 		exit(0);
 	}
 
+	/// Pool list of the endpoint options, the legacy secondary user following the primary one.
+	vector<PoolConnection> pools() const
+	{
+		vector<PoolConnection> endpoints = m_endpoints;
+		if (m_legacyParameters && !endpoints[k_secondary_ep_ix].User().empty()) {
+			endpoints[k_secondary_ep_ix].User(endpoints[k_primary_ep_ix].User());
+			endpoints[k_secondary_ep_ix].Pass(endpoints[k_primary_ep_ix].Pass());
+		}
+		vector<PoolConnection> pools;
+		for (PoolConnection const& conn: endpoints)
+		{
+			if (conn.Host().empty())
+				break;
+			pools.push_back(conn);
+		}
+		return pools;
+	}
+
+	/// Reads the command line and its configuration file again and applies what
+	/// changes while mining: pools, display, hardware monitoring and launch sizes.
+	void reload(PoolManager& _mgr, Farm& _f)
+	{
+		if (m_configFile.empty())
+		{
+			cwarn << "Nothing to reload without --config";
+			return;
+		}
+		cnote << "Reloading " + m_configFile;
+
+		MinerCLI fresh;
+		vector<string> args = m_args;
+		vector<char*> argv;
+		for (string& a: args)
+			argv.push_back(&a[0]);
+		int argc = (int)argv.size();
+		try
+		{
+			// Skips the options main handles, all were checked at startup.
+			for (int i = 1; i < argc; ++i)
+				fresh.interpretOption(i, argc, argv.data());
+		}
+		catch (...)
+		{
+			cwarn << "Bad configuration, keeping the running one";
+			return;
+		}
+
+		if (fresh.m_mode != m_mode || fresh.m_minerType != m_minerType)
+			cwarn << "Changes of protocol or device type take a restart";
+		else if (fresh.pools() != pools())
+		{
+			_mgr.setConnections(fresh.pools());
+			m_endpoints = fresh.m_endpoints;
+			m_legacyParameters = fresh.m_legacyParameters;
+		}
+
+		m_displayInterval = fresh.m_displayInterval;
+		m_show_hwmonitors = fresh.m_show_hwmonitors;
+		m_show_power = fresh.m_show_power;
+
+#if ETH_ETHASHCL
+		if (fresh.m_localWorkSize != m_localWorkSize || fresh.m_globalWorkSizeMultiplier != m_globalWorkSizeMultiplier)
+		{
+			m_localWorkSize = fresh.m_localWorkSize;
+			m_globalWorkSizeMultiplier = fresh.m_globalWorkSizeMultiplier;
+			_f.setSealerLaunch("opencl", MinerLaunch{m_localWorkSize, m_globalWorkSizeMultiplier * m_localWorkSize, 0});
+		}
+#endif
+#if ETH_ETHASHCUDA
+		if (fresh.m_cudaBlockSize != m_cudaBlockSize || fresh.m_cudaGridSize != m_cudaGridSize || fresh.m_numStreams != m_numStreams)
+		{
+			m_cudaBlockSize = fresh.m_cudaBlockSize;
+			m_cudaGridSize = fresh.m_cudaGridSize;
+			m_numStreams = fresh.m_numStreams;
+			_f.setSealerLaunch("cuda", MinerLaunch{m_cudaBlockSize, m_cudaGridSize, m_numStreams});
+		}
+#endif
+#if ETH_ETHASHCPU
+		// 0 goes back to the interleave of the startup, auto or not.
+		if (fresh.m_cpuInterleave != m_cpuInterleave)
+		{
+			m_cpuInterleave = fresh.m_cpuInterleave;
+			_f.setSealerLaunch("cpu", MinerLaunch{m_cpuInterleave, 0, 0});
+		}
+#endif
+		(void)_f;
+	}
+
+	/// Lock profile at shutdown, in builds with ETH_LOCK_PROFILING.
+	static void logLockProfile()
+	{
+		for (LockStats const& s: lockProfile())
+		{
+			if (!s.acquisitions)
+				continue;
+			minelog << s.name << " " << s.acquisitions << " locks, " << s.contended << " contended, wait "
+				<< s.waitNs / 1000 << " us total " << s.maxWaitNs / 1000 << " us max, hold "
+				<< s.holdNs / max<uint64_t>(s.acquisitions, 1) << " ns mean " << s.maxHoldNs / 1000 << " us max";
+		}
+	}
+
 	/// Operating mode.
 	OperationMode m_mode = OperationMode::None;
 
@@ -1002,6 +1595,7 @@ private:
 	unsigned m_openclDeviceCount = 0;
 	vector<unsigned> m_openclDevices = vector<unsigned>(MAX_MINERS, -1);
 	unsigned m_openclThreadsPerHash = 8;
+	bool m_openclSubgroups = false;
 	unsigned m_globalWorkSizeMultiplier = CLMiner::c_defaultGlobalWorkSizeMultiplier;
 	unsigned m_localWorkSize = CLMiner::c_defaultLocalWorkSize;
 #endif
@@ -1014,8 +1608,18 @@ private:
 	unsigned m_cudaBlockSize = CUDAMiner::c_defaultBlockSize;
 	bool m_cudaNoEval = true;
 	unsigned m_parallelHash    = 4;
+#endif
+#if ETH_ETHASHCPU
+	unsigned m_cpuInterleave = 0; // auto
+	string m_cpuJitCompiler;	///< Empty when not building programs
+	string m_cpuJitDir;
 #endif
 	unsigned m_dagLoadMode = 0; // parallel
+	unsigned m_dagParallel = 0;
+	unsigned m_verifyCacheMB = 64;
+	unsigned m_dagHeadroom = Miner::c_defaultDagHeadroom;
+	bool m_sharedMemory = false;
+	HostMemoryPolicy m_hostMemory;
 	unsigned m_dagCreateDevice = 0;
 	bool m_exit = false;
 	/// Benchmarking params
@@ -1023,6 +1627,7 @@ private:
 	unsigned m_benchmarkTrial = 3;
 	unsigned m_benchmarkTrials = 5;
 	unsigned m_benchmarkBlock = 0;
+	unsigned m_benchmarkFarm = 0;		///< Simulated miners of the farm benchmark.
 
 	vector<PoolConnection> m_endpoints;
 	const unsigned k_max_endpoints = 6;
@@ -1031,14 +1636,27 @@ private:
 	unsigned m_ep_ix = 0;
 
 	unsigned m_maxFarmRetries = 3;
+	unsigned m_poolProbe = 0;
+	unsigned m_poolPreferMs = 0;
 	unsigned m_farmRecheckPeriod = 500;
 	unsigned m_displayInterval = 5;
 	bool m_farmRecheckSet = false;
 	int m_worktimeout = 180;
 	bool m_show_hwmonitors = false;
 	bool m_show_power = false;
+	GovernorTargets m_governor;
+	WatchdogSettings m_watchdog;
+	string m_statsShm;
+	string m_tracePath;
+	string m_configFile;
+	vector<string> m_args;		///< Command line of a --config, read again on reload.
+	bool m_inConfig = false;
 #if API_CORE
 	int m_api_port = 0;
+	unsigned m_pushPort = 0;
+	unsigned m_pushInterval = 1000;
+	unsigned m_validatePort = 0;
+	unsigned m_validateThreads = 0;
 #endif
 
 	bool m_report_stratum_hashrate = false;
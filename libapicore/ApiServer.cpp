@@ -6,9 +6,15 @@ ApiServer::ApiServer(AbstractServerConnector *conn, serverVersion_t type, Farm &
 {
 	this->bindAndAddMethod(Procedure("miner_getstat1", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::getMinerStat1);
 	this->bindAndAddMethod(Procedure("miner_getstathr", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::getMinerStatHR);	
+	if (lockProfiling())
+		this->bindAndAddMethod(Procedure("miner_getlockprofile", PARAMS_BY_NAME, JSON_ARRAY, NULL), &ApiServer::getLockProfile);
 	if (!readonly) {
 		this->bindAndAddMethod(Procedure("miner_restart", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::doMinerRestart);
 		this->bindAndAddMethod(Procedure("miner_reboot", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::doMinerReboot);
+		this->bindAndAddMethod(Procedure("miner_reload", PARAMS_BY_NAME, JSON_BOOLEAN, NULL), &ApiServer::doMinerReload);
+		this->bindAndAddMethod(Procedure("miner_pausegpu", PARAMS_BY_NAME, JSON_BOOLEAN, "index", JSON_INTEGER, "pause", JSON_BOOLEAN, NULL), &ApiServer::doPauseGpu);
+		this->bindAndAddMethod(Procedure("miner_setlaunch", PARAMS_BY_NAME, JSON_BOOLEAN, "index", JSON_INTEGER, NULL), &ApiServer::doSetLaunch);
+		this->bindAndAddMethod(Procedure("miner_restartgpu", PARAMS_BY_NAME, JSON_BOOLEAN, "index", JSON_INTEGER, NULL), &ApiServer::doRestartGpu);
 	}
 }
 
@@ -117,6 +123,116 @@ void ApiServer::getMinerStatHR(const Json::Value& request, Json::Value& response
 	response["fanpercentages"] = fans;             		// Fans speed(%) for all GPUs
 	response["powerusages"] = powers;         			// Power Usages(W) for all GPUs
 	response["pooladdrs"] = poolAddresses.str();        // current mining pool. For dual mode, there will be two pools here.
+	// Stall watchdog, absent when disabled
+	std::vector<WatchdogDevice> const watched = m_farm.watchdogDevices();
+	if (!watched.empty())
+	{
+		Json::Value watchdog;
+		Json::Value stalls;
+		Json::Value kicks;
+		Json::Value reinits;
+		Json::Value restarts;
+		Json::Value recoveries;
+		gpuIndex = 0;
+		for (auto const& d : watched)
+		{
+			stalls[gpuIndex] = d.stalls;
+			kicks[gpuIndex] = d.kicks;
+			reinits[gpuIndex] = d.reinits;
+			restarts[gpuIndex] = d.restarts;
+			recoveries[gpuIndex] = d.recoveries;
+			gpuIndex++;
+		}
+		watchdog["stalls"] = stalls;			// Stalls detected for all GPUs
+		watchdog["kicks"] = kicks;				// Actions taken on them, in escalation order
+		watchdog["reinits"] = reinits;
+		watchdog["restarts"] = restarts;
+		watchdog["recoveries"] = recoveries;	// Stalls that ended before a restart
+		response["watchdog"] = watchdog;
+	}
+	Json::Value paused;
+	gpuIndex = 0;
+	for (bool i : m_farm.pausedMiners())
+		paused[gpuIndex++] = i;
+	response["paused"] = paused;						// GPUs paused through miner_pausegpu
+	// Host share verification
+	DagItemCacheStats c = EthashAux::itemCacheStats();
+	Json::Value verifyCache;
+	verifyCache["hits"] = (Json::UInt64)c.hits;
+	verifyCache["misses"] = (Json::UInt64)c.misses;
+	verifyCache["evictions"] = (Json::UInt64)c.evictions;
+	verifyCache["bytes"] = (Json::UInt64)c.bytes;
+	verifyCache["hitrate"] = c.hitRate();
+	response["verifycache"] = verifyCache;
+	// Intensity governor, absent when no target is set
+	if (m_farm.governed())
+	{
+		GovernorTargets const t = m_farm.governorTargets();
+		Json::Value governor;
+		governor["targettemp"] = t.tempC;
+		governor["targetpower"] = t.powerW;
+		Json::Value intensities;
+		Json::Value throttled;
+		Json::Value downs;
+		Json::Value ups;
+		gpuIndex = 0;
+		for (auto const& d : m_farm.governorDevices())
+		{
+			intensities[gpuIndex] = d.intensity;
+			throttled[gpuIndex] = d.throttled;
+			downs[gpuIndex] = d.downs;
+			ups[gpuIndex] = d.ups;
+			gpuIndex++;
+		}
+		governor["intensities"] = intensities;	// Fraction of the full launch size for all GPUs
+		governor["throttled"] = throttled;		// Over a target at the last step
+		governor["downs"] = downs;				// Steps taken down and up since start
+		governor["ups"] = ups;
+		response["governor"] = governor;
+	}
+}
+
+namespace
+{
+
+unsigned requestedGpu(const Json::Value& request)
+{
+	int const index = request["index"].asInt();
+	if (index < 0)
+		throw JsonRpcException(Errors::ERROR_RPC_INVALID_PARAMS, "no gpu " + std::to_string(index));
+	return (unsigned)index;
+}
+
+void checkGpu(bool found, unsigned index)
+{
+	if (!found)
+		throw JsonRpcException(Errors::ERROR_RPC_INVALID_PARAMS, "no gpu " + std::to_string(index));
+}
+
+}
+
+void ApiServer::getLockProfile(const Json::Value& request, Json::Value& response)
+{
+	(void) request; // unused
+
+	// Times in nanoseconds, waits[i] counts contended waits under 2^i us
+	response = Json::Value(Json::arrayValue);
+	for (LockStats const& s: lockProfile())
+	{
+		Json::Value lock;
+		lock["name"] = s.name;
+		lock["acquisitions"] = (Json::UInt64)s.acquisitions;
+		lock["contended"] = (Json::UInt64)s.contended;
+		lock["waitns"] = (Json::UInt64)s.waitNs;
+		lock["maxwaitns"] = (Json::UInt64)s.maxWaitNs;
+		lock["holdns"] = (Json::UInt64)s.holdNs;
+		lock["maxholdns"] = (Json::UInt64)s.maxHoldNs;
+		Json::Value waits(Json::arrayValue);
+		for (unsigned b = 0; b < c_lockWaitBuckets; b++)
+			waits.append((Json::UInt64)s.waits[b]);
+		lock["waits"] = waits;
+		response.append(lock);
+	}
 }
 
 void ApiServer::doMinerRestart(const Json::Value& request, Json::Value& response)
@@ -127,6 +243,14 @@ void ApiServer::doMinerRestart(const Json::Value& request, Json::Value& response
 	this->m_farm.restart();
 }
 
+void ApiServer::doMinerReload(const Json::Value& request, Json::Value& response)
+{
+	(void) request; // unused
+
+	this->m_farm.reload();
+	response = true;
+}
+
 void ApiServer::doMinerReboot(const Json::Value& request, Json::Value& response)
 {
 	(void) request; // unused
@@ -134,3 +258,29 @@ void ApiServer::doMinerReboot(const Json::Value& request, Json::Value& response)
 	
 	// Not supported
 }
+
+void ApiServer::doPauseGpu(const Json::Value& request, Json::Value& response)
+{
+	unsigned const index = requestedGpu(request);
+	checkGpu(m_farm.pauseMiner(index, request["pause"].asBool()), index);
+	response = true;
+}
+
+void ApiServer::doSetLaunch(const Json::Value& request, Json::Value& response)
+{
+	// Absent or 0 fields go back to the command line value.
+	unsigned const index = requestedGpu(request);
+	MinerLaunch launch;
+	launch.localWorkSize = request.get("local", 0).asUInt();
+	launch.globalWorkSize = request.get("global", 0).asUInt();
+	launch.streams = request.get("streams", 0).asUInt();
+	checkGpu(m_farm.setMinerLaunch(index, launch), index);
+	response = true;
+}
+
+void ApiServer::doRestartGpu(const Json::Value& request, Json::Value& response)
+{
+	unsigned const index = requestedGpu(request);
+	checkGpu(m_farm.restartMiner(index, std::chrono::milliseconds(Farm::c_restartStopTimeout)), index);
+	response = true;
+}
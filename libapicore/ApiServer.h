@@ -1,5 +1,6 @@
 #pragma once
 
+#include <libethcore/EthashAux.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 #include <jsonrpccpp/server.h>
@@ -17,7 +18,12 @@ private:
 	Farm &m_farm;
 	void getMinerStat1(const Json::Value& request, Json::Value& response);
 	void getMinerStatHR(const Json::Value& request, Json::Value& response);
+	void getLockProfile(const Json::Value& request, Json::Value& response);
 	void doMinerRestart(const Json::Value& request, Json::Value& response);
 	void doMinerReboot(const Json::Value& request, Json::Value& response);
+	void doMinerReload(const Json::Value& request, Json::Value& response);
+	void doPauseGpu(const Json::Value& request, Json::Value& response);
+	void doSetLaunch(const Json::Value& request, Json::Value& response);
+	void doRestartGpu(const Json::Value& request, Json::Value& response);
 };
 
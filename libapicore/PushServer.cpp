@@ -0,0 +1,220 @@
+#include "PushServer.h"
+
+#include <libdevcore/Log.h>
+#include <ethminer-buildinfo.h>
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+namespace
+{
+
+char const* kindName(FarmEvent::Kind _k)
+{
+	switch (_k)
+	{
+	case FarmEvent::Job: return "job";
+	case FarmEvent::Found: return "found";
+	case FarmEvent::Accepted: return "accepted";
+	case FarmEvent::Rejected: return "rejected";
+	case FarmEvent::Failed: return "failed";
+	}
+	return "unknown";
+}
+
+bool sameReading(HwMonitor const& _a, HwMonitor const& _b)
+{
+	return _a.tempC == _b.tempC && _a.fanP == _b.fanP && _a.powerW == _b.powerW;
+}
+
+}
+
+const unsigned PushServer::c_minInterval;
+const size_t PushServer::c_maxBacklog;
+
+PushServer::PushServer(unsigned _port, unsigned _intervalMs, Farm& _farm):
+	m_farm(_farm),
+	m_interval(max(_intervalMs, c_minInterval)),
+	m_strand(EventLoop::service()),
+	m_acceptor(EventLoop::service(), tcp::endpoint(tcp::v4(), _port)),
+	m_sampleTimer(EventLoop::service())
+{
+	m_farm.onFarmEvent([this](FarmEvent const& _e) {
+		if (m_running)
+			m_strand.post(m_handlers.wrap([this, _e]() { event(_e); }));
+	});
+	m_strand.dispatch(m_handlers.wrap([this]() {
+		accept();
+		scheduleSample();
+	}));
+	cnote << "Pushing telemetry on port" << _port << "every" << m_interval << "ms";
+}
+
+PushServer::~PushServer()
+{
+	m_farm.onFarmEvent(nullptr);
+	m_running = false;
+	m_strand.dispatch(m_handlers.wrap([this]() {
+		boost::system::error_code ec;
+		m_acceptor.close(ec);
+		m_sampleTimer.cancel();
+		for (auto const& s: m_subscribers)
+			s->socket.close(ec);
+		m_subscribers.clear();
+	}));
+	m_handlers.wait();
+}
+
+void PushServer::accept()
+{
+	SubscriberPtr s = make_shared<Subscriber>(EventLoop::service());
+	m_acceptor.async_accept(s->socket, m_strand.wrap(m_handlers.wrap([this, s](const boost::system::error_code& ec) {
+		if (!m_running)
+			return;
+		if (!ec)
+		{
+			boost::system::error_code ignored;
+			s->socket.set_option(tcp::no_delay(true), ignored);
+			s->peer = s->socket.remote_endpoint(ignored).address().to_string();
+			m_subscribers.push_back(s);
+			m_fullHw = true;
+
+			Json::Value hello;
+			hello["type"] = "hello";
+			hello["version"] = ethminer_get_buildinfo()->project_version;
+			hello["interval"] = m_interval;
+			Json::StreamWriterBuilder builder;
+			builder["indentation"] = "";
+			send(s, Json::writeString(builder, hello) + "\n");
+		}
+		else if (ec != boost::asio::error::operation_aborted)
+			cwarn << "Telemetry accept failed:" << ec.message();
+		accept();
+	})));
+}
+
+void PushServer::scheduleSample()
+{
+	m_sampleTimer.expires_from_now(boost::posix_time::milliseconds(m_interval));
+	m_sampleTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		[this](const boost::system::error_code& ec) { sample(ec); })));
+}
+
+void PushServer::sample(const boost::system::error_code& ec)
+{
+	if (ec || !m_running)
+		return;
+	scheduleSample();
+
+	// Nobody listening, leave the farm alone.
+	if (m_subscribers.empty())
+		return;
+
+	WorkingProgress p = m_farm.miningProgress(true, true);
+	SolutionStats s = m_farm.getSolutionStats();
+
+	Json::Value line;
+	line["type"] = "stats";
+	line["seq"] = (Json::UInt64)++m_seq;
+	line["uptime"] = (Json::UInt64)chrono::duration_cast<chrono::milliseconds>(
+		chrono::steady_clock::now() - m_farm.farmLaunched()).count();
+	line["hashrate"] = (Json::UInt64)p.rate();
+	Json::Value rates(Json::arrayValue);
+	for (auto const& h: p.minersHashes)
+		rates.append((Json::UInt64)p.minerRate(h));
+	line["hashrates"] = rates;
+	line["accepted"] = s.getAccepts();
+	line["rejected"] = s.getRejects();
+	line["failed"] = s.getFailures();
+
+	// Devices whose readings moved, all of them after a subscriber joined.
+	Json::Value hw(Json::arrayValue);
+	m_lastHw.resize(p.minerMonitors.size());
+	for (size_t i = 0; i < p.minerMonitors.size(); i++)
+	{
+		HwMonitor const& m = p.minerMonitors[i];
+		if (!m_fullHw && sameReading(m, m_lastHw[i]))
+			continue;
+		Json::Value d;
+		d["gpu"] = (Json::UInt)i;
+		d["temp"] = m.tempC;
+		d["fan"] = m.fanP;
+		d["power"] = m.powerW;
+		hw.append(d);
+		m_lastHw[i] = m;
+	}
+	if (hw.size())
+		line["hw"] = hw;
+	m_fullHw = false;
+
+	publish(line);
+}
+
+void PushServer::event(FarmEvent const& _e)
+{
+	if (m_subscribers.empty())
+		return;
+
+	Json::Value line;
+	if (_e.kind == FarmEvent::Job)
+	{
+		line["type"] = "job";
+		line["header"] = "0x" + _e.work.header.hex();
+		line["epoch"] = _e.work.epoch;
+		line["height"] = (Json::UInt64)_e.work.height;
+	}
+	else
+	{
+		line["type"] = "share";
+		line["result"] = kindName(_e.kind);
+		line["stale"] = _e.stale;
+	}
+	publish(line);
+}
+
+void PushServer::publish(Json::Value const& _line)
+{
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	string const text = Json::writeString(builder, _line) + "\n";
+
+	// Copy, send() may drop a subscriber from the list.
+	list<SubscriberPtr> const subscribers = m_subscribers;
+	for (auto const& s: subscribers)
+		send(s, text);
+}
+
+void PushServer::send(SubscriberPtr const& _s, string const& _line)
+{
+	if (_s->backlog.size() >= c_maxBacklog)
+	{
+		cwarn << "Dropping telemetry subscriber" << _s->peer << "falling behind";
+		drop(_s);
+		return;
+	}
+	_s->backlog.push_back(_line);
+	if (_s->backlog.size() == 1)
+		write(_s);
+}
+
+void PushServer::write(SubscriberPtr const& _s)
+{
+	boost::asio::async_write(_s->socket, boost::asio::buffer(_s->backlog.front()),
+		m_strand.wrap(m_handlers.wrap([this, _s](const boost::system::error_code& ec, size_t) {
+			if (ec)
+			{
+				drop(_s);
+				return;
+			}
+			_s->backlog.pop_front();
+			if (!_s->backlog.empty())
+				write(_s);
+		})));
+}
+
+void PushServer::drop(SubscriberPtr const& _s)
+{
+	boost::system::error_code ec;
+	_s->socket.close(ec);	// a write in flight still owns the backlog, it completes aborted
+	m_subscribers.remove(_s);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <deque>
+#include <list>
+#include <memory>
+#include <boost/asio.hpp>
+#include <json/json.h>
+#include <libdevcore/EventLoop.h>
+#include <libethcore/Farm.h>
+#include <libethcore/Miner.h>
+
+using namespace dev;
+using namespace dev::eth;
+
+/**
+ * @brief Streams live telemetry to TCP subscribers, one JSON object per line.
+ *
+ * A single producer on the shared loop samples the farm once per interval,
+ * whatever the number of subscribers, and fans the line out to all of them.
+ * Share and job events are pushed as they happen. Hardware readings are only
+ * sent for the devices whose values changed since the previous sample.
+ * Subscribers falling too far behind are dropped.
+ */
+class PushServer
+{
+public:
+	/// Shortest sampling interval, in milliseconds.
+	static const unsigned c_minInterval = 100;
+	/// Lines a subscriber may have queued before it is dropped.
+	static const size_t c_maxBacklog = 256;
+
+	PushServer(unsigned _port, unsigned _intervalMs, Farm& _farm);
+	~PushServer();
+
+private:
+	struct Subscriber
+	{
+		Subscriber(boost::asio::io_service& _io): socket(_io) {}
+		boost::asio::ip::tcp::socket socket;
+		std::string peer;
+		std::deque<std::string> backlog;
+	};
+	using SubscriberPtr = std::shared_ptr<Subscriber>;
+
+	void accept();
+	void scheduleSample();
+	void sample(const boost::system::error_code& ec);
+	void event(FarmEvent const& _e);
+	void publish(Json::Value const& _line);
+	void send(SubscriberPtr const& _s, std::string const& _line);
+	void write(SubscriberPtr const& _s);
+	void drop(SubscriberPtr const& _s);
+
+	Farm& m_farm;
+	unsigned m_interval;
+	std::atomic<bool> m_running = {true};
+
+	/// Accepts, samples and writes all run on this strand of the shared loop.
+	boost::asio::io_service::strand m_strand;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	boost::asio::deadline_timer m_sampleTimer;
+	std::list<SubscriberPtr> m_subscribers;
+
+	uint64_t m_seq = 0;
+	std::vector<HwMonitor> m_lastHw;	///< Readings of the previous sample, for the deltas.
+	bool m_fullHw = true;				///< Next sample carries every device, for new subscribers.
+
+	PendingHandlers m_handlers;
+};
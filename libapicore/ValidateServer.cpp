@@ -0,0 +1,89 @@
+#include "ValidateServer.h"
+
+namespace
+{
+
+/// Shares of one call are verified as a single batch, larger calls are rejected.
+const Json::ArrayIndex c_maxBatch = 4096;
+
+ShareCheck parseShare(const Json::Value& share)
+{
+	ShareCheck s;
+	s.header = h256(share["header"].asString());
+	s.mixHash = h256(share["mix"].asString());
+	s.boundary = h256(share["boundary"].asString());
+	const Json::Value& nonce = share["nonce"];
+	s.nonce = nonce.isString() ? std::stoull(nonce.asString(), nullptr, 16) : nonce.asUInt64();
+	s.height = share["height"].asUInt64();
+	if (share.isMember("epoch"))
+		s.epoch = share["epoch"].asInt();
+	return s;
+}
+
+}
+
+ValidateServer::ValidateServer(AbstractServerConnector *conn, serverVersion_t type, ShareValidator &validator) : AbstractServer(*conn, type), m_validator(validator)
+{
+	this->bindAndAddMethod(Procedure("validator_check", PARAMS_BY_NAME, JSON_OBJECT, "shares", JSON_ARRAY, NULL), &ValidateServer::checkShares);
+	this->bindAndAddMethod(Procedure("validator_stats", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ValidateServer::getStats);
+	this->bindAndAddMethod(Procedure("validator_warm", PARAMS_BY_NAME, JSON_OBJECT, "height", JSON_INTEGER, NULL), &ValidateServer::warm);
+}
+
+void ValidateServer::checkShares(const Json::Value& request, Json::Value& response)
+{
+	const Json::Value& shares = request["shares"];
+	if (shares.size() > c_maxBatch)
+		throw JsonRpcException(Errors::ERROR_RPC_INVALID_PARAMS, "at most " + std::to_string(c_maxBatch) + " shares per call");
+
+	// Malformed entries get an "error" verdict without failing the rest of the batch.
+	std::vector<ShareCheck> batch;
+	std::vector<Json::ArrayIndex> index;
+	Json::Value verdicts(Json::arrayValue);
+	uint64_t height = 0;
+	for (Json::ArrayIndex i = 0; i < shares.size(); i++)
+	{
+		verdicts[i] = toString(ShareVerdict::Error);
+		try
+		{
+			batch.push_back(parseShare(shares[i]));
+			index.push_back(i);
+			height = std::max(height, batch.back().height);
+		}
+		catch (...)
+		{
+		}
+	}
+
+	// The first shares of the next epoch should not wait for its light cache.
+	if (height)
+		m_validator.warm(height + ETHASH_EPOCH_LENGTH);
+
+	std::vector<ShareVerdict> results = m_validator.validate(batch);
+	for (size_t i = 0; i < results.size(); i++)
+		verdicts[index[i]] = toString(results[i]);
+	response["verdicts"] = verdicts;
+}
+
+void ValidateServer::warm(const Json::Value& request, Json::Value& response)
+{
+	m_validator.warm(request["height"].asUInt64());
+	response = true;
+}
+
+void ValidateServer::getStats(const Json::Value& request, Json::Value& response)
+{
+	(void) request; // unused
+
+	ShareValidatorStats s = m_validator.stats();
+	response["threads"] = m_validator.threads();
+	response["shares"] = (Json::UInt64)s.shares;
+	response["valid"] = (Json::UInt64)s.valid;
+	response["badmix"] = (Json::UInt64)s.badMix;
+	response["lowdifficulty"] = (Json::UInt64)s.lowDifficulty;
+	response["errors"] = (Json::UInt64)s.errors;
+	response["batches"] = (Json::UInt64)s.batches;
+	response["sharespersecond"] = s.sharesPerSecond();
+	response["meanlatencyms"] = s.meanLatencyMs();
+	response["maxlatencyms"] = s.maxLatencyUs / 1000.0;
+	response["uptime"] = (Json::UInt64)(s.uptimeMs / 1000);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <libethash/ethash.h>
+#include <libethcore/ShareValidator.h>
+#include <jsonrpccpp/server.h>
+
+using namespace jsonrpc;
+using namespace dev;
+using namespace dev::eth;
+
+/// JSON-RPC front end of a ShareValidator, for pools checking shares.
+class ValidateServer : public AbstractServer<ValidateServer>
+{
+public:
+	ValidateServer(AbstractServerConnector *conn, serverVersion_t type, ShareValidator &validator);
+private:
+	ShareValidator &m_validator;
+	void checkShares(const Json::Value& request, Json::Value& response);
+	void getStats(const Json::Value& request, Json::Value& response);
+	void warm(const Json::Value& request, Json::Value& response);
+};
@@ -0,0 +1,96 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file EventLoop.cpp
+ */
+
+#include "EventLoop.h"
+
+#include <thread>
+#include "Log.h"
+
+using namespace std;
+using namespace dev;
+
+unsigned EventLoop::s_threads = EventLoop::c_defaultThreads;
+atomic<bool> EventLoop::s_stopped = {false};
+
+EventLoop::EventLoop():
+	m_work(new boost::asio::io_service::work(m_service))
+{
+	for (unsigned i = 0; i < max(1u, s_threads); i++)
+		m_threads.emplace_back([this]() {
+			setThreadName("loop");
+			while (true)
+			{
+				try
+				{
+					m_service.run();
+					return;
+				}
+				catch (std::exception const& _e)
+				{
+					// A throwing handler must not take the loop down with it.
+					cwarn << "Event loop handler failed:" << _e.what();
+				}
+			}
+		});
+}
+
+EventLoop::~EventLoop()
+{
+	shutdown();
+}
+
+EventLoop& EventLoop::get()
+{
+	static EventLoop s_loop;
+	return s_loop;
+}
+
+boost::asio::io_service& EventLoop::service()
+{
+	return get().m_service;
+}
+
+void EventLoop::setThreads(unsigned _threads)
+{
+	s_threads = _threads;
+}
+
+void EventLoop::shutdown()
+{
+	EventLoop& l = get();
+	Guard g(l.x_threads);
+	l.m_work.reset();
+	l.m_service.stop();
+	bool inHandler = false;
+	for (auto& t: l.m_threads)
+		if (t.get_id() == this_thread::get_id())
+		{
+			t.detach();		// shut down from a handler, the thread returns on its own
+			inHandler = true;
+		}
+		else if (t.joinable())
+			t.join();
+	l.m_threads.clear();
+	s_stopped = true;
+
+	// The queued handlers go now rather than with the service at exit, and
+	// with them the counts PendingHandlers::wait() is blocked on.
+	if (!inHandler)
+		l.m_service.dropHandlers();
+}
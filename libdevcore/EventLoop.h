@@ -0,0 +1,144 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file EventLoop.h
+ * The asio service shared by the farm, the pool clients and the pool manager.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <boost/asio.hpp>
+#include "Guards.h"
+
+namespace dev
+{
+
+/**
+ * @brief One io_service for the process, run by a small pool of threads.
+ *
+ * Components keep a strand of their own, so their handlers never run
+ * concurrently with each other, and timers in place of sleeping threads.
+ * The threads start on the first call to service().
+ */
+class EventLoop
+{
+public:
+	/// One thread can sit in a blocking getwork request while the others go on.
+	static const unsigned c_defaultThreads = 2;
+
+	static boost::asio::io_service& service();
+
+	/// Threads to run the loop with, only effective before the first service().
+	static void setThreads(unsigned _threads);
+
+	/// Stops the loop and joins its threads. Components still holding
+	/// handlers must be gone before, they are dropped without being run.
+	static void shutdown();
+
+	/// True once shutdown() has joined the threads, no handler runs after.
+	static bool stopped() { return s_stopped; }
+
+private:
+	EventLoop();
+	~EventLoop();
+
+	static EventLoop& get();
+
+	/// The io_service, able to destroy its queued handlers before its own end.
+	class Service: public boost::asio::io_service
+	{
+	public:
+		void dropHandlers() { boost::asio::io_service::shutdown(); }
+	};
+
+	Service m_service;
+	std::unique_ptr<boost::asio::io_service::work> m_work;
+	std::vector<std::thread> m_threads;
+	Mutex x_threads;
+
+	static unsigned s_threads;
+	static std::atomic<bool> s_stopped;
+};
+
+/**
+ * @brief Counts the handlers a component has handed to the loop.
+ *
+ * wrap() a handler before passing it to asio; the count covers it until
+ * asio has run or dropped every copy of it. A destructor calls wait() after
+ * cancelling its timers and sockets so no handler is left with a dangling
+ * this.
+ */
+class PendingHandlers
+{
+public:
+	PendingHandlers(): m_state(std::make_shared<State>()) {}
+	~PendingHandlers() { wait(); }
+
+	template <class Handler>
+	class Counted
+	{
+	public:
+		Counted(Handler _h, std::shared_ptr<void> _token): m_handler(std::move(_h)), m_token(std::move(_token)) {}
+		template <class... Args>
+		void operator()(Args&&... _args) { m_handler(std::forward<Args>(_args)...); }
+
+	private:
+		Handler m_handler;
+		std::shared_ptr<void> m_token;
+	};
+
+	template <class Handler>
+	Counted<Handler> wrap(Handler _h)
+	{
+		std::shared_ptr<State> s = m_state;
+		{
+			Guard l(s->x_count);
+			s->count++;
+		}
+		// Released with the last copy of the handler, run or not.
+		std::shared_ptr<void> token(nullptr, [s](void*) {
+			Guard l(s->x_count);
+			if (--s->count == 0)
+				s->idle.notify_all();
+		});
+		return Counted<Handler>(std::move(_h), std::move(token));
+	}
+
+	/// Blocks until every wrapped handler is gone, or until the loop has stopped
+	/// and will not run those left.
+	void wait()
+	{
+		UniqueGuard l(m_state->x_count);
+		while (!m_state->idle.wait_for(l, std::chrono::milliseconds(100),
+			[&] { return m_state->count == 0 || EventLoop::stopped(); }))
+		{}
+	}
+
+private:
+	struct State
+	{
+		Mutex x_count;
+		Condition idle;
+		unsigned count = 0;
+	};
+	std::shared_ptr<State> m_state;
+};
+
+}
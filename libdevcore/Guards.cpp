@@ -0,0 +1,183 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Guards.cpp
+ */
+
+#include "Guards.h"
+
+using namespace std;
+using namespace dev;
+
+#if ETH_LOCK_PROFILING
+
+#include <map>
+
+struct ProfiledMutex::Counters
+{
+	string name;
+	atomic<uint64_t> acquisitions = {0};
+	atomic<uint64_t> contended = {0};
+	atomic<uint64_t> waitNs = {0};
+	atomic<uint64_t> maxWaitNs = {0};
+	atomic<uint64_t> holdNs = {0};
+	atomic<uint64_t> maxHoldNs = {0};
+	atomic<uint64_t> waits[c_lockWaitBuckets];
+
+	Counters()
+	{
+		for (auto& w: waits)
+			w = 0;
+	}
+};
+
+namespace
+{
+
+/// Never destroyed, mutexes outliving main() still account into it.
+struct Registry
+{
+	std::mutex x_counters;
+	map<string, ProfiledMutex::Counters*> counters;
+};
+
+Registry& registry()
+{
+	static Registry* r = new Registry;
+	return *r;
+}
+
+void raiseMax(atomic<uint64_t>& _max, uint64_t _v)
+{
+	uint64_t m = _max.load(memory_order_relaxed);
+	while (_v > m && !_max.compare_exchange_weak(m, _v, memory_order_relaxed)) {}
+}
+
+uint64_t nanoseconds(chrono::steady_clock::duration _d)
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(_d).count();
+}
+
+unsigned bucket(uint64_t _ns)
+{
+	unsigned b = 0;
+	for (uint64_t us = _ns / 1000; us && b < c_lockWaitBuckets - 1; us >>= 1)
+		b++;
+	return b;
+}
+
+}
+
+void ProfiledMutex::setName(char const* _name)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> l(r.x_counters);
+	Counters*& c = r.counters[_name];
+	if (!c)
+	{
+		c = new Counters;
+		c->name = _name;
+	}
+	m_counters = c;
+}
+
+void ProfiledMutex::lock()
+{
+	if (!m_counters)
+	{
+		m_mutex.lock();
+		return;
+	}
+	auto start = chrono::steady_clock::now();
+	if (!m_mutex.try_lock())
+	{
+		m_mutex.lock();
+		m_acquired = chrono::steady_clock::now();
+		uint64_t const wait = nanoseconds(m_acquired - start);
+		m_counters->contended.fetch_add(1, memory_order_relaxed);
+		m_counters->waitNs.fetch_add(wait, memory_order_relaxed);
+		m_counters->waits[bucket(wait)].fetch_add(1, memory_order_relaxed);
+		raiseMax(m_counters->maxWaitNs, wait);
+	}
+	else
+		m_acquired = start;
+	m_counters->acquisitions.fetch_add(1, memory_order_relaxed);
+}
+
+bool ProfiledMutex::try_lock()
+{
+	if (!m_mutex.try_lock())
+		return false;
+	if (m_counters)
+	{
+		m_acquired = chrono::steady_clock::now();
+		m_counters->acquisitions.fetch_add(1, memory_order_relaxed);
+	}
+	return true;
+}
+
+void ProfiledMutex::unlock()
+{
+	if (m_counters)
+	{
+		uint64_t const hold = nanoseconds(chrono::steady_clock::now() - m_acquired);
+		m_counters->holdNs.fetch_add(hold, memory_order_relaxed);
+		raiseMax(m_counters->maxHoldNs, hold);
+	}
+	m_mutex.unlock();
+}
+
+bool dev::lockProfiling()
+{
+	return true;
+}
+
+vector<LockStats> dev::lockProfile()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> l(r.x_counters);
+	vector<LockStats> ret;
+	for (auto const& i: r.counters)
+	{
+		ProfiledMutex::Counters const& c = *i.second;
+		LockStats s;
+		s.name = c.name;
+		s.acquisitions = c.acquisitions;
+		s.contended = c.contended;
+		s.waitNs = c.waitNs;
+		s.maxWaitNs = c.maxWaitNs;
+		s.holdNs = c.holdNs;
+		s.maxHoldNs = c.maxHoldNs;
+		for (unsigned b = 0; b < c_lockWaitBuckets; b++)
+			s.waits[b] = c.waits[b];
+		ret.push_back(s);
+	}
+	return ret;
+}
+
+#else
+
+bool dev::lockProfiling()
+{
+	return false;
+}
+
+vector<LockStats> dev::lockProfile()
+{
+	return {};
+}
+
+#endif
@@ -24,13 +24,86 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
 
 namespace dev
 {
 
+/// Wait time histogram buckets of the lock profile, bucket i counts waits under 2^i microseconds.
+static const unsigned c_lockWaitBuckets = 20;
+
+/// What the profile recorded for all the locks sharing one name.
+struct LockStats
+{
+	std::string name;
+	uint64_t acquisitions = 0;
+	uint64_t contended = 0;			///< Acquisitions that had to wait.
+	uint64_t waitNs = 0;			///< Total time spent waiting.
+	uint64_t maxWaitNs = 0;
+	uint64_t holdNs = 0;			///< Total time held.
+	uint64_t maxHoldNs = 0;
+	uint64_t waits[c_lockWaitBuckets] = {};	///< Contended waits, the last bucket takes everything longer.
+};
+
+#if ETH_LOCK_PROFILING
+
+/**
+ * @brief Mutex recording how long it is waited for and held.
+ *
+ * Only named mutexes are recorded, see profileLock(). The uncontended path
+ * costs a try_lock and two clock reads.
+ */
+class ProfiledMutex
+{
+public:
+	ProfiledMutex() = default;
+	ProfiledMutex(ProfiledMutex const&) = delete;
+	ProfiledMutex& operator=(ProfiledMutex const&) = delete;
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	void setName(char const* _name);
+
+	struct Counters;
+
+private:
+	std::mutex m_mutex;
+	Counters* m_counters = nullptr;
+	std::chrono::steady_clock::time_point m_acquired;
+};
+
+using Mutex = ProfiledMutex;
+using Condition = std::condition_variable_any;
+
+#else
+
 using Mutex = std::mutex;
-using Guard = std::lock_guard<std::mutex>;
-using UniqueGuard = std::unique_lock<std::mutex>;
+using Condition = std::condition_variable;
+
+#endif
+
+using Guard = std::lock_guard<Mutex>;
+using UniqueGuard = std::unique_lock<Mutex>;
+
+/// Names @a _m in the lock profile, mutexes of the same name are accounted together.
+inline void profileLock(Mutex& _m, char const* _name)
+{
+#if ETH_LOCK_PROFILING
+	_m.setName(_name);
+#else
+	(void)_m;
+	(void)_name;
+#endif
+}
+
+/// True when built with ETH_LOCK_PROFILING.
+bool lockProfiling();
+/// Snapshot of the lock profile, by name; empty unless lockProfiling().
+std::vector<LockStats> lockProfile();
 
 template <class GuardType, class MutexType>
 struct GenericGuardBool: GuardType
@@ -62,7 +135,7 @@ public:
 
 private:
 	mutable Mutex m_mutex;
-	mutable std::condition_variable m_cv;
+	mutable Condition m_cv;
 	N m_value;
 };
 
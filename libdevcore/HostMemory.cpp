@@ -0,0 +1,303 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file HostMemory.cpp
+ */
+
+#include "HostMemory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include "Guards.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ETH_HOST_MEMORY_LINUX 1
+#endif
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+
+Mutex x_policy;
+HostMemoryPolicy s_policy;
+
+uint64_t const c_2M = 2ull << 20;
+uint64_t const c_1G = 1ull << 30;
+
+#if ETH_HOST_MEMORY_LINUX
+
+// From <linux/mempolicy.h>, not every libc ships <numaif.h>.
+int const c_mpolBind = 2;
+int const c_mpolInterleave = 3;
+int const c_hugeShift = 26;	// MAP_HUGE_SHIFT
+
+/// Parses a sysfs cpulist such as "0-7,16-23".
+vector<unsigned> parseList(string const& _list)
+{
+	vector<unsigned> ret;
+	stringstream ss(_list);
+	string range;
+	while (getline(ss, range, ','))
+	{
+		if (range.empty() || !isdigit((unsigned char)range[0]))
+			continue;
+		size_t dash = range.find('-');
+		unsigned first = stoul(range.substr(0, dash));
+		unsigned last = dash == string::npos ? first : stoul(range.substr(dash + 1));
+		for (unsigned i = first; i <= last; i++)
+			ret.push_back(i);
+	}
+	return ret;
+}
+
+string readLine(string const& _path)
+{
+	ifstream f(_path);
+	string line;
+	getline(f, line);
+	return line;
+}
+
+bool bindPages(void* _addr, uint64_t _size, int _mode, vector<unsigned> const& _nodes)
+{
+	unsigned long mask[16] = {};
+	unsigned const bits = sizeof(unsigned long) * 8;
+	for (unsigned n: _nodes)
+		if (n < 16 * bits)
+			mask[n / bits] |= 1ul << (n % bits);
+	return syscall(SYS_mbind, _addr, _size, _mode, mask, 16 * bits, 0) == 0;
+}
+
+#endif
+
+}
+
+void HostMemory::setPolicy(HostMemoryPolicy const& _policy)
+{
+	Guard l(x_policy);
+	s_policy = _policy;
+}
+
+HostMemoryPolicy HostMemory::policy()
+{
+	Guard l(x_policy);
+	return s_policy;
+}
+
+unsigned HostMemory::numaNodes()
+{
+#if ETH_HOST_MEMORY_LINUX
+	static unsigned const nodes = [] {
+		vector<unsigned> online = parseList(readLine("/sys/devices/system/node/online"));
+		return online.empty() ? 1u : online.back() + 1;
+	}();
+	return nodes;
+#else
+	return 1;
+#endif
+}
+
+int HostMemory::currentNode()
+{
+#if ETH_HOST_MEMORY_LINUX
+	unsigned cpu = 0, node = 0;
+	if (numaNodes() > 1 && syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+		return (int)node;
+#endif
+	return 0;
+}
+
+int HostMemory::nodeOfPciDevice(string const& _busId)
+{
+#if ETH_HOST_MEMORY_LINUX
+	string id = _busId;
+	transform(id.begin(), id.end(), id.begin(), ::tolower);
+	string node = readLine("/sys/bus/pci/devices/" + id + "/numa_node");
+	if (!node.empty())
+		try
+		{
+			return stoi(node);
+		}
+		catch (...)
+		{
+		}
+#else
+	(void)_busId;
+#endif
+	return -1;
+}
+
+bool HostMemory::bindThreadToNode(int _node)
+{
+#if ETH_HOST_MEMORY_LINUX
+	if (_node < 0 || numaNodes() < 2)
+		return false;
+	vector<unsigned> cpus = parseList(readLine("/sys/devices/system/node/node" + to_string(_node) + "/cpulist"));
+	if (cpus.empty())
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned c: cpus)
+		if (c < CPU_SETSIZE)
+			CPU_SET(c, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)_node;
+	return false;
+#endif
+}
+
+bool HostMemory::parseHugePages(string const& _s, HugePages& o_hugePages)
+{
+	if (_s == "none") o_hugePages = HugePages::None;
+	else if (_s == "thp") o_hugePages = HugePages::Transparent;
+	else if (_s == "2m") o_hugePages = HugePages::Explicit2M;
+	else if (_s == "1g") o_hugePages = HugePages::Explicit1G;
+	else return false;
+	return true;
+}
+
+bool HostMemory::parseNumaPolicy(string const& _s, NumaPolicy& o_numa)
+{
+	if (_s == "none") o_numa = NumaPolicy::None;
+	else if (_s == "interleave") o_numa = NumaPolicy::Interleave;
+	else if (_s == "replicate") o_numa = NumaPolicy::Replicate;
+	else return false;
+	return true;
+}
+
+HostBuffer::HostBuffer(uint64_t _size, HostMemoryPolicy const& _policy, int _node):
+	m_size(_size)
+{
+	stringstream desc;
+#if ETH_HOST_MEMORY_LINUX
+	HugePages pages = _policy.hugePages;
+	void* p = MAP_FAILED;
+
+	// Explicit pools degrade one step at a time, they are often not reserved.
+	if (pages == HugePages::Explicit1G)
+	{
+		m_mapSize = (_size + c_1G - 1) / c_1G * c_1G;
+		p = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << c_hugeShift), -1, 0);
+		if (p != MAP_FAILED)
+			desc << "1 GB pages";
+		else
+			pages = HugePages::Explicit2M;
+	}
+	if (p == MAP_FAILED && pages == HugePages::Explicit2M)
+	{
+		m_mapSize = (_size + c_2M - 1) / c_2M * c_2M;
+		p = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << c_hugeShift), -1, 0);
+		if (p != MAP_FAILED)
+			desc << "2 MB pages";
+		else
+			pages = HugePages::Transparent;
+	}
+	if (p == MAP_FAILED)
+	{
+		m_mapSize = (_size + c_2M - 1) / c_2M * c_2M;
+		p = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::bad_alloc();
+		if (pages == HugePages::Transparent && madvise(p, m_mapSize, MADV_HUGEPAGE) == 0)
+			desc << "transparent huge pages";
+		else
+			desc << "regular pages";
+	}
+	m_data = (uint8_t*)p;
+	m_mapped = true;
+
+	// The policy must be in place before the first touch.
+	if (_node >= 0 && HostMemory::numaNodes() > 1)
+	{
+		if (bindPages(p, m_mapSize, c_mpolBind, {(unsigned)_node}))
+			desc << ", node " << _node;
+	}
+	else if (_policy.numa == NumaPolicy::Interleave && HostMemory::numaNodes() > 1)
+	{
+		vector<unsigned> all;
+		for (unsigned n = 0; n < HostMemory::numaNodes(); n++)
+			all.push_back(n);
+		if (bindPages(p, m_mapSize, c_mpolInterleave, all))
+			desc << ", interleaved over " << all.size() << " nodes";
+	}
+#else
+	(void)_policy;
+	(void)_node;
+	m_data = new uint8_t[_size];
+	desc << "regular pages";
+#endif
+	m_describe = desc.str();
+}
+
+HostBuffer::~HostBuffer()
+{
+#if ETH_HOST_MEMORY_LINUX
+	if (m_mapped)
+		munmap(m_data, m_mapSize);
+#else
+	delete[] m_data;
+#endif
+}
+
+HostReplicas::HostReplicas(uint64_t _size, HostMemoryPolicy const& _policy)
+{
+	unsigned const nodes = HostMemory::numaNodes();
+	if (_policy.numa == NumaPolicy::Replicate && nodes > 1)
+	{
+		for (unsigned n = 0; n < nodes; n++)
+		{
+			m_copies.emplace_back(new HostBuffer(_size, _policy, (int)n));
+			m_nodes.push_back((int)n);
+		}
+	}
+	else
+	{
+		m_copies.emplace_back(new HostBuffer(_size, _policy));
+		m_nodes.push_back(-1);
+	}
+}
+
+void HostReplicas::replicate()
+{
+	for (size_t i = 1; i < m_copies.size(); i++)
+		memcpy(m_copies[i]->data(), m_copies[0]->data(), m_copies[0]->size());
+}
+
+uint8_t const* HostReplicas::forNode(int _node) const
+{
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		if (m_nodes[i] == _node)
+			return m_copies[i]->data();
+	return m_copies[0]->data();
+}
+
+string HostReplicas::describe() const
+{
+	stringstream ss;
+	ss << m_copies.size() << (m_copies.size() > 1 ? " copies, " : " copy, ") << m_copies[0]->describe();
+	return ss.str();
+}
@@ -0,0 +1,122 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file HostMemory.h
+ * Placement of large host buffers: huge pages and NUMA nodes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dev
+{
+
+enum class HugePages
+{
+	None,		///< Regular pages.
+	Transparent,	///< madvise(MADV_HUGEPAGE), the kernel backs what it can with 2 MB pages.
+	Explicit2M,	///< MAP_HUGETLB from the 2 MB pool, falls back to Transparent.
+	Explicit1G	///< MAP_HUGETLB from the 1 GB pool, falls back to Explicit2M.
+};
+
+enum class NumaPolicy
+{
+	None,		///< First touch.
+	Interleave,	///< Pages spread round robin over all nodes.
+	Replicate	///< One copy per node, readers use the copy of their node.
+};
+
+struct HostMemoryPolicy
+{
+	HugePages hugePages = HugePages::Transparent;
+	NumaPolicy numa = NumaPolicy::None;
+};
+
+/// Process wide placement policy and NUMA topology helpers. All of them degrade to
+/// a single node on systems without NUMA information.
+class HostMemory
+{
+public:
+	static void setPolicy(HostMemoryPolicy const& _policy);
+	static HostMemoryPolicy policy();
+
+	static unsigned numaNodes();
+	/// Node the calling thread currently runs on.
+	static int currentNode();
+	/// Node of the PCI device @a _busId ("0000:01:00.0"), -1 if unknown.
+	static int nodeOfPciDevice(std::string const& _busId);
+	/// Restricts the calling thread to the CPUs of @a _node.
+	static bool bindThreadToNode(int _node);
+
+	static bool parseHugePages(std::string const& _s, HugePages& o_hugePages);
+	static bool parseNumaPolicy(std::string const& _s, NumaPolicy& o_numa);
+};
+
+/// A host buffer placed according to a HostMemoryPolicy.
+class HostBuffer
+{
+public:
+	/// Allocates @a _size bytes. @a _node binds the pages to that node, -1 applies the policy's
+	/// NUMA mode instead. Throws std::bad_alloc when even regular pages are not available.
+	HostBuffer(uint64_t _size, HostMemoryPolicy const& _policy, int _node = -1);
+	~HostBuffer();
+
+	uint8_t* data() { return m_data; }
+	uint8_t const* data() const { return m_data; }
+	uint64_t size() const { return m_size; }
+	/// What was actually obtained, e.g. "1 GB pages, node 0".
+	std::string const& describe() const { return m_describe; }
+
+private:
+	HostBuffer(HostBuffer const&) = delete;
+	HostBuffer& operator=(HostBuffer const&) = delete;
+
+	uint8_t* m_data = nullptr;
+	uint64_t m_size = 0;
+	uint64_t m_mapSize = 0;
+	bool m_mapped = false;
+	std::string m_describe;
+};
+
+/// A read-only dataset with one HostBuffer per NUMA node under NumaPolicy::Replicate,
+/// otherwise a single buffer shared by every node.
+class HostReplicas
+{
+public:
+	HostReplicas(uint64_t _size, HostMemoryPolicy const& _policy);
+
+	/// The first copy, to be filled by the caller before replicate().
+	uint8_t* primary() { return m_copies[0]->data(); }
+	/// Copies the primary to the other nodes.
+	void replicate();
+
+	uint8_t const* forNode(int _node) const;
+	/// The copy of the node the calling thread runs on.
+	uint8_t const* local() const { return forNode(HostMemory::currentNode()); }
+
+	uint64_t size() const { return m_copies[0]->size(); }
+	std::string describe() const;
+
+private:
+	std::vector<std::unique_ptr<HostBuffer>> m_copies;
+	std::vector<int> m_nodes;
+};
+
+}
@@ -0,0 +1,419 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file SharedSegment.cpp
+ */
+
+#include "SharedSegment.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "Log.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ETH_SHARED_SEGMENT 1
+#endif
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+
+uint64_t const c_magic = 0x324d48534d485445;	// "ETHMSHM2"
+uint32_t const c_version = 2;
+/// The control page, then the header page, then the blob on a page of its own.
+uint64_t const c_pageBytes = 4096;
+/// Processes that can be attached to one segment and counted.
+unsigned const c_slots = 1000;
+
+uint64_t checksum(uint8_t const* _data, uint64_t _size)
+{
+	uint64_t h = 0xcbf29ce484222325;
+	uint64_t const words = _size / sizeof(uint64_t);
+	for (uint64_t i = 0; i < words; i++)
+	{
+		uint64_t w;
+		memcpy(&w, _data + i * sizeof(uint64_t), sizeof(w));
+		h = (h ^ w) * 0x100000001b3;
+	}
+	for (uint64_t i = words * sizeof(uint64_t); i < _size; i++)
+		h = (h ^ _data[i]) * 0x100000001b3;
+	return h;
+}
+
+}
+
+/// The words every attached process may write.
+struct SharedSegment::Control
+{
+	/// Generation in the high half, builder pid in the low half, so a build is
+	/// claimed with a single CAS. The generation is 0 while the creator
+	/// initialises, odd while building and even once published; an odd
+	/// generation without builder marks a failed build, one with c_retired as
+	/// builder a published segment replaced under its name.
+	std::atomic<uint64_t> state;
+	/// Last generation whose checksum a reader verified.
+	std::atomic<uint64_t> verified;
+	/// Pids of the attached processes, 0 for a free slot.
+	std::atomic<uint32_t> attached[c_slots];
+};
+
+/// Written by the builder only, read-only to everybody else.
+struct SharedSegment::Header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t size;
+	uint64_t checksum;
+};
+
+#if ETH_SHARED_SEGMENT
+
+namespace
+{
+
+uint64_t const c_retired = 0xFFFFFFFF;
+
+uint64_t stateGeneration(uint64_t _state) { return _state >> 32; }
+uint64_t stateBuilder(uint64_t _state) { return _state & 0xFFFFFFFF; }
+
+bool alive(uint64_t _pid)
+{
+	return kill((pid_t)_pid, 0) == 0 || errno == EPERM;
+}
+
+/// Segments of this process still attached, detached at exit. Never destroyed,
+/// exit handlers and static destructors run in no fixed order with it.
+struct Attached
+{
+	std::mutex x_segments;
+	std::set<SharedSegment*> segments;
+};
+
+Attached& attached()
+{
+	static Attached* a = new Attached;
+	return *a;
+}
+
+}
+
+unique_ptr<SharedSegment> SharedSegment::open(string const& _name, uint64_t _size, Builder const& _build)
+{
+	static_assert(sizeof(Control) <= c_pageBytes, "the control words take one page");
+	string const path = "/" + _name;
+	uint64_t const mapSize = 2 * c_pageBytes + _size;
+
+	// A few attempts cover a segment being unlinked or replaced between our two shm_open calls.
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		bool created = false;
+		int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0)
+		{
+			created = true;
+			if (ftruncate(fd, (off_t)mapSize) != 0)
+			{
+				cwarn << "Cannot size shared segment" << _name << ":" << strerror(errno);
+				close(fd);
+				shm_unlink(path.c_str());
+				return nullptr;
+			}
+		}
+		else if (errno == EEXIST)
+		{
+			fd = shm_open(path.c_str(), O_RDWR, 0600);
+			if (fd < 0)
+				continue;
+
+			// The creator may not have sized it yet.
+			struct stat st;
+			auto const deadline = chrono::steady_clock::now() + chrono::seconds(10);
+			while (fstat(fd, &st) == 0 && st.st_size == 0 && chrono::steady_clock::now() < deadline)
+				this_thread::sleep_for(chrono::milliseconds(10));
+			if ((uint64_t)st.st_size != mapSize)
+			{
+				cwarn << "Shared segment" << _name << "has size" << st.st_size << ", expected" << mapSize;
+				close(fd);
+				return nullptr;
+			}
+		}
+		else
+		{
+			cwarn << "Cannot open shared segment" << _name << ":" << strerror(errno);
+			return nullptr;
+		}
+
+		// Only the control page is writable, the content is mapped for writing while building only.
+		void* control = mmap(nullptr, c_pageBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		void* content = control == MAP_FAILED ? MAP_FAILED :
+			mmap(nullptr, mapSize - c_pageBytes, PROT_READ, MAP_SHARED, fd, c_pageBytes);
+		if (content == MAP_FAILED)
+		{
+			cwarn << "Cannot map shared segment" << _name << ":" << strerror(errno);
+			if (control != MAP_FAILED)
+				munmap(control, c_pageBytes);
+			close(fd);
+			if (created)
+				shm_unlink(path.c_str());
+			return nullptr;
+		}
+
+		unique_ptr<SharedSegment> seg(new SharedSegment);
+		seg->m_name = _name;
+		seg->m_fd = fd;
+		seg->m_control = (Control*)control;
+		seg->m_content = content;
+		seg->m_contentSize = mapSize - c_pageBytes;
+		seg->m_data = (uint8_t const*)content + c_pageBytes;
+		seg->m_size = _size;
+		seg->attach();
+
+		Control* ctl = seg->m_control;
+		Header const* header = (Header const*)content;
+		if (created && !seg->build(0, _build))
+			return nullptr;
+
+		bool retired = false;
+		while (!seg->m_owner)
+		{
+			uint64_t state = ctl->state.load(memory_order_acquire);
+			uint64_t g = stateGeneration(state);
+			if (g == 0)
+			{
+				// Creator still initialising.
+				this_thread::sleep_for(chrono::milliseconds(10));
+				continue;
+			}
+			if (g & 1)
+			{
+				if (stateBuilder(state) == c_retired)
+				{
+					retired = true;
+					break;
+				}
+				if (stateBuilder(state) == 0)
+					return nullptr;	// build failed and the name was unlinked
+				if (!alive(stateBuilder(state)))
+				{
+					cnote << "Builder of shared segment" << _name << "is gone, rebuilding";
+					if (!seg->build(state, _build))
+						return nullptr;
+					continue;
+				}
+				this_thread::sleep_for(chrono::milliseconds(50));
+				continue;
+			}
+
+			// Once per generation, the whole blob is read by the first reader only.
+			bool valid = header->magic == c_magic && header->version == c_version && header->size == _size;
+			bool const checked = ctl->verified.load(memory_order_acquire) == g;
+			if (valid && !checked)
+				valid = checksum(seg->m_data, _size) == header->checksum;
+			if (ctl->state.load(memory_order_acquire) != state)
+				continue;	// rebuilt while we were reading
+			if (!valid)
+			{
+				// Processes that verified it before keep reading these pages, so the
+				// rebuild goes to a new segment under the name instead.
+				if (ctl->state.compare_exchange_strong(state, (g + 1) << 32 | c_retired, memory_order_acq_rel))
+				{
+					cwarn << "Shared segment" << _name << "failed verification, replacing it";
+					shm_unlink(path.c_str());
+				}
+				retired = true;
+				break;
+			}
+			if (!checked)
+				ctl->verified.store(g, memory_order_release);
+			seg->m_generation = g;
+			break;
+		}
+		if (retired)
+		{
+			// Leaves the old pages to their readers, the next attempt opens the replacement.
+			seg.reset();
+			this_thread::sleep_for(chrono::milliseconds(10));
+			continue;
+		}
+		return seg;
+	}
+	return nullptr;
+}
+
+bool SharedSegment::build(uint64_t _expected, Builder const& _build)
+{
+	// Whoever moves the generation to odd owns the build.
+	uint64_t g = stateGeneration(_expected);
+	g += (g & 1) ? 2 : 1;
+	if (!m_control->state.compare_exchange_strong(_expected, g << 32 | (uint32_t)getpid(), memory_order_acq_rel))
+		return true;	// someone else took it, wait for them
+
+	if (mprotect(m_content, m_contentSize, PROT_READ | PROT_WRITE) != 0)
+	{
+		cwarn << "Cannot write shared segment" << m_name << ":" << strerror(errno);
+		m_control->state.store(g << 32, memory_order_release);
+		shm_unlink(("/" + m_name).c_str());
+		return false;
+	}
+	Header* header = (Header*)m_content;
+	uint8_t* data = (uint8_t*)m_content + c_pageBytes;
+	try
+	{
+		_build(data, m_size);
+	}
+	catch (std::exception const& _e)
+	{
+		cwarn << "Building shared segment" << m_name << "failed:" << _e.what();
+		mprotect(m_content, m_contentSize, PROT_READ);
+		m_control->state.store(g << 32, memory_order_release);
+		shm_unlink(("/" + m_name).c_str());
+		return false;
+	}
+
+	header->magic = c_magic;
+	header->version = c_version;
+	header->size = m_size;
+	header->checksum = checksum(data, m_size);
+	mprotect(m_content, m_contentSize, PROT_READ);
+	m_control->state.store((g + 1) << 32, memory_order_release);
+
+	m_owner = true;
+	m_generation = g + 1;
+	return true;
+}
+
+void SharedSegment::attach()
+{
+	uint32_t const pid = (uint32_t)getpid();
+	for (unsigned i = 0; i < c_slots && m_slot < 0; i++)
+	{
+		uint32_t v = m_control->attached[i].load(memory_order_relaxed);
+		if ((v == 0 || !alive(v)) && m_control->attached[i].compare_exchange_strong(v, pid, memory_order_acq_rel))
+			m_slot = (int)i;
+	}
+	// Without a slot this process does not count, the name may go while it maps it.
+
+	Attached& a = attached();
+	lock_guard<mutex> l(a.x_segments);
+	static bool const registered = atexit(&SharedSegment::detachAll) == 0;
+	(void)registered;
+	a.segments.insert(this);
+}
+
+void SharedSegment::detach()
+{
+	if (m_detached || !m_control)
+		return;
+	m_detached = true;
+	if (m_slot >= 0)
+		m_control->attached[m_slot].store(0, memory_order_release);
+
+	uint32_t const pid = (uint32_t)getpid();
+	for (unsigned i = 0; i < c_slots; i++)
+	{
+		uint32_t const v = m_control->attached[i].load(memory_order_acquire);
+		if (v && (v == pid || alive(v)))
+			return;
+	}
+
+	// Last one out, unless the name already is another segment's.
+	string const path = "/" + m_name;
+	int const fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return;
+	struct stat mine, named;
+	if (fstat(m_fd, &mine) == 0 && fstat(fd, &named) == 0 && mine.st_dev == named.st_dev && mine.st_ino == named.st_ino)
+		shm_unlink(path.c_str());
+	close(fd);
+}
+
+void SharedSegment::detachAll()
+{
+	// The mappings stay, threads may still read them while the process exits.
+	Attached& a = attached();
+	lock_guard<mutex> l(a.x_segments);
+	for (SharedSegment* s: a.segments)
+		s->detach();
+}
+
+void SharedSegment::remove(string const& _name)
+{
+	shm_unlink(("/" + _name).c_str());
+}
+
+SharedSegment::~SharedSegment()
+{
+	{
+		Attached& a = attached();
+		lock_guard<mutex> l(a.x_segments);
+		a.segments.erase(this);
+		detach();
+	}
+	if (m_content)
+		munmap(m_content, m_contentSize);
+	if (m_control)
+		munmap(m_control, c_pageBytes);
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+#else
+
+unique_ptr<SharedSegment> SharedSegment::open(string const&, uint64_t, Builder const&)
+{
+	return nullptr;
+}
+
+bool SharedSegment::build(uint64_t, Builder const&)
+{
+	return false;
+}
+
+void SharedSegment::attach()
+{
+}
+
+void SharedSegment::detach()
+{
+}
+
+void SharedSegment::detachAll()
+{
+}
+
+void SharedSegment::remove(string const&)
+{
+}
+
+SharedSegment::~SharedSegment()
+{
+}
+
+#endif
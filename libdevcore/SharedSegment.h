@@ -0,0 +1,96 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file SharedSegment.h
+ * Immutable blobs shared between processes through POSIX shared memory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace dev
+{
+
+/**
+ * @brief A named POSIX shared memory segment holding one immutable blob.
+ *
+ * The first process to open a name builds the content and publishes it, every
+ * other process maps it read-only once published. A separate control page,
+ * the only page mapped writable by all, carries a generation counter that is
+ * odd while a build is in progress and even once published. The first reader
+ * of a generation verifies the checksum and marks it verified there, later
+ * readers trust the mark. A segment whose builder died is rebuilt in place by
+ * whichever process notices first. A published one whose checksum does not
+ * match is never written again, since processes that verified it before still
+ * map it; it is unlinked and a new segment is built under the same name.
+ *
+ * Every process attached to a segment holds a slot of the control page. The
+ * last one to detach, on destruction or at exit, unlinks the name; slots of
+ * processes that died count as free.
+ */
+class SharedSegment
+{
+public:
+	using Builder = std::function<void(uint8_t* _data, uint64_t _size)>;
+
+	/// Maps segment @a _name of @a _size bytes, running @a _build if no process has published it yet.
+	/// Returns nullptr when shared memory is unavailable or the build failed, callers then fall back
+	/// to a private copy.
+	static std::unique_ptr<SharedSegment> open(std::string const& _name, uint64_t _size, Builder const& _build);
+
+	/// Unlinks @a _name. Processes that still map it keep their mapping.
+	static void remove(std::string const& _name);
+
+	~SharedSegment();
+
+	uint8_t const* data() const { return m_data; }
+	uint64_t size() const { return m_size; }
+	/// True if this process built the content.
+	bool owner() const { return m_owner; }
+	uint64_t generation() const { return m_generation; }
+
+private:
+	SharedSegment() = default;
+	SharedSegment(SharedSegment const&) = delete;
+	SharedSegment& operator=(SharedSegment const&) = delete;
+
+	struct Control;
+	struct Header;
+
+	bool build(uint64_t _expected, Builder const& _build);
+	void attach();
+	/// Gives up the slot of this process, unlinking the name if it was the last one.
+	void detach();
+	static void detachAll();
+
+	std::string m_name;
+	int m_fd = -1;
+	Control* m_control = nullptr;
+	void* m_content = nullptr;
+	uint64_t m_contentSize = 0;
+	uint8_t const* m_data = nullptr;
+	uint64_t m_size = 0;
+	bool m_owner = false;
+	uint64_t m_generation = 0;
+	int m_slot = -1;
+	bool m_detached = false;
+};
+
+}
@@ -0,0 +1,245 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StatsSegment.cpp
+ */
+
+#include "StatsSegment.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include "Log.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ETH_STATS_SEGMENT 1
+#endif
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+
+uint64_t const c_magic = 0x3154415453485445;	// "ETHSTAT1"
+/// The block starts on its own cache line, away from the sequence counter.
+uint64_t const c_headerBytes = 64;
+/// Copies a reader attempts before giving up on a busy writer.
+unsigned const c_readAttempts = 1000;
+
+struct Header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t size;				///< sizeof(StatsBlock) of the writer.
+	std::atomic<uint64_t> seq;	///< Odd while an update is copied in.
+	uint64_t writer;			///< Pid of the writing process.
+};
+
+}
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "the sequence counter must be a plain word");
+
+const uint32_t StatsSegment::c_version;
+
+#if ETH_STATS_SEGMENT
+
+unique_ptr<StatsSegment> StatsSegment::create(string const& _name)
+{
+	string const path = "/" + _name;
+	uint64_t const mapSize = c_headerBytes + sizeof(StatsBlock);
+
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		cwarn << "Cannot open stats segment" << _name << ":" << strerror(errno);
+		return nullptr;
+	}
+
+	// Refuse to take over from another running miner.
+	struct stat st;
+	if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= c_headerBytes)
+	{
+		Header h;
+		if (pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && h.magic == c_magic && h.writer &&
+			h.writer != (uint64_t)getpid() && (kill((pid_t)h.writer, 0) == 0 || errno == EPERM))
+		{
+			cwarn << "Stats segment" << _name << "is in use by process" << h.writer;
+			close(fd);
+			return nullptr;
+		}
+	}
+
+	if (ftruncate(fd, (off_t)mapSize) != 0)
+	{
+		cwarn << "Cannot size stats segment" << _name << ":" << strerror(errno);
+		close(fd);
+		return nullptr;
+	}
+	void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		cwarn << "Cannot map stats segment" << _name << ":" << strerror(errno);
+		close(fd);
+		return nullptr;
+	}
+
+	unique_ptr<StatsSegment> seg(new StatsSegment);
+	seg->m_name = _name;
+	seg->m_fd = fd;
+	seg->m_map = map;
+	seg->m_mapSize = mapSize;
+
+	// Readers ignore the segment while the magic is wrong or the sequence odd.
+	Header* h = (Header*)map;
+	h->magic = 0;
+	h->seq.store(1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	h->version = c_version;
+	h->size = sizeof(StatsBlock);
+	h->writer = (uint64_t)getpid();
+	memset((uint8_t*)map + c_headerBytes, 0, sizeof(StatsBlock));
+	h->magic = c_magic;
+	h->seq.store(2, memory_order_release);
+	return seg;
+}
+
+StatsSegment::~StatsSegment()
+{
+	if (m_map)
+		munmap(m_map, m_mapSize);
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		shm_unlink(("/" + m_name).c_str());
+	}
+}
+
+void StatsSegment::publish(StatsBlock const& _block)
+{
+	Header* h = (Header*)m_map;
+	uint64_t const s = h->seq.load(memory_order_relaxed);
+	h->seq.store(s + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	StatsBlock* b = (StatsBlock*)((uint8_t*)m_map + c_headerBytes);
+	memcpy(b, &_block, sizeof(StatsBlock));
+	b->pid = (uint32_t)h->writer;
+	h->seq.store(s + 2, memory_order_release);
+}
+
+unique_ptr<StatsReader> StatsReader::open(string const& _name)
+{
+	int fd = shm_open(("/" + _name).c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < c_headerBytes)
+	{
+		close(fd);
+		return nullptr;
+	}
+	void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return nullptr;
+
+	unique_ptr<StatsReader> r(new StatsReader);
+	r->m_map = map;
+	r->m_mapSize = st.st_size;
+	if (((Header const*)map)->magic != c_magic)
+		return nullptr;
+	return r;
+}
+
+StatsReader::~StatsReader()
+{
+	if (m_map)
+		munmap(const_cast<void*>(m_map), m_mapSize);
+}
+
+bool StatsReader::read(StatsBlock& _block) const
+{
+	Header const* h = (Header const*)m_map;
+	for (unsigned i = 0; i < c_readAttempts; i++)
+	{
+		uint64_t const s = h->seq.load(memory_order_acquire);
+		if (s & 1)
+		{
+			this_thread::yield();
+			continue;
+		}
+		if (h->magic != c_magic)
+			return false;
+
+		// Older writers publish a prefix of the block, newer ones more than we know.
+		uint64_t const size = min<uint64_t>(min<uint64_t>(h->size, sizeof(StatsBlock)), m_mapSize - c_headerBytes);
+		memcpy(&_block, (uint8_t const*)m_map + c_headerBytes, size);
+		atomic_thread_fence(memory_order_acquire);
+		if (h->seq.load(memory_order_relaxed) == s)
+		{
+			memset((uint8_t*)&_block + size, 0, sizeof(StatsBlock) - size);
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t StatsReader::version() const
+{
+	return ((Header const*)m_map)->version;
+}
+
+#else
+
+unique_ptr<StatsSegment> StatsSegment::create(string const&)
+{
+	return nullptr;
+}
+
+StatsSegment::~StatsSegment()
+{
+}
+
+void StatsSegment::publish(StatsBlock const&)
+{
+}
+
+unique_ptr<StatsReader> StatsReader::open(string const&)
+{
+	return nullptr;
+}
+
+StatsReader::~StatsReader()
+{
+}
+
+bool StatsReader::read(StatsBlock&) const
+{
+	return false;
+}
+
+uint32_t StatsReader::version() const
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StatsSegment.h
+ * Miner counters published in POSIX shared memory for external monitors.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace dev
+{
+
+/// Devices described by the segment, the others are left out.
+static const unsigned c_statsMaxDevices = 64;
+/// Per collection hashrates kept for each device.
+static const unsigned c_statsWindow = 16;
+
+struct StatsDevice
+{
+	uint64_t hashrate;					///< Smoothed, in hashes per second.
+	uint64_t window[c_statsWindow];		///< Rate of each of the last collections, newest at StatsBlock::windowHead.
+	int32_t tempC;
+	int32_t fanP;
+	uint32_t powerMW;
+	uint32_t intensity;					///< Governor intensity, in thousandths.
+};
+
+/**
+ * @brief Everything a reader gets, layout version c_statsVersion.
+ *
+ * Only fixed width fields so tools in any language can map it; fields are
+ * only ever appended, with the version bumped.
+ */
+struct StatsBlock
+{
+	uint64_t updatedMs;		///< Unix time of the last update.
+	uint64_t uptimeMs;
+	uint32_t pid;			///< Of the writer, filled by StatsSegment::publish().
+	uint32_t devices;
+	uint64_t hashrate;
+
+	uint32_t accepted;
+	uint32_t acceptedStale;
+	uint32_t rejected;
+	uint32_t rejectedStale;
+	uint32_t failed;
+	int32_t epoch;
+	uint64_t height;
+	uint64_t period;
+	uint8_t header[32];
+
+	uint32_t windowHead;
+	uint32_t windowMs;		///< Nominal length of one window slot.
+	StatsDevice device[c_statsMaxDevices];
+};
+
+/**
+ * @brief The writing side: owns the segment and unlinks it when destroyed.
+ *
+ * A sequence counter in the segment header is odd while an update is being
+ * copied in. Readers retry when it was odd or changed across their copy, so
+ * the writer never waits for them and they never take any of its locks.
+ */
+class StatsSegment
+{
+public:
+	static const uint32_t c_version = 1;
+
+	/// Creates or takes over segment @a _name, nullptr when shared memory is unavailable.
+	static std::unique_ptr<StatsSegment> create(std::string const& _name);
+	~StatsSegment();
+
+	void publish(StatsBlock const& _block);
+
+	std::string const& name() const { return m_name; }
+
+private:
+	StatsSegment() = default;
+	StatsSegment(StatsSegment const&) = delete;
+	StatsSegment& operator=(StatsSegment const&) = delete;
+
+	std::string m_name;
+	int m_fd = -1;
+	void* m_map = nullptr;
+	uint64_t m_mapSize = 0;
+};
+
+/// The reading side, for monitoring tools.
+class StatsReader
+{
+public:
+	/// Maps segment @a _name read-only, nullptr when it does not exist or is not a stats segment.
+	static std::unique_ptr<StatsReader> open(std::string const& _name);
+	~StatsReader();
+
+	/// Copies a consistent update, false when the writer stayed busy or the layout is foreign.
+	bool read(StatsBlock& _block) const;
+
+	uint32_t version() const;
+
+private:
+	StatsReader() = default;
+	StatsReader(StatsReader const&) = delete;
+	StatsReader& operator=(StatsReader const&) = delete;
+
+	void const* m_map = nullptr;
+	uint64_t m_mapSize = 0;
+};
+
+}
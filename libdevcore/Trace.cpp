@@ -0,0 +1,249 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Trace.cpp
+ */
+
+#include "Trace.h"
+
+#include <fstream>
+#include <vector>
+#include "Guards.h"
+#include "Log.h"
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+
+struct Event
+{
+	char phase;		///< 'X' complete, 'i' instant.
+	char const* name;
+	char const* cat;
+	unsigned tid;
+	int64_t ts;		///< Microseconds since the recording started.
+	int64_t dur;
+	string args;
+};
+
+struct Recording
+{
+	Mutex x_events;
+	string path;
+	chrono::steady_clock::time_point origin;
+	vector<Event> events;
+	vector<string> threads;		///< Names by trace thread id.
+	unsigned generation = 0;	///< Bumped by each start, thread ids are per recording.
+	bool truncated = false;
+};
+
+/// Never destroyed, threads may record while the process exits.
+Recording& recording()
+{
+	static Recording* r = new Recording;
+	return *r;
+}
+
+void escape(string& _out, string const& _s)
+{
+	for (char c: _s)
+	{
+		if (c == '"' || c == '\\')
+		{
+			_out += '\\';
+			_out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+			_out += ' ';
+		else
+			_out += c;
+	}
+}
+
+/// Trace thread id of the calling thread, registered with its name under x_events.
+unsigned threadId(Recording& _r)
+{
+	thread_local unsigned id = 0;
+	thread_local unsigned generation = 0;
+	if (generation != _r.generation)
+	{
+		id = (unsigned)_r.threads.size();
+		_r.threads.push_back(getThreadName());
+		generation = _r.generation;
+	}
+	return id;
+}
+
+int64_t micros(chrono::steady_clock::duration _d)
+{
+	return chrono::duration_cast<chrono::microseconds>(_d).count();
+}
+
+void record(char _phase, char const* _name, char const* _cat, chrono::steady_clock::time_point _start,
+	chrono::steady_clock::time_point _end, TraceArgs const& _args)
+{
+	Recording& r = recording();
+	Guard l(r.x_events);
+	if (!Trace::enabled())
+		return;
+	if (r.events.size() >= Trace::c_maxEvents)
+	{
+		r.truncated = true;
+		return;
+	}
+	r.events.push_back(Event{_phase, _name, _cat, threadId(r), micros(_start - r.origin), micros(_end - _start), _args.json()});
+}
+
+}
+
+const size_t Trace::c_maxEvents;
+atomic<bool> Trace::s_enabled = {false};
+
+TraceArgs& TraceArgs::add(char const* _key, int64_t _value)
+{
+	if (!m_json.empty())
+		m_json += ',';
+	m_json += '"';
+	m_json += _key;
+	m_json += "\":" + to_string(_value);
+	return *this;
+}
+
+TraceArgs& TraceArgs::add(char const* _key, string const& _value)
+{
+	if (!m_json.empty())
+		m_json += ',';
+	m_json += '"';
+	m_json += _key;
+	m_json += "\":\"";
+	escape(m_json, _value);
+	m_json += '"';
+	return *this;
+}
+
+void Trace::start(string const& _path)
+{
+	Recording& r = recording();
+	Guard l(r.x_events);
+	r.path = _path;
+	r.origin = chrono::steady_clock::now();
+	r.events.clear();
+	r.threads.clear();
+	r.truncated = false;
+	r.generation++;
+	s_enabled = true;
+}
+
+bool Trace::stop()
+{
+	Recording& r = recording();
+	vector<Event> events;
+	vector<string> threads;
+	string path;
+	bool truncated;
+	{
+		Guard l(r.x_events);
+		if (!s_enabled)
+			return true;
+		s_enabled = false;
+		events.swap(r.events);
+		threads.swap(r.threads);
+		path = r.path;
+		truncated = r.truncated;
+	}
+
+	ofstream out(path);
+	if (!out)
+	{
+		cwarn << "Cannot write trace to" << path;
+		return false;
+	}
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	string line;
+	line.reserve(256);
+	for (unsigned tid = 0; tid < threads.size(); tid++)
+	{
+		line = "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + to_string(tid) + ",\"args\":{\"name\":\"";
+		escape(line, threads[tid].empty() ? "thread " + to_string(tid) : threads[tid]);
+		line += "\"}},\n";
+		out << line;
+	}
+	for (Event const& e: events)
+	{
+		line = "{\"ph\":\"";
+		line += e.phase;
+		line += "\",\"name\":\"";
+		line += e.name;
+		line += "\",\"cat\":\"";
+		line += e.cat;
+		line += "\",\"pid\":1,\"tid\":" + to_string(e.tid) + ",\"ts\":" + to_string(e.ts);
+		if (e.phase == 'X')
+			line += ",\"dur\":" + to_string(e.dur);
+		else
+			line += ",\"s\":\"t\"";
+		line += ",\"args\":{" + e.args + "}},\n";
+		out << line;
+	}
+	out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"ethminer\"}}\n]}\n";
+	out.close();
+	if (!out)
+	{
+		cwarn << "Cannot write trace to" << path;
+		return false;
+	}
+	cnote << "Wrote" << events.size() << "trace events to" << path << (truncated ? "(truncated)" : "");
+	return true;
+}
+
+void Trace::instant(char const* _name, char const* _cat, TraceArgs const& _args)
+{
+	if (!enabled())
+		return;
+	auto now = chrono::steady_clock::now();
+	record('i', _name, _cat, now, now, _args);
+}
+
+void Trace::complete(char const* _name, char const* _cat, chrono::steady_clock::time_point _start,
+	chrono::steady_clock::time_point _end, TraceArgs const& _args)
+{
+	if (!enabled())
+		return;
+	record('X', _name, _cat, _start, _end, _args);
+}
+
+TraceSpan::TraceSpan(char const* _name, char const* _cat):
+	m_name(_name),
+	m_cat(_cat),
+	m_active(Trace::enabled())
+{
+	if (m_active)
+		m_start = chrono::steady_clock::now();
+}
+
+TraceSpan::~TraceSpan()
+{
+	end();
+}
+
+void TraceSpan::end()
+{
+	if (!m_active)
+		return;
+	m_active = false;
+	Trace::complete(m_name, m_cat, m_start, chrono::steady_clock::now(), m_args);
+}
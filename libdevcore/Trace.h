@@ -0,0 +1,98 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Trace.h
+ * Timeline of startup and switch phases in the Chrome trace event format.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace dev
+{
+
+/// Arguments of a trace event, rendered as they are added.
+class TraceArgs
+{
+public:
+	TraceArgs& add(char const* _key, int64_t _value);
+	TraceArgs& add(char const* _key, std::string const& _value);
+
+	std::string const& json() const { return m_json; }
+
+private:
+	std::string m_json;
+};
+
+/**
+ * @brief Process wide trace recorder, off unless started.
+ *
+ * Events are kept in memory and written as one JSON file loadable by
+ * chrome://tracing or Perfetto. Meant for phases lasting milliseconds
+ * or more, not for per kernel launch events. Names and categories must
+ * be string literals.
+ */
+class Trace
+{
+public:
+	/// Events kept at most, later ones are dropped.
+	static const size_t c_maxEvents = 1 << 20;
+
+	/// Starts recording for a write to @a _path.
+	static void start(std::string const& _path);
+	/// Writes what was recorded and stops recording, false if the file could not be written.
+	static bool stop();
+
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	/// Point in time event.
+	static void instant(char const* _name, char const* _cat, TraceArgs const& _args = TraceArgs());
+	static void complete(char const* _name, char const* _cat, std::chrono::steady_clock::time_point _start,
+		std::chrono::steady_clock::time_point _end, TraceArgs const& _args);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+/// Records the time from its construction to its destruction as one trace span.
+class TraceSpan
+{
+public:
+	TraceSpan(char const* _name, char const* _cat);
+	~TraceSpan();
+
+	TraceSpan& arg(char const* _key, int64_t _value) { if (m_active) m_args.add(_key, _value); return *this; }
+	TraceSpan& arg(char const* _key, std::string const& _value) { if (m_active) m_args.add(_key, _value); return *this; }
+
+	/// Ends the span before the end of the scope.
+	void end();
+
+private:
+	TraceSpan(TraceSpan const&) = delete;
+	TraceSpan& operator=(TraceSpan const&) = delete;
+
+	char const* m_name;
+	char const* m_cat;
+	bool m_active;
+	std::chrono::steady_clock::time_point m_start;
+	TraceArgs m_args;
+};
+
+}
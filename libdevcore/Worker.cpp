@@ -90,6 +90,25 @@ void Worker::stopWorking()
 		}
 }
 
+bool Worker::stopWorking(chrono::milliseconds _timeout)
+{
+	auto const deadline = chrono::steady_clock::now() + _timeout;
+	DEV_GUARDED(x_work)
+		if (m_work)
+		{
+			WorkerState ex = WorkerState::Started;
+			m_state.compare_exchange_strong(ex, WorkerState::Stopping);
+
+			while (m_state != WorkerState::Stopped)
+			{
+				if (chrono::steady_clock::now() > deadline)
+					return false;
+				this_thread::sleep_for(chrono::microseconds(20));
+			}
+		}
+	return true;
+}
+
 Worker::~Worker()
 {
 	DEV_GUARDED(x_work)
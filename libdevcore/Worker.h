@@ -24,6 +24,7 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <cassert>
 #include "Guards.h"
 
@@ -55,6 +56,9 @@ public:
 	/// Stop worker thread; causes call to stopWorking().
 	void stopWorking();
 
+	/// The same, giving up after @a _timeout. False if the thread is still busy then.
+	bool stopWorking(std::chrono::milliseconds _timeout);
+
 	bool shouldStop() const { return m_state != WorkerState::Started; }
 
 private:
@@ -6,6 +6,8 @@
 #include "CLMiner.h"
 #include <libethash/internal.h>
 #include "CLMiner_kernel.h"
+#include <libethcore/InitPipeline.h>
+#include <libethcore/KernelCache.h>
 #include <iostream>
 #include <fstream>
 
@@ -21,6 +23,7 @@ unsigned CLMiner::s_workgroupSize = CLMiner::c_defaultLocalWorkSize;
 unsigned CLMiner::s_initialGlobalWorkSize = CLMiner::c_defaultGlobalWorkSizeMultiplier * CLMiner::c_defaultLocalWorkSize;
 unsigned CLMiner::s_threadsPerHash = 8;
 CLKernelName CLMiner::s_clKernelName = CLMiner::c_defaultKernelName;
+bool CLMiner::s_subgroups = false;
 
 constexpr size_t c_maxSearchResults = 1;
 
@@ -216,6 +219,55 @@ void addDefinition(string& _source, char const* _id, unsigned _value)
 	_source.insert(_source.begin(), buf, buf + strlen(buf));
 }
 
+/// The fastest lane exchange of the device for work groups of @a _localSize, see ProgPow::subgroup_t.
+ProgPow::subgroup_t subgroupPath(cl::Device const& _device, int _platformId, size_t _localSize)
+{
+	string const extensions = " " + _device.getInfo<CL_DEVICE_EXTENSIONS>() + " ";
+	auto const has = [&](char const* _extension) { return extensions.find(" " + string(_extension) + " ") != string::npos; };
+
+	if (has("cl_intel_subgroups"))
+		return ProgPow::SUBGROUP_INTEL;
+	if (has("cl_khr_subgroups") && has("cl_khr_subgroup_shuffle"))
+		return ProgPow::SUBGROUP_KHR_SHUFFLE;
+	if (has("cl_khr_subgroups"))
+		return ProgPow::SUBGROUP_KHR;
+	// The AMD compilers do not advertise their cross-lane built-ins, the
+	// wavefront holds whole hashes of every work group or the path is not
+	// taken. A compiler without ds_bpermute fails the build and falls back.
+	if (_platformId == OPENCL_PLATFORM_AMD && has("cl_amd_device_attribute_query"))
+	{
+		cl_uint width = 0;
+		if (clGetDeviceInfo(_device(), CL_DEVICE_WAVEFRONT_WIDTH_AMD, sizeof(width), &width, nullptr) == CL_SUCCESS &&
+			width >= PROGPOW_LANES && width % PROGPOW_LANES == 0 && _localSize % width == 0)
+			return ProgPow::SUBGROUP_AMD;
+	}
+	return ProgPow::SUBGROUP_NONE;
+}
+
+char const* subgroupName(ProgPow::subgroup_t _subgroup)
+{
+	switch (_subgroup)
+	{
+	case ProgPow::SUBGROUP_INTEL: return "cl_intel_subgroups";
+	case ProgPow::SUBGROUP_KHR_SHUFFLE: return "cl_khr_subgroup_shuffle";
+	case ProgPow::SUBGROUP_KHR: return "cl_khr_subgroups";
+	case ProgPow::SUBGROUP_AMD: return "amdgcn ds_bpermute";
+	default: return "local memory";
+	}
+}
+
+/// Whether every sub-group of a work group of @a _localSize holds whole hashes.
+bool subgroupsFit(cl::Platform const& _platform, cl::Device const& _device, cl::Kernel const& _kernel, size_t _localSize)
+{
+	typedef cl_int (*GetKernelSubGroupInfo)(cl_kernel, cl_device_id, cl_uint, size_t, void const*, size_t, void*, size_t*);
+	auto const getInfo = (GetKernelSubGroupInfo)clGetExtensionFunctionAddressForPlatform(_platform(), "clGetKernelSubGroupInfoKHR");
+	size_t size = 0;
+	if (!getInfo || getInfo(_kernel(), _device(), CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE_KHR,
+			sizeof(_localSize), &_localSize, sizeof(size), &size, nullptr) != CL_SUCCESS)
+		return false;
+	return size >= PROGPOW_LANES && size % PROGPOW_LANES == 0 && _localSize % size == 0;
+}
+
 std::vector<cl::Platform> getPlatforms()
 {
 	vector<cl::Platform> platforms;
@@ -280,6 +332,8 @@ void CLMiner::workLoop()
 	uint32_t const c_zero = 0;
 
 	uint64_t startNonce = 0;
+	uint64_t launchedNonce = 0;		// first nonce of the kernel running
+	shared_ptr<NonceCursor> nonces;
 
 	// The work package currently processed by GPU.
 	WorkPackage current;
@@ -289,7 +343,37 @@ void CLMiner::workLoop()
 	try {
 		while (!shouldStop())
 		{
-			const WorkPackage w = work();
+			bool switched = false;
+			if (waitWhilePaused())
+				continue;
+
+			if (takeReinit())
+			{
+				// Rebuild the program and rewrite the buffers, as on a new period.
+				cllog << "Reinitialising";
+				old_period_seed = -1;
+			}
+
+			MinerLaunch geometry;
+			if (takeLaunch(geometry) && m_workgroupSize)
+			{
+				unsigned const local = geometry.localWorkSize ? geometry.localWorkSize : s_workgroupSize;
+				if (local != m_workgroupSize)
+				{
+					// The work-group size is compiled in, rebuild the program as
+					// on a new period. The DAG stays.
+					cllog << "Work-group size" << local << ", rebuilding the kernel";
+					old_period_seed = -1;
+				}
+				else
+				{
+					unsigned const global = geometry.globalWorkSize ? geometry.globalWorkSize : s_initialGlobalWorkSize;
+					m_globalWorkSize = (global + m_workgroupSize - 1) / m_workgroupSize * m_workgroupSize;
+					cllog << "Global work size" << m_globalWorkSize;
+				}
+			}
+
+			const WorkPackage w = work(nonces);
 			uint64_t period_seed = (w.height + 2584000) / PROGPOW_PERIOD;
 
 			if (current.header != w.header || current.epoch != w.epoch || old_period_seed != period_seed)
@@ -306,13 +390,7 @@ void CLMiner::workLoop()
 
 				if (current.epoch != w.epoch || old_period_seed != period_seed)
 				{
-					if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
-					{
-						while (s_dagLoadIndex < index)
-							this_thread::sleep_for(chrono::seconds(1));
-						++s_dagLoadIndex;
-					}
-
+					Busy busy(*this);
 					cllog << "New epoch " << w.epoch << "/ period " << period_seed;
 					init(w.epoch, (w.height + 2584000), current.epoch != w.epoch, old_period_seed != period_seed);
 				}
@@ -328,15 +406,8 @@ void CLMiner::workLoop()
 				m_searchKernel.setArg(0, m_searchBuffer);  // Supply output buffer to kernel.
 				m_searchKernel.setArg(4, target);
 
-				// FIXME: This logic should be move out of here.
-				if (w.exSizeBits >= 0)
-				{
-					// This can support up to 2^c_log2MaxMiners devices.
-					startNonce = w.startNonce | ((uint32_t)index << (32 - LOG2_MAX_MINERS - w.exSizeBits));
-				}
-				else
-					startNonce = get_start_nonce();
-
+				switched = true;
+				traceSwitch("cl");
 				clswitchlog << "Switch time"
 					<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - workSwitchStart).count()
 					<< "ms.";
@@ -352,31 +423,38 @@ void CLMiner::workLoop()
 			if (results[0] > 0)
 			{
 				// Ignore results except the first one.
-				nonce = current.startNonce + results[1];
+				nonce = launchedNonce + results[1];
 				// Reset search buffer if any solution found.
 				m_queue.enqueueWriteBuffer(m_searchBuffer, CL_FALSE, 0, sizeof(c_zero), &c_zero);
 			}
 
-			// Run the kernel.
-			m_searchKernel.setArg(3, startNonce);
-			m_queue.enqueueNDRangeKernel(m_searchKernel, cl::NullRange, m_globalWorkSize, m_workgroupSize);
+			// Run the kernel, scaled down in whole work-groups by the governor.
+			unsigned launch = max(m_workgroupSize,
+				unsigned(m_globalWorkSize * intensity()) / m_workgroupSize * m_workgroupSize);
+			launch = (unsigned)leaseNonces(*nonces, launch, m_workgroupSize, startNonce);
+			if (launch)
+			{
+				m_searchKernel.setArg(3, startNonce);
+				m_queue.enqueueNDRangeKernel(m_searchKernel, cl::NullRange, launch, m_workgroupSize);
+				if (switched)
+					Trace::instant("launch", "cl", TraceArgs().add("gpu", (int64_t)index));
+			}
 
 			// Report results while the kernel is running.
-			// It takes some time because ethash must be re-evaluated on CPU.
+			// It takes some time because ProgPoW must be re-evaluated on CPU.
 			if (nonce != 0) {
-					Result r = EthashAux::eval(current.epoch, current.header, nonce);
+					Result r = EthashAux::evalProgPow(current.epoch, current.height, current.header, nonce);
 					farm.submitProof(Solution{nonce, r.mixHash, current, current.header != w.header});
 			}
 
 			old_period_seed = period_seed;
 
 			current = w;        // kernel now processing newest work
-			current.startNonce = startNonce;
-			// Increase start nonce for following kernel execution.
-			startNonce += m_globalWorkSize;
+			launchedNonce = startNonce;
 
 			// Report hash count
-			addHashCount(m_globalWorkSize);
+			if (launch)
+				addHashCount(launch);
 
 			// Make sure the last buffer write has finished --
 			// it reads local variable.
@@ -396,6 +474,7 @@ void CLMiner::kick_miner() {}
 
 unsigned CLMiner::getNumDevices()
 {
+	TraceSpan span("enumerate", "cl");
 	vector<cl::Platform> platforms = getPlatforms();
 	if (platforms.empty())
 		return 0;
@@ -504,7 +583,8 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 {
 	assert(new_epoch || new_period);
 
-	EthashAux::LightType light = EthashAux::light(epoch);
+	TraceSpan span("init", "cl");
+	span.arg("gpu", (int64_t)index).arg("epoch", epoch);
 
 	// get all platforms
 	try
@@ -521,10 +601,6 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 
 		int platformId = OPENCL_PLATFORM_UNKNOWN;
 		{
-			// this mutex prevents race conditions when calling the adl wrapper since it is apparently not thread safe
-			static std::mutex mtx;
-			std::lock_guard<std::mutex> lock(mtx);
-
 			if (platformName == "NVIDIA CUDA")
 			{
 				platformId = OPENCL_PLATFORM_NVIDIA;
@@ -588,16 +664,28 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 		else {
 			sprintf(options, "%s", "");
 		}
-		// create context
-		m_context = cl::Context(vector<cl::Device>(&device, &device + 1));
-		m_queue = cl::CommandQueue(m_context, device);
+		// The context, queue and buffers live as long as the miner: a new period
+		// only rebuilds the program, a new epoch regenerates the DAG in place
+		// while it fits the buffer.
+		if (!m_context())
+		{
+			m_context = cl::Context(vector<cl::Device>(&device, &device + 1));
+			m_queue = cl::CommandQueue(m_context, device);
+		}
 
 		// make sure that global work size is evenly divisible by the local workgroup size
-		m_workgroupSize = s_workgroupSize;
-		m_globalWorkSize = s_initialGlobalWorkSize;
+		MinerLaunch const l = launch();
+		m_workgroupSize = l.localWorkSize ? l.localWorkSize : s_workgroupSize;
+		m_globalWorkSize = l.globalWorkSize ? l.globalWorkSize : s_initialGlobalWorkSize;
 		if (m_globalWorkSize % m_workgroupSize != 0)
 			m_globalWorkSize = ((m_globalWorkSize / m_workgroupSize) + 1) * m_workgroupSize;
 
+		// The context is up, the light cache the farm started building is needed from here.
+		EthashAux::LightType light;
+		{
+			InitPipeline::Phase phase(index, "light");
+			light = EthashAux::light(epoch);
+		}
 		uint64_t dagBytes = ethash_get_datasize(light->light->block_number);
 		uint32_t dagElms = (unsigned)(dagBytes / (PROGPOW_LANES * PROGPOW_DAG_LOADS * 4));
 		uint32_t lightWords = (unsigned)(light->data().size() / sizeof(node));
@@ -606,35 +694,99 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 		// note: The kernels here are simply compiled version of the respective .cl kernels
 		// into a byte array by bin2h.cmake. There is no need to load the file by hand in runtime
 		// See libethash-cl/CMakeLists.txt: add_custom_command()
-		std::string code = ProgPow::getKern(block_number, ProgPow::KERNEL_CL);
-		code += string(CLMiner_kernel, sizeof(CLMiner_kernel));
-
-		addDefinition(code, "GROUP_SIZE", m_workgroupSize);
-		addDefinition(code, "PROGPOW_DAG_BYTES", dagBytes);
-		addDefinition(code, "PROGPOW_DAG_ELEMENTS", dagElms);
-		addDefinition(code, "LIGHT_WORDS", lightWords);
-		addDefinition(code, "MAX_OUTPUTS", c_maxSearchResults);
-		addDefinition(code, "PLATFORM", platformId);
-		addDefinition(code, "COMPUTE", computeCapability);
-
-        ofstream out;
-        out.open("kernel.cl");
-        out << code;
-        out.close();
-
-		// create miner OpenCL program
-		cl::Program::Sources sources{{code.data(), code.size()}};
-		cl::Program program(m_context, sources);
-		try
+		std::string const kernel = ProgPow::getKern(block_number, ProgPow::KERNEL_CL) + string(CLMiner_kernel, sizeof(CLMiner_kernel));
+
+		// Lanes exchange values through __local memory unless sub-groups are
+		// enabled and the device has them, falling back to it if the build or
+		// the sub-group size does not work out.
+		ProgPow::subgroup_t subgroup = ProgPow::SUBGROUP_NONE;
+		if (s_subgroups && m_workgroupSize % PROGPOW_LANES == 0)
+			subgroup = subgroupPath(device, platformId, m_workgroupSize);
+
+		InitPipeline::Phase phase(index, "compile");
+		TraceSpan compile("compile", "cl");
+		compile.arg("gpu", (int64_t)index).arg("period", (int64_t)(block_number / PROGPOW_PERIOD));
+		cl::Program program;
+		while (true)
 		{
-			program.build({device}, options);
-			cllog << "Build info:" << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
-		}
-		catch (cl::Error const&)
-		{
-			cwarn << "Build info:" << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
-			return false;
+			std::string code = kernel;
+			addDefinition(code, "GROUP_SIZE", m_workgroupSize);
+			addDefinition(code, "PROGPOW_DAG_BYTES", dagBytes);
+			addDefinition(code, "PROGPOW_DAG_ELEMENTS", dagElms);
+			addDefinition(code, "LIGHT_WORDS", lightWords);
+			addDefinition(code, "MAX_OUTPUTS", c_maxSearchResults);
+			addDefinition(code, "PLATFORM", platformId);
+			addDefinition(code, "COMPUTE", computeCapability);
+			addDefinition(code, "PROGPOW_SUBGROUP", subgroup);
+
+			ofstream out;
+			out.open("kernel.cl");
+			out << code;
+			out.close();
+
+			// The cl_khr_subgroups built-ins are OpenCL C 2.0
+			string buildOptions = options;
+			if (subgroup == ProgPow::SUBGROUP_KHR || subgroup == ProgPow::SUBGROUP_KHR_SHUFFLE)
+				buildOptions += " -cl-std=CL2.0";
+
+			// create miner OpenCL program, built once for the devices of the same
+			// model and driver and loaded from its binary by the others
+			string const target = platforms[platformIdx].getInfo<CL_PLATFORM_NAME>() + '/' +
+				device.getInfo<CL_DEVICE_NAME>() + '/' + device.getInfo<CL_DRIVER_VERSION>();
+			bool compiled = false;
+			try
+			{
+				KernelCache::Binary binary = KernelCache::get(KernelCache::key(code, buildOptions, target), [&]() {
+					cl::Program::Sources sources{{code.data(), code.size()}};
+					cl::Program built(m_context, sources);
+					try
+					{
+						built.build({device}, buildOptions.c_str());
+					}
+					catch (cl::Error const&)
+					{
+						throw std::runtime_error(built.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
+					}
+					cllog << "Build info:" << built.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+					cl::Program::Binaries binaries = built.getInfo<CL_PROGRAM_BINARIES>();
+					return binaries.empty() ? bytes() : bytes(binaries[0].begin(), binaries[0].end());
+				}, &compiled);
+				if (binary->empty())
+				{
+					// The runtime hands out no binaries, every device builds the source.
+					cl::Program::Sources sources{{code.data(), code.size()}};
+					program = cl::Program(m_context, sources);
+				}
+				else
+					program = cl::Program(m_context, {device}, cl::Program::Binaries{*binary});
+				program.build({device}, buildOptions.c_str());
+				if (!compiled)
+					cllog << "Program built by another device";
+			}
+			catch (std::exception const& _e)
+			{
+				if (subgroup == ProgPow::SUBGROUP_NONE)
+				{
+					cwarn << "Build info:" << _e.what();
+					return false;
+				}
+				cllog << "Build with " << subgroupName(subgroup) << " sub-groups failed:" << _e.what();
+				subgroup = ProgPow::SUBGROUP_NONE;
+				continue;
+			}
+
+			if ((subgroup == ProgPow::SUBGROUP_KHR || subgroup == ProgPow::SUBGROUP_KHR_SHUFFLE) &&
+				!subgroupsFit(platforms[platformIdx], device, cl::Kernel(program, "ethash_search"), m_workgroupSize))
+			{
+				cllog << "Sub-groups do not hold whole hashes, using local memory";
+				subgroup = ProgPow::SUBGROUP_NONE;
+				continue;
+			}
+			break;
 		}
+		compile.end();
+		phase.end();
+		cllog << "Lane exchange: " << subgroupName(subgroup);
 
 		//check whether the current dag fits in memory everytime we recreate the DAG
 		cl_ulong result = 0;
@@ -651,24 +803,52 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 		// create buffer for dag
 		try
 		{
-			cllog << "Creating light cache buffer, size" << light->data().size();
-			m_light = cl::Buffer(m_context, CL_MEM_READ_ONLY, light->data().size());
-			cllog << "Creating DAG buffer, size" << dagBytes;
-			m_dag = cl::Buffer(m_context, CL_MEM_READ_ONLY, dagBytes);
+			// Reserve for the epochs of the headroom, the buffers then outlive
+			// the next epoch switches. The old buffer goes first.
+			cl_ulong const maxAlloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+			if (light->data().size() > m_lightCapacity)
+			{
+				m_light = cl::Buffer();
+				m_lightCapacity = lightReservation(light->light->block_number, maxAlloc);
+				cllog << "Creating light cache buffer, size" << m_lightCapacity;
+				m_light = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_lightCapacity);
+			}
+			if (dagBytes > m_dagCapacity)
+			{
+				m_dag = cl::Buffer();
+				m_dagCapacity = dagReservation(light->light->block_number, maxAlloc);
+				cllog << "Creating DAG buffer, size" << m_dagCapacity << "for" << dagBytes;
+				m_dag = cl::Buffer(m_context, CL_MEM_READ_ONLY, m_dagCapacity);
+			}
+			else if (new_epoch)
+				cllog << "Reusing DAG buffer of" << m_dagCapacity << "for" << dagBytes;
 			cllog << "Loading kernels";
 			m_searchKernel = cl::Kernel(program, "ethash_search");
 			m_dagKernel = cl::Kernel(program, "ethash_calculate_dag_item");
-			cllog << "Writing light cache buffer";
-			m_queue.enqueueWriteBuffer(m_light, CL_TRUE, 0, light->data().size(), light->data().data());
+			if (new_epoch)
+			{
+				cllog << "Writing light cache buffer";
+				m_queue.enqueueWriteBuffer(m_light, CL_TRUE, 0, light->data().size(), light->data().data());
+			}
 		}
 		catch (cl::Error const& err)
 		{
+			m_dag = cl::Buffer();
+			m_light = cl::Buffer();
+			m_dagCapacity = m_lightCapacity = 0;
 			cwarn << ethCLErrorHelper("Creating DAG buffer failed", err);
 			return false;
 		}
-		// create buffer for header
-		ETHCL_LOG("Creating buffer for header.");
-		m_header = cl::Buffer(m_context, CL_MEM_READ_ONLY, 32);
+		if (!m_header())
+		{
+			ETHCL_LOG("Creating buffer for header.");
+			m_header = cl::Buffer(m_context, CL_MEM_READ_ONLY, 32);
+		}
+		if (!m_searchBuffer())
+		{
+			ETHCL_LOG("Creating mining buffer");
+			m_searchBuffer = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, (c_maxSearchResults + 1) * sizeof(uint32_t));
+		}
 
 		m_searchKernel.setArg(1, m_header);
 		m_searchKernel.setArg(2, m_dag);
@@ -677,10 +857,6 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 		if (!new_epoch)
 			return true;
 
-		// create mining buffers
-		ETHCL_LOG("Creating mining buffer");
-		m_searchBuffer = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, (c_maxSearchResults + 1) * sizeof(uint32_t));
-
 		uint32_t const work = (uint32_t)(dagBytes / sizeof(node));
 		uint32_t fullRuns = work / m_globalWorkSize;
 		uint32_t const restWork = work % m_globalWorkSize;
@@ -690,6 +866,7 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 		m_dagKernel.setArg(2, m_dag);
 		m_dagKernel.setArg(3, ~0u);
 
+		InitPipeline::DagSlot slot(index);
 		auto startDAG = std::chrono::steady_clock::now();
 		for (uint32_t i = 0; i < fullRuns; i++)
 		{
@@ -698,6 +875,7 @@ bool CLMiner::init(int epoch, uint64_t block_number, bool new_epoch, bool new_pe
 			m_queue.finish();
 		}
 		auto endDAG = std::chrono::steady_clock::now();
+		Trace::complete("dag", "cl", startDAG, endDAG, TraceArgs().add("gpu", (int64_t)index).add("bytes", (int64_t)dagBytes));
 
 		auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(endDAG-startDAG);
 		float gb = (float)dagBytes / (1024 * 1024 * 1024);
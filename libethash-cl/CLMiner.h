@@ -26,6 +26,14 @@
 #define CL_DEVICE_COMPUTE_CAPABILITY_MINOR_NV       0x4001
 #endif
 
+#ifndef CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE_KHR
+#define CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE_KHR 0x2033
+#endif
+
+#ifndef CL_DEVICE_WAVEFRONT_WIDTH_AMD
+#define CL_DEVICE_WAVEFRONT_WIDTH_AMD 0x4043
+#endif
+
 #define OPENCL_PLATFORM_UNKNOWN 0
 #define OPENCL_PLATFORM_NVIDIA  1
 #define OPENCL_PLATFORM_AMD     2
@@ -79,6 +87,9 @@ public:
 		}
 	}
 	static void setCLKernel(unsigned _clKernel) { s_clKernelName = _clKernel == 1 ? CLKernelName::Experimental : CLKernelName::Stable; }
+	/// Use sub-group shuffles between the lanes of a hash where the device supports them,
+	/// instead of local memory. Off by default until checked against the host hash on the device.
+	static void setSubgroups(bool _subgroups) { s_subgroups = _subgroups; }
 protected:
 	void kick_miner() override;
 
@@ -95,6 +106,9 @@ private:
 	cl::Buffer m_light;
 	cl::Buffer m_header;
 	cl::Buffer m_searchBuffer;
+	/// Allocated sizes of m_dag and m_light, reused while an epoch fits.
+	uint64_t m_dagCapacity = 0;
+	uint64_t m_lightCapacity = 0;
 	unsigned m_globalWorkSize = 0;
 	unsigned m_workgroupSize = 0;
 
@@ -102,6 +116,7 @@ private:
 	static unsigned s_numInstances;
 	static unsigned s_threadsPerHash;
 	static CLKernelName s_clKernelName;
+	static bool s_subgroups;
 	static vector<int> s_devices;
 
 	/// The local work size for the search
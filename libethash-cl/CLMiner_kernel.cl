@@ -17,6 +17,13 @@
 
 #define HASHES_PER_GROUP (GROUP_SIZE / PROGPOW_LANES)
 
+// The lanes of a hash exchange values through __local share and rely on
+// running in lockstep, as they do on GPUs. Devices that run work-items one
+// after another between barriers (CPU implementations) need PROGPOW_SHARE_FENCE
+// so share is not overwritten before every lane has read it. With
+// PROGPOW_SUBGROUP the lanes use the sub-group shuffles of the generated
+// progpow_shuffle() instead, without share or barriers.
+
 typedef struct
 {
     uint32_t uint32s[32 / sizeof(uint32_t)];
@@ -157,6 +164,9 @@ typedef struct {
 #if PLATFORM != OPENCL_PLATFORM_NVIDIA // use maxrregs on nv
 __attribute__((reqd_work_group_size(GROUP_SIZE, 1, 1)))
 #endif
+#if PROGPOW_SUBGROUP == PROGPOW_SUBGROUP_INTEL
+__attribute__((intel_reqd_sub_group_size(PROGPOW_LANES)))
+#endif
 __kernel void ethash_search(
     __global volatile uint* restrict g_output,
     __constant hash32_t const* g_header,
@@ -164,6 +174,10 @@ __kernel void ethash_search(
     ulong start_nonce,
     ulong target,
     uint hack_false
+#ifdef PROGPOW_CHECK
+    // digest and result of every nonce, for progpow-check
+    , __global uint* restrict g_check
+#endif
 )
 {
     __local shuffle_t share[HASHES_PER_GROUP];
@@ -220,10 +234,17 @@ __kernel void ethash_search(
 
         // share the hash's seed across all lanes
         //uint64_t hash_seed = __shfl_sync(0xFFFFFFFF, seed, h, PROGPOW_LANES);
+#if PROGPOW_SUBGROUP
+        uint64_t hash_seed = progpow_shuffle64(seed, h);
+#else
         if (lane_id == h)
             share[group_id].uint64s[0] = seed;
         barrier(CLK_LOCAL_MEM_FENCE);
         uint64_t hash_seed = share[group_id].uint64s[0];
+#ifdef PROGPOW_SHARE_FENCE
+        barrier(CLK_LOCAL_MEM_FENCE);
+#endif
+#endif
 
         // initialize mix for all lanes
         fill_mix(hash_seed, lane_id, mix);
@@ -244,6 +265,13 @@ __kernel void ethash_search(
         hash32_t digest_temp;
         for (int i = 0; i < 8; i++)
             digest_temp.uint32s[i] = 0x811c9dc5;
+#if PROGPOW_SUBGROUP
+        #pragma unroll
+        for (int i = 0; i < PROGPOW_LANES; i++)
+            fnv1a(digest_temp.uint32s[i % 8], progpow_shuffle(mix_hash, i));
+        if (h == lane_id)
+            digest = digest_temp;
+#else
         share[group_id].uint32s[lane_id] = mix_hash;
         barrier(CLK_LOCAL_MEM_FENCE);
         #pragma unroll
@@ -251,10 +279,21 @@ __kernel void ethash_search(
             fnv1a(digest_temp.uint32s[i % 8], share[group_id].uint32s[i]);
         if (h == lane_id)
             digest = digest_temp;
+#ifdef PROGPOW_SHARE_FENCE
+        barrier(CLK_LOCAL_MEM_FENCE);
+#endif
+#endif
     }
 
     // keccak(header .. keccak(header..nonce) .. digest);
-    if (keccak_f800(header_copy, seed, digest) < target)
+    uint64_t const result = keccak_f800(header_copy, seed, digest);
+#ifdef PROGPOW_CHECK
+    for (int i = 0; i < 8; i++)
+        g_check[gid * 10 + i] = digest.uint32s[i];
+    g_check[gid * 10 + 8] = (uint32_t)result;
+    g_check[gid * 10 + 9] = (uint32_t)(result >> 32);
+#endif
+    if (result < target)
     {
         uint slot = atomic_inc(&g_output[0]) + 1;
         if(slot <= MAX_OUTPUTS)
@@ -0,0 +1,314 @@
+/*
+This file is part of cpp-ethereum.
+
+cpp-ethereum is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+cpp-ethereum is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CPUMiner.cpp
+ */
+
+#include "CPUMiner.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <libethash/internal.h>
+#include <libethcore/InitPipeline.h>
+#include <libprogpow/ProgPowJit.h>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+unsigned CPUMiner::s_numInstances = 0;
+unsigned CPUMiner::s_interleave = 0;
+Mutex CPUMiner::x_dag;
+shared_ptr<CPUMiner::Dag const> CPUMiner::s_dag;
+
+struct CPUChannel: public LogChannel
+{
+	static const char* name() { return EthOrange " cp"; }
+	static const int verbosity = 2;
+	static const bool debug = false;
+};
+
+struct CPUSwitchChannel: public LogChannel
+{
+	static const char* name() { return EthOrange " cp"; }
+	static const int verbosity = 6;
+	static const bool debug = false;
+};
+
+#define cpulog clog(CPUChannel)
+#define cpuswitchlog clog(CPUSwitchChannel)
+
+namespace
+{
+
+/// Interleaves tried by tuneInterleave().
+unsigned const c_tuneInterleaves[] = {1, 2, 4, 8, 16};
+/// Hashes timed per candidate, a multiple of every candidate.
+unsigned const c_tuneHashes = 32;
+unsigned const c_maxResults = 4;
+
+}
+
+uint32_t const* CPUMiner::Dag::words(int _node) const
+{
+	if (shared)
+		return reinterpret_cast<uint32_t const*>(shared->data());
+	return reinterpret_cast<uint32_t const*>(replicas->forNode(_node));
+}
+
+CPUMiner::CPUMiner(FarmFace& _farm, unsigned _index):
+	Miner("cpu-", _farm, _index) {}
+
+CPUMiner::~CPUMiner()
+{
+	stopWorking();
+	kick_miner();
+}
+
+void CPUMiner::kick_miner() {}
+
+void CPUMiner::setNumInstances(unsigned _instances)
+{
+	if (_instances == 0)
+		_instances = std::max(1u, thread::hardware_concurrency());
+	s_numInstances = std::min<unsigned>(_instances, MAX_MINERS);
+}
+
+void CPUMiner::configure(unsigned _instances, unsigned _interleave, bool _exit)
+{
+	setNumInstances(_instances);
+	setInterleave(_interleave);
+	s_exit = _exit;
+}
+
+void CPUMiner::generate(ethash_light_t _light, uint8_t* _data, uint64_t _size)
+{
+	uint32_t const nodes = (uint32_t)(_size / sizeof(node));
+	unsigned const threads = std::max(1u, thread::hardware_concurrency());
+
+	vector<thread> workers;
+	for (unsigned t = 0; t < threads; t++)
+		workers.emplace_back([=]() {
+			uint32_t const first = (uint32_t)((uint64_t)nodes * t / threads);
+			uint32_t const last = (uint32_t)((uint64_t)nodes * (t + 1) / threads);
+			node item;
+			for (uint32_t i = first; i < last; i++)
+			{
+				ethash_calculate_dag_item(&item, i, _light);
+				memcpy(_data + (uint64_t)i * sizeof(node), &item, sizeof(node));
+			}
+		});
+	for (auto& w: workers)
+		w.join();
+}
+
+shared_ptr<CPUMiner::Dag const> CPUMiner::loadDag(int _epoch)
+{
+	Guard l(x_dag);
+	if (s_dag && s_dag->epoch == _epoch)
+		return s_dag;
+	// Drop the previous epoch before allocating the next one.
+	s_dag.reset();
+
+	EthashAux::LightType light = EthashAux::light(_epoch);
+	uint64_t const dagBytes = ethash_get_datasize(light->light->block_number);
+
+	shared_ptr<Dag> dag = make_shared<Dag>();
+	dag->epoch = _epoch;
+	dag->elements = (uint32_t)(dagBytes / (PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t)));
+
+	auto const start = chrono::steady_clock::now();
+	if (EthashAux::sharedMemory())
+	{
+		dag->shared = SharedSegment::open(EthashAux::sharedName("dag", _epoch), dagBytes, [&](uint8_t* _data, uint64_t _size) {
+			cpulog << "Generating DAG for epoch " << _epoch << " into shared memory";
+			generate(light->light, _data, _size);
+		});
+		if (dag->shared && dag->shared->owner() && _epoch >= 2)
+			SharedSegment::remove(EthashAux::sharedName("dag", _epoch - 2));
+	}
+	if (!dag->shared)
+	{
+		dag->replicas.reset(new HostReplicas(dagBytes, HostMemory::policy()));
+		cpulog << "Generating DAG for epoch " << _epoch << " (" << dag->replicas->describe() << ")";
+		generate(light->light, dag->replicas->primary(), dagBytes);
+		dag->replicas->replicate();
+	}
+	cpulog << "DAG of " << dagBytes / (1024 * 1024) << " MB ready in "
+		<< chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << " ms";
+
+	s_dag = dag;
+	return s_dag;
+}
+
+unsigned CPUMiner::tuneInterleave(ProgPow::program_t const& _prog, ProgPow::loop_t _jit, Dag const& _dag, uint32_t const* _words)
+{
+	ProgPow::hash32_t header;
+	for (int i = 0; i < 8; i++)
+		header.uint32s[i] = (uint32_t)index * 8 + i;
+
+	unsigned best = 1;
+	double bestRate = 0;
+	for (unsigned k: c_tuneInterleaves)
+	{
+		uint64_t found[c_maxResults];
+		auto const start = chrono::steady_clock::now();
+		ProgPow::search(_prog, header, 0, c_tuneHashes, 0, k, _dag.elements, _words, _words, found, c_maxResults, _jit);
+		double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		double const rate = c_tuneHashes / std::max(seconds, 1e-9);
+		cpuswitchlog << "Interleave " << k << ": " << (uint64_t)rate << " H/s";
+		if (rate > bestRate)
+		{
+			bestRate = rate;
+			best = k;
+		}
+	}
+	addHashCount(c_tuneHashes * (sizeof(c_tuneInterleaves) / sizeof(c_tuneInterleaves[0])));
+	cpulog << "Interleave " << best << " selected (" << (uint64_t)bestRate << " H/s)";
+	return best;
+}
+
+void CPUMiner::workLoop()
+{
+	// Under a NUMA policy spread the threads over the nodes, each reading the
+	// DAG copy of its node with Replicate.
+	if (HostMemory::policy().numa != NumaPolicy::None && HostMemory::numaNodes() > 1)
+		HostMemory::bindThreadToNode((int)(index % HostMemory::numaNodes()));
+
+	WorkPackage current;
+	current.header = h256{1u};
+	uint64_t old_period_seed = -1;
+	uint64_t startNonce = 0;
+	shared_ptr<NonceCursor> nonces;
+
+	ProgPow::program_t prog;
+	ProgPowJit::kernel_ptr jit;		// null until the build of the period is loaded
+	ProgPow::hash32_t header;
+	shared_ptr<Dag const> dag;
+	uint32_t const* words = nullptr;
+	unsigned setting = s_interleave;	// 0 to tune on each epoch
+	unsigned interleave = setting;
+
+	try {
+		while (!shouldStop())
+		{
+			if (waitWhilePaused())
+				continue;
+
+			MinerLaunch launch;
+			if (takeLaunch(launch))
+			{
+				setting = launch.localWorkSize ? std::min<unsigned>(launch.localWorkSize, ProgPow::MAX_INTERLEAVE) : s_interleave;
+				interleave = setting;
+			}
+
+			const WorkPackage w = work(nonces);
+			if (!w)
+			{
+				cpulog << "No work. Pause for 3 s.";
+				this_thread::sleep_for(chrono::seconds(3));
+				continue;
+			}
+
+			if (takeReinit())
+			{
+				cpulog << "Reinitialising";
+				dag.reset();
+				old_period_seed = -1;
+			}
+
+			uint64_t period_seed = (w.height + PROGPOW_BLOCK_OFFSET) / PROGPOW_PERIOD;
+			if (!dag || dag->epoch != w.epoch)
+			{
+				Busy busy(*this);
+				InitPipeline::Phase phase(index, "dag");
+				TraceSpan span("dag", "cpu");
+				span.arg("gpu", (int64_t)index).arg("epoch", w.epoch);
+				dag.reset();
+				dag = loadDag(w.epoch);
+				words = dag->words(HostMemory::currentNode());
+				interleave = setting;
+			}
+
+			if (current.header != w.header || current.epoch != w.epoch || old_period_seed != period_seed)
+			{
+				if (old_period_seed != period_seed)
+				{
+					InitPipeline::Phase phase(index, "compile");
+					TraceSpan span("compile", "cpu");
+					span.arg("gpu", (int64_t)index).arg("period", (int64_t)period_seed);
+					prog = ProgPow::decode(w.height + PROGPOW_BLOCK_OFFSET);
+					old_period_seed = period_seed;
+					jit = ProgPowJit::get(period_seed);
+					ProgPowJit::prepare(period_seed + 1);
+				}
+				memcpy(header.uint32s, w.header.data(), sizeof(header));
+
+				current = w;
+				traceSwitch("cpu");
+				cpuswitchlog << "Switch time"
+					<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - workSwitchStart).count()
+					<< "ms.";
+			}
+
+			if (!jit && ProgPowJit::enabled())
+			{
+				jit = ProgPowJit::get(old_period_seed);
+				// Tuned with the interpreter, the built program may hide latency differently.
+				if (jit && !setting)
+					interleave = 0;
+			}
+
+			if (!interleave)
+			{
+				Busy busy(*this);
+				interleave = tuneInterleave(prog, jit ? jit->loop : nullptr, *dag, words);
+			}
+
+			// Upper 64 bits of the boundary.
+			const uint64_t target = (uint64_t)(u64)((u256)current.boundary >> 192);
+
+			uint32_t const batch = (uint32_t)leaseNonces(*nonces, c_batchSize, 1, startNonce);
+			if (!batch)
+				continue;
+
+			uint64_t found[c_maxResults];
+			auto const batchStart = chrono::steady_clock::now();
+			uint32_t count = ProgPow::search(prog, header, startNonce, batch, target, interleave,
+				dag->elements, words, words, found, c_maxResults, jit ? jit->loop : nullptr);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				Result r = EthashAux::evalProgPow(current.epoch, current.height, current.header, found[i]);
+				farm.submitProof(Solution{found[i], r.mixHash, current, current.header != work().header});
+			}
+
+			addHashCount(batch);
+
+			// The governor runs the cores on a duty cycle, idle for the share
+			// of each batch it takes off.
+			float const duty = intensity();
+			if (duty < 1.0f)
+				this_thread::sleep_for((chrono::steady_clock::now() - batchStart) * ((1.0f - duty) / duty));
+		}
+	}
+	catch (std::exception const& _e)
+	{
+		cwarn << "CPU miner " << index << " failed: " << _e.what();
+		if (s_exit)
+			exit(1);
+	}
+}
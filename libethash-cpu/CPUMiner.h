@@ -0,0 +1,83 @@
+/*
+This file is part of cpp-ethereum.
+
+cpp-ethereum is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+cpp-ethereum is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CPUMiner.h
+ * ProgPoW search on host threads over a full DAG in host memory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <libdevcore/Guards.h>
+#include <libdevcore/HostMemory.h>
+#include <libdevcore/SharedSegment.h>
+#include <libethcore/EthashAux.h>
+#include <libethcore/Miner.h>
+#include <libprogpow/ProgPow.h>
+
+namespace dev
+{
+namespace eth
+{
+
+class CPUMiner: public Miner
+{
+public:
+	/// Nonces searched between two checks for new work.
+	static const unsigned c_batchSize = 256;
+
+	CPUMiner(FarmFace& _farm, unsigned _index);
+	~CPUMiner() override;
+
+	static unsigned instances() { return s_numInstances > 0 ? s_numInstances : 1; }
+	/// @a _instances threads, 0 for one per hardware thread. Capped to MAX_MINERS.
+	static void setNumInstances(unsigned _instances);
+	/// Hashes kept in flight by each thread, 0 to tune it on the first work of each epoch.
+	static void setInterleave(unsigned _interleave) { s_interleave = std::min<unsigned>(_interleave, ProgPow::MAX_INTERLEAVE); }
+	static void configure(unsigned _instances, unsigned _interleave, bool _exit);
+
+protected:
+	void kick_miner() override;
+
+private:
+	/// The full DAG of one epoch, shared by all CPU miners.
+	struct Dag
+	{
+		int epoch = -1;
+		uint32_t elements = 0;
+		std::unique_ptr<SharedSegment> shared;
+		std::unique_ptr<HostReplicas> replicas;
+
+		uint32_t const* words(int _node) const;
+	};
+
+	void workLoop() override;
+
+	static std::shared_ptr<Dag const> loadDag(int _epoch);
+	static void generate(ethash_light_t _light, uint8_t* _data, uint64_t _size);
+
+	/// Times a short search for every interleave and returns the fastest.
+	unsigned tuneInterleave(ProgPow::program_t const& _prog, ProgPow::loop_t _jit, Dag const& _dag, uint32_t const* _words);
+
+	static unsigned s_numInstances;
+	static unsigned s_interleave;
+
+	static Mutex x_dag;
+	static std::shared_ptr<Dag const> s_dag;
+};
+
+}
+}
@@ -20,6 +20,8 @@ along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "CUDAMiner.h"
 #include "CUDAMiner_kernel.h"
+#include <libethcore/InitPipeline.h>
+#include <libethcore/KernelCache.h>
 #include <nvrtc.h>
 
 using namespace std;
@@ -60,15 +62,17 @@ CUDAMiner::~CUDAMiner()
 bool CUDAMiner::init(int epoch)
 {
 	try {
-		if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
-			while (s_dagLoadIndex < index)
-				this_thread::sleep_for(chrono::milliseconds(100));
 		unsigned device = s_devices[index] > -1 ? s_devices[index] : index;
 
 		cnote << "Initialising miner " << index;
+		TraceSpan span("init", "cuda");
+		span.arg("gpu", (int64_t)index).arg("epoch", epoch);
 
 		EthashAux::LightType light;
-		light = EthashAux::light(epoch);
+		{
+			InitPipeline::Phase phase(index, "light");
+			light = EthashAux::light(epoch);
+		}
 		bytesConstRef lightData = light->data();
 
 		cuda_init(getNumDevices(), light->light, lightData.data(), lightData.size(),
@@ -80,7 +84,7 @@ bool CUDAMiner::init(int epoch)
 			if (s_dagLoadIndex >= s_numInstances && s_dagInHostMemory)
 			{
 				// all devices have loaded DAG, we can free now
-				delete[] s_dagInHostMemory;
+				delete s_dagInHostMemory;
 				s_dagInHostMemory = NULL;
 				cnote << "Freeing DAG from host";
 			}
@@ -106,8 +110,28 @@ void CUDAMiner::workLoop()
 	{
 		while(!shouldStop())
 		{
+			if (waitWhilePaused())
+				continue;
+
+			MinerLaunch launch;
+			if (takeLaunch(launch) && m_search_buf)
+				applyLaunch(launch);
+
+			if (takeReinit() && m_search_buf)
+			{
+				// Drain the streams, rebuild the kernel and restart the search state.
+				cudalog << "Reinitialising";
+				CUDA_SAFE_CALL(cudaDeviceSynchronize());
+				for (unsigned i = 0; i < m_numStreams; i++)
+					m_search_buf[i]->count = 0;
+				m_current_index = 0;
+				memset(&m_current_header, 0, sizeof(m_current_header));
+				old_period_seed = -1;
+			}
+
 	                // take local copy of work since it may end up being overwritten.
-			const WorkPackage w = work();
+			shared_ptr<NonceCursor> nonces;
+			const WorkPackage w = work(nonces);
 			uint64_t period_seed = (w.height + 2584000) / PROGPOW_PERIOD;
 
 			if (current.header != w.header || current.epoch != w.epoch || old_period_seed != period_seed)
@@ -118,6 +142,7 @@ void CUDAMiner::workLoop()
 					//std::this_thread::sleep_for(std::chrono::seconds(3));
 					continue;
 				}
+				Busy busy(*this);
 				if (current.epoch != w.epoch)
 					if(!init(w.epoch))
 						break;
@@ -131,13 +156,7 @@ void CUDAMiner::workLoop()
 				current = w;
 			}
 			uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
-			uint32_t startN = current.startNonce;
-			if (current.exSizeBits >= 0)
-			{
-				// this can support up to 2^c_log2Max_miners devices
-				startN = current.startNonce | ((uint32_t)index << (32 - LOG2_MAX_MINERS - current.exSizeBits));
-			}
-			search(current.header.data(), upper64OfBoundary, (current.exSizeBits >= 0), startN, w);
+			search(current.header.data(), upper64OfBoundary, nonces, w);
 		}
 
 		// Reset miner and stop working
@@ -157,6 +176,41 @@ void CUDAMiner::workLoop()
 	}
 }
 
+void CUDAMiner::createStreams(unsigned _streams)
+{
+	m_numStreams = _streams;
+	m_search_buf = new volatile search_results *[m_numStreams];
+	m_streams = new cudaStream_t[m_numStreams];
+	m_stream_nonce.assign(m_numStreams, 0);
+	for (unsigned i = 0; i != m_numStreams; ++i)
+	{
+		CUDA_SAFE_CALL(cudaMallocHost(&m_search_buf[i], sizeof(search_results)));
+		CUDA_SAFE_CALL(cudaStreamCreate(&m_streams[i]));
+	}
+}
+
+void CUDAMiner::applyLaunch(MinerLaunch const& _launch)
+{
+	m_blockSize = _launch.localWorkSize ? _launch.localWorkSize : s_blockSize;
+	m_gridSize = _launch.globalWorkSize ? _launch.globalWorkSize : s_gridSize;
+	unsigned const streams = _launch.streams ? _launch.streams : s_numStreams;
+	cudalog << "Grid size " << m_gridSize << ", block size " << m_blockSize << ", " << streams << " streams";
+	if (streams == m_numStreams)
+		return;
+
+	// Results still in flight on the old streams are dropped.
+	CUDA_SAFE_CALL(cudaDeviceSynchronize());
+	for (unsigned i = 0; i != m_numStreams; ++i)
+	{
+		CUDA_SAFE_CALL(cudaStreamDestroy(m_streams[i]));
+		CUDA_SAFE_CALL(cudaFreeHost((void*)m_search_buf[i]));
+	}
+	delete[] m_streams;
+	delete[] m_search_buf;
+	createStreams(streams);
+	m_current_index = 0;
+}
+
 void CUDAMiner::kick_miner()
 {
 	m_new_work.store(true, std::memory_order_relaxed);
@@ -175,6 +229,7 @@ void CUDAMiner::setDevices(const vector<unsigned>& _devices, unsigned _selectedD
 
 unsigned CUDAMiner::getNumDevices()
 {
+	TraceSpan span("enumerate", "cuda");
 	int deviceCount = -1;
 	cudaError_t err = cudaGetDeviceCount(&deviceCount);
 	if (err == cudaSuccess)
@@ -333,7 +388,7 @@ bool CUDAMiner::cuda_init(
 	uint64_t _lightBytes,
 	unsigned _deviceId,
 	bool _cpyToHost,
-	uint8_t* &hostDAG,
+	HostBuffer* &hostDAG,
 	unsigned dagCreateDevice)
 {
 	try
@@ -352,8 +407,17 @@ bool CUDAMiner::cuda_init(
 
 		cudalog << "Using device: " << device_props.name << " (Compute " + to_string(device_props.major) + "." + to_string(device_props.minor) + ")";
 
-		m_search_buf = new volatile search_results *[s_numStreams];
-		m_streams = new cudaStream_t[s_numStreams];
+		// Keep this thread, and the host DAG it may allocate, on the node the GPU hangs off.
+		if (HostMemory::policy().numa != NumaPolicy::None)
+		{
+			char busId[32];
+			if (cudaDeviceGetPCIBusId(busId, sizeof(busId), m_device_num) == cudaSuccess)
+			{
+				m_numaNode = HostMemory::nodeOfPciDevice(busId);
+				if (HostMemory::bindThreadToNode(m_numaNode))
+					cudalog << "Bound to NUMA node " << m_numaNode;
+			}
+		}
 
 		uint64_t dagBytes = ethash_get_datasize(_light->block_number);
 		uint32_t dagElms   = (unsigned)(dagBytes / (PROGPOW_LANES * PROGPOW_DAG_LOADS * 4));
@@ -361,57 +425,108 @@ bool CUDAMiner::cuda_init(
 
 		CUDA_SAFE_CALL(cudaSetDevice(m_device_num));
 		cudalog << "Set Device to current";
-		if(dagElms != m_dag_elms || !m_dag)
+		if (!m_search_buf)
 		{
-			//Check whether the current device has sufficient memory every time we recreate the dag
-			if (device_props.totalGlobalMem < dagBytes)
-			{
-				cudalog <<  "CUDA device " << string(device_props.name) << " has insufficient GPU memory." << device_props.totalGlobalMem << " bytes of memory found < " << dagBytes << " bytes of memory required";
-				return false;
-			}
-			//We need to reset the device and recreate the dag  
+			// The context, streams and buffers live as long as the miner, the
+			// device is reset once here and not on every epoch.
 			cudalog << "Resetting device";
 			CUDA_SAFE_CALL(cudaDeviceReset());
 			CUdevice device;
 			CUcontext context;
 			cuDeviceGet(&device, m_device_num);
 			cuCtxCreate(&context, s_scheduleFlag, device);
-			//We need to reset the light and the Dag for the following code to reallocate
-			//since cudaDeviceReset() frees all previous allocated memory
-			m_light[m_device_num] = nullptr;
-			m_dag = nullptr; 
+
+			MinerLaunch const l = launch();
+			m_blockSize = l.localWorkSize ? l.localWorkSize : s_blockSize;
+			m_gridSize = l.globalWorkSize ? l.globalWorkSize : s_gridSize;
+			cudalog << "Generating mining buffers";
+			createStreams(l.streams ? l.streams : s_numStreams);
 		}
-		// create buffer for cache
-		hash64_t * dag = m_dag;
-		hash64_t * light = m_light[m_device_num];
 
-		if(!light){ 
-			cudalog << "Allocating light with size: " << _lightBytes;
-			CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&light), _lightBytes));
+		//Check whether the current device has sufficient memory every time we recreate the dag
+		if (device_props.totalGlobalMem < dagBytes)
+		{
+			cudalog <<  "CUDA device " << string(device_props.name) << " has insufficient GPU memory." << device_props.totalGlobalMem << " bytes of memory found < " << dagBytes << " bytes of memory required";
+			return false;
+		}
+
+		// Buffers are reserved for the epochs of the headroom and reused while
+		// the epoch fits, the old one is freed first.
+		hash64_t * light = m_light[m_device_num];
+		if (_lightBytes > m_lightCapacity)
+		{
+			if (light)
+				CUDA_SAFE_CALL(cudaFree(light));
+			light = m_light[m_device_num] = nullptr;
+			m_lightCapacity = 0;
+			uint64_t const bytes = lightReservation(_light->block_number, device_props.totalGlobalMem);
+			cudalog << "Allocating light with size: " << bytes;
+			CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&light), bytes));
+			m_lightCapacity = bytes;
 		}
 		// copy lightData to device
 		CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(light), _lightData, _lightBytes, cudaMemcpyHostToDevice));
 		m_light[m_device_num] = light;
-		
-		if(dagElms != m_dag_elms || !dag) // create buffer for dag
-			CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&dag), dagBytes));
-		
-		if(dagElms != m_dag_elms || !dag)
+
+		hash64_t * dag = m_dag;
+		if (dagBytes > m_dagCapacity)
 		{
-			// create mining buffers
-			cudalog << "Generating mining buffers";
-			for (unsigned i = 0; i != s_numStreams; ++i)
-			{
-				CUDA_SAFE_CALL(cudaMallocHost(&m_search_buf[i], sizeof(search_results)));
-				CUDA_SAFE_CALL(cudaStreamCreate(&m_streams[i]));
-			}
-			
+			if (dag)
+				CUDA_SAFE_CALL(cudaFree(dag));
+			dag = m_dag = nullptr;
+			m_dagCapacity = 0;
+			m_dag_elms = -1;
+			size_t freeBytes = 0, totalBytes = 0;
+			CUDA_SAFE_CALL(cudaMemGetInfo(&freeBytes, &totalBytes));
+			// Leave room for the kernel and the driver.
+			uint64_t const limit = freeBytes > (256u << 20) ? freeBytes - (256u << 20) : 0;
+			uint64_t const bytes = dagReservation(_light->block_number, limit);
+			cudalog << "Allocating DAG with size: " << bytes << " for " << dagBytes;
+			CUDA_SAFE_CALL(cudaMalloc(reinterpret_cast<void**>(&dag), bytes));
+			m_dagCapacity = bytes;
+		}
+		else if (dagElms != m_dag_elms)
+			cudalog << "Reusing DAG buffer of " << m_dagCapacity << " for " << dagBytes;
+
+		if (dagElms != m_dag_elms)
+		{
+			// In single mode the other devices wait for the host copy, they must not hold a slot.
+			std::unique_ptr<InitPipeline::DagSlot> slot;
+			if (s_dagLoadMode != DAG_LOAD_MODE_SINGLE)
+				slot.reset(new InitPipeline::DagSlot(index));
+			TraceSpan span("dag", "cuda");
+			span.arg("gpu", (int64_t)m_device_num).arg("bytes", (int64_t)dagBytes);
 			memset(&m_current_header, 0, sizeof(hash32_t));
 			m_current_target = 0;
 			m_current_nonce = 0;
 			m_current_index = 0;
 
-			if (!hostDAG)
+			// With shared memory the first device of any process generates the DAG,
+			// every other device, in this process or another, uploads that copy.
+			std::unique_ptr<SharedSegment> sharedDag;
+			if (EthashAux::sharedMemory())
+			{
+				int epoch = (int)(_light->block_number / ETHASH_EPOCH_LENGTH);
+				sharedDag = SharedSegment::open(EthashAux::sharedName("dag", epoch), dagBytes, [&](uint8_t* _data, uint64_t _size) {
+					cudalog << "Generating DAG for GPU #" << m_device_num <<
+							   " with dagBytes: " << dagBytes <<" gridSize: " << s_gridSize;
+					ethash_generate_dag(dag, dagBytes, light, lightWords, s_gridSize, s_blockSize, m_streams[0], m_device_num);
+					cudalog << "Copying DAG from GPU #" << m_device_num << " to shared memory";
+					CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(_data), dag, _size, cudaMemcpyDeviceToHost));
+				});
+				if (sharedDag && sharedDag->owner() && epoch >= 2)
+					SharedSegment::remove(EthashAux::sharedName("dag", epoch - 2));
+			}
+
+			if (sharedDag)
+			{
+				if (!sharedDag->owner())
+				{
+					cudalog << "Copying DAG from shared memory to GPU #" << m_device_num;
+					CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(dag), sharedDag->data(), dagBytes, cudaMemcpyHostToDevice));
+				}
+			}
+			else if (!hostDAG)
 			{
 				if((m_device_num == dagCreateDevice) || !_cpyToHost){ //if !cpyToHost -> All devices shall generate their DAG
 					cudalog << "Generating DAG for GPU #" << m_device_num <<
@@ -421,9 +536,11 @@ bool CUDAMiner::cuda_init(
 
 					if (_cpyToHost)
 					{
-						uint8_t* memoryDAG = new uint8_t[dagBytes];
-						cudalog << "Copying DAG from GPU #" << m_device_num << " to host";
-						CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(memoryDAG), dag, dagBytes, cudaMemcpyDeviceToHost));
+						HostMemoryPolicy policy = HostMemory::policy();
+						HostBuffer* memoryDAG = new HostBuffer(dagBytes, policy,
+							policy.numa == NumaPolicy::Replicate ? m_numaNode : -1);
+						cudalog << "Copying DAG from GPU #" << m_device_num << " to host (" << memoryDAG->describe() << ")";
+						CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(memoryDAG->data()), dag, dagBytes, cudaMemcpyDeviceToHost));
 
 						hostDAG = memoryDAG;
 					}
@@ -437,7 +554,7 @@ bool CUDAMiner::cuda_init(
 			{
 cpyDag:
 				cudalog << "Copying DAG from host to GPU #" << m_device_num;
-				const void* hdag = (const void*)hostDAG;
+				const void* hdag = (const void*)hostDAG->data();
 				CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(dag), hdag, dagBytes, cudaMemcpyHostToDevice));
 			}
 		}
@@ -470,56 +587,78 @@ void CUDAMiner::compileKernel(
 	uint64_t dag_elms)
 {
 	const char* name = "progpow_search";
+	InitPipeline::Phase phase(index, "compile");
+	TraceSpan span("compile", "cuda");
+	span.arg("gpu", (int64_t)index).arg("period", (int64_t)(block_number / PROGPOW_PERIOD));
 
 	std::string text = ProgPow::getKern(block_number, ProgPow::KERNEL_CUDA);
 	text += std::string(CUDAMiner_kernel, sizeof(CUDAMiner_kernel));
 
-	ofstream write;
-	write.open("kernel.cu");
-	write << text;
-	write.close();
-
-	nvrtcProgram prog;
-	NVRTC_SAFE_CALL(
-		nvrtcCreateProgram(
-			&prog,         // prog
-			text.c_str(),  // buffer
-			"kernel.cu",    // name
-			0,             // numHeaders
-			NULL,          // headers
-			NULL));        // includeNames
-
-	NVRTC_SAFE_CALL(nvrtcAddNameExpression(prog, name));
 	cudaDeviceProp device_props;
 	CUDA_SAFE_CALL(cudaGetDeviceProperties(&device_props, m_device_num));
 	std::string op_arch = "--gpu-architecture=compute_" + to_string(device_props.major) + to_string(device_props.minor);
 	std::string op_dag = "-DPROGPOW_DAG_ELEMENTS=" + to_string(dag_elms);
 
-	const char *opts[] = {
-		op_arch.c_str(),
-		op_dag.c_str(),
-		"-lineinfo"
-	};
-	nvrtcResult compileResult = nvrtcCompileProgram(
-		prog,  // prog
-		3,     // numOptions
-		opts); // options
-	// Obtain compilation log from the program.
-	size_t logSize;
-	NVRTC_SAFE_CALL(nvrtcGetProgramLogSize(prog, &logSize));
-	char *log = new char[logSize];
-	NVRTC_SAFE_CALL(nvrtcGetProgramLog(prog, log));
-	cudalog << "Compile log: " << log;
-	delete[] log;
-	NVRTC_SAFE_CALL(compileResult);
-	// Obtain PTX from the program.
-	size_t ptxSize;
-	NVRTC_SAFE_CALL(nvrtcGetPTXSize(prog, &ptxSize));
-	char *ptx = new char[ptxSize];
-	NVRTC_SAFE_CALL(nvrtcGetPTX(prog, ptx));
-	write.open("kernel.ptx");
-	write << ptx;
-	write.close();
+	// Devices of the same architecture share the PTX, each loads its own module from it.
+	// The binary holds the mangled kernel name and the PTX, both NUL terminated.
+	bool compiled = false;
+	KernelCache::Binary binary = KernelCache::get(KernelCache::key(text, op_dag + " -lineinfo", op_arch), [&]() {
+		ofstream write;
+		write.open("kernel.cu");
+		write << text;
+		write.close();
+
+		nvrtcProgram prog;
+		NVRTC_SAFE_CALL(
+			nvrtcCreateProgram(
+				&prog,         // prog
+				text.c_str(),  // buffer
+				"kernel.cu",    // name
+				0,             // numHeaders
+				NULL,          // headers
+				NULL));        // includeNames
+
+		NVRTC_SAFE_CALL(nvrtcAddNameExpression(prog, name));
+		const char *opts[] = {
+			op_arch.c_str(),
+			op_dag.c_str(),
+			"-lineinfo"
+		};
+		nvrtcResult compileResult = nvrtcCompileProgram(
+			prog,  // prog
+			3,     // numOptions
+			opts); // options
+		// Obtain compilation log from the program.
+		size_t logSize;
+		NVRTC_SAFE_CALL(nvrtcGetProgramLogSize(prog, &logSize));
+		char *log = new char[logSize];
+		NVRTC_SAFE_CALL(nvrtcGetProgramLog(prog, log));
+		cudalog << "Compile log: " << log;
+		delete[] log;
+		NVRTC_SAFE_CALL(compileResult);
+		// Obtain PTX from the program.
+		size_t ptxSize;
+		NVRTC_SAFE_CALL(nvrtcGetPTXSize(prog, &ptxSize));
+		char *ptx = new char[ptxSize];
+		NVRTC_SAFE_CALL(nvrtcGetPTX(prog, ptx));
+		write.open("kernel.ptx");
+		write << ptx;
+		write.close();
+		// Find the mangled name
+		const char* mangledName;
+		NVRTC_SAFE_CALL(nvrtcGetLoweredName(prog, name, &mangledName));
+		cudalog << "Mangled name: " << mangledName;
+		bytes out(mangledName, mangledName + strlen(mangledName) + 1);
+		out.insert(out.end(), ptx, ptx + ptxSize);
+		delete[] ptx;
+		// Destroy the program.
+		NVRTC_SAFE_CALL(nvrtcDestroyProgram(&prog));
+		return out;
+	}, &compiled);
+	if (!compiled)
+		cudalog << "PTX built by another device";
+	const char* mangledName = (const char*)binary->data();
+	const char* ptx = mangledName + strlen(mangledName) + 1;
 	// Load the generated PTX and get a handle to the kernel.
 	char *jitInfo = new char[32 * 1024];
 	char *jitErr = new char[32 * 1024];
@@ -539,27 +678,27 @@ void CUDAMiner::compileKernel(
 		(void*)(1),
 		(void*)(1)
 	};
+	if (m_module)
+	{
+		// The context outlives the periods, their modules do not. The launches
+		// still running the old kernel end first.
+		CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		CU_SAFE_CALL(cuModuleUnload(m_module));
+		m_module = nullptr;
+	}
 	CU_SAFE_CALL(cuModuleLoadDataEx(&m_module, ptx, 6, jitOpt, jitOptVal));
 	cudalog << "JIT info: \n" << jitInfo;
 	cudalog << "JIT err: \n" << jitErr;
-	delete[] ptx;
 	delete[] jitInfo;
 	delete[] jitErr;
-	// Find the mangled name
-	const char* mangledName;
-	NVRTC_SAFE_CALL(nvrtcGetLoweredName(prog, name, &mangledName));
-	cudalog << "Mangled name: " << mangledName;
 	CU_SAFE_CALL(cuModuleGetFunction(&m_kernel, m_module, mangledName));
 	cudalog << "done compiling";
-	// Destroy the program.
-	NVRTC_SAFE_CALL(nvrtcDestroyProgram(&prog));
 }
 
 void CUDAMiner::search(
 	uint8_t const* header,
 	uint64_t target,
-	bool _ethStratum,
-	uint64_t _startN,
+	shared_ptr<NonceCursor> const& _nonces,
 	const dev::eth::WorkPackage& w)
 {
 	bool initialize = false;
@@ -573,56 +712,32 @@ void CUDAMiner::search(
 		m_current_target = target;
 		initialize = true;
 	}
-	if (_ethStratum)
+	if (initialize)
 	{
-		if (initialize)
-		{
-			m_starting_nonce = 0;
-			m_current_index = 0;
-			CUDA_SAFE_CALL(cudaDeviceSynchronize());
-			for (unsigned int i = 0; i < s_numStreams; i++)
-				m_search_buf[i]->count = 0;
-		}
-		if (m_starting_nonce != _startN)
-		{
-			// reset nonce counter
-			m_starting_nonce = _startN;
-			m_current_nonce = m_starting_nonce;
-		}
+		m_current_index = 0;
+		CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		for (unsigned int i = 0; i < m_numStreams; i++)
+			m_search_buf[i]->count = 0;
 	}
-	else
-	{
-		if (initialize)
-		{
-			m_current_nonce = get_start_nonce();
-			m_current_index = 0;
-			CUDA_SAFE_CALL(cudaDeviceSynchronize());
-			for (unsigned int i = 0; i < s_numStreams; i++)
-				m_search_buf[i]->count = 0;
-		}
-	}
-	const uint32_t batch_size = s_gridSize * s_blockSize;
-	const uint32_t max_nonce = 0xEFFFFFFFF;
 	while (true)
 	{
+		// The governor scales the grid down when the device runs hot.
+		uint32_t grid_size = max(1u, unsigned(m_gridSize * intensity()));
+		uint32_t batch_size = grid_size * m_blockSize;
 		m_current_index++;
-		m_current_nonce += batch_size;
-		
-		if ((m_current_nonce & 0x0000000FFFFFFFFF) > max_nonce) {
-			m_current_nonce = 0;
-		}
-		
-		m_current_nonce = m_current_nonce & 0xFFFFFF0FFFFFFFFF; // zero out bits 37-40
-		m_current_nonce = m_current_nonce | (((uint64_t)(m_device_num & 0x0F)) << 36); // Use device number to create unique nonce range
-		
-		auto stream_index = m_current_index % s_numStreams;
+		// Leased from the job, a stream left idle once it has none left.
+		batch_size = (uint32_t)leaseNonces(*_nonces, batch_size, m_blockSize, m_current_nonce);
+		grid_size = batch_size / m_blockSize;
+
+		auto stream_index = m_current_index % m_numStreams;
 		cudaStream_t stream = m_streams[stream_index];
 		volatile search_results* buffer = m_search_buf[stream_index];
 		uint32_t found_count = 0;
 		uint64_t nonces[SEARCH_RESULTS];
 		h256 mixes[SEARCH_RESULTS];
-		uint64_t nonce_base = m_current_nonce - s_numStreams * batch_size;
-		if (m_current_index >= s_numStreams)
+		// Launches differ in size under the governor, each stream keeps its own base.
+		uint64_t nonce_base = m_stream_nonce[stream_index];
+		if (m_current_index >= m_numStreams)
 		{
 			CUDA_SAFE_CALL(cudaStreamSynchronize(stream));
 			found_count = buffer->count;
@@ -637,15 +752,23 @@ void CUDAMiner::search(
 				}
 			}
 		}
+        m_stream_nonce[stream_index] = m_current_nonce;
         bool hack_false = false;
 		void *args[] = {&m_current_nonce, &m_current_header, &m_current_target, &m_dag, &buffer, &hack_false};
-		CU_SAFE_CALL(cuLaunchKernel(m_kernel,
-			s_gridSize, 1, 1,   // grid dim
-			s_blockSize, 1, 1,  // block dim
-			0,					// shared mem
-			stream,				// stream
-			args, 0));          // arguments
-		if (m_current_index >= s_numStreams)
+		if (grid_size)
+			CU_SAFE_CALL(cuLaunchKernel(m_kernel,
+				grid_size, 1, 1,    // grid dim
+				m_blockSize, 1, 1,  // block dim
+				0,					// shared mem
+				stream,				// stream
+				args, 0));          // arguments
+		if (initialize && grid_size)
+		{
+			// First launch on new work, ends the downtime of a switch.
+			Trace::instant("launch", "cuda", TraceArgs().add("gpu", (int64_t)index));
+			initialize = false;
+		}
+		if (m_current_index >= m_numStreams)
 		{
             if (found_count)
             {
@@ -654,7 +777,7 @@ void CUDAMiner::search(
                         farm.submitProof(Solution{nonces[i], mixes[i], w, m_new_work});
                     else
                     {
-                        Result r = EthashAux::eval(w.epoch, w.header, nonces[i]);
+                        Result r = EthashAux::evalProgPow(w.epoch, w.height, w.header, nonces[i]);
                         if (r.value < w.boundary)
                             farm.submitProof(Solution{nonces[i], r.mixHash, w, m_new_work});
                         else
@@ -665,9 +788,11 @@ void CUDAMiner::search(
                     }
             }
 
-            addHashCount(batch_size);
+            if (batch_size)
+                addHashCount(batch_size);
 			bool t = true;
 			if (m_new_work.compare_exchange_strong(t, false)) {
+				traceSwitch("cuda");
 				cudaswitchlog << "Switch time "
 					<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - workSwitchStart).count()
 					<< "ms.";
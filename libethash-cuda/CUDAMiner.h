@@ -80,14 +80,13 @@ public:
 		uint64_t _lightSize,
 		unsigned _deviceId,
 		bool _cpyToHost,
-		uint8_t * &hostDAG,
+		HostBuffer * &hostDAG,
 		unsigned dagCreateDevice);
 
 	void search(
 		uint8_t const* header,
 		uint64_t target,
-		bool _ethStratum,
-		uint64_t _startN,
+		std::shared_ptr<dev::eth::NonceCursor> const& _nonces,
 		const dev::eth::WorkPackage& w);
 
 	/* -- default values -- */
@@ -111,19 +110,28 @@ private:
 	hash32_t m_current_header;
 	uint64_t m_current_target;
 	uint64_t m_current_nonce;
-	uint64_t m_starting_nonce;
 	uint64_t m_current_index;
 
 	///Constants on GPU
 	hash64_t* m_dag = nullptr;
 	std::vector<hash64_t*> m_light;
 	uint32_t m_dag_elms = -1;
+	/// Allocated sizes of m_dag and the light, reused while an epoch fits.
+	uint64_t m_dagCapacity = 0;
+	uint64_t m_lightCapacity = 0;
 	uint32_t m_device_num;
+	int m_numaNode = -1;
 
-	CUmodule m_module;
+	CUmodule m_module = nullptr;	///< Of the current period.
 	CUfunction m_kernel;
-	volatile search_results** m_search_buf;
-	cudaStream_t  * m_streams;
+	volatile search_results** m_search_buf = nullptr;
+	cudaStream_t  * m_streams = nullptr;
+	/// Start nonce of the last launch on each stream.
+	std::vector<uint64_t> m_stream_nonce;
+	/// The launch geometry of this device, the command line one unless set through the API.
+	unsigned m_gridSize = 0;
+	unsigned m_blockSize = 0;
+	unsigned m_numStreams = 0;
 
 	/// The local work size for the search
 	static unsigned s_blockSize;
@@ -142,6 +150,8 @@ private:
 	static bool s_noeval;
 
 	void compileKernel(uint64_t block_number, uint64_t dag_words);
+	void createStreams(unsigned _streams);
+	void applyLaunch(MinerLaunch const& _launch);
 
 };
 
@@ -0,0 +1,97 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DagItemCache.h"
+#include <libprogpow/ProgPow.h>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+DagItemCache::DagItemCache(ethash_light_t _light, size_t _budgetBytes):
+	m_light(_light),
+	m_shardCapacity(_budgetBytes / c_shards / (sizeof(Entry) + c_entryOverhead))
+{
+}
+
+void DagItemCache::item(uint32_t _index, node& o_node)
+{
+	if (!m_shardCapacity)
+	{
+		++m_misses;
+		ethash_calculate_dag_item(&o_node, _index, m_light);
+		return;
+	}
+
+	// Consecutive items of a DAG line land on different shards.
+	Shard& shard = m_shards[_index % c_shards];
+	{
+		Guard l(shard.x);
+		auto it = shard.index.find(_index);
+		if (it != shard.index.end())
+		{
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			o_node = it->second->second;
+			++m_hits;
+			return;
+		}
+	}
+
+	// Computed outside of the lock; two threads missing on the same item both
+	// compute it and the second insert is dropped.
+	++m_misses;
+	ethash_calculate_dag_item(&o_node, _index, m_light);
+
+	Guard l(shard.x);
+	if (shard.index.count(_index))
+		return;
+	shard.lru.emplace_front(_index, o_node);
+	shard.index[_index] = shard.lru.begin();
+	if (shard.lru.size() > m_shardCapacity)
+	{
+		shard.index.erase(shard.lru.back().first);
+		shard.lru.pop_back();
+		++m_evictions;
+	}
+}
+
+uint32_t const* DagItemCache::cDag()
+{
+	call_once(m_cDagOnce, [&]() {
+		unsigned const nodes = PROGPOW_CACHE_BYTES / sizeof(node);
+		m_cDag.resize(PROGPOW_CACHE_BYTES / sizeof(uint32_t));
+		for (unsigned i = 0; i < nodes; i++)
+			ethash_calculate_dag_item((node*)m_cDag.data() + i, i, m_light);
+		m_cDagReady = true;
+	});
+	return m_cDag.data();
+}
+
+DagItemCacheStats DagItemCache::stats() const
+{
+	DagItemCacheStats s;
+	s.hits = m_hits;
+	s.misses = m_misses;
+	s.evictions = m_evictions;
+	for (auto const& shard: m_shards)
+	{
+		Guard l(shard.x);
+		s.items += shard.lru.size();
+	}
+	s.bytes = s.items * (sizeof(Entry) + c_entryOverhead) + (m_cDagReady ? PROGPOW_CACHE_BYTES : 0);
+	return s;
+}
@@ -0,0 +1,89 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <libdevcore/Guards.h>
+#include <libethash/internal.h>
+
+namespace dev
+{
+namespace eth
+{
+
+struct DagItemCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	uint64_t items = 0;
+	uint64_t bytes = 0;
+
+	double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+/// Memoizes ethash_calculate_dag_item() for light-mode ProgPoW verification.
+/// Every item costs 256 parent lookups, and a hash reads 512 of them, so shares
+/// of the same job hitting nearby lines pay for the cache quickly. Items are
+/// spread over lock-striped shards, each one an LRU holding its slice of the
+/// memory budget. A budget of 0 disables memoization.
+class DagItemCache
+{
+public:
+	DagItemCache(ethash_light_t _light, size_t _budgetBytes);
+
+	void item(uint32_t _index, node& o_node);
+
+	/// The first PROGPOW_CACHE_BYTES of the DAG, which the kernels keep in c_dag.
+	uint32_t const* cDag();
+
+	DagItemCacheStats stats() const;
+
+private:
+	static const unsigned c_shards = 64;
+	/// Approximate bookkeeping cost of one entry on top of the node itself.
+	static const size_t c_entryOverhead = 64;
+
+	using Entry = std::pair<uint32_t, node>;
+
+	struct Shard
+	{
+		mutable Mutex x;
+		std::list<Entry> lru;
+		std::unordered_map<uint32_t, std::list<Entry>::iterator> index;
+	};
+
+	ethash_light_t m_light;
+	size_t m_shardCapacity;
+	Shard m_shards[c_shards];
+
+	std::once_flag m_cDagOnce;
+	std::vector<uint32_t> m_cDag;
+	std::atomic<bool> m_cDagReady = {false};
+
+	std::atomic<uint64_t> m_hits = {0};
+	std::atomic<uint64_t> m_misses = {0};
+	std::atomic<uint64_t> m_evictions = {0};
+};
+
+}
+}
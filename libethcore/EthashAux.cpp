@@ -17,12 +17,17 @@
 
 #include "EthashAux.h"
 #include <libethash/internal.h>
+#include <libdevcore/Trace.h>
+#include <libprogpow/ProgPowJit.h>
 
 using namespace std;
 using namespace chrono;
 using namespace dev;
 using namespace eth;
 
+std::atomic<size_t> EthashAux::s_itemCacheBudget = {64 * 1024 * 1024};
+std::atomic<bool> EthashAux::s_sharedMemory = {false};
+
 EthashAux& EthashAux::get()
 {
 	static EthashAux instance;
@@ -54,6 +59,11 @@ int EthashAux::toEpoch(h256 const& _seedHash)
     return ethash.m_cached_epoch;
 }
 
+string EthashAux::sharedName(string const& _kind, int _epoch)
+{
+	return "ethminer-" + _kind + "-" + to_string(_epoch);
+}
+
 EthashAux::LightType EthashAux::light(int epoch)
 {
     // TODO: Use epoch number instead of seed hash?
@@ -71,14 +81,47 @@ EthashAux::LightType EthashAux::light(int epoch)
 
 EthashAux::LightAllocation::LightAllocation(int epoch)
 {
+    TraceSpan span("light", "ethash");
+    span.arg("epoch", epoch);
     int blockNumber = epoch * ETHASH_EPOCH_LENGTH;
-    light = ethash_light_new(blockNumber);
     size = ethash_get_cachesize(blockNumber);
+    light = nullptr;
+
+    if (s_sharedMemory)
+    {
+        shared = SharedSegment::open(sharedName("light", epoch), size, [&](uint8_t* _data, uint64_t _size) {
+            ethash_light_t l = ethash_light_new(blockNumber);
+            if (!l)
+                throw std::runtime_error("light cache allocation failed");
+            memcpy(_data, l->cache, _size);
+            ethash_light_delete(l);
+        });
+        if (shared)
+        {
+            // The cache is only ever read, pointing the handle into the mapping is enough.
+            light = (ethash_light_t)calloc(1, sizeof(ethash_light));
+            light->cache = (void*)shared->data();
+            light->cache_size = size;
+            light->block_number = blockNumber;
+            cnote << (shared->owner() ? "Published" : "Mapped") << "shared light cache of epoch" << epoch;
+            if (shared->owner() && epoch >= 2)
+                SharedSegment::remove(sharedName("light", epoch - 2));
+        }
+    }
+
+    if (!light)
+        light = ethash_light_new(blockNumber);
+    items.reset(new DagItemCache(light, s_itemCacheBudget));
 }
 
 EthashAux::LightAllocation::~LightAllocation()
 {
-	ethash_light_delete(light);
+	// The item cache refers to the light handle.
+	items.reset();
+	if (shared)
+		free(light);
+	else
+		ethash_light_delete(light);
 }
 
 bytesConstRef EthashAux::LightAllocation::data() const
@@ -94,6 +137,45 @@ Result EthashAux::LightAllocation::compute(h256 const& _headerHash, uint64_t _no
 	return Result{h256((uint8_t*)&r.result, h256::ConstructFromPointer), h256((uint8_t*)&r.mix_hash, h256::ConstructFromPointer)};
 }
 
+Result EthashAux::LightAllocation::computeProgPow(uint64_t _height, h256 const& _headerHash, uint64_t _nonce) const
+{
+	return computeProgPow(ProgPow::decode(_height + PROGPOW_BLOCK_OFFSET), _headerHash, _nonce);
+}
+
+Result EthashAux::LightAllocation::computeProgPow(ProgPow::program_t const& _prog, h256 const& _headerHash, uint64_t _nonce) const
+{
+	if (!light)
+		BOOST_THROW_EXCEPTION(DAGCreationFailure());
+
+	uint64_t dagBytes = ethash_get_datasize(light->block_number);
+	uint32_t dagElms = (uint32_t)(dagBytes / (PROGPOW_LANES * PROGPOW_DAG_LOADS * 4));
+
+	ProgPow::hash32_t header;
+	memcpy(header.uint32s, _headerHash.data(), sizeof(header));
+
+	// A ProgPoW DAG line spans several consecutive ethash items
+	unsigned const lineNodes = PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t) / sizeof(node);
+	DagItemCache& cache = *items;
+	auto load = [&cache, lineNodes](uint32_t line, uint32_t* words) {
+		node item;
+		for (unsigned n = 0; n < lineNodes; n++)
+		{
+			cache.item(line * lineNodes + n, item);
+			memcpy(words + n * NODE_WORDS, item.words, sizeof(item));
+		}
+	};
+
+	uint64_t result;
+	ProgPowJit::kernel_ptr jit = ProgPowJit::get(_prog.prog_seed);
+	ProgPow::hash32_t digest = ProgPow::hash(_prog, header, _nonce, dagElms, cache.cDag(), load, result, jit ? jit->loop : nullptr);
+
+	Result r;
+	for (unsigned i = 0; i < 8; i++)
+		r.value[i] = (byte)(result >> (56 - 8 * i));
+	memcpy(r.mixHash.data(), digest.uint32s, sizeof(digest));
+	return r;
+}
+
 Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noexcept
 {
 	try
@@ -105,3 +187,32 @@ Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noex
 		return Result{~h256(), h256()};
 	}
 }
+
+Result EthashAux::evalProgPow(int epoch, uint64_t height, h256 const& _headerHash, uint64_t _nonce) noexcept
+{
+	try
+	{
+		return get().light(epoch)->computeProgPow(height, _headerHash, _nonce);
+	}
+	catch(...)
+	{
+		return Result{~h256(), h256()};
+	}
+}
+
+DagItemCacheStats EthashAux::itemCacheStats()
+{
+	EthashAux& ethash = EthashAux::get();
+	DagItemCacheStats total;
+	Guard l(ethash.x_lights);
+	for (auto const& l: ethash.m_lights)
+	{
+		DagItemCacheStats s = l.second->items->stats();
+		total.hits += s.hits;
+		total.misses += s.misses;
+		total.evictions += s.evictions;
+		total.items += s.items;
+		total.bytes += s.bytes;
+	}
+	return total;
+}
@@ -20,8 +20,11 @@
 #include <condition_variable>
 #include <libethash/ethash.h>
 #include <libdevcore/Log.h>
+#include <libdevcore/SharedSegment.h>
 #include <libdevcore/Worker.h>
+#include <libprogpow/ProgPow.h>
 #include "BlockHeader.h"
+#include "DagItemCache.h"
 
 namespace dev
 {
@@ -43,8 +46,13 @@ public:
 		~LightAllocation();
 		bytesConstRef data() const;
 		Result compute(h256 const& _headerHash, uint64_t _nonce) const;
+		Result computeProgPow(uint64_t _height, h256 const& _headerHash, uint64_t _nonce) const;
+		/// As above with the program of the period already decoded.
+		Result computeProgPow(ProgPow::program_t const& _prog, h256 const& _headerHash, uint64_t _nonce) const;
 		ethash_light_t light;
 		uint64_t size;
+		std::unique_ptr<DagItemCache> items;
+		std::unique_ptr<SharedSegment> shared;
 	};
 
 	using LightType = std::shared_ptr<LightAllocation>;
@@ -55,8 +63,22 @@ public:
 
 	static Result eval(int epoch, h256 const& _headerHash, uint64_t  _nonce) noexcept;
 
+	/// Light-mode ProgPoW evaluation of a share, as computed by the search kernels.
+	/// The 64-bit kernel result is returned in the high bytes of Result::value.
+	static Result evalProgPow(int epoch, uint64_t height, h256 const& _headerHash, uint64_t _nonce) noexcept;
+
+	/// Memory budget of the DAG item cache of each light allocation created from now on.
+	static void setItemCacheBudget(size_t _bytes) { s_itemCacheBudget = _bytes; }
+	static DagItemCacheStats itemCacheStats();
+
+	/// Share light caches and host DAGs with other processes through POSIX shared memory.
+	static void setSharedMemory(bool _enabled) { s_sharedMemory = _enabled; }
+	static bool sharedMemory() { return s_sharedMemory; }
+	/// Name of the shared segment holding @a _kind ("light" or "dag") of @a _epoch.
+	static std::string sharedName(std::string const& _kind, int _epoch);
+
 private:
-    EthashAux() = default;
+    EthashAux() { profileLock(x_lights, "EthashAux::x_lights"); }
     static EthashAux& get();
 
     Mutex x_lights;
@@ -64,6 +86,9 @@ private:
 
     int m_cached_epoch = 0;
     h256 m_cached_seed;  // Seed for epoch 0 is the null hash.
+
+    static std::atomic<size_t> s_itemCacheBudget;
+    static std::atomic<bool> s_sharedMemory;
 };
 
 struct WorkPackage
@@ -82,7 +107,7 @@ struct WorkPackage
     h256 job;
     int epoch = -1;
 
-    uint32_t startNonce = 0;
+    uint64_t startNonce = 0;     ///< With a pool extranonce, that in the top exSizeBits.
     uint64_t height = 0;
     int exSizeBits = -1;
     int job_len = 8;
@@ -26,15 +26,15 @@
 #include <thread>
 #include <list>
 #include <atomic>
+#include <deque>
 #include <libdevcore/Common.h>
+#include <libdevcore/EventLoop.h>
+#include <libdevcore/StatsSegment.h>
 #include <libdevcore/Worker.h>
 #include <libethcore/Miner.h>
 #include <libethcore/BlockHeader.h>
-#include <libhwmon/wrapnvml.h>
-#include <libhwmon/wrapadl.h>
-#if defined(__linux)
-#include <libhwmon/wrapamdsysfs.h>
-#endif
+#include <libethcore/Governor.h>
+#include <libethcore/Watchdog.h>
 
 namespace dev
 {
@@ -42,12 +42,25 @@ namespace dev
 namespace eth
 {
 
+/// Something monitoring wants to hear about as it happens.
+struct FarmEvent
+{
+	enum Kind { Job, Found, Accepted, Rejected, Failed };
+
+	FarmEvent(Kind _kind, bool _stale = false, WorkPackage const& _work = WorkPackage()):
+		kind(_kind), stale(_stale), work(_work) {}
+
+	Kind kind;
+	bool stale;
+	WorkPackage work;	///< The new job, for Job only.
+};
+
 /**
  * @brief A collective of Miners.
  * Miners ask for work, then submit proofs
  * @threadsafe
  */
-class Farm: public FarmFace
+class Farm: public FarmFace, public MinerControl
 {
 public:
 	struct SealerDescriptor
@@ -56,7 +69,7 @@ public:
 		std::function<Miner*(FarmFace&, unsigned)> create;
 	};
 
-	Farm(): m_hashrateTimer(m_io_service)
+	Farm(): m_strand(EventLoop::service()), m_hashrateTimer(EventLoop::service())
 	{
 		// Given that all nonces are equally likely to solve the problem
 		// we could reasonably always start the nonce search ranges
@@ -64,29 +77,71 @@ public:
 		// per run randomized start place, without creating much overhead.
 		random_device engine;
 		m_nonce_scrambler = uniform_int_distribution<uint64_t>()(engine);
-
-		// Init HWMON
-		// adlh = wrap_adl_create();
-#if defined(__linux)
-		sysfsh = wrap_amdsysfs_create();
-#endif
-		nvmlh = wrap_nvml_create();
+		profileLock(x_minerWork, "Farm::x_minerWork");
 	}
 
 	~Farm()
 	{
-		// Deinit HWMON
-		if (adlh)
-			wrap_adl_destroy(adlh);
-#if defined(__linux)
-		if (sysfsh)
-			wrap_amdsysfs_destroy(sysfsh);
-#endif
-		if (nvmlh)
-			wrap_nvml_destroy(nvmlh);
-
 		// Stop mining
 		stop();
+		m_handlers.wait();
+		{
+			Guard l(x_restarter);
+			if (m_restarter.joinable())
+				m_restarter.join();
+		}
+
+		// Miners given up on get one more wait, bounded for all of them. One
+		// still in its driver call is destroyed, and its thread joined, on a
+		// detached thread once the call returns, or never.
+		auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(c_restartStopTimeout);
+		for (auto& m: m_abandoned)
+		{
+			auto const left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			if (!m->stopWorking(std::max(left, std::chrono::milliseconds(1))))
+				std::thread([](std::shared_ptr<Miner> const&) {}, std::move(m)).detach();
+		}
+		m_abandoned.clear();
+	}
+
+	/// Nonce bits searched without a pool extranonce.
+	static const unsigned c_nonceBits = 40;
+
+	/// The nonces of @a _wp: below its extranonce with one, otherwise those below
+	/// c_nonceBits from a random start taken from @a _scrambler.
+	static std::shared_ptr<NonceCursor> nonceSpace(WorkPackage const& _wp, uint64_t _scrambler)
+	{
+		if (_wp.exSizeBits >= 0)
+			return std::make_shared<NonceCursor>(_wp.startNonce, 64 - _wp.exSizeBits);
+		return std::make_shared<NonceCursor>(_scrambler >> (64 - c_nonceBits + 1), c_nonceBits - 1);
+	}
+
+	/// Seconds between two steps of the intensity governor.
+	static const unsigned c_governorPeriod = 5;
+
+	/**
+	 * @brief Enables the intensity governor.
+	 * @param _targets The temperature and power to keep the devices under.
+	 * @param _provider The sensors to read, the hardware ones when null.
+	 */
+	void setGovernor(GovernorTargets const& _targets, HwMonitorProvider const* _provider = nullptr)
+	{
+		Guard l(x_minerWork);
+		m_governor.reset(_targets.enabled() ? new Governor(_provider ? *_provider : m_sensors, _targets) : nullptr);
+	}
+
+	/// The governor state of each device, empty when it is disabled.
+	std::vector<GovernorDevice> governorDevices() const
+	{
+		Guard l(x_minerWork);
+		return m_governor ? m_governor->devices() : std::vector<GovernorDevice>();
+	}
+
+	bool governed() const { Guard l(x_minerWork); return !!m_governor; }
+	GovernorTargets governorTargets() const
+	{
+		Guard l(x_minerWork);
+		return m_governor ? m_governor->targets() : GovernorTargets();
 	}
 
 	/**
@@ -98,13 +153,26 @@ public:
 		//Collect hashrate before miner reset their work
 		collectHashRate();
 
-		// Set work to each miner
-		Guard l(x_minerWork);
-		if (_wp.header == m_work.header && _wp.startNonce == m_work.startNonce)
-			return;
-		m_work = _wp;
-		for (auto const& m: m_miners)
-			m->setWork(m_work);
+		// One job at a time, the miners end up on the last one set.
+		Guard f(x_fanOut);
+		std::shared_ptr<Miners const> miners;
+		std::shared_ptr<NonceCursor> nonces;
+		{
+			Guard l(x_minerWork);
+			if (_wp.header == m_work.header && _wp.startNonce == m_work.startNonce)
+				return;
+			if (_wp.epoch != m_work.epoch && !m_miners->empty())
+				InitPipeline::begin(_wp.epoch, m_miners->size());
+			m_work = _wp;
+			m_nonces = nonceSpace(_wp, m_nonce_scrambler);
+			miners = m_miners;
+			nonces = m_nonces;
+		}
+		// Outside the lock, the API and the stats do not wait for the miners.
+		for (auto const& m: *miners)
+			m->setWork(_wp, nonces);
+		Trace::instant("job", "farm", TraceArgs().add("epoch", _wp.epoch).add("height", (int64_t)_wp.height));
+		raise({FarmEvent::Job, false, _wp});
 	}
 
 	void setSealers(std::map<std::string, SealerDescriptor> const& _sealers) { m_sealers = _sealers; }
@@ -114,53 +182,43 @@ public:
 	 */
 	bool start(std::string const& _sealer, bool mixed)
 	{
+		TraceSpan span("start", "farm");
+		span.arg("sealer", _sealer);
 		Guard l(x_minerWork);
-		if (!m_miners.empty() && m_lastSealer == _sealer)
+		if (!m_miners->empty() && m_lastSealer == _sealer)
 			return true;
 		if (!m_sealers.count(_sealer))
 			return false;
 
 		if (!mixed)
 		{
-			m_miners.clear();
+			m_miners = std::make_shared<Miners>();
+			m_minerSealers.clear();
 		}
+		std::shared_ptr<Miners> miners = std::make_shared<Miners>(*m_miners);
 		auto ins = m_sealers[_sealer].instances();
-		unsigned start = 0;
-		if (!mixed)
-		{
-			m_miners.reserve(ins);
-		}
-		else
-		{
-
-			start = m_miners.size();
-			ins += start;
-			m_miners.reserve(ins);
-		}
+		unsigned start = miners->size();
+		ins += start;
+		miners->reserve(ins);
 		for (unsigned i = start; i < ins; ++i)
 		{
 			// TODO: Improve miners creation, use unique_ptr.
-			m_miners.push_back(std::shared_ptr<Miner>(m_sealers[_sealer].create(*this, i)));
+			miners->push_back(std::shared_ptr<Miner>(m_sealers[_sealer].create(*this, i)));
+			m_minerSealers.push_back(_sealer);
+			if (m_sealerLaunch.count(_sealer))
+				miners->back()->setLaunch(m_sealerLaunch[_sealer]);
 
 			// Start miners' threads. They should pause waiting for new work
 			// package.
-			m_miners.back()->startWorking();
+			miners->back()->startWorking();
 		}
+		m_miners = miners;
 		m_isMining = true;
 		m_lastSealer = _sealer;
 		b_lastMixed = mixed;
 
 		// Start hashrate collector
-		m_hashrateTimer.cancel();
-		m_hashrateTimer.expires_from_now(boost::posix_time::milliseconds(1000));
-		m_hashrateTimer.async_wait(boost::bind(&Farm::processHashRate, this, boost::asio::placeholders::error));
-
-		if (m_serviceThread.joinable()) {
-			m_io_service.reset();
-			m_serviceThread.join();
-		}
-
-		m_serviceThread = std::thread{ boost::bind(&boost::asio::io_service::run, &m_io_service) };
+		m_strand.post(m_handlers.wrap([this]() { scheduleHashRate(); }));
 
 		return true;
 	}
@@ -170,64 +228,323 @@ public:
 	 */
 	void stop()
 	{
+		std::shared_ptr<Miners const> miners;
 		{
 			Guard l(x_minerWork);
-			m_miners.clear();
+			miners.swap(m_miners);
+			m_miners = std::make_shared<Miners>();
+			m_minerSealers.clear();
 			m_isMining = false;
 		}
+		// Joins the threads outside the lock, unless a reader still holds them.
+		miners.reset();
 
-		m_hashrateTimer.cancel();
-		m_io_service.stop();
+		m_strand.post(m_handlers.wrap([this]() { m_hashrateTimer.cancel(); }));
 
+		Guard l(x_progress);
 		m_lastProgresses.clear();
+		m_window = WorkingProgress();
 	}
 
     void collectHashRate()
     {
-        auto now = std::chrono::steady_clock::now();
-
-        std::lock_guard<std::mutex> lock(x_minerWork);
+        std::shared_ptr<Miners const> const miners = this->miners();
 
+        // Collect and reset
         WorkingProgress p;
-        p.ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastStart).count();
-        m_lastStart = now;
-
-        // Collect
-        for (auto const& i : m_miners)
+        p.minersHashes.reserve(miners->size());
+        for (auto const& i : *miners)
         {
-            uint64_t minerHashCount = i->hashCount();
+            uint64_t minerHashCount = i->takeHashCount();
             p.hashes += minerHashCount;
             p.minersHashes.push_back(minerHashCount);
         }
 
-        // Reset
-        for (auto const& i : m_miners)
-            i->resetHashCount();
+        auto now = std::chrono::steady_clock::now();
+
+        Guard lock(x_progress);
+        p.ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastStart).count();
+        m_lastStart = now;
 
+        m_lastCollected = p;
         if (p.hashes > 0)
+        {
             m_lastProgresses.push_back(p);
+            accumulate(p, true);
+        }
 
-        // We smooth the hashrate over the last x seconds
-        uint64_t allMs = 0;
-        for (auto const& cp : m_lastProgresses)
-            allMs += cp.ms;
-
-        if (allMs > m_hashrateSmoothInterval)
-            m_lastProgresses.erase(m_lastProgresses.begin());
+        // We smooth the hashrate over the last x seconds, the window keeps the
+        // sums so the progress is not summed again on each read.
+        if (m_window.ms > m_hashrateSmoothInterval)
+        {
+            accumulate(m_lastProgresses.front(), false);
+            m_lastProgresses.pop_front();
+        }
     }
 
+	/// Arms the hashrate timer, on the strand.
+	void scheduleHashRate()
+	{
+		m_hashrateTimer.cancel();
+		m_hashrateTimer.expires_from_now(boost::posix_time::milliseconds(1000));
+		m_hashrateTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+			boost::bind(&Farm::processHashRate, this, boost::asio::placeholders::error))));
+	}
+
 	void processHashRate(const boost::system::error_code& ec) {
 
-		if (!ec) {
+		if (!ec && m_isMining) {
 			collectHashRate();
-
-			// Restart timer 	
-			m_hashrateTimer.cancel();
-			m_hashrateTimer.expires_from_now(boost::posix_time::milliseconds(1000));
-			m_hashrateTimer.async_wait(boost::bind(&Farm::processHashRate, this, boost::asio::placeholders::error));
+			if (++m_governorTicks % c_governorPeriod == 0)
+				governIntensity();
+			if (Watchdog* w = watchdog())
+				w->tick(std::chrono::steady_clock::now());
+			if (m_stats)
+				updateStats();
+
+			// Restart timer
+			scheduleHashRate();
 		}
 	}
 	
+	Watchdog* watchdog() const { Guard l(x_minerWork); return m_watchdog.get(); }
+
+	/// Steps the governor and hands each miner its intensity.
+	void governIntensity()
+	{
+		std::shared_ptr<Miners const> const miners = this->miners();
+		std::vector<HwMonitorInfo> devices;
+		for (auto const& i : *miners)
+			devices.push_back(i->hwmonInfo());
+		std::vector<float> intensities;
+		{
+			Guard l(x_minerWork);
+			if (!m_governor)
+				return;
+			intensities = m_governor->tick(devices);
+		}
+		for (size_t i = 0; i < miners->size(); i++)
+			(*miners)[i]->setIntensity(intensities[i]);
+	}
+
+	/**
+	 * @brief Publishes the counters in shared memory segment @a _name at every hashrate collection.
+	 * @return false if the segment could not be created.
+	 */
+	bool publishStats(std::string const& _name)
+	{
+		std::unique_ptr<StatsSegment> seg = StatsSegment::create(_name);
+		if (!seg)
+			return false;
+		Guard l(x_minerWork);
+		m_statsBlock.reset(new StatsBlock());
+		m_statsBlock->windowMs = 1000;
+		m_stats = std::move(seg);
+		return true;
+	}
+
+	/// Copies the counters to the stats segment, readers never wait on the farm.
+	void updateStats()
+	{
+		WorkingProgress const p = miningProgress(true, true);
+		SolutionStats s = m_solutionStats;
+
+		Guard l(x_minerWork);
+		StatsBlock& b = *m_statsBlock;
+		auto const now = std::chrono::system_clock::now().time_since_epoch();
+		b.updatedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+		b.uptimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_farm_launched).count();
+		b.hashrate = p.rate();
+		b.accepted = s.getAccepts();
+		b.acceptedStale = s.getAcceptedStales();
+		b.rejected = s.getRejects();
+		b.rejectedStale = s.getRejectedStales();
+		b.failed = s.getFailures();
+		b.epoch = m_work.epoch;
+		b.height = m_work.height;
+		b.period = (m_work.height + PROGPOW_BLOCK_OFFSET) / PROGPOW_PERIOD;
+		memcpy(b.header, m_work.header.data(), sizeof(b.header));
+
+		b.windowHead = (b.windowHead + 1) % c_statsWindow;
+		b.devices = std::min<uint32_t>(p.minersHashes.size(), c_statsMaxDevices);
+		Guard lp(x_progress);
+		for (unsigned i = 0; i < b.devices; i++)
+		{
+			StatsDevice& d = b.device[i];
+			d.hashrate = p.minerRate(p.minersHashes[i]);
+			d.window[b.windowHead] = i < m_lastCollected.minersHashes.size() && m_lastCollected.ms ?
+				m_lastCollected.minersHashes[i] * 1000 / m_lastCollected.ms : 0;
+			if (i < p.minerMonitors.size())
+			{
+				d.tempC = p.minerMonitors[i].tempC;
+				d.fanP = p.minerMonitors[i].fanP;
+				d.powerMW = (uint32_t)(p.minerMonitors[i].powerW * 1000);
+			}
+			d.intensity = i < m_miners->size() ? (uint32_t)((*m_miners)[i]->intensity() * 1000) : 0;
+		}
+		m_stats->publish(b);
+	}
+
+	/// Pauses or resumes miner @a _index alone, false if there is no such miner.
+	bool pauseMiner(unsigned _index, bool _pause)
+	{
+		std::shared_ptr<Miner> const m = miner(_index);
+		if (!m)
+			return false;
+		m->pause(_pause);
+		return true;
+	}
+
+	/// Changes the launch geometry of miner @a _index, applied before its next launch.
+	bool setMinerLaunch(unsigned _index, MinerLaunch const& _launch)
+	{
+		std::shared_ptr<Miner> const m = miner(_index);
+		if (!m)
+			return false;
+		m->setLaunch(_launch);
+		return true;
+	}
+
+	/// Changes the launch geometry of the miners of @a _sealer, running ones before
+	/// their next launch and later ones from their start.
+	void setSealerLaunch(std::string const& _sealer, MinerLaunch const& _launch)
+	{
+		Guard l(x_minerWork);
+		m_sealerLaunch[_sealer] = _launch;
+		for (unsigned i = 0; i < m_miners->size(); i++)
+			if (m_minerSealers[i] == _sealer)
+				(*m_miners)[i]->setLaunch(_launch);
+	}
+
+	std::vector<bool> pausedMiners() const
+	{
+		std::shared_ptr<Miners const> const miners = this->miners();
+		std::vector<bool> paused;
+		for (auto const& m: *miners)
+			paused.push_back(m->paused());
+		return paused;
+	}
+
+	/// Milliseconds a restart waits for the old miner to stop before giving up on it.
+	static const unsigned c_restartStopTimeout = 5000;
+
+	/// Enables the watchdog, on the miners of this farm unless @a _control is given.
+	void setWatchdog(WatchdogSettings const& _settings, MinerControl* _control = nullptr)
+	{
+		Guard l(x_minerWork);
+		m_watchdog.reset(_settings.enabled() ? new Watchdog(_control ? *_control : *this, _settings) : nullptr);
+	}
+
+	/// What the watchdog did for each miner, empty when it is disabled.
+	std::vector<WatchdogDevice> watchdogDevices() const
+	{
+		Guard l(x_minerWork);
+		return m_watchdog ? m_watchdog->devices() : std::vector<WatchdogDevice>();
+	}
+
+	std::vector<MinerHealth> health() const override
+	{
+		std::shared_ptr<Miners const> miners;
+		bool working;
+		{
+			Guard l(x_minerWork);
+			miners = m_miners;
+			working = !!m_work;
+		}
+		std::vector<MinerHealth> health;
+		for (auto const& m: *miners)
+		{
+			MinerHealth h;
+			h.lastProgress = m->lastProgress();
+			h.batchMs = m->batchMs();
+			h.idle = !working || m->paused() || m->busy();
+			health.push_back(h);
+		}
+		return health;
+	}
+
+	void kick(unsigned _index) override
+	{
+		if (std::shared_ptr<Miner> const m = miner(_index))
+			m->kick();
+	}
+
+	void reinit(unsigned _index) override
+	{
+		if (std::shared_ptr<Miner> const m = miner(_index))
+			m->reinit();
+	}
+
+	/// Starts replacing miner @a _index on a thread of its own, the strand goes on
+	/// collecting hashrates meanwhile. One restart at a time, false while another runs.
+	bool restart(unsigned _index) override
+	{
+		if (!miner(_index))
+			return false;
+		Guard l(x_restarter);
+		if (m_restarting)
+			return false;
+		if (m_restarter.joinable())
+			m_restarter.join();
+		m_restarting = true;
+		m_restarter = std::thread([this, _index]() {
+			dev::setThreadName("restart");
+			restartMiner(_index, std::chrono::milliseconds(c_restartStopTimeout));
+			m_restarting = false;
+		});
+		return true;
+	}
+
+	/**
+	 * @brief Replaces miner @a _index by a new one of the same kind, the others keep mining.
+	 * The new miner inherits the pause state and launch geometry of the old one.
+	 * @param _stopTimeout How long to wait for the old one to stop, 0 for as long as it takes.
+	 * A miner that does not stop in time is given up on and left running.
+	 * @return false if there is no such miner.
+	 */
+	bool restartMiner(unsigned _index, std::chrono::milliseconds _stopTimeout = std::chrono::milliseconds(0))
+	{
+		TraceSpan span("restart", "farm");
+		span.arg("gpu", (int64_t)_index);
+		std::shared_ptr<Miner> old = miner(_index);
+		if (!old)
+			return false;
+
+		// Outside the lock, the thread may take a while to leave its kernel.
+		bool stopped = true;
+		if (_stopTimeout.count())
+			stopped = old->stopWorking(_stopTimeout);
+		else
+			old->stopWorking();
+		MinerLaunch const launch = old->launch();
+		bool const paused = old->paused();
+
+		Guard l(x_minerWork);
+		if (_index >= m_miners->size() || (*m_miners)[_index] != old)
+			return false;	// stopped or restarted meanwhile
+		// Release the device before the new miner claims it.
+		std::shared_ptr<Miners> miners = std::make_shared<Miners>(*m_miners);
+		(*miners)[_index].reset();
+		m_miners = miners;	// readers only see it with the new miner
+		if (!stopped)
+		{
+			cwarn << "Miner" << _index << "does not stop, starting a new one beside it";
+			m_abandoned.push_back(old);
+		}
+		old.reset();
+		std::shared_ptr<Miner> const m(m_sealers[m_minerSealers[_index]].create(*this, _index));
+		m->setLaunch(launch);
+		m->pause(paused);
+		if (m_work)
+			m->setWork(m_work, m_nonces);
+		m->startWorking();
+		miners = std::make_shared<Miners>(*m_miners);
+		(*miners)[_index] = m;
+		m_miners = miners;
+		cnote << "Restarted miner" << _index;
+		return true;
+	}
+
 	/**
 	 * @brief Stop all mining activities and Starts them again
 	 */
@@ -237,6 +554,16 @@ public:
 			m_onMinerRestart();
 		}
 	}
+
+	/**
+	 * @brief Asks for the configuration to be read again and applied in place.
+	 */
+	void reload()
+	{
+		if (m_onReloadRequest) {
+			m_onReloadRequest();
+		}
+	}
 		
 	bool isMining() const
 	{
@@ -247,91 +574,25 @@ public:
      * @brief Get information on the progress of mining this work package.
      * @return The progress with mining so far.
      */
-    WorkingProgress const& miningProgress(bool hwmon = false, bool power = false) const
+    WorkingProgress miningProgress(bool hwmon = false, bool power = false) const
     {
-        std::lock_guard<std::mutex> lock(x_minerWork);
+        std::shared_ptr<Miners const> const miners = this->miners();
         WorkingProgress p;
-        p.ms = 0;
-        p.hashes = 0;
-        for (auto const& i : m_miners)
         {
-            p.minersHashes.push_back(0);
-			if (hwmon) {
-				HwMonitorInfo hwInfo = i->hwmonInfo();
-				HwMonitor hw;
-				unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
-				if (hwInfo.deviceIndex >= 0) {
-					if (hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh) {
-						int typeidx = 0;
-						if(hwInfo.indexSource == HwMonitorIndexSource::CUDA){
-							typeidx = nvmlh->cuda_nvml_device_id[hwInfo.deviceIndex];
-						}
-						else if(hwInfo.indexSource == HwMonitorIndexSource::OPENCL){
-							typeidx = nvmlh->opencl_nvml_device_id[hwInfo.deviceIndex];
-						}
-						else{
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_nvml_get_tempC(nvmlh, typeidx, &tempC);
-						wrap_nvml_get_fanpcnt(nvmlh, typeidx, &fanpcnt);
-						if(power) {
-							wrap_nvml_get_power_usage(nvmlh, typeidx, &powerW);
-						}
-					}
-					else if (hwInfo.deviceType == HwMonitorInfoType::AMD && adlh) {
-						int typeidx = 0;
-						if(hwInfo.indexSource == HwMonitorIndexSource::OPENCL){
-							typeidx = adlh->opencl_adl_device_id[hwInfo.deviceIndex];
-						}
-						else{
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_adl_get_tempC(adlh, typeidx, &tempC);
-						wrap_adl_get_fanpcnt(adlh, typeidx, &fanpcnt);
-						if(power) {
-							wrap_adl_get_power_usage(adlh, typeidx, &powerW);
-						}
-					}
-#if defined(__linux)
-					// Overwrite with sysfs data if present
-					if (hwInfo.deviceType == HwMonitorInfoType::AMD && sysfsh) {
-						int typeidx = 0;
-						if(hwInfo.indexSource == HwMonitorIndexSource::OPENCL){
-							typeidx = sysfsh->opencl_sysfs_device_id[hwInfo.deviceIndex];
-						}
-						else{
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_amdsysfs_get_tempC(sysfsh, typeidx, &tempC);
-						wrap_amdsysfs_get_fanpcnt(sysfsh, typeidx, &fanpcnt);
-						if(power) {
-							wrap_amdsysfs_get_power_usage(sysfsh, typeidx, &powerW);
-						}
-					}
-#endif
-				}
-				hw.tempC = tempC;
-				hw.fanP = fanpcnt;
-				hw.powerW = powerW/((double)1000.0);
-				p.minerMonitors.push_back(hw);
-			}
+            Guard lock(x_progress);
+            p = m_window;
         }
-
-        for (auto const& cp : m_lastProgresses)
+        p.minersHashes.resize(miners->size());
+        if (hwmon)
         {
-            p.ms += cp.ms;
-            p.hashes += cp.hashes;
-            for (unsigned int i = 0; i < cp.minersHashes.size() && i < p.minersHashes.size(); i++)
+            for (auto const& i : *miners)
             {
-                p.minersHashes.at(i) += cp.minersHashes.at(i);
+                HwMonitor hw;
+                m_sensors.read(i->hwmonInfo(), power, hw);
+                p.minerMonitors.push_back(hw);
             }
         }
-
-        m_progress = p;
-        return m_progress;
+        return p;
     }
 
 	SolutionStats getSolutionStats() {
@@ -340,6 +601,7 @@ public:
 
 	void failedSolution() override {
 		m_solutionStats.failed();
+		raise({FarmEvent::Failed});
 	}
 
 	void acceptedSolution(bool _stale) {
@@ -351,6 +613,7 @@ public:
 		{
 			m_solutionStats.acceptedStale();
 		}
+		raise({FarmEvent::Accepted, _stale});
 	}
 
 	void rejectedSolution(bool _stale) {
@@ -362,10 +625,13 @@ public:
 		{
 			m_solutionStats.rejectedStale();
 		}
+		raise({FarmEvent::Rejected, _stale});
 	}
 
 	using SolutionFound = std::function<void(Solution const&)>;
 	using MinerRestart = std::function<void()>;
+	using ReloadRequest = std::function<void()>;
+	using FarmEventHandler = std::function<void(FarmEvent const&)>;
 
 	/**
 	 * @brief Provides a valid header based upon that received previously with setWork().
@@ -374,6 +640,11 @@ public:
 	 */
 	void onSolutionFound(SolutionFound const& _handler) { m_onSolutionFound = _handler; }
 	void onMinerRestart(MinerRestart const& _handler) { m_onMinerRestart = _handler; }
+	void onReloadRequest(ReloadRequest const& _handler) { m_onReloadRequest = _handler; }
+
+	/// The handler runs on the thread raising the event and must not block,
+	/// pass an empty one to stop hearing about them.
+	void onFarmEvent(FarmEventHandler const& _handler) { Guard l(x_onFarmEvent); m_onFarmEvent = _handler; }
 
 	WorkPackage work() const { Guard l(x_minerWork); return m_work; }
 
@@ -405,7 +676,7 @@ public:
 		return m_pool_addresses;
 	}
 
-	uint64_t get_nonce_scrambler() override
+	uint64_t get_nonce_scrambler()
 	{
 		return m_nonce_scrambler;
 	}
@@ -420,30 +691,72 @@ private:
 	void submitProof(Solution const& _s) override
 	{
 		assert(m_onSolutionFound);
+		raise({FarmEvent::Found, _s.stale});
 		m_onSolutionFound(_s);
 	}
 
+	using Miners = std::vector<std::shared_ptr<Miner>>;
+
+	/// The miners as they are now, walked outside the lock.
+	std::shared_ptr<Miners const> miners() const { Guard l(x_minerWork); return m_miners; }
+	/// Miner @a _index, null if there is no such miner.
+	std::shared_ptr<Miner> miner(unsigned _index) const
+	{
+		Guard l(x_minerWork);
+		return _index < m_miners->size() ? (*m_miners)[_index] : nullptr;
+	}
+
+	/// Adds @a _p to the window sums, or takes it out.
+	void accumulate(WorkingProgress const& _p, bool _add)
+	{
+		auto apply = [_add](uint64_t& _sum, uint64_t _v) { _sum = _add ? _sum + _v : _sum - _v; };
+		apply(m_window.ms, _p.ms);
+		apply(m_window.hashes, _p.hashes);
+		if (m_window.minersHashes.size() < _p.minersHashes.size())
+			m_window.minersHashes.resize(_p.minersHashes.size());
+		for (size_t i = 0; i < _p.minersHashes.size(); i++)
+			apply(m_window.minersHashes[i], _p.minersHashes[i]);
+	}
+
+	void raise(FarmEvent const& _e)
+	{
+		Guard l(x_onFarmEvent);
+		if (m_onFarmEvent)
+			m_onFarmEvent(_e);
+	}
+
 	mutable Mutex x_minerWork;
-	std::vector<std::shared_ptr<Miner>> m_miners;
+	/// Replaced as a whole when the miners change, never modified in place.
+	std::shared_ptr<Miners const> m_miners = std::make_shared<Miners>();
+	std::vector<std::string> m_minerSealers;	///< Sealer of each miner, to restart it alone.
 	WorkPackage m_work;
+	std::shared_ptr<NonceCursor> m_nonces;		///< Of m_work.
+	Mutex x_fanOut;		///< Held while a job goes to the miners.
 
 	std::atomic<bool> m_isMining = {false};
 
-	mutable WorkingProgress m_progress;
-
 	SolutionFound m_onSolutionFound;
 	MinerRestart m_onMinerRestart;
+	ReloadRequest m_onReloadRequest;
+	FarmEventHandler m_onFarmEvent;
+	Mutex x_onFarmEvent;
 
 	std::map<std::string, SealerDescriptor> m_sealers;
+	std::map<std::string, MinerLaunch> m_sealerLaunch;	///< Reloaded launch geometry by sealer.
 	std::string m_lastSealer;
 	bool b_lastMixed = false;
 
+	mutable Mutex x_progress;		///< Guards the collections below.
 	std::chrono::steady_clock::time_point m_lastStart;
 	uint64_t m_hashrateSmoothInterval = 10000;
-	std::thread m_serviceThread;  ///< The IO service thread.
-	boost::asio::io_service m_io_service;
+	boost::asio::io_service::strand m_strand;	///< Serialises the timer handlers on the shared loop.
 	boost::asio::deadline_timer m_hashrateTimer;
-	std::vector<WorkingProgress> m_lastProgresses;
+	std::deque<WorkingProgress> m_lastProgresses;
+	WorkingProgress m_window;				///< Sums of m_lastProgresses.
+	WorkingProgress m_lastCollected;		///< The latest collection alone, for the stats windows.
+
+	std::unique_ptr<StatsSegment> m_stats;
+	std::unique_ptr<StatsBlock> m_statsBlock;
 
 	mutable SolutionStats m_solutionStats;
 	std::chrono::steady_clock::time_point m_farm_launched = std::chrono::steady_clock::now();
@@ -451,11 +764,16 @@ private:
     	string m_pool_addresses;
 	uint64_t m_nonce_scrambler;
 
-	wrap_nvml_handle *nvmlh = NULL;
-	wrap_adl_handle *adlh = NULL;
-#if defined(__linux)
-	wrap_amdsysfs_handle *sysfsh = NULL;
-#endif
+	HwMonitorSensors m_sensors;
+	std::unique_ptr<Governor> m_governor;
+	std::unique_ptr<Watchdog> m_watchdog;
+	std::vector<std::shared_ptr<Miner>> m_abandoned;	///< Miners that would not stop for a restart.
+	Mutex x_restarter;
+	std::thread m_restarter;		///< The last watchdog restart.
+	std::atomic<bool> m_restarting = {false};
+	unsigned m_governorTicks = 0;
+
+	PendingHandlers m_handlers;
 }; 
 
 }
@@ -0,0 +1,161 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Governor.cpp
+ */
+
+#include "Governor.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+HwMonitorSensors::HwMonitorSensors()
+{
+	// m_adl = wrap_adl_create();
+#if defined(__linux)
+	m_sysfs = wrap_amdsysfs_create();
+#endif
+	m_nvml = wrap_nvml_create();
+}
+
+HwMonitorSensors::~HwMonitorSensors()
+{
+	if (m_adl)
+		wrap_adl_destroy(m_adl);
+#if defined(__linux)
+	if (m_sysfs)
+		wrap_amdsysfs_destroy(m_sysfs);
+#endif
+	if (m_nvml)
+		wrap_nvml_destroy(m_nvml);
+}
+
+bool HwMonitorSensors::read(HwMonitorInfo const& _info, bool _power, HwMonitor& _hw) const
+{
+	unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
+	bool sensed = false;
+	if (_info.deviceIndex >= 0)
+	{
+		Guard l(x_read);
+		if (_info.deviceType == HwMonitorInfoType::NVIDIA && m_nvml)
+		{
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::CUDA)
+				typeidx = m_nvml->cuda_nvml_device_id[_info.deviceIndex];
+			else if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_nvml->opencl_nvml_device_id[_info.deviceIndex];
+			else
+				typeidx = _info.deviceIndex;	// Unknown, don't map
+			wrap_nvml_get_tempC(m_nvml, typeidx, &tempC);
+			wrap_nvml_get_fanpcnt(m_nvml, typeidx, &fanpcnt);
+			if (_power)
+				wrap_nvml_get_power_usage(m_nvml, typeidx, &powerW);
+			sensed = true;
+		}
+		else if (_info.deviceType == HwMonitorInfoType::AMD && m_adl)
+		{
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_adl->opencl_adl_device_id[_info.deviceIndex];
+			else
+				typeidx = _info.deviceIndex;	// Unknown, don't map
+			wrap_adl_get_tempC(m_adl, typeidx, &tempC);
+			wrap_adl_get_fanpcnt(m_adl, typeidx, &fanpcnt);
+			if (_power)
+				wrap_adl_get_power_usage(m_adl, typeidx, &powerW);
+			sensed = true;
+		}
+#if defined(__linux)
+		// Overwrite with sysfs data if present
+		if (_info.deviceType == HwMonitorInfoType::AMD && m_sysfs)
+		{
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_sysfs->opencl_sysfs_device_id[_info.deviceIndex];
+			else
+				typeidx = _info.deviceIndex;	// Unknown, don't map
+			wrap_amdsysfs_get_tempC(m_sysfs, typeidx, &tempC);
+			wrap_amdsysfs_get_fanpcnt(m_sysfs, typeidx, &fanpcnt);
+			if (_power)
+				wrap_amdsysfs_get_power_usage(m_sysfs, typeidx, &powerW);
+			sensed = true;
+		}
+#endif
+	}
+	_hw.tempC = tempC;
+	_hw.fanP = fanpcnt;
+	_hw.powerW = powerW / 1000.0;
+	return sensed;
+}
+
+Governor::Governor(HwMonitorProvider const& _provider, GovernorTargets const& _targets):
+	m_provider(_provider),
+	m_targets(_targets)
+{}
+
+vector<float> Governor::tick(vector<HwMonitorInfo> const& _devices)
+{
+	GovernorTargets const& t = m_targets;
+	bool const power = t.powerW > 0;
+
+	Guard l(x_devices);
+	m_devices.resize(_devices.size());
+	vector<float> intensities(_devices.size());
+	for (size_t i = 0; i < _devices.size(); i++)
+	{
+		GovernorDevice& d = m_devices[i];
+		HwMonitor hw;
+		d.sensed = m_provider.read(_devices[i], power, hw) && (hw.tempC > 0 || hw.powerW > 0);
+		if (!d.sensed)
+		{
+			// Without readings there is nothing to govern on, hold the last setting.
+			d.throttled = false;
+			intensities[i] = d.intensity;
+			continue;
+		}
+		d.hw = hw;
+
+		bool const hotT = t.tempC > 0 && hw.tempC > t.tempC;
+		bool const hotP = power && hw.powerW > t.powerW;
+		bool const coolT = t.tempC <= 0 || hw.tempC <= t.tempC - t.hysteresisC;
+		bool const coolP = !power || hw.powerW <= t.powerW - t.hysteresisW;
+
+		float const was = d.intensity;
+		d.throttled = hotT || hotP;
+		if (d.throttled)
+		{
+			bool const far = (hotT && hw.tempC >= t.tempC + t.hysteresisC) ||
+				(hotP && hw.powerW >= t.powerW + t.hysteresisW);
+			d.intensity = max(t.floor, d.intensity - (far ? 2 : 1) * t.step);
+		}
+		else if (coolT && coolP)
+			d.intensity = min(1.0f, d.intensity + t.step / 2);
+
+		if (d.intensity != was)
+		{
+			(d.intensity < was ? d.downs : d.ups)++;
+			ostringstream reading;
+			reading << hw.tempC << "C";
+			if (power)
+				reading << " " << fixed << setprecision(0) << hw.powerW << "W";
+			cnote << "Governor: gpu/" + to_string(i) << "at" << reading.str() << (d.throttled ? "over" : "under")
+				  << "target, intensity" << to_string(int(was * 100 + 0.5f)) + "% ->" << to_string(int(d.intensity * 100 + 0.5f)) + "%";
+		}
+		intensities[i] = d.intensity;
+	}
+	return intensities;
+}
@@ -0,0 +1,120 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Governor.h
+ * Sensor access and the thermal and power intensity governor.
+ */
+
+#pragma once
+
+#include <vector>
+#include <libdevcore/Guards.h>
+#include <libhwmon/wrapnvml.h>
+#include <libhwmon/wrapadl.h>
+#if defined(__linux)
+#include <libhwmon/wrapamdsysfs.h>
+#endif
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+
+/// Source of the temperature, fan and power readings of the devices.
+class HwMonitorProvider
+{
+public:
+	virtual ~HwMonitorProvider() = default;
+
+	/// Fills @a _hw for the device of @a _info, with the power draw only when
+	/// @a _power is set. False when no sensor answers for the device.
+	virtual bool read(HwMonitorInfo const& _info, bool _power, HwMonitor& _hw) const = 0;
+};
+
+/// Reads NVML, ADL and on Linux the amdgpu sysfs nodes, one caller at a time.
+class HwMonitorSensors: public HwMonitorProvider
+{
+public:
+	HwMonitorSensors();
+	~HwMonitorSensors();
+
+	bool read(HwMonitorInfo const& _info, bool _power, HwMonitor& _hw) const override;
+
+private:
+	/// The handles keep per-device state and the sysfs one a shared read buffer.
+	mutable Mutex x_read;
+	wrap_nvml_handle* m_nvml = nullptr;
+	wrap_adl_handle* m_adl = nullptr;
+#if defined(__linux)
+	wrap_amdsysfs_handle* m_sysfs = nullptr;
+#endif
+};
+
+struct GovernorTargets
+{
+	int tempC = 0;				///< Temperature to stay under, 0 to ignore.
+	double powerW = 0;			///< Board power to stay under, 0 to ignore.
+	int hysteresisC = 3;		///< Degrees under the target before raising again.
+	double hysteresisW = 10;	///< Watts under the target before raising again.
+	float step = 0.1f;			///< Intensity taken off per tick over target.
+	float floor = 0.25f;		///< Lowest intensity the governor goes to.
+
+	bool enabled() const { return tempC > 0 || powerW > 0; }
+};
+
+/// What the governor last saw and did for one device.
+struct GovernorDevice
+{
+	float intensity = 1.0f;
+	HwMonitor hw;
+	bool sensed = false;		///< The last read returned data.
+	bool throttled = false;		///< Over a target on the last tick.
+	unsigned downs = 0;
+	unsigned ups = 0;
+};
+
+/**
+ * @brief Scales the launch size of each device to keep it under the
+ * temperature and power targets.
+ *
+ * Every tick reads the sensors through the provider. A device over a target
+ * loses one step of intensity, two when it is a full hysteresis band over,
+ * down to the floor. Once it is a hysteresis band under every target it gets
+ * half a step back, up to full intensity. Between the two it holds, so a
+ * device settles instead of oscillating across the target.
+ */
+class Governor
+{
+public:
+	Governor(HwMonitorProvider const& _provider, GovernorTargets const& _targets);
+
+	/// Reads the sensors of @a _devices and returns the new intensity of each.
+	std::vector<float> tick(std::vector<HwMonitorInfo> const& _devices);
+
+	GovernorTargets const& targets() const { return m_targets; }
+	std::vector<GovernorDevice> devices() const { Guard l(x_devices); return m_devices; }
+
+private:
+	HwMonitorProvider const& m_provider;
+	GovernorTargets const m_targets;
+
+	mutable Mutex x_devices;
+	std::vector<GovernorDevice> m_devices;
+};
+
+}
+}
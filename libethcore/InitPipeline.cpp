@@ -0,0 +1,193 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file InitPipeline.cpp
+ */
+
+#include "InitPipeline.h"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <libdevcore/Guards.h>
+#include <libdevcore/Log.h>
+#include <libdevcore/Trace.h>
+#include "EthashAux.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+
+struct Timing
+{
+	char const* name;
+	chrono::steady_clock::duration duration;
+};
+
+struct State
+{
+	Mutex x_state;
+	Condition slotFreed;
+
+	unsigned slots = 0;
+	bool ordered = false;
+	unsigned active = 0;
+	set<unsigned> waiting;
+
+	int epoch = -1;
+	unsigned devices = 0;
+	chrono::steady_clock::time_point started;
+	map<unsigned, vector<Timing>> timings;
+	set<unsigned> ready;
+	bool reported = false;
+};
+
+State& state()
+{
+	static State* s = new State;
+	return *s;
+}
+
+long long millis(chrono::steady_clock::duration _d)
+{
+	return chrono::duration_cast<chrono::milliseconds>(_d).count();
+}
+
+}
+
+atomic<unsigned> InitPipeline::s_round = {0};
+
+void InitPipeline::configure(unsigned _dagSlots, bool _ordered)
+{
+	State& s = state();
+	Guard l(s.x_state);
+	s.slots = _ordered ? 1 : _dagSlots;
+	s.ordered = _ordered;
+}
+
+void InitPipeline::begin(int _epoch, unsigned _devices)
+{
+	State& s = state();
+	{
+		Guard l(s.x_state);
+		if (_epoch == s.epoch)
+			return;
+		s.epoch = _epoch;
+		s.devices = _devices;
+		s.started = chrono::steady_clock::now();
+		s.timings.clear();
+		s.ready.clear();
+		s.reported = false;
+		s_round++;
+	}
+
+	// Built once here while the devices set up, they share it through EthashAux.
+	thread([_epoch]() {
+		setThreadName("light");
+		EthashAux::light(_epoch);
+	}).detach();
+}
+
+void InitPipeline::ready(unsigned _index, unsigned _round)
+{
+	State& s = state();
+	UniqueGuard l(s.x_state);
+	if (_round != s_round || s.reported)
+		return;
+	if (!s.ready.insert(_index).second)
+		return;
+	auto const took = chrono::steady_clock::now() - s.started;
+	s.timings[_index].push_back(Timing{"ready", took});
+	if (s.ready.size() < s.devices)
+		return;
+	s.reported = true;
+
+	// The last device in is the slowest one.
+	stringstream phases;
+	for (auto const& d: s.timings)
+	{
+		phases << " gpu" << d.first;
+		for (Timing const& t: d.second)
+			phases << " " << t.name << " " << millis(t.duration);
+		phases << ";";
+	}
+	int const epoch = s.epoch;
+	size_t const devices = s.ready.size();
+	l.unlock();
+
+	cnote << "Epoch " + to_string(epoch) + " ready on " + to_string(devices) + " devices in " + to_string(millis(took)) +
+		" ms, slowest gpu" + to_string(_index);
+	cnote << "Phases in ms:" + phases.str();
+	Trace::instant("ready", "init", TraceArgs().add("epoch", epoch).add("ms", millis(took)));
+}
+
+void InitPipeline::record(unsigned _index, unsigned _round, char const* _name, chrono::steady_clock::duration _d)
+{
+	State& s = state();
+	Guard l(s.x_state);
+	if (_round == s_round && !s.reported)
+		s.timings[_index].push_back(Timing{_name, _d});
+}
+
+InitPipeline::Phase::Phase(unsigned _index, char const* _name):
+	m_index(_index),
+	m_name(_name),
+	m_round(round()),
+	m_start(chrono::steady_clock::now())
+{
+}
+
+void InitPipeline::Phase::end()
+{
+	if (!m_active)
+		return;
+	m_active = false;
+	record(m_index, m_round, m_name, chrono::steady_clock::now() - m_start);
+}
+
+unsigned InitPipeline::acquire(unsigned _index)
+{
+	State& s = state();
+	Phase wait(_index, "dag-wait");
+	UniqueGuard l(s.x_state);
+	s.waiting.insert(_index);
+	s.slotFreed.wait(l, [&]() {
+		return (!s.slots || s.active < s.slots) && (!s.ordered || *s.waiting.begin() == _index);
+	});
+	s.waiting.erase(_index);
+	s.active++;
+	return _index;
+}
+
+void InitPipeline::release()
+{
+	State& s = state();
+	{
+		Guard l(s.x_state);
+		s.active--;
+	}
+	s.slotFreed.notify_all();
+}
+
+InitPipeline::DagSlot::~DagSlot()
+{
+	release();
+}
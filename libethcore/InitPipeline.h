@@ -0,0 +1,98 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file InitPipeline.h
+ * Scheduling and timing of the per device phases of a cold start or epoch change.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace dev
+{
+namespace eth
+{
+
+/**
+ * @brief Orchestrates the devices bringing up a new epoch.
+ *
+ * A round starts when the farm gets work of a new epoch: its light cache is
+ * built once in the background while the devices set up their contexts and
+ * kernels. DAG generation and uploads, bound by host memory bandwidth, take
+ * one of a limited number of slots, lowest device first when ordered. Each
+ * device's phases are timed and a report is logged once all of them hash.
+ */
+class InitPipeline
+{
+public:
+	/// At most @a _dagSlots DAG phases at once, 0 for no limit; @a _ordered grants them by device index.
+	static void configure(unsigned _dagSlots, bool _ordered);
+
+	/// Starts the round of epoch @a _epoch for @a _devices devices.
+	static void begin(int _epoch, unsigned _devices);
+	/// Current round, 0 before the first one.
+	static unsigned round() { return s_round.load(std::memory_order_relaxed); }
+	/// Device @a _index hashes on the epoch of round @a _round.
+	static void ready(unsigned _index, unsigned _round);
+
+	/// Times a phase of device @a _index for the report of the current round.
+	class Phase
+	{
+	public:
+		Phase(unsigned _index, char const* _name);
+		~Phase() { end(); }
+
+		/// Ends the phase before the end of the scope.
+		void end();
+
+	private:
+		Phase(Phase const&) = delete;
+		Phase& operator=(Phase const&) = delete;
+
+		unsigned m_index;
+		char const* m_name;
+		unsigned m_round;
+		bool m_active = true;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	/// Holds one of the DAG slots for as long as it lives, waiting for it first.
+	class DagSlot
+	{
+	public:
+		DagSlot(unsigned _index): m_index(acquire(_index)), m_phase(_index, "dag") {}
+		~DagSlot();
+
+	private:
+		DagSlot(DagSlot const&) = delete;
+		DagSlot& operator=(DagSlot const&) = delete;
+
+		unsigned m_index;
+		Phase m_phase;
+	};
+
+private:
+	static unsigned acquire(unsigned _index);
+	static void release();
+	static void record(unsigned _index, unsigned _round, char const* _name, std::chrono::steady_clock::duration _d);
+
+	static std::atomic<unsigned> s_round;
+};
+
+}
+}
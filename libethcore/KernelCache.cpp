@@ -0,0 +1,137 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file KernelCache.cpp
+ */
+
+#include "KernelCache.h"
+
+#include <future>
+#include <map>
+#include <libdevcore/Guards.h>
+#include <libdevcore/SHA3.h>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+
+struct Entry
+{
+	shared_future<KernelCache::Binary> result;
+	uint64_t used;
+};
+
+struct State
+{
+	Mutex x_entries;
+	map<h256, Entry> entries;
+	uint64_t clock = 0;
+	unsigned compiles = 0;
+	unsigned hits = 0;
+};
+
+State& state()
+{
+	static State* s = new State;
+	return *s;
+}
+
+bool ready(Entry const& _e)
+{
+	return _e.result.wait_for(chrono::seconds(0)) == future_status::ready;
+}
+
+}
+
+const unsigned KernelCache::c_maxEntries;
+
+h256 KernelCache::key(string const& _source, string const& _options, string const& _target)
+{
+	// Lengths first, no two inputs make the same text.
+	string const all = to_string(_target.size()) + ':' + to_string(_options.size()) + ':' + _target + _options + _source;
+	return sha3(bytesConstRef(reinterpret_cast<byte const*>(all.data()), all.size()));
+}
+
+KernelCache::Binary KernelCache::get(h256 const& _key, function<bytes()> const& _compile, bool* o_compiled)
+{
+	State& s = state();
+	promise<Binary> built;
+	shared_future<Binary> result;
+	bool first = false;
+	{
+		Guard l(s.x_entries);
+		auto it = s.entries.find(_key);
+		if (it != s.entries.end())
+		{
+			it->second.used = ++s.clock;
+			result = it->second.result;
+			s.hits++;
+		}
+		else
+		{
+			result = built.get_future().share();
+			s.entries[_key] = Entry{result, ++s.clock};
+			s.compiles++;
+			first = true;
+
+			while (s.entries.size() > c_maxEntries)
+			{
+				auto oldest = s.entries.end();
+				for (auto e = s.entries.begin(); e != s.entries.end(); ++e)
+					if (ready(e->second) && (oldest == s.entries.end() || e->second.used < oldest->second.used))
+						oldest = e;
+				if (oldest == s.entries.end())
+					break;
+				s.entries.erase(oldest);
+			}
+		}
+	}
+
+	if (o_compiled)
+		*o_compiled = first;
+	if (first)
+	{
+		try
+		{
+			built.set_value(make_shared<bytes const>(_compile()));
+		}
+		catch (...)
+		{
+			// Only the callers already waiting see the failure, the next one builds again.
+			{
+				Guard l(s.x_entries);
+				s.entries.erase(_key);
+			}
+			built.set_exception(current_exception());
+		}
+	}
+	return result.get();
+}
+
+unsigned KernelCache::compiles()
+{
+	Guard l(state().x_entries);
+	return state().compiles;
+}
+
+unsigned KernelCache::hits()
+{
+	Guard l(state().x_entries);
+	return state().hits;
+}
@@ -0,0 +1,65 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file KernelCache.h
+ * Compiled kernels shared by the devices building the same program.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <libdevcore/Common.h>
+#include <libdevcore/FixedHash.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/**
+ * @brief Process wide single-flight cache of compiled kernels.
+ *
+ * Identical devices build identical programs each period. The first request
+ * of a key compiles while the concurrent ones wait for its result, and later
+ * ones take it as is. A key covers the source, the build options and the
+ * compiler target, such as a device and driver or an architecture. A failed
+ * build is thrown to the requests waiting for it and not kept, a reinit
+ * builds again.
+ */
+class KernelCache
+{
+public:
+	using Binary = std::shared_ptr<bytes const>;
+
+	/// Entries kept, the most recently used. In flight builds are never dropped.
+	static const unsigned c_maxEntries = 16;
+
+	/// Key of @a _source built with @a _options for @a _target.
+	static h256 key(std::string const& _source, std::string const& _options, std::string const& _target);
+
+	/// The binary of @a _key, built by @a _compile for the first caller only. Throws what
+	/// a failed build threw to its concurrent callers. @a o_compiled tells whether this caller built it.
+	static Binary get(h256 const& _key, std::function<bytes()> const& _compile, bool* o_compiled = nullptr);
+
+	/// Builds run and requests served by earlier or concurrent builds.
+	static unsigned compiles();
+	static unsigned hits();
+};
+
+}
+}
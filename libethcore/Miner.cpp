@@ -1,5 +1,6 @@
 #include "Miner.h"
 #include "EthashAux.h"
+#include <libethash/internal.h>
 
 using namespace dev;
 using namespace eth;
@@ -10,7 +11,36 @@ unsigned dev::eth::Miner::s_dagLoadIndex = 0;
 
 unsigned dev::eth::Miner::s_dagCreateDevice = 0;
 
-uint8_t* dev::eth::Miner::s_dagInHostMemory = NULL;
+HostBuffer* dev::eth::Miner::s_dagInHostMemory = NULL;
 
 bool dev::eth::Miner::s_exit = false;
 
+unsigned dev::eth::Miner::s_dagHeadroom = Miner::c_defaultDagHeadroom;
+
+namespace
+{
+
+/// Last epoch of the libethash size tables.
+uint64_t const c_lastEpoch = 2047;
+
+/// Block of the epoch @a _epochs after the one of @a _blockNumber, within the size tables.
+uint64_t headroomBlock(uint64_t _blockNumber, unsigned _epochs)
+{
+	uint64_t const epoch = std::min<uint64_t>(_blockNumber / ETHASH_EPOCH_LENGTH + _epochs, c_lastEpoch);
+	return std::max(_blockNumber, epoch * ETHASH_EPOCH_LENGTH);
+}
+
+}
+
+uint64_t dev::eth::Miner::dagReservation(uint64_t _blockNumber, uint64_t _limit)
+{
+	uint64_t const need = ethash_get_datasize(_blockNumber);
+	return std::max(need, std::min(ethash_get_datasize(headroomBlock(_blockNumber, s_dagHeadroom)), _limit));
+}
+
+uint64_t dev::eth::Miner::lightReservation(uint64_t _blockNumber, uint64_t _limit)
+{
+	uint64_t const need = ethash_get_cachesize(_blockNumber);
+	return std::max(need, std::min(ethash_get_cachesize(headroomBlock(_blockNumber, s_dagHeadroom)), _limit));
+}
+
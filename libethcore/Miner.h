@@ -26,9 +26,12 @@
 #include <string>
 #include <boost/timer.hpp>
 #include <libdevcore/Common.h>
+#include <libdevcore/HostMemory.h>
 #include <libdevcore/Log.h>
+#include <libdevcore/Trace.h>
 #include <libdevcore/Worker.h>
 #include "EthashAux.h"
+#include "InitPipeline.h"
 
 #define MINER_WAIT_STATE_WORK	 1
 
@@ -49,7 +52,8 @@ enum class MinerType
 {
 	Mixed,
 	CL,
-	CUDA
+	CUDA,
+	CPU
 };
 
 enum class HwMonitorInfoType
@@ -173,14 +177,69 @@ public:
 	 */
 	virtual void submitProof(Solution const& _p) = 0;
 	virtual void failedSolution() = 0;
-	virtual uint64_t get_nonce_scrambler() = 0;
+};
+
+/// Launch geometry one device runs with instead of the command line one, 0 keeps a value.
+struct MinerLaunch
+{
+	MinerLaunch(unsigned _local = 0, unsigned _global = 0, unsigned _streams = 0):
+		localWorkSize(_local), globalWorkSize(_global), streams(_streams) {}
+
+	unsigned localWorkSize;		///< OpenCL work-group size, CUDA block size, CPU interleave.
+	unsigned globalWorkSize;	///< OpenCL global work size, CUDA grid size in blocks.
+	unsigned streams;			///< CUDA streams.
+};
+
+/**
+ * @brief Nonce space of one job, handed out to its miners a launch at a time.
+ *
+ * Each miner leases the range its next launch searches, so a fast device
+ * takes more of the space than a slow one and no nonce is searched twice.
+ */
+class NonceCursor
+{
+public:
+	/// The space of the @a _bits low bits above @a _base, unbounded from 64 bits.
+	NonceCursor(uint64_t _base, unsigned _bits):
+		m_base(_base),
+		m_size(_bits >= 64 ? 0 : uint64_t(1) << _bits)
+	{}
+
+	/// Leases up to @a _count nonces from @a o_start, in multiples of @a _granularity.
+	/// Returns how many, 0 once the space is used up.
+	uint64_t lease(uint64_t _count, uint64_t _granularity, uint64_t& o_start)
+	{
+		uint64_t const offset = m_next.fetch_add(_count, std::memory_order_relaxed);
+		if (m_size)
+		{
+			if (offset >= m_size)
+				return 0;
+			// The lease crossing the end is cut to whole multiples, the few
+			// nonces left past them are not searched.
+			_count = std::min(_count, m_size - offset) / _granularity * _granularity;
+		}
+		o_start = m_base + offset;
+		return _count;
+	}
+
+	/// Nonces leased so far, past the end of the space once used up.
+	uint64_t leased() const { return m_next.load(std::memory_order_relaxed); }
+
+	/// True for the first caller only, to report the end of the space once.
+	bool takeExhausted() { return !m_exhausted.exchange(true); }
+
+private:
+	uint64_t const m_base;
+	uint64_t const m_size;
+	std::atomic<uint64_t> m_next = {0};
+	std::atomic<bool> m_exhausted = {false};
 };
 
 /**
  * @brief A miner - a member and adoptee of the Farm.
  * @warning Not threadsafe. It is assumed Farm will synchronise calls to/from this class.
  */
-#define LOG2_MAX_MINERS 5u
+#define LOG2_MAX_MINERS 10u
 #define MAX_MINERS (1u << LOG2_MAX_MINERS)
 
 class Miner: public Worker
@@ -191,33 +250,84 @@ public:
 		Worker(_name + std::to_string(_index)),
 		index(_index),
 		farm(_farm)
-	{}
+	{
+		profileLock(x_work, "Miner::x_work");
+	}
 
 	virtual ~Miner() = default;
 
-	void setWork(WorkPackage const& _work)
+	/// Epochs of DAG growth past the current one device buffers are reserved for.
+	static const unsigned c_defaultDagHeadroom = 4;
+	static void setDagHeadroom(unsigned _epochs) { s_dagHeadroom = _epochs; }
+
+	/// @a _nonces is shared by the miners of the job.
+	void setWork(WorkPackage const& _work, std::shared_ptr<NonceCursor> const& _nonces)
 	{
 		{
 			Guard l(x_work);
 			m_work = _work;
+			m_nonces = _nonces;
 			workSwitchStart = std::chrono::high_resolution_clock::now();
+			m_switchTraced = std::chrono::steady_clock::now();
 		}
 		kick_miner();
 	}
 
 	uint64_t hashCount() const { return m_hashCount.load(std::memory_order_relaxed); }
 
-	void resetHashCount() { m_hashCount.store(0, std::memory_order_relaxed); }
+	/// The hashes since the last call, none lost to a concurrent report.
+	uint64_t takeHashCount() { return m_hashCount.exchange(0, std::memory_order_relaxed); }
 
-	unsigned Index() { return index; };
-	HwMonitorInfo hwmonInfo() { return m_hwmoninfo; }
+	/// When the miner last reported hashes, or left a busy phase.
+	std::chrono::steady_clock::time_point lastProgress() const
+	{
+		return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_lastProgress.load(std::memory_order_relaxed)));
+	}
+	/// Smoothed time between two hash reports, 0 before the first one.
+	float batchMs() const { return m_batchMs.load(std::memory_order_relaxed); }
+	/// In a phase that reports no hashes: DAG generation, kernel builds.
+	bool busy() const { return m_busy.load(std::memory_order_relaxed) > 0; }
+
+	/// Wakes the mining thread out of a wait.
+	void kick() { kick_miner(); }
+
+	/// Asks the mining thread to rebuild its kernel and search state before the next launch.
+	void reinit()
+	{
+		m_reinit = true;
+		kick_miner();
+	}
+
+	/// Fraction of the full launch size to run, lowered by the governor when hot.
+	void setIntensity(float _intensity) { m_intensity.store(_intensity, std::memory_order_relaxed); }
+	float intensity() const { return m_intensity.load(std::memory_order_relaxed); }
+
+	/// Stops launching kernels until resumed, the device keeps its DAG and kernel.
+	void pause(bool _pause)
+	{
+		{
+			Guard l(x_pause);
+			m_paused = _pause;
+		}
+		m_pauseChanged.notify_all();
+		kick_miner();
+	}
+	bool paused() const { Guard l(x_pause); return m_paused; }
 
-	uint64_t get_start_nonce()
+	/// Applied by the mining thread before its next launch.
+	void setLaunch(MinerLaunch const& _launch)
 	{
-		// Each GPU is given a non-overlapping 2^40 range to search
-		printf("Start nonce with index %d\n", index);
-		return farm.get_nonce_scrambler() + ((uint64_t) index << 40);
+		{
+			Guard l(x_launch);
+			m_launch = _launch;
+			m_launchChanged = true;
+		}
+		kick_miner();
 	}
+	MinerLaunch launch() const { Guard l(x_launch); return m_launch; }
+
+	unsigned Index() { return index; };
+	HwMonitorInfo hwmonInfo() { return m_hwmoninfo; }
 
 protected:
 
@@ -227,24 +337,149 @@ protected:
 	virtual void kick_miner() = 0;
 
 	WorkPackage work() const { Guard l(x_work); return m_work; }
+	/// The work with the nonce cursor of its job.
+	WorkPackage work(std::shared_ptr<NonceCursor>& o_nonces) const
+	{
+		Guard l(x_work);
+		o_nonces = m_nonces;
+		return m_work;
+	}
+
+	/// Leases the nonces of a launch of up to @a _count from @a _nonces, see NonceCursor::lease().
+	/// Once the job has none left, idles a while for new work and returns 0.
+	uint64_t leaseNonces(NonceCursor& _nonces, uint64_t _count, uint64_t _granularity, uint64_t& o_start)
+	{
+		uint64_t const leased = _nonces.lease(_count, _granularity, o_start);
+		if (leased)
+			return leased;
+		if (_nonces.takeExhausted())
+			cwarn << "Nonce space of the job searched, waiting for new work";
+		Busy busy(*this);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		return 0;
+	}
 
-	void addHashCount(uint64_t _n) { m_hashCount.fetch_add(_n, std::memory_order_relaxed); }
+	void addHashCount(uint64_t _n)
+	{
+		m_hashCount.fetch_add(_n, std::memory_order_relaxed);
+
+		// Only the mining thread writes these.
+		auto const now = std::chrono::steady_clock::now();
+		float const ms = std::chrono::duration<float, std::milli>(now - lastProgress()).count();
+		float const batch = m_batchMs.load(std::memory_order_relaxed);
+		m_batchMs.store(batch == 0 ? ms : batch * 0.9f + ms * 0.1f, std::memory_order_relaxed);
+		touch(now);
+
+		// First hashes since the init of the current epoch round.
+		if (m_initRound != m_readyRound)
+		{
+			m_readyRound = m_initRound;
+			InitPipeline::ready(index, m_readyRound);
+		}
+	}
+
+	/// Marks a phase without hash reports for the watchdog, for as long as it lives.
+	class Busy
+	{
+	public:
+		Busy(Miner& _m): m_miner(_m) { m_miner.m_busy++; }
+		~Busy()
+		{
+			m_miner.touch(std::chrono::steady_clock::now());
+			m_miner.m_initRound = InitPipeline::round();
+			m_miner.m_busy--;
+		}
+
+	private:
+		Miner& m_miner;
+	};
+
+	/// True once after reinit() was called.
+	bool takeReinit() { return m_reinit.exchange(false); }
+
+	/// Blocks the mining thread while paused, returns true if it did.
+	bool waitWhilePaused()
+	{
+		UniqueGuard l(x_pause);
+		if (!m_paused)
+			return false;
+		// Worker::stopWorking() does not know about us, poll for it.
+		while (m_paused && !shouldStop())
+			m_pauseChanged.wait_for(l, std::chrono::milliseconds(100));
+		touch(std::chrono::steady_clock::now());
+		return true;
+	}
+
+	/// The launch set since the last call, false when it did not change.
+	bool takeLaunch(MinerLaunch& _launch)
+	{
+		Guard l(x_launch);
+		if (!m_launchChanged)
+			return false;
+		m_launchChanged = false;
+		_launch = m_launch;
+		return true;
+	}
+
+	/// Bytes to allocate for the DAG of the epoch of @a _blockNumber: the size of
+	/// the last epoch of the headroom, within @a _limit but never below the DAG itself.
+	static uint64_t dagReservation(uint64_t _blockNumber, uint64_t _limit);
+	/// The same for the light cache.
+	static uint64_t lightReservation(uint64_t _blockNumber, uint64_t _limit);
 
 	static unsigned s_dagLoadMode;
 	static unsigned s_dagLoadIndex;
 	static unsigned s_dagCreateDevice;
-	static uint8_t* s_dagInHostMemory;
+	static HostBuffer* s_dagInHostMemory;
 	static bool s_exit;
+	static unsigned s_dagHeadroom;
 
 	const size_t index = 0;
 	FarmFace& farm;
 	std::chrono::high_resolution_clock::time_point workSwitchStart;
 	HwMonitorInfo m_hwmoninfo;
+
+	/// Traces the switch to the last work set, from setWork() until now.
+	void traceSwitch(char const* _cat)
+	{
+		if (!Trace::enabled())
+			return;
+		std::chrono::steady_clock::time_point start;
+		int epoch;
+		{
+			Guard l(x_work);
+			start = m_switchTraced;
+			epoch = m_work.epoch;
+		}
+		Trace::complete("switch", _cat, start, std::chrono::steady_clock::now(),
+			TraceArgs().add("gpu", (int64_t)index).add("epoch", epoch));
+	}
+
 private:
 	std::atomic<uint64_t> m_hashCount = {0};
+	std::atomic<float> m_intensity = {1.0f};
+	std::chrono::steady_clock::time_point m_switchTraced;
+	unsigned m_initRound = 0;		///< InitPipeline round at the end of the last busy phase.
+	unsigned m_readyRound = 0;		///< Round reported ready.
+
+	void touch(std::chrono::steady_clock::time_point _t) { m_lastProgress.store(_t.time_since_epoch().count(), std::memory_order_relaxed); }
+
+	std::atomic<std::chrono::steady_clock::rep> m_lastProgress = {std::chrono::steady_clock::now().time_since_epoch().count()};
+	std::atomic<float> m_batchMs = {0};
+	std::atomic<int> m_busy = {0};
+	std::atomic<bool> m_reinit = {false};
 
 	WorkPackage m_work;
+	std::shared_ptr<NonceCursor> m_nonces;
 	mutable Mutex x_work;
+
+	bool m_paused = false;
+	mutable Mutex x_pause;
+	Condition m_pauseChanged;
+
+	MinerLaunch m_launch;
+	bool m_launchChanged = false;
+	mutable Mutex x_launch;
 };
 
 }
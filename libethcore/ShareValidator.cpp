@@ -0,0 +1,214 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ShareValidator.cpp
+ */
+
+#include "ShareValidator.h"
+#include "EthashAux.h"
+#include "Exceptions.h"
+
+using namespace std;
+using namespace chrono;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+
+/// Epochs covered by the libethash size tables, light() asserts beyond.
+int const c_maxEpochs = 2048;
+
+/// The 64 bits the search kernels compare, held in the high bytes.
+uint64_t upper64(h256 const& _h)
+{
+	uint64_t v = 0;
+	for (unsigned i = 0; i < 8; i++)
+		v = v << 8 | _h[i];
+	return v;
+}
+
+}
+
+char const* dev::eth::toString(ShareVerdict _v)
+{
+	switch (_v)
+	{
+	case ShareVerdict::Valid: return "valid";
+	case ShareVerdict::BadMix: return "badmix";
+	case ShareVerdict::LowDifficulty: return "lowdifficulty";
+	case ShareVerdict::Error: return "error";
+	}
+	return "error";
+}
+
+ShareValidator::ShareValidator(unsigned _threads)
+{
+	if (_threads == 0)
+		_threads = std::max(1u, thread::hardware_concurrency());
+	for (unsigned i = 0; i < _threads; i++)
+		m_workers.emplace_back(&ShareValidator::workLoop, this);
+}
+
+ShareValidator::~ShareValidator()
+{
+	{
+		Guard l(x_queue);
+		m_stop = true;
+	}
+	m_queued.notify_all();
+	for (auto& t: m_workers)
+		t.join();
+	Guard l(x_warm);
+	if (m_warming.joinable())
+		m_warming.join();
+}
+
+vector<ShareVerdict> ShareValidator::validate(vector<ShareCheck> const& _shares)
+{
+	vector<ShareVerdict> verdicts(_shares.size(), ShareVerdict::Error);
+	if (_shares.empty())
+		return verdicts;
+
+	auto const start = steady_clock::now();
+	Batch batch;
+	batch.shares = &_shares;
+	batch.verdicts = &verdicts;
+	{
+		UniqueGuard l(x_queue);
+		m_queue.push_back(&batch);
+		m_queued.notify_all();
+		m_finished.wait(l, [&] { return batch.done == _shares.size(); });
+	}
+
+	uint64_t const us = duration_cast<microseconds>(steady_clock::now() - start).count();
+	m_batches++;
+	m_latencyUs += us;
+	uint64_t max = m_maxLatencyUs;
+	while (us > max && !m_maxLatencyUs.compare_exchange_weak(max, us))
+		;
+	return verdicts;
+}
+
+void ShareValidator::warm(uint64_t _height)
+{
+	if (_height / ETHASH_EPOCH_LENGTH >= (uint64_t)c_maxEpochs)
+		return;
+	int const epoch = (int)(_height / ETHASH_EPOCH_LENGTH);
+
+	Guard l(x_warm);
+	if (epoch <= m_warmedEpoch)
+		return;
+	m_warmedEpoch = epoch;
+	// Epochs are days apart, the previous build is long done.
+	if (m_warming.joinable())
+		m_warming.join();
+	m_warming = thread([epoch]() {
+		try
+		{
+			EthashAux::light(epoch);
+		}
+		catch (std::exception const& _e)
+		{
+			cwarn << "Cannot build the light cache of epoch " << epoch << ": " << _e.what();
+		}
+	});
+}
+
+void ShareValidator::workLoop()
+{
+	int epoch = -1;
+	EthashAux::LightType light;
+	uint64_t period = ~0ull;
+	ProgPow::program_t prog;
+
+	UniqueGuard l(x_queue);
+	while (true)
+	{
+		m_queued.wait(l, [&] { return m_stop || !m_queue.empty(); });
+		if (m_stop)
+			return;
+
+		Batch& b = *m_queue.front();
+		size_t const i = b.next++;
+		if (b.next >= b.shares->size())
+			m_queue.pop_front();	// nothing left to hand out, helpers move to the next batch
+		l.unlock();
+
+		ShareCheck const& s = (*b.shares)[i];
+		ShareVerdict v = ShareVerdict::Error;
+		try
+		{
+			int const e = s.epoch >= 0 ? s.epoch : (int)(s.height / ETHASH_EPOCH_LENGTH);
+			if (e >= c_maxEpochs)
+				BOOST_THROW_EXCEPTION(InvalidNumber());
+			if (e != epoch || !light)
+			{
+				light.reset();
+				light = EthashAux::light(e);
+				epoch = e;
+			}
+			uint64_t const p = (s.height + PROGPOW_BLOCK_OFFSET) / PROGPOW_PERIOD;
+			if (p != period)
+			{
+				prog = ProgPow::decode(s.height + PROGPOW_BLOCK_OFFSET);
+				period = p;
+			}
+
+			Result r = light->computeProgPow(prog, s.header, s.nonce);
+			if (r.mixHash != s.mixHash)
+				v = ShareVerdict::BadMix;
+			else if (upper64(r.value) >= upper64(s.boundary))
+				v = ShareVerdict::LowDifficulty;
+			else
+				v = ShareVerdict::Valid;
+		}
+		catch (...)
+		{
+			light.reset();
+			epoch = -1;
+		}
+
+		m_shares++;
+		switch (v)
+		{
+		case ShareVerdict::Valid: m_valid++; break;
+		case ShareVerdict::BadMix: m_badMix++; break;
+		case ShareVerdict::LowDifficulty: m_lowDifficulty++; break;
+		case ShareVerdict::Error: m_errors++; break;
+		}
+
+		l.lock();
+		(*b.verdicts)[i] = v;
+		if (++b.done == b.shares->size())
+			m_finished.notify_all();
+	}
+}
+
+ShareValidatorStats ShareValidator::stats() const
+{
+	ShareValidatorStats s;
+	s.shares = m_shares;
+	s.valid = m_valid;
+	s.badMix = m_badMix;
+	s.lowDifficulty = m_lowDifficulty;
+	s.errors = m_errors;
+	s.batches = m_batches;
+	s.latencyUs = m_latencyUs;
+	s.maxLatencyUs = m_maxLatencyUs;
+	s.uptimeMs = duration_cast<milliseconds>(steady_clock::now() - m_started).count();
+	return s;
+}
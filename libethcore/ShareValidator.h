@@ -0,0 +1,137 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ShareValidator.h
+ * Batch verification of submitted ProgPoW shares, for pools.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/Guards.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// One share as submitted by a miner.
+struct ShareCheck
+{
+	h256 header;
+	uint64_t nonce = 0;
+	uint64_t height = 0;
+	h256 mixHash;
+	h256 boundary;
+	/// Epoch of the light cache, -1 to derive it from the height.
+	int epoch = -1;
+};
+
+enum class ShareVerdict
+{
+	Valid,
+	BadMix,			///< The mix digest does not match the recomputed one.
+	LowDifficulty,	///< The result is not below the boundary.
+	Error			///< The share could not be evaluated.
+};
+
+char const* toString(ShareVerdict _v);
+
+struct ShareValidatorStats
+{
+	uint64_t shares = 0;
+	uint64_t valid = 0;
+	uint64_t badMix = 0;
+	uint64_t lowDifficulty = 0;
+	uint64_t errors = 0;
+	uint64_t batches = 0;
+	/// Sum and maximum of the time batches spent in validate().
+	uint64_t latencyUs = 0;
+	uint64_t maxLatencyUs = 0;
+	uint64_t uptimeMs = 0;
+
+	double sharesPerSecond() const { return uptimeMs ? shares * 1000.0 / uptimeMs : 0.0; }
+	double meanLatencyMs() const { return batches ? latencyUs / 1000.0 / batches : 0.0; }
+};
+
+/**
+ * @brief Verifies batches of shares on a pool of threads.
+ *
+ * Shares are evaluated in light mode through EthashAux, which keeps the light
+ * cache of each epoch and its DAG item cache for the life of the process. Each
+ * worker keeps the decoded program of the last period it saw, shares of a job
+ * all share one. Batches submitted concurrently are served in order, every
+ * worker helping with the oldest one first.
+ */
+class ShareValidator
+{
+public:
+	/// Starts @a _threads workers, 0 for one per hardware thread.
+	explicit ShareValidator(unsigned _threads = 0);
+	~ShareValidator();
+
+	/// Blocks until every share of @a _shares has its verdict, in the same order.
+	std::vector<ShareVerdict> validate(std::vector<ShareCheck> const& _shares);
+
+	/// Builds the light cache @a _height needs in the background, ahead of its first
+	/// share. Epochs already warmed or older return at once.
+	void warm(uint64_t _height);
+
+	ShareValidatorStats stats() const;
+	unsigned threads() const { return (unsigned)m_workers.size(); }
+
+private:
+	struct Batch
+	{
+		std::vector<ShareCheck> const* shares;
+		std::vector<ShareVerdict>* verdicts;
+		size_t next = 0;
+		size_t done = 0;
+	};
+
+	void workLoop();
+
+	std::vector<std::thread> m_workers;
+
+	Mutex x_queue;
+	Condition m_queued;
+	Condition m_finished;
+	std::deque<Batch*> m_queue;
+	bool m_stop = false;
+
+	Mutex x_warm;
+	std::thread m_warming;
+	int m_warmedEpoch = -1;
+
+	std::chrono::steady_clock::time_point const m_started = std::chrono::steady_clock::now();
+	std::atomic<uint64_t> m_shares = {0};
+	std::atomic<uint64_t> m_valid = {0};
+	std::atomic<uint64_t> m_badMix = {0};
+	std::atomic<uint64_t> m_lowDifficulty = {0};
+	std::atomic<uint64_t> m_errors = {0};
+	std::atomic<uint64_t> m_batches = {0};
+	std::atomic<uint64_t> m_latencyUs = {0};
+	std::atomic<uint64_t> m_maxLatencyUs = {0};
+};
+
+}
+}
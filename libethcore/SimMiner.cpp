@@ -0,0 +1,94 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file SimMiner.cpp
+ */
+
+#include "SimMiner.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+unsigned SimMiner::s_numInstances = 0;
+
+SimMiner::SimMiner(FarmFace& _farm, unsigned _index):
+	Miner("sim-", _farm, _index) {}
+
+SimMiner::~SimMiner()
+{
+	stopWorking();
+	kick_miner();
+}
+
+void SimMiner::kick_miner()
+{
+	{
+		Guard l(x_kick);
+		m_kick = true;
+	}
+	m_kicked.notify_one();
+}
+
+uint64_t SimMiner::expectedRate(unsigned _instances)
+{
+	double rate = 0;
+	for (unsigned i = 0; i < _instances; i++)
+		rate += c_batchSize * 1000.0 / (c_batchMs * (1 + i % 4));
+	return (uint64_t)rate;
+}
+
+void SimMiner::workLoop()
+{
+	chrono::milliseconds const batchTime(c_batchMs * (1 + index % 4));
+	h256 current;
+	shared_ptr<NonceCursor> nonces;
+
+	while (!shouldStop())
+	{
+		if (waitWhilePaused())
+			continue;
+
+		const WorkPackage w = work(nonces);
+		if (!w)
+		{
+			UniqueGuard l(x_kick);
+			m_kicked.wait_for(l, chrono::milliseconds(100), [&]() { return m_kick; });
+			m_kick = false;
+			continue;
+		}
+		if (w.header != current)
+		{
+			current = w.header;
+			traceSwitch("sim");
+		}
+
+		uint64_t start;
+		uint64_t const leased = leaseNonces(*nonces, c_batchSize, 1, start);
+		if (!leased)
+			continue;
+
+		// A kick for new work ends the batch early, the part done is reported.
+		auto const batchStart = chrono::steady_clock::now();
+		{
+			UniqueGuard l(x_kick);
+			m_kicked.wait_for(l, batchTime, [&]() { return m_kick; });
+			m_kick = false;
+		}
+		auto const took = chrono::steady_clock::now() - batchStart;
+		addHashCount(took >= batchTime ? leased : leased * took.count() / chrono::duration_cast<chrono::steady_clock::duration>(batchTime).count());
+	}
+}
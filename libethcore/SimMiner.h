@@ -0,0 +1,70 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file SimMiner.h
+ * Miners that hash nothing, to measure the farm around them.
+ */
+
+#pragma once
+
+#include <libdevcore/Guards.h>
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+
+/**
+ * @brief A miner that only pretends to search.
+ *
+ * Each batch leases its nonces like a device would and reports them as
+ * hashed after the batch time. Miners differ in speed, miner i takes
+ * 1 + i % 4 times the batch time of the fastest, to model mixed devices.
+ */
+class SimMiner: public Miner
+{
+public:
+	/// Nonces of a batch.
+	static const unsigned c_batchSize = 1 << 16;
+	/// Milliseconds a batch of the fastest miner takes.
+	static const unsigned c_batchMs = 10;
+
+	SimMiner(FarmFace& _farm, unsigned _index);
+	~SimMiner() override;
+
+	static unsigned instances() { return s_numInstances; }
+	/// Capped to MAX_MINERS.
+	static void setNumInstances(unsigned _instances) { s_numInstances = std::min<unsigned>(_instances, MAX_MINERS); }
+
+	/// Hashes per second all @a _instances miners report together.
+	static uint64_t expectedRate(unsigned _instances);
+
+protected:
+	void kick_miner() override;
+
+private:
+	void workLoop() override;
+
+	Mutex x_kick;
+	Condition m_kicked;
+	bool m_kick = false;
+
+	static unsigned s_numInstances;
+};
+
+}
+}
@@ -0,0 +1,101 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Watchdog.cpp
+ */
+
+#include "Watchdog.h"
+
+#include <algorithm>
+#include <libdevcore/Log.h>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+Watchdog::Watchdog(MinerControl& _control, WatchdogSettings const& _settings):
+	m_control(_control),
+	m_settings(_settings)
+{}
+
+void Watchdog::tick(chrono::steady_clock::time_point _now)
+{
+	vector<MinerHealth> const health = m_control.health();
+
+	// Decided under the lock, acted upon outside it: a restart can take a while.
+	vector<pair<unsigned, unsigned>> actions;
+	{
+		Guard l(x_devices);
+		m_devices.resize(health.size());
+		for (unsigned i = 0; i < health.size(); i++)
+		{
+			MinerHealth const& h = health[i];
+			WatchdogDevice& d = m_devices[i];
+			auto const stall = chrono::milliseconds(max<unsigned>(m_settings.minStallMs, (unsigned)(m_settings.factor * h.batchMs)));
+
+			if (h.idle || _now - h.lastProgress <= stall)
+			{
+				if (d.level && !h.idle)
+				{
+					d.recoveries++;
+					cnote << "Miner " + to_string(i) + " recovered";
+				}
+				d.level = 0;
+				continue;
+			}
+
+			// Give each step one stall time to take effect.
+			if (d.level && _now - d.escalated <= stall)
+				continue;
+
+			d.escalated = _now;
+			if (d.level == 0)
+			{
+				d.stalls++;
+				d.kicks++;
+				unsigned const silent = (unsigned)chrono::duration_cast<chrono::seconds>(_now - h.lastProgress).count();
+				cwarn << "Miner " + to_string(i) + " reported no hashes for " + to_string(silent) + " s, kicking it";
+			}
+			else if (d.level == 1)
+			{
+				d.reinits++;
+				cwarn << "Miner " + to_string(i) + " still stalled, reinitialising it";
+			}
+			else
+			{
+				d.restarts++;
+				cwarn << "Miner " + to_string(i) + " still stalled, restarting it";
+			}
+			d.level = min(d.level + 1, 3u);
+			actions.emplace_back(i, d.level);
+		}
+	}
+
+	for (auto const& a: actions)
+	{
+		if (a.second == 1)
+			m_control.kick(a.first);
+		else if (a.second == 2)
+			m_control.reinit(a.first);
+		else if (m_control.restart(a.first))
+		{
+			// A new miner starts a new count, otherwise retry after the next stall time.
+			Guard l(x_devices);
+			if (a.first < m_devices.size())
+				m_devices[a.first].level = 0;
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Watchdog.h
+ * Detection of stalled miners and their recovery.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <libdevcore/Guards.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// What the watchdog sees of one miner.
+struct MinerHealth
+{
+	std::chrono::steady_clock::time_point lastProgress;
+	float batchMs = 0;		///< Smoothed time between two hash reports, 0 before the first.
+	bool idle = false;		///< Paused, without work or in a phase without hash reports.
+};
+
+/// The miners the watchdog looks after and the actions it can take on them.
+class MinerControl
+{
+public:
+	virtual ~MinerControl() = default;
+
+	virtual std::vector<MinerHealth> health() const = 0;
+	/// Wakes miner @a _index out of a wait.
+	virtual void kick(unsigned _index) = 0;
+	/// Has miner @a _index rebuild its kernel and search state.
+	virtual void reinit(unsigned _index) = 0;
+	/// Replaces miner @a _index by a new one or starts doing so, false if that cannot be done now.
+	virtual bool restart(unsigned _index) = 0;
+};
+
+struct WatchdogSettings
+{
+	float factor = 20;			///< Stalled after this many batch times without hashes, 0 disables.
+	unsigned minStallMs = 15000;	///< Never stalled before this.
+
+	bool enabled() const { return factor > 0; }
+};
+
+/// What the watchdog did for one miner.
+struct WatchdogDevice
+{
+	unsigned level = 0;			///< 0 healthy, then 1 kicked, 2 reinitialised, 3 restarted.
+	unsigned stalls = 0;
+	unsigned kicks = 0;
+	unsigned reinits = 0;
+	unsigned restarts = 0;
+	unsigned recoveries = 0;	///< Stalls that ended without a restart.
+	std::chrono::steady_clock::time_point escalated;
+};
+
+/**
+ * @brief Escalates on miners that stopped reporting hashes.
+ *
+ * A miner is stalled when it reported no hashes for factor times its usual
+ * batch time, and never under minStallMs. Idle miners are left alone. A stalled
+ * miner is kicked; if it still is one stall time later it is reinitialised,
+ * then restarted on its own. Progress at any step ends the escalation.
+ */
+class Watchdog
+{
+public:
+	Watchdog(MinerControl& _control, WatchdogSettings const& _settings);
+
+	void tick(std::chrono::steady_clock::time_point _now);
+
+	WatchdogSettings const& settings() const { return m_settings; }
+	std::vector<WatchdogDevice> devices() const { Guard l(x_devices); return m_devices; }
+
+private:
+	MinerControl& m_control;
+	WatchdogSettings const m_settings;
+
+	mutable Mutex x_devices;
+	std::vector<WatchdogDevice> m_devices;
+};
+
+}
+}
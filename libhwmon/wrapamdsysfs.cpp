@@ -15,21 +15,18 @@
 #include <algorithm>
 #include <fstream>
 #include <sys/types.h>
-#include <regex>
+#include <chrono>
 #if defined(__linux)
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "wraphelper.h"
 #include "wrapamdsysfs.h"
 
-static bool getFileContentValue(const char* filename, unsigned int& value)
+static bool parseValue(const char* p, unsigned int& value)
 {
-	value = 0;
-	std::ifstream ifs(filename, std::ios::binary);
-	std::string line;
-	std::getline(ifs, line);
-	char* p = (char*)line.c_str();
 	char* p2;
 	errno = 0;
 	value = strtoul(p, &p2, 0);
@@ -38,16 +35,96 @@ static bool getFileContentValue(const char* filename, unsigned int& value)
 	return (p != p2);
 }
 
+static bool getFileContentValue(const char* filename, unsigned int& value)
+{
+	value = 0;
+	std::ifstream ifs(filename, std::ios::binary);
+	std::string line;
+	std::getline(ifs, line);
+	return parseValue(line.c_str(), value);
+}
+
+static long long nowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if defined(__linux)
+static int openFile(const char* filename)
+{
+	return open(filename, O_RDONLY | O_CLOEXEC);
+}
+
+/* Reads the whole of fd from offset 0 into the handle buffer, growing it when
+ * the file does not fit. sysfs and seq_file both regenerate the content on a
+ * read at offset 0, so the file stays open between polls. */
+static ssize_t readFile(wrap_amdsysfs_handle* sysfsh, int fd)
+{
+	if (fd < 0)
+		return -1;
+	while (true)
+	{
+		ssize_t n = pread(fd, sysfsh->buf, sysfsh->bufsize - 1, 0);
+		if (n < 0)
+			return -1;
+		if ((size_t)n < sysfsh->bufsize - 1)
+		{
+			sysfsh->buf[n] = 0;
+			return n;
+		}
+		char* buf = (char*)realloc(sysfsh->buf, sysfsh->bufsize * 2);
+		if (buf == NULL)
+			return -1;
+		sysfsh->buf = buf;
+		sysfsh->bufsize *= 2;
+	}
+}
+
+static bool readFileValue(wrap_amdsysfs_handle* sysfsh, int fd, unsigned int& value)
+{
+	value = 0;
+	return readFile(sysfsh, fd) > 0 && parseValue(sysfsh->buf, value);
+}
+
+/* Finds "<watts> W (average GPU)" in amdgpu_pm_info. */
+static bool parseAveragePower(const char* text, unsigned int& milliwatts)
+{
+	const char* unit = strstr(text, " W (average GPU)");
+	if (unit == NULL)
+		return false;
+	const char* p = unit;
+	while (p > text && (isdigit((unsigned char)p[-1]) || p[-1] == '.'))
+		p--;
+	if (p == unit)
+		return false;
+	milliwatts = (unsigned int)(atof(p) * 1000);
+	return true;
+}
+#endif
+
 wrap_amdsysfs_handle * wrap_amdsysfs_create()
+{
+	return wrap_amdsysfs_create_at("/sys");
+}
+
+wrap_amdsysfs_handle * wrap_amdsysfs_create_at(const char *root)
 {
 	wrap_amdsysfs_handle *sysfsh = NULL;
 
 #if defined(__linux)
 	sysfsh = (wrap_amdsysfs_handle *)calloc(1, sizeof(wrap_amdsysfs_handle));
-
-	DIR* dirp = opendir("/sys/class/drm");
-	if (dirp == nullptr)
+	sysfsh->sysfs_root = strdup(root);
+	sysfsh->bufsize = 4096;
+	sysfsh->buf = (char*)malloc(sysfsh->bufsize);
+
+	char dbuf[PATH_MAX];
+	snprintf(dbuf, sizeof(dbuf), "%s/class/drm", root);
+	DIR* dirp = opendir(dbuf);
+	if (dirp == nullptr) {
+		wrap_amdsysfs_destroy(sysfsh);
 		return NULL;
+	}
 
 	unsigned int gpucount = 0;
 	struct dirent* dire;
@@ -66,6 +143,7 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 	if (errno != 0)
 	{
 		closedir(dirp);
+		wrap_amdsysfs_destroy(sysfsh);
 		return NULL;
 	}
 	closedir(dirp);
@@ -74,14 +152,13 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 	sysfsh->sysfs_hwmon_id = (int*)calloc(gpucount, sizeof(int));
 
 	// filter AMD GPU cards and create mappings
-	char dbuf[120];
 	int cardIndex = 0;
 	for (unsigned int i = 0; i < gpucount; i++)
 	{
 		sysfsh->card_sysfs_device_id[cardIndex] = -1;
 		sysfsh->sysfs_hwmon_id[cardIndex] = -1;
 
-		snprintf(dbuf, 120, "/sys/class/drm/card%u/device/vendor", i);
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/vendor", root, i);
 		unsigned int vendorId = 0;
 		if (!getFileContentValue(dbuf, vendorId))
 			continue;
@@ -102,16 +179,16 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 
 		// Should not happen
 		if (sysfsIdx < 0) {
-			free(sysfsh);
+			wrap_amdsysfs_destroy(sysfsh);
 			return NULL;
 		}
 
 		// search hwmon
 		errno = 0;
-		snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon", sysfsIdx);
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/hwmon", root, sysfsIdx);
 		DIR* dirp = opendir(dbuf);
 		if (dirp == nullptr) {
-			free(sysfsh);
+			wrap_amdsysfs_destroy(sysfsh);
 			return NULL;
 		}
 		errno = 0;
@@ -132,25 +209,61 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 		if (errno != 0)
 		{
 			closedir(dirp);
-			free(sysfsh);
+			wrap_amdsysfs_destroy(sysfsh);
 			return NULL;
 		}
 		closedir(dirp);
 		if (hwmonIndex == UINT_MAX) {
-			free(sysfsh);
+			wrap_amdsysfs_destroy(sysfsh);
 			return NULL;
 		}
 
 		sysfsh->sysfs_hwmon_id[i] = hwmonIndex;
 	}
 
+	// Open the files polled for every card once, the fan range does not change
+	sysfsh->devices = (wrap_amdsysfs_device*)calloc(sysfsh->sysfs_gpucount, sizeof(wrap_amdsysfs_device));
+	for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+	{
+		wrap_amdsysfs_device* dev = &sysfsh->devices[i];
+		int gpuindex = sysfsh->card_sysfs_device_id[i];
+		int hwmonindex = sysfsh->sysfs_hwmon_id[i];
+
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/hwmon/hwmon%u/temp1_input",
+			root, gpuindex, hwmonindex);
+		dev->temp_fd = openFile(dbuf);
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/hwmon/hwmon%u/pwm1",
+			root, gpuindex, hwmonindex);
+		dev->pwm_fd = openFile(dbuf);
+
+		dev->pwm_max = 255;
+		dev->pwm_min = 0;
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/hwmon/hwmon%u/pwm1_max",
+			root, gpuindex, hwmonindex);
+		getFileContentValue(dbuf, dev->pwm_max);
+		snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/hwmon/hwmon%u/pwm1_min",
+			root, gpuindex, hwmonindex);
+		getFileContentValue(dbuf, dev->pwm_min);
+
+		// debugfs, usually only readable by root
+		snprintf(dbuf, sizeof(dbuf), "%s/kernel/debug/dri/%u/amdgpu_pm_info", root, gpuindex);
+		dev->pm_info_fd = openFile(dbuf);
+	}
+
 	sysfsh->opencl_gpucount = 0;
 	sysfsh->sysfs_opencl_device_id = (int*)calloc(sysfsh->sysfs_gpucount, sizeof(int));
 #if ETH_ETHASHCL
 	if (sysfsh->sysfs_gpucount > 0) {
 		//Get and count OpenCL devices.
 		std::vector<cl::Platform> platforms;
-		cl::Platform::get(&platforms);
+		try
+		{
+			cl::Platform::get(&platforms);
+		}
+		catch (cl::Error const&)
+		{
+			// No OpenCL platform, the cards stay unmapped
+		}
 		std::vector<cl::Device> platdevs;
 		for (unsigned p = 0; p < platforms.size(); p++) {
 			std::string platformName = platforms[p].getInfo<CL_PLATFORM_NAME>();
@@ -176,8 +289,7 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 					if (topology.raw.type == CL_DEVICE_TOPOLOGY_TYPE_PCIE_AMD) {
 
 						int gpuindex = sysfsh->card_sysfs_device_id[i];
-						char dbuf[120];
-						snprintf(dbuf, 120, "/sys/class/drm/card%u/device/uevent", gpuindex);
+						snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/uevent", root, gpuindex);
 						std::ifstream ifs(dbuf, std::ios::binary);
 						std::string line;
 						int iBus = 0, iDevice = 0, iFunction = 0;
@@ -230,10 +342,73 @@ wrap_amdsysfs_handle * wrap_amdsysfs_create()
 }
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle *sysfsh)
 {
+#if defined(__linux)
+	if (sysfsh->devices) {
+		for (int i = 0; i < sysfsh->sysfs_gpucount; i++) {
+			wrap_amdsysfs_device* dev = &sysfsh->devices[i];
+			if (dev->temp_fd >= 0)
+				close(dev->temp_fd);
+			if (dev->pwm_fd >= 0)
+				close(dev->pwm_fd);
+			if (dev->pm_info_fd >= 0)
+				close(dev->pm_info_fd);
+		}
+	}
+#endif
+	free(sysfsh->devices);
+	free(sysfsh->card_sysfs_device_id);
+	free(sysfsh->sysfs_hwmon_id);
+	free(sysfsh->sysfs_opencl_device_id);
+	free(sysfsh->opencl_sysfs_device_id);
+	free(sysfsh->sysfs_root);
+	free(sysfsh->buf);
 	free(sysfsh);
 	return 0;
 }
 
+int wrap_amdsysfs_refresh(wrap_amdsysfs_handle *sysfsh, int power)
+{
+#if defined(__linux)
+	for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+	{
+		wrap_amdsysfs_device* dev = &sysfsh->devices[i];
+
+		unsigned int temp = 0;
+		readFileValue(sysfsh, dev->temp_fd, temp);
+		if (temp > 0)
+			dev->tempC = temp / 1000;
+
+		unsigned int pwm = 0;
+		readFileValue(sysfsh, dev->pwm_fd, pwm);
+		if (dev->pwm_max > dev->pwm_min && pwm >= dev->pwm_min)
+			dev->fanpcnt = (unsigned int)(double(pwm - dev->pwm_min) / double(dev->pwm_max - dev->pwm_min) * 100.0);
+		else
+			dev->fanpcnt = 0;
+
+		if (power)
+			dev->power_valid = readFile(sysfsh, dev->pm_info_fd) > 0 &&
+				parseAveragePower(sysfsh->buf, dev->milliwatts);
+	}
+	sysfsh->refreshed_ms = nowMs();
+	if (power)
+		sysfsh->power_refreshed_ms = sysfsh->refreshed_ms;
+	return 0;
+#else
+	(void)sysfsh;
+	(void)power;
+	return -1;
+#endif
+}
+
+/* Refreshes all cards when the values asked for are stale. */
+static void refreshIfStale(wrap_amdsysfs_handle *sysfsh, bool power)
+{
+	long long now = nowMs();
+	long long last = power ? sysfsh->power_refreshed_ms : sysfsh->refreshed_ms;
+	if (last == 0 || now - last >= WRAP_AMDSYSFS_REFRESH_MS)
+		wrap_amdsysfs_refresh(sysfsh, power);
+}
+
 int wrap_amdsysfs_get_gpucount(wrap_amdsysfs_handle *sysfsh, int *gpucount)
 {
 	*gpucount = sysfsh->sysfs_gpucount;
@@ -246,8 +421,8 @@ int wrap_amdsysfs_get_gpu_pci_id(wrap_amdsysfs_handle *sysfsh, int index, char *
 	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/uevent", gpuindex);
+	char dbuf[PATH_MAX];
+	snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%u/device/uevent", sysfsh->sysfs_root, gpuindex);
 
 	std::ifstream ifs(dbuf, std::ios::binary);
 	std::string line;
@@ -270,19 +445,12 @@ int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle *sysfsh, int index, unsigned in
 	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-	if (hwmonindex < 0)
+	if (sysfsh->devices[index].temp_fd < 0)
 		return -1;
 
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/temp1_input",
-		gpuindex, hwmonindex);
-
-	unsigned int temp = 0;
-	getFileContentValue(dbuf, temp);
-
-	if (temp > 0)
-		*tempC = temp / 1000;
+	refreshIfStale(sysfsh, false);
+	if (sysfsh->devices[index].tempC > 0)
+		*tempC = sysfsh->devices[index].tempC;
 
 	return 0;
 }
@@ -293,26 +461,11 @@ int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle *sysfsh, int index, unsigned
 	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-	if (hwmonindex < 0)
+	if (sysfsh->devices[index].pwm_fd < 0)
 		return -1;
 
-	unsigned int pwm = 0, pwmMax = 255, pwmMin = 0;
-
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1",
-		gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwm);
-
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_max",
-		gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwmMax);
-
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_min",
-		gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwmMin);
-
-	*fanpcnt = (unsigned int)(double(pwm - pwmMin) / double(pwmMax - pwmMin) * 100.0);
+	refreshIfStale(sysfsh, false);
+	*fanpcnt = sysfsh->devices[index].fanpcnt;
 	return 0;
 }
 
@@ -322,25 +475,13 @@ int wrap_amdsysfs_get_power_usage(wrap_amdsysfs_handle *sysfsh, int index, unsig
 	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/kernel/debug/dri/%u/amdgpu_pm_info", gpuindex);
-
-	std::ifstream ifs(dbuf, std::ios::binary);
-	std::string line;
-
-	while (std::getline(ifs, line))
-	{
-		std::smatch sm;
-		std::regex regex(R"(([\d|\.]+) W \(average GPU\))");
-		if (std::regex_search(line, sm, regex)) {
-			if (sm.size() == 2) {
-				double watt = atof(sm.str(1).c_str());
-				*milliwatts = (unsigned int)(watt * 1000);
-				return 0;
-			}
-		}
+	if (sysfsh->devices[index].pm_info_fd < 0)
+		return -1;
 
-	}
+	refreshIfStale(sysfsh, true);
+	if (!sysfsh->devices[index].power_valid)
+		return -1;
 
-	return -1;
-}
\ No newline at end of file
+	*milliwatts = sysfsh->devices[index].milliwatts;
+	return 0;
+}
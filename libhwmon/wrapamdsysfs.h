@@ -6,6 +6,20 @@
 
 #pragma once
 
+#include <stddef.h>
+
+typedef struct {
+	int temp_fd;                /* hwmon temp1_input, -1 when absent */
+	int pwm_fd;                 /* hwmon pwm1, -1 when absent */
+	int pm_info_fd;             /* debugfs amdgpu_pm_info, -1 when not readable */
+	unsigned int pwm_min;
+	unsigned int pwm_max;
+	unsigned int tempC;         /* values of the last refresh */
+	unsigned int fanpcnt;
+	unsigned int milliwatts;
+	int power_valid;
+} wrap_amdsysfs_device;
+
 typedef struct {
 	int sysfs_gpucount;
 	int opencl_gpucount;
@@ -13,11 +27,27 @@ typedef struct {
 	int *sysfs_hwmon_id;        /* filesystem card idx to filesystem hwmon idx */
 	int *sysfs_opencl_device_id;          /* map ADL dev to OPENCL dev */
 	int *opencl_sysfs_device_id;          /* map OPENCL dev to ADL dev */
+	char *sysfs_root;                     /* "/sys", or a fake tree */
+	wrap_amdsysfs_device *devices;        /* open files and cached values per card */
+	char *buf;                            /* reused by every read */
+	size_t bufsize;
+	long long refreshed_ms;               /* time of the last refresh, 0 for never */
+	long long power_refreshed_ms;
 } wrap_amdsysfs_handle;
 
+/* Milliseconds the values of a refresh are served before the next one. */
+#define WRAP_AMDSYSFS_REFRESH_MS 250
+
 wrap_amdsysfs_handle * wrap_amdsysfs_create();
+/* Same as wrap_amdsysfs_create() on the tree under root instead of /sys. */
+wrap_amdsysfs_handle * wrap_amdsysfs_create_at(const char *root);
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle *sysfsh);
 
+/* Reads temperature and fan, and power when asked, of all cards in one pass.
+ * The getters below serve the values of the last refresh and only refresh
+ * by themselves once it is older than WRAP_AMDSYSFS_REFRESH_MS. */
+int wrap_amdsysfs_refresh(wrap_amdsysfs_handle *sysfsh, int power);
+
 int wrap_amdsysfs_get_gpucount(wrap_amdsysfs_handle *sysfsh, int *gpucount);
 
 int wrap_amdsysfs_get_gpu_pci_id(wrap_amdsysfs_handle *sysfsh, int index, char *idbuf, int bufsize);
@@ -0,0 +1,50 @@
+#include "JobMailbox.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+static bool sameJob(WorkPackage const& a, WorkPackage const& b)
+{
+	return a.header == b.header && a.startNonce == b.startNonce && a.exSizeBits == b.exSizeBits &&
+		a.boundary == b.boundary && a.epoch == b.epoch;
+}
+
+bool JobMailbox::post(WorkPackage const& wp)
+{
+	Guard l(x_slot);
+	m_stats.posted++;
+	if (m_latest && sameJob(wp, m_latest))
+	{
+		m_stats.dropped++;
+		return false;
+	}
+	if (m_full)
+		m_stats.coalesced++;
+	m_slot = wp;
+	m_latest = wp;
+	m_full = true;
+	if (m_woken)
+		return false;
+	m_woken = true;
+	return true;
+}
+
+bool JobMailbox::take(WorkPackage& o_wp)
+{
+	Guard l(x_slot);
+	m_woken = false;
+	if (!m_full)
+		return false;
+	o_wp = m_slot;
+	m_full = false;
+	m_stats.dispatched++;
+	return true;
+}
+
+void JobMailbox::clear()
+{
+	Guard l(x_slot);
+	m_full = false;
+	m_latest = WorkPackage();
+}
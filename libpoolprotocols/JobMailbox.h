@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <libdevcore/Guards.h>
+#include <libethcore/EthashAux.h>
+
+namespace dev
+{
+	namespace eth
+	{
+		/// What became of the jobs handed to a JobMailbox.
+		struct JobMailboxStats
+		{
+			uint64_t posted = 0;
+			uint64_t dispatched = 0;
+			uint64_t coalesced = 0;		///< Replaced by a newer job before the dispatcher took them.
+			uint64_t dropped = 0;		///< Repeats of the latest job.
+		};
+
+		/// Single slot between the pool client and the farm, the latest job wins. The client
+		/// posts from its network handler and goes on; the dispatcher takes whatever job
+		/// waits when it gets to run, so a burst of notifications makes one switch.
+		class JobMailbox
+		{
+		public:
+			/// Leaves @a wp for the dispatcher, true when it has to be woken for it.
+			bool post(WorkPackage const& wp);
+			/// Takes the waiting job, false if there is none.
+			bool take(WorkPackage& o_wp);
+			/// Drops the waiting job and forgets the latest one.
+			void clear();
+
+			JobMailboxStats stats() const { Guard l(x_slot); return m_stats; }
+
+		private:
+			mutable Mutex x_slot;
+			WorkPackage m_slot;
+			bool m_full = false;
+			bool m_woken = false;		///< The dispatcher is due to take the slot.
+			WorkPackage m_latest;		///< Last job posted, to drop repeats.
+			JobMailboxStats m_stats;
+		};
+	}
+}
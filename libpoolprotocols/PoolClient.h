@@ -42,6 +42,14 @@ namespace dev
 			void Address(boost::asio::ip::address address) { m_address = address; };
 			void Version(unsigned version) { m_version = version; };
 
+			bool operator==(PoolConnection const& other) const
+			{
+				return m_host == other.m_host && m_port == other.m_port && m_user == other.m_user &&
+					m_pass == other.m_pass && m_secLevel == other.m_secLevel && m_version == other.m_version &&
+					m_path == other.m_path;
+			};
+			bool operator!=(PoolConnection const& other) const { return !(*this == other); };
+
 		private:
 			// Normally we'd replace the following with a single URI variable
 			// But URI attributes are read only, and to support legacy parameters
@@ -70,11 +78,16 @@ namespace dev
 			virtual void disconnect() = 0;
 
 			virtual void submitHashrate(string const & rate) = 0;
-			virtual void submitSolution(Solution solution) = 0;
+			/// Submits @a solution as request @a _id, which its answer reports back.
+			virtual void submitSolution(Solution solution, unsigned _id) = 0;
 			virtual bool isConnected() = 0;
 
-			using SolutionAccepted = std::function<void(bool const&)>;
-			using SolutionRejected = std::function<void(bool const&)>;
+			/// Request ids from here on are submissions, those below the protocol's own.
+			static const unsigned c_firstSubmitId = 10;
+
+			/// Whether the solution went stale, and the id it was submitted with.
+			using SolutionAccepted = std::function<void(bool const&, unsigned)>;
+			using SolutionRejected = std::function<void(bool const&, unsigned)>;
 			using Disconnected = std::function<void()>;
 			using Connected = std::function<void()>;
 			using WorkReceived = std::function<void(WorkPackage const&)>;
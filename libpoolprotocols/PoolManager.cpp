@@ -5,6 +5,22 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
+struct PoolChannel: public LogChannel
+{
+	static const char* name() { return EthWhite " pm"; }
+	static const int verbosity = 3;
+	static const bool debug = false;
+};
+
+#define poollog clog(PoolChannel)
+
+const unsigned PoolManager::c_minDwellSeconds;
+
+static string poolKey(PoolConnection const& conn)
+{
+	return conn.Host() + ':' + to_string(conn.Port());
+}
+
 static string diffToDisplay(double diff)
 {
 	static const char* k[] = {"hashes", "kilohashes", "megahashes", "gigahashes", "terahashes", "petahashes"};
@@ -19,15 +35,19 @@ static string diffToDisplay(double diff)
 	return ss.str();
 }
 
-PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & minerType) : Worker("main"), m_farm(farm), m_minerType(minerType)
+PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & minerType) :
+	m_farm(farm),
+	m_minerType(minerType),
+	m_strand(EventLoop::service()),
+	m_hashrateTimer(EventLoop::service()),
+	m_reconnectTimer(EventLoop::service()),
+	m_probeTimer(EventLoop::service())
 {
 	p_client = client;
 
 	p_client->onConnected([&]()
 	{
-		stringstream ssPort;
-		ssPort << m_connections[m_activeConnectionIdx].Port();
-		cnote << "Connected to " << m_connections[m_activeConnectionIdx].Host() + ':' + ssPort.str();
+		cnote << "Connected to " << poolKey(activeConnection());
 		if (!m_farm.isMining())
 		{
 			cnote << "Spinning up miners...";
@@ -35,6 +55,8 @@ PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & mine
 				m_farm.start("opencl", false);
 			else if (m_minerType == MinerType::CUDA)
 				m_farm.start("cuda", false);
+			else if (m_minerType == MinerType::CPU)
+				m_farm.start("cpu", false);
 			else if (m_minerType == MinerType::Mixed) {
 				m_farm.start("cuda", false);
 				m_farm.start("opencl", true);
@@ -43,7 +65,23 @@ PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & mine
 	});
 	p_client->onDisconnected([&]()
 	{
-		cnote << "Disconnected from " + m_connections[m_activeConnectionIdx].Host();
+		cnote << "Disconnected from " + activeConnection().Host();
+		// The answers to its submissions will not come.
+		{
+			Guard l(x_submits);
+			m_submits.clear();
+		}
+		// The first job of the next connection goes through, repeat or not.
+		m_jobs.clear();
+
+		// Moving to another pool, the miners keep their DAGs and wait for its first job.
+		if (m_switching.exchange(false) && m_running) {
+			m_strand.post(m_handlers.wrap([this]() {
+				m_reconnectTry = 0;
+				p_client->connect();
+			}));
+			return;
+		}
 
 		if (m_farm.isMining()) {
 			cnote << "Shutting down miners...";
@@ -55,44 +93,45 @@ PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & mine
 	});
 	p_client->onWorkReceived([&](WorkPackage const& wp)
 	{
-		m_reconnectTry = 0;
-		m_farm.setWork(wp);
-		if (wp.boundary != m_lastBoundary)
-		{
-			using namespace boost::multiprecision;
-
-			m_lastBoundary = wp.boundary;
-			static const uint512_t dividend("0x10000000000000000000000000000000000000000000000000000000000000000");
-			const uint256_t divisor(string("0x") + m_lastBoundary.hex());
-			cnote << "New pool difficulty:" << EthWhite << diffToDisplay(double(dividend / divisor)) << EthReset;
-		}
-		cnote << "Received new job" << wp.header << "from " + m_connections[m_activeConnectionIdx].Host();
+		// The network handler goes on at once, the farm gets the newest job on the strand.
+		if (m_jobs.post(wp))
+			m_strand.post(m_handlers.wrap([this]() { dispatchJob(); }));
 	});
-	p_client->onSolutionAccepted([&](bool const& stale)
+	p_client->onSolutionAccepted([&](bool const& stale, unsigned id)
 	{
-		using namespace std::chrono;
-		auto ms = duration_cast<milliseconds>(steady_clock::now() - m_submit_time);
-		cnote << EthLime "**Accepted" EthReset << (stale ? " (stale)" : "") << " in" << ms.count() << "ms.";
+		int const ms = answered(id);
+		cnote << EthLime "**Accepted" EthReset << (stale ? " (stale)" : "") << (ms >= 0 ? " in " + to_string(ms) + " ms." : "");
+		recordShare(ms, true, stale);
 		m_farm.acceptedSolution(stale);
 	});
-	p_client->onSolutionRejected([&](bool const& stale)
+	p_client->onSolutionRejected([&](bool const& stale, unsigned id)
 	{
-		using namespace std::chrono;
-		auto ms = duration_cast<milliseconds>(steady_clock::now() - m_submit_time);
-		cwarn << EthRed "**Rejected" EthReset << (stale ? " (stale)" : "") << " in" << ms.count() << "ms.";
+		int const ms = answered(id);
+		cwarn << EthRed "**Rejected" EthReset << (stale ? " (stale)" : "") << (ms >= 0 ? " in " + to_string(ms) + " ms." : "");
+		recordShare(ms, false, stale);
 		m_farm.rejectedSolution(stale);
 	});
 
 	m_farm.onSolutionFound([&](Solution sol)
 	{
-		m_submit_time = std::chrono::steady_clock::now();
+		// Miner threads find solutions at once, each submission is timed on its own.
+		unsigned id;
+		{
+			Guard l(x_submits);
+			id = m_nextSubmitId++;
+			m_submits[id] = std::chrono::steady_clock::now();
+			// Getwork drops a solution the next one replaces before its poll.
+			if (m_submits.size() > c_maxSubmits)
+				m_submits.erase(m_submits.begin());
+		}
 
+		string const host = activeConnection().Host();
 		if (sol.stale)
-			cnote << string(EthYellow "Stale nonce 0x") + toHex(sol.nonce) + " submitted to " + m_connections[m_activeConnectionIdx].Host();
+			cnote << string(EthYellow "Stale nonce 0x") + toHex(sol.nonce) + " submitted to " + host;
 		else
-			cnote << string("Nonce 0x") + toHex(sol.nonce) + " submitted to " + m_connections[m_activeConnectionIdx].Host();
+			cnote << string("Nonce 0x") + toHex(sol.nonce) + " submitted to " + host;
 
-		p_client->submitSolution(sol);
+		p_client->submitSolution(sol, id);
 		return false;
 	});
 	m_farm.onMinerRestart([&]() {
@@ -109,6 +148,8 @@ PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & mine
 			m_farm.start("opencl", false);
 		else if (m_minerType == MinerType::CUDA)
 			m_farm.start("cuda", false);
+		else if (m_minerType == MinerType::CPU)
+			m_farm.start("cpu", false);
 		else if (m_minerType == MinerType::Mixed) {
 			m_farm.start("cuda", false);
 			m_farm.start("opencl", true);
@@ -116,11 +157,24 @@ PoolManager::PoolManager(PoolClient * client, Farm &farm, MinerType const & mine
 	});
 }
 
+PoolManager::~PoolManager()
+{
+	stop();
+	m_handlers.wait();
+}
+
 void PoolManager::stop()
 {
 	if (m_running) {
 		cnote << "Shutting down...";
 		m_running = false;
+		m_jobs.clear();
+		m_strand.post(m_handlers.wrap([this]() {
+			m_hashrateTimer.cancel();
+			m_reconnectTimer.cancel();
+			m_probeTimer.cancel();
+		}));
+		logPools();
 
 		if (p_client->isConnected())
 			p_client->disconnect();
@@ -133,22 +187,24 @@ void PoolManager::stop()
 	}
 }
 
-void PoolManager::workLoop()
+void PoolManager::scheduleHashrateReport()
 {
-	while (m_running)
-	{
-		this_thread::sleep_for(chrono::seconds(1));
-		m_hashrateReportingTimePassed++;
-		// Hashrate reporting
-		if (m_hashrateReportingTimePassed > m_hashrateReportingTime) {
-			auto mp = m_farm.miningProgress();
-			std::string h = toHex(toCompactBigEndian(mp.rate(), 1));
-			std::string res = h[0] != '0' ? h : h.substr(1);
-
-			p_client->submitHashrate("0x" + res);
-			m_hashrateReportingTimePassed = 0;
-		}
-	}
+	m_hashrateTimer.expires_from_now(boost::posix_time::seconds(m_hashrateReportingTime));
+	m_hashrateTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&PoolManager::reportHashrate, this, boost::asio::placeholders::error))));
+}
+
+void PoolManager::reportHashrate(const boost::system::error_code& ec)
+{
+	if (ec || !m_running)
+		return;
+
+	auto mp = m_farm.miningProgress();
+	std::string h = toHex(toCompactBigEndian(mp.rate(), 1));
+	std::string res = h[0] != '0' ? h : h.substr(1);
+
+	p_client->submitHashrate("0x" + res);
+	scheduleHashrateReport();
 }
 
 void PoolManager::addConnection(PoolConnection &conn)
@@ -156,9 +212,12 @@ void PoolManager::addConnection(PoolConnection &conn)
 	if (conn.Host().empty())
 		return;
 
-	m_connections.push_back(conn);
+	{
+		Guard l(x_connections);
+		m_connections.push_back(conn);
+	}
 
-	if (m_connections.size() == 1) {
+	if (connectionCount() == 1) {
 		p_client->setConnection(conn);
 		m_farm.set_pool_addresses(conn.Host(), conn.Port());
 	}
@@ -166,17 +225,234 @@ void PoolManager::addConnection(PoolConnection &conn)
 
 void PoolManager::clearConnections()
 {
-	m_connections.clear();
+	{
+		Guard l(x_connections);
+		m_connections.clear();
+	}
 	m_farm.set_pool_addresses("", 0);
 	if (p_client && p_client->isConnected())
 		p_client->disconnect();
 }
 
+void PoolManager::setConnections(std::vector<PoolConnection> const& connections)
+{
+	m_strand.post(m_handlers.wrap([this, connections]() {
+		std::vector<PoolConnection> pools;
+		for (PoolConnection const& conn : connections)
+			if (!conn.Host().empty())
+				pools.push_back(conn);
+		if (pools.empty()) {
+			cwarn << "Keeping the current pools, the new configuration has none";
+			return;
+		}
+
+		unsigned active = 0;
+		bool stay = false;
+		if (m_activeConnectionIdx < m_connections.size())
+			for (unsigned i = 0; i < pools.size() && !stay; i++)
+				if (pools[i] == m_connections[m_activeConnectionIdx]) {
+					active = i;
+					stay = true;
+				}
+
+		{
+			Guard l(x_connections);
+			m_connections = pools;
+			m_activeConnectionIdx = active;
+		}
+		if (stay)
+			return;
+
+		cnote << "Switching to " + m_connections[0].Host();
+		switchTo(0);
+	}));
+}
+
+void PoolManager::dispatchJob()
+{
+	WorkPackage wp;
+	if (!m_jobs.take(wp) || !m_running)
+		return;
+
+	m_reconnectTry = 0;
+	m_farm.setWork(wp);
+	if (wp.boundary != m_lastBoundary)
+	{
+		using namespace boost::multiprecision;
+
+		m_lastBoundary = wp.boundary;
+		static const uint512_t dividend("0x10000000000000000000000000000000000000000000000000000000000000000");
+		const uint256_t divisor(string("0x") + m_lastBoundary.hex());
+		cnote << "New pool difficulty:" << EthWhite << diffToDisplay(double(dividend / divisor)) << EthReset;
+	}
+	cnote << "Received new job" << wp.header << "from " + m_connections[m_activeConnectionIdx].Host();
+}
+
+PoolConnection PoolManager::activeConnection() const
+{
+	Guard l(x_connections);
+	return m_connections[m_activeConnectionIdx];
+}
+
+void PoolManager::switchTo(unsigned idx)
+{
+	// Jobs of the old pool still waiting are not worth a switch.
+	m_jobs.clear();
+	{
+		Guard l(x_connections);
+		m_activeConnectionIdx = idx;
+	}
+	m_reconnectTry = 0;
+	m_lastSwitch = std::chrono::steady_clock::now();
+	p_client->setConnection(m_connections[idx]);
+	m_farm.set_pool_addresses(m_connections[idx].Host(), m_connections[idx].Port());
+	if (m_running) {
+		m_switching = true;
+		p_client->disconnect();
+	}
+}
+
+void PoolManager::setProbing(unsigned interval, unsigned preferMs, bool subscribe)
+{
+	m_probeInterval = interval;
+	m_preferMs = preferMs;
+	m_probeSubscribe = subscribe;
+}
+
+int PoolManager::answered(unsigned id)
+{
+	using namespace std::chrono;
+	Guard l(x_submits);
+	auto const submit = m_submits.find(id);
+	if (submit == m_submits.end())
+		return -1;
+	int const ms = (int)duration_cast<milliseconds>(steady_clock::now() - submit->second).count();
+	m_submits.erase(submit);
+	return ms;
+}
+
+void PoolManager::recordShare(int ms, bool accepted, bool stale)
+{
+	string const key = poolKey(activeConnection());
+	Guard l(x_stats);
+	PoolStats& s = m_stats[key];
+	if (accepted)
+		s.accepted++;
+	else
+		s.rejected++;
+	if (stale)
+		s.stale++;
+	if (ms >= 0)
+		s.shareMs = s.timed++ ? s.shareMs * 0.8 + ms * 0.2 : ms;
+}
+
+void PoolManager::scheduleProbe()
+{
+	m_probeTimer.expires_from_now(boost::posix_time::seconds(m_probeInterval));
+	m_probeTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&PoolManager::probePools, this, boost::asio::placeholders::error))));
+}
+
+void PoolManager::probePools(const boost::system::error_code& ec)
+{
+	if (ec || !m_running)
+		return;
+
+	// The active pool is probed as well, its mining connection is no fair comparison.
+	m_probesPending = 0;
+	for (PoolConnection const& conn : m_connections) {
+		if (conn.Host() == "exit")
+			continue;
+		m_probesPending++;
+		string key = poolKey(conn);
+		PoolProbe::run(conn, m_probeSubscribe, m_strand.wrap(m_handlers.wrap(
+			[this, key](bool ok, int connectMs, int subscribeMs) {
+				{
+					Guard l(x_stats);
+					PoolStats& s = m_stats[key];
+					if (ok) {
+						s.probeMs = subscribeMs >= 0 ? connectMs + subscribeMs : connectMs;
+						s.probeFailures = 0;
+					}
+					else
+						s.probeFailures++;
+				}
+				if (--m_probesPending)
+					return;
+				logPools();
+				preferFastest();
+				if (m_running)
+					scheduleProbe();
+			})));
+	}
+	if (!m_probesPending)
+		scheduleProbe();
+}
+
+void PoolManager::preferFastest()
+{
+	if (!m_preferMs || !m_running || m_switching || !p_client->isConnected() ||
+		std::chrono::steady_clock::now() - m_lastSwitch < std::chrono::seconds(c_minDwellSeconds))
+		return;
+
+	// Healthy: answered the last probe and rejects under one share in ten.
+	auto healthy = [](PoolStats const& s) {
+		return s.probeMs >= 0 && !s.probeFailures && (s.accepted + s.rejected < 10 || s.rejected * 10 < s.accepted + s.rejected);
+	};
+
+	unsigned best = m_activeConnectionIdx;
+	int activeMs, bestMs;
+	{
+		Guard l(x_stats);
+		activeMs = bestMs = m_stats[poolKey(m_connections[best])].probeMs;
+		if (activeMs < 0)
+			return;
+		for (unsigned i = 0; i < m_connections.size(); i++) {
+			if (m_connections[i].Host() == "exit")
+				continue;
+			PoolStats const& s = m_stats[poolKey(m_connections[i])];
+			if (healthy(s) && s.probeMs + (int)m_preferMs < bestMs) {
+				best = i;
+				bestMs = s.probeMs;
+			}
+		}
+	}
+	if (best == m_activeConnectionIdx)
+		return;
+
+	cnote << "Moving to " + m_connections[best].Host() + ", probed in " + to_string(bestMs) + " ms against " +
+		to_string(activeMs) + " ms";
+	switchTo(best);
+}
+
+void PoolManager::logPools()
+{
+	Guard l(x_stats);
+	for (auto const& p : m_stats) {
+		PoolStats const& s = p.second;
+		stringstream ss;
+		ss << p.first << " probe " << (s.probeMs >= 0 ? to_string(s.probeMs) + " ms" : string("-"));
+		if (s.probeFailures)
+			ss << " (" << s.probeFailures << " failed)";
+		ss << ", shares " << s.accepted << " accepted " << s.rejected << " rejected " << s.stale << " stale";
+		if (s.timed)
+			ss << " in " << fixed << setprecision(0) << s.shareMs << " ms";
+		poollog << ss.str();
+	}
+	JobMailboxStats const j = m_jobs.stats();
+	poollog << "Jobs " << j.posted << " received, " << j.dispatched << " dispatched, " << j.coalesced << " coalesced, " << j.dropped << " repeated";
+}
+
 void PoolManager::start()
 {
-	if (m_connections.size() > 0) {
+	if (connectionCount() > 0) {
 		m_running = true;
-		startWorking();
+		m_lastSwitch = std::chrono::steady_clock::now();
+		m_strand.post(m_handlers.wrap([this]() {
+			scheduleHashrateReport();
+			if (m_probeInterval)
+				scheduleProbe();
+		}));
 
 		// Try to connect to pool
 		p_client->connect();
@@ -189,14 +465,25 @@ void PoolManager::start()
 void PoolManager::tryReconnect()
 {
 	// No connections available, so why bother trying to reconnect
-	if (m_connections.size() <= 0) {
+	if (connectionCount() <= 0) {
 		cwarn << "Manager has no connections defined!";
 		return;
 	}
 
-	for (auto i = 4; --i; this_thread::sleep_for(chrono::seconds(1))) {
-		cnote << "Retrying in " << i << "... \r";
-	}
+	// The client calls in from its own handlers, wait on the manager strand
+	// instead of holding up the loop.
+	cnote << "Retrying in 3 seconds...";
+	m_strand.post(m_handlers.wrap([this]() {
+		m_reconnectTimer.expires_from_now(boost::posix_time::seconds(3));
+		m_reconnectTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+			boost::bind(&PoolManager::reconnect, this, boost::asio::placeholders::error))));
+	}));
+}
+
+void PoolManager::reconnect(const boost::system::error_code& ec)
+{
+	if (ec || !m_running)
+		return;
 
 	// We do not need awesome logic here, we just have one connection anyway
 	if (m_connections.size() == 1) {
@@ -212,9 +499,12 @@ void PoolManager::tryReconnect()
 	}
 	else {
 		m_reconnectTry = 0;
-		m_activeConnectionIdx++;
-		if (m_activeConnectionIdx >= m_connections.size()) {
-			m_activeConnectionIdx = 0;
+		{
+			Guard l(x_connections);
+			m_activeConnectionIdx++;
+			if (m_activeConnectionIdx >= m_connections.size()) {
+				m_activeConnectionIdx = 0;
+			}
 		}
 		if (m_connections[m_activeConnectionIdx].Host() == "exit") {
 			dev::setThreadName("main");
@@ -1,11 +1,14 @@
 #pragma once
 
 #include <iostream>
-#include <libdevcore/Worker.h>
+#include <boost/asio.hpp>
+#include <libdevcore/EventLoop.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
+#include "JobMailbox.h"
 #include "PoolClient.h"
+#include "PoolProbe.h"
 #if ETH_DBUS
 #include "DBusInt.h"
 #endif
@@ -16,35 +19,92 @@ namespace dev
 {
 	namespace eth
 	{
-		class PoolManager : public Worker
+		/// Share and probe figures of one pool.
+		struct PoolStats
+		{
+			double shareMs = 0;			///< Rolling submit to answer time of its shares.
+			unsigned accepted = 0;
+			unsigned rejected = 0;
+			unsigned stale = 0;
+			unsigned timed = 0;			///< Shares shareMs averages.
+			int probeMs = -1;			///< Last probe round trip, -1 before one succeeded.
+			unsigned probeFailures = 0;	///< Probes failed in a row.
+		};
+
+		class PoolManager
 		{
 		public:
 			PoolManager(PoolClient * client, Farm &farm, MinerType const & minerType);
+			~PoolManager();
 			void addConnection(PoolConnection &conn);
 			void clearConnections();
+			/// Replaces the pool list, staying on the active pool if it is still listed and
+			/// switching without stopping the miners otherwise.
+			void setConnections(std::vector<PoolConnection> const& connections);
 			void start();
 			void stop();
 			void setReconnectTries(unsigned const & reconnectTries) { m_reconnectTries = reconnectTries; };
+			/// Probes every pool each @a interval seconds, 0 disables. With @a preferMs above 0 the
+			/// manager moves to a healthy pool answering probes that many ms faster than the active one.
+			/// @a subscribe times a stratum subscribe after the connect.
+			void setProbing(unsigned interval, unsigned preferMs, bool subscribe);
 			bool isConnected() { return p_client->isConnected(); };
 			bool isRunning() { return m_running; };
 
 		private:
 			unsigned m_hashrateReportingTime = 60;
-			unsigned m_hashrateReportingTimePassed = 0;
 
-			bool m_running = false;
-			void workLoop() override;
+			std::atomic<bool> m_running = {false};
+			std::atomic<bool> m_switching = {false};
+			void switchTo(unsigned idx);
+			/// Hands the newest job to the farm, on the strand.
+			void dispatchJob();
+			JobMailbox m_jobs;
+			void scheduleHashrateReport();
+			void reportHashrate(const boost::system::error_code& ec);
 			unsigned m_reconnectTries = 3;
 			unsigned m_reconnectTry = 0;
+			/// Changed on the strand only, readers elsewhere go through activeConnection().
+			mutable Mutex x_connections;
 			std::vector <PoolConnection> m_connections;
 			unsigned m_activeConnectionIdx = 0;
+			PoolConnection activeConnection() const;
+			size_t connectionCount() const { Guard l(x_connections); return m_connections.size(); }
 			h256 m_lastBoundary = h256();
 
 			PoolClient *p_client;
 			Farm &m_farm;
 			MinerType m_minerType;
-			std::chrono::steady_clock::time_point m_submit_time;
+			/// Submissions awaiting an answer by request id, with their time, for the share latency.
+			Mutex x_submits;
+			std::map<unsigned, std::chrono::steady_clock::time_point> m_submits;
+			unsigned m_nextSubmitId = PoolClient::c_firstSubmitId;
+			static const size_t c_maxSubmits = 64;
+			/// Milliseconds since submission @a id went out, -1 if it is unknown.
+			int answered(unsigned id);
 			void tryReconnect();
+			void reconnect(const boost::system::error_code& ec);
+
+			/// Shortest time between two moves to a faster pool.
+			static const unsigned c_minDwellSeconds = 300;
+			void recordShare(int ms, bool accepted, bool stale);
+			void scheduleProbe();
+			void probePools(const boost::system::error_code& ec);
+			void preferFastest();
+			void logPools();
+			unsigned m_probeInterval = 0;
+			unsigned m_preferMs = 0;
+			bool m_probeSubscribe = false;
+			unsigned m_probesPending = 0;
+			std::chrono::steady_clock::time_point m_lastSwitch;
+			mutable Mutex x_stats;
+			std::map<std::string, PoolStats> m_stats;	///< By host:port, kept across reloads.
+
+			boost::asio::io_service::strand m_strand;
+			boost::asio::deadline_timer m_hashrateTimer;
+			boost::asio::deadline_timer m_reconnectTimer;
+			boost::asio::deadline_timer m_probeTimer;
+			PendingHandlers m_handlers;
 		};
 	}
 }
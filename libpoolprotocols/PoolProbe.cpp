@@ -0,0 +1,126 @@
+#include "PoolProbe.h"
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+using boost::asio::ip::tcp;
+
+const unsigned PoolProbe::c_timeoutMs;
+
+static int millisSince(chrono::steady_clock::time_point start)
+{
+	return (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+PoolProbe::PoolProbe(PoolConnection const& conn, bool subscribe, Done const& done) :
+	m_conn(conn),
+	m_subscribe(subscribe),
+	m_done(done),
+	m_strand(EventLoop::service()),
+	m_resolver(EventLoop::service()),
+	m_socket(EventLoop::service()),
+	m_timer(EventLoop::service())
+{
+}
+
+void PoolProbe::run(PoolConnection const& conn, bool subscribe, Done const& done)
+{
+	shared_ptr<PoolProbe> probe(new PoolProbe(conn, subscribe, done));
+	probe->m_strand.post(boost::bind(&PoolProbe::start, probe));
+}
+
+void PoolProbe::start()
+{
+	auto self = shared_from_this();
+	m_started = chrono::steady_clock::now();
+	m_timer.expires_from_now(boost::posix_time::milliseconds(c_timeoutMs));
+	m_timer.async_wait(m_strand.wrap([self](const boost::system::error_code& ec) {
+		if (!ec)
+			self->finish(false);
+	}));
+
+	tcp::resolver::query q(m_conn.Host(), to_string(m_conn.Port()));
+	m_resolver.async_resolve(q, m_strand.wrap(boost::bind(&PoolProbe::resolved, self,
+		boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+}
+
+void PoolProbe::resolved(const boost::system::error_code& ec, tcp::resolver::iterator i)
+{
+	if (m_finished)
+		return;
+	if (ec)
+	{
+		finish(false);
+		return;
+	}
+	// Name resolution is cached by the mining connection, time the connect alone.
+	m_started = chrono::steady_clock::now();
+	boost::asio::async_connect(m_socket, i, m_strand.wrap(boost::bind(&PoolProbe::connected, shared_from_this(),
+		boost::asio::placeholders::error)));
+}
+
+void PoolProbe::connected(const boost::system::error_code& ec)
+{
+	if (m_finished)
+		return;
+	if (ec)
+	{
+		finish(false);
+		return;
+	}
+	m_connectMs = millisSince(m_started);
+
+	// Secure pools would take a handshake first, their connect time stands for the round trip.
+	if (!m_subscribe || m_conn.SecLevel() != SecureLevel::NONE)
+	{
+		finish(true);
+		return;
+	}
+
+	// Any answer does, an error from a pool expecting another dialect included.
+	ostream os(&m_request);
+	os << "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": []}\n";
+	m_started = chrono::steady_clock::now();
+	auto self = shared_from_this();
+	boost::asio::async_write(m_socket, m_request, m_strand.wrap([self](const boost::system::error_code& ec, size_t) {
+		if (self->m_finished)
+			return;
+		if (ec)
+		{
+			self->finish(false);
+			return;
+		}
+		boost::asio::async_read_until(self->m_socket, self->m_response, "\n", self->m_strand.wrap(
+			boost::bind(&PoolProbe::answered, self, boost::asio::placeholders::error)));
+	}));
+}
+
+void PoolProbe::answered(const boost::system::error_code& ec)
+{
+	if (m_finished)
+		return;
+	if (ec)
+	{
+		finish(false);
+		return;
+	}
+	m_subscribeMs = millisSince(m_started);
+	finish(true);
+}
+
+void PoolProbe::finish(bool ok)
+{
+	if (m_finished)
+		return;
+	m_finished = true;
+
+	boost::system::error_code ec;
+	m_timer.cancel(ec);
+	m_resolver.cancel();
+	m_socket.close(ec);
+
+	Done done;
+	done.swap(m_done);
+	done(ok, m_connectMs, m_subscribeMs);
+}
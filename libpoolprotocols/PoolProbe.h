@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+#include <libdevcore/EventLoop.h>
+
+#include "PoolClient.h"
+
+namespace dev
+{
+	namespace eth
+	{
+		/// Times a TCP connect to a pool and, for plain stratum, the answer to a
+		/// mining.subscribe, on a connection of its own beside the mining one.
+		class PoolProbe : public std::enable_shared_from_this<PoolProbe>
+		{
+		public:
+			/// Times in ms, -1 when not measured; @a ok is false when the pool did not answer in time.
+			using Done = std::function<void(bool ok, int connectMs, int subscribeMs)>;
+
+			static const unsigned c_timeoutMs = 5000;
+
+			/// Probes @a conn on the event loop and calls @a done once.
+			static void run(PoolConnection const& conn, bool subscribe, Done const& done);
+
+		private:
+			PoolProbe(PoolConnection const& conn, bool subscribe, Done const& done);
+
+			void start();
+			void resolved(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
+			void connected(const boost::system::error_code& ec);
+			void answered(const boost::system::error_code& ec);
+			void finish(bool ok);
+
+			PoolConnection m_conn;
+			bool m_subscribe;
+			Done m_done;
+			bool m_finished = false;
+			int m_connectMs = -1;
+			int m_subscribeMs = -1;
+			std::chrono::steady_clock::time_point m_started;
+
+			boost::asio::io_service::strand m_strand;
+			boost::asio::ip::tcp::resolver m_resolver;
+			boost::asio::ip::tcp::socket m_socket;
+			boost::asio::deadline_timer m_timer;
+			boost::asio::streambuf m_request;
+			boost::asio::streambuf m_response;
+		};
+	}
+}
@@ -2,7 +2,8 @@
 
 #include <jsonrpccpp/client/connectors/httpclient.h>
 #include <iostream>
-#include <libdevcore/Worker.h>
+#include <boost/asio.hpp>
+#include <libdevcore/EventLoop.h>
 #include "jsonrpc_getwork.h"
 #include "../PoolClient.h"
 
@@ -10,7 +11,7 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
-class EthGetworkClient : public PoolClient, Worker
+class EthGetworkClient : public PoolClient
 {
 public:
 	EthGetworkClient(unsigned const & farmRecheckPeriod);
@@ -22,16 +23,23 @@ public:
 	bool isConnected() override { return m_connected; }
 
 	void submitHashrate(string const & rate) override;
-	void submitSolution(Solution solution) override;
+	void submitSolution(Solution solution, unsigned _id) override;
 
 private:
-	void workLoop() override;
+	void schedulePoll();
+	void poll(const boost::system::error_code& ec);
 	unsigned m_farmRecheckPeriod = 500;
 
 	string m_currentHashrateToSubmit = "";
 	Solution m_solutionToSubmit;
+	unsigned m_solutionId = 0;
 	bool m_justConnected = false;
 	h256 m_client_id;
 	JsonrpcGetwork *p_client;
 	WorkPackage m_prevWorkPackage;
+
+	/// Polls run on this strand of the shared loop, paced by the timer.
+	boost::asio::io_service::strand m_strand;
+	boost::asio::deadline_timer m_pollTimer;
+	PendingHandlers m_handlers;
 };
@@ -33,12 +33,14 @@ static void diffToTarget(uint32_t *target, double diff)
 
 
 EthStratumClient::EthStratumClient(int const & worktimeout, string const & email, bool const & submitHashrate) : PoolClient(),
-        m_socket(nullptr),
-	m_worktimer(m_io_service),
-	m_responsetimer(m_io_service),
-	m_hashrate_event(m_io_service),
-        m_resolver(m_io_service)
+	m_strand(EventLoop::service()),
+	m_socket(nullptr),
+	m_worktimer(EventLoop::service()),
+	m_responsetimer(EventLoop::service()),
+	m_hashrate_event(EventLoop::service()),
+	m_resolver(EventLoop::service())
 {
+	profileLock(x_pending, "EthStratumClient::x_pending");
 	m_authorized = false;
 	m_pending = 0;
 	m_worktimeout = worktimeout;
@@ -51,16 +53,22 @@ EthStratumClient::EthStratumClient(int const & worktimeout, string const & email
 
 EthStratumClient::~EthStratumClient()
 {
-	m_io_service.stop();
-	m_serviceThread.join();
+	m_strand.post(m_handlers.wrap([this]() { closeSocket(); }));
+	m_handlers.wait();
 }
 
 void EthStratumClient::connect()
+{
+	m_strand.dispatch(m_handlers.wrap([this]() { startConnect(); }));
+}
+
+void EthStratumClient::startConnect()
 {
 	m_connection = m_conn;
 
 	m_authorized = false;
 	m_connected.store(false, std::memory_order_relaxed);
+	m_phaseStarted = std::chrono::steady_clock::now();
 
 	stringstream ssPort;
 	ssPort << m_connection.Port();
@@ -75,7 +83,7 @@ void EthStratumClient::connect()
 			method = boost::asio::ssl::context::tlsv12;
 
 		boost::asio::ssl::context ctx(method);
-		m_securesocket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket> >(m_io_service, ctx);
+		m_securesocket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket> >(EventLoop::service(), ctx);
 		m_socket = &m_securesocket->next_layer();
 
 		if (m_connection.SecLevel() != SecureLevel::ALLOW_SELFSIGNED) {
@@ -117,7 +125,7 @@ void EthStratumClient::connect()
 		}
 	}
 	else {
-	  m_nonsecuresocket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
+	  m_nonsecuresocket = std::make_shared<boost::asio::ip::tcp::socket>(EventLoop::service());
 	  m_socket = m_nonsecuresocket.get();
 	}
 
@@ -136,71 +144,66 @@ void EthStratumClient::connect()
 	setsockopt(m_socket->native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 #endif
 
-	m_resolver.async_resolve(q, boost::bind(&EthStratumClient::resolve_handler,
+	m_resolver.async_resolve(q, m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::resolve_handler,
 		this, boost::asio::placeholders::error,
-		boost::asio::placeholders::iterator));
-
-    if (m_serviceThread.joinable())
-	{
-		// If the service thread have been created try to reset the service.
-		m_io_service.reset();
-	}
-	else
-	{
-		// Otherwise, if the first time here, create new thread.
-		m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
-	}
+		boost::asio::placeholders::iterator))));
 }
 
 #define BOOST_ASIO_ENABLE_CANCELIO 
 
 void EthStratumClient::disconnect()
+{
+	m_strand.dispatch(m_handlers.wrap([this]() {
+		closeSocket();
+
+		m_authorized = false;
+		m_connected.store(false, std::memory_order_relaxed);
+
+		if (m_onDisconnected) {
+			m_onDisconnected();
+		}
+	}));
+}
+
+void EthStratumClient::closeSocket()
 {
 	m_worktimer.cancel();
 	m_responsetimer.cancel();
+	m_hashrate_event.cancel();
+	m_resolver.cancel();
 	m_response_pending = false;
+	m_submits.clear();
 	m_linkdown = true;
 
+	// Closing aborts the pending operations, their handlers still run on the
+	// strand, so the sockets stay alive until the next connect replaces them.
 	try {
-		if (m_connection.SecLevel() != SecureLevel::NONE) {
+		if (m_securesocket) {
 			boost::system::error_code sec;
 			m_securesocket->shutdown(sec);
 		}
 
-		m_socket->close();
-		m_io_service.stop();
+		if (m_socket)
+			m_socket->close();
 	}
 	catch (std::exception const& _e) {
 		cwarn << "Error while disconnecting:" << _e.what();
 	}
-
-        if (m_connection.SecLevel() != SecureLevel::NONE) {
-                if (m_securesocket)
-                        m_securesocket = nullptr;
-        }
-        else {
-                if (m_socket)
-                        m_socket = nullptr;
-        }
-
-	m_authorized = false;
-	m_connected.store(false, std::memory_order_relaxed);
-
-	if (m_onDisconnected) {
-		m_onDisconnected();
-	}
 }
 
 void EthStratumClient::resolve_handler(const boost::system::error_code& ec, tcp::resolver::iterator i)
 {
 	dev::setThreadName("stratum");
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+	tracePhase("resolve");
 	if (!ec)
 	{
 		//cnote << "Connecting to stratum server " + m_connection.Host() + ":" + m_connection.Port();
 		tcp::resolver::iterator end;
-		async_connect(*m_socket, i, end, boost::bind(&EthStratumClient::connect_handler,
+		async_connect(*m_socket, i, end, m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::connect_handler,
 						this, boost::asio::placeholders::error,
-						boost::asio::placeholders::iterator));
+						boost::asio::placeholders::iterator))));
 	}
 	else
 	{
@@ -211,24 +214,32 @@ void EthStratumClient::resolve_handler(const boost::system::error_code& ec, tcp:
 	}
 }
 
+void EthStratumClient::tracePhase(char const* _name)
+{
+	auto now = std::chrono::steady_clock::now();
+	Trace::complete(_name, "pool", m_phaseStarted, now, TraceArgs().add("host", m_connection.Host()));
+	m_phaseStarted = now;
+}
+
 void EthStratumClient::reset_work_timeout()
 {
 	m_worktimer.cancel();
 	m_worktimer.expires_from_now(boost::posix_time::seconds(m_worktimeout));
-	m_worktimer.async_wait(boost::bind(&EthStratumClient::work_timeout_handler, this, boost::asio::placeholders::error));
+	m_worktimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&EthStratumClient::work_timeout_handler, this, boost::asio::placeholders::error))));
 }
 
 void EthStratumClient::async_write_with_response()
 {
 	if (m_connection.SecLevel() != SecureLevel::NONE) {
 		async_write(*m_securesocket, m_requestBuffer,
-			boost::bind(&EthStratumClient::handleResponse, this,
-				boost::asio::placeholders::error));
+			m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::handleResponse, this,
+				boost::asio::placeholders::error))));
 	}
 	else {
 		async_write(*m_nonsecuresocket, m_requestBuffer,
-			boost::bind(&EthStratumClient::handleResponse, this,
-				boost::asio::placeholders::error));
+			m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::handleResponse, this,
+				boost::asio::placeholders::error))));
 	}
 }
 
@@ -237,7 +248,10 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec, tcp:
 	(void)i;
 
 	dev::setThreadName("stratum");
-	
+
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+	tracePhase("connect");
 	if (!ec)
 	{
 		m_connected.store(true, std::memory_order_relaxed);
@@ -322,13 +336,13 @@ void EthStratumClient::readline() {
 	if (m_pending == 0) {
 		if (m_connection.SecLevel() != SecureLevel::NONE) {
 			async_read_until(*m_securesocket, m_responseBuffer, "\n",
-				boost::bind(&EthStratumClient::readResponse, this,
-					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+				m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::readResponse, this,
+					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))));
 		}
 		else {
 			async_read_until(*m_socket, m_responseBuffer, "\n",
-				boost::bind(&EthStratumClient::readResponse, this,
-					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+				m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::readResponse, this,
+					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred))));
 		}
 	
 		m_pending++;
@@ -346,7 +360,7 @@ void EthStratumClient::handleResponse(const boost::system::error_code& ec) {
 	{
 		readline();
 	}
-	else
+	else if (ec != boost::asio::error::operation_aborted)
 	{
 		dev::setThreadName("stratum");
 		cwarn << "Handle response failed: " + ec.message();
@@ -415,9 +429,35 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 	std::ostream os(&m_requestBuffer);
 	Json::Value params;
 	int id = responseObject.get("id", Json::Value::null).asInt();
+	if (id >= (int)c_firstSubmitId)
+	{
+		// The answer to a submission, which may come after those of later ones.
+		auto const submit = m_submits.find(id);
+		if (submit == m_submits.end())
+			return;
+		bool const stale = submit->second;
+		m_submits.erase(submit);
+		if (m_submits.empty())
+		{
+			m_responsetimer.cancel();
+			m_response_pending = false;
+		}
+		if (responseObject.get("result", false).asBool()) {
+			if (m_onSolutionAccepted) {
+				m_onSolutionAccepted(stale, id);
+			}
+		}
+		else {
+			if (m_onSolutionRejected) {
+				m_onSolutionRejected(stale, id);
+			}
+		}
+		return;
+	}
 	switch (id)
 	{
 		case 1:
+		tracePhase("subscribe");
 		if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM)
 		{
 			m_nextWorkDifficulty = 1;
@@ -448,6 +488,7 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 		// nothing to do...
 		break;
 	case 3:
+		tracePhase("authorize");
 		m_authorized = responseObject.get("result", Json::Value::null).asBool();
 		if (!m_authorized)
 		{
@@ -457,22 +498,6 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 		}
 		cnote << "Authorized worker " + m_connection.User();
 		break;
-	case 4:
-		{
-			m_responsetimer.cancel();
-			m_response_pending = false;
-			if (responseObject.get("result", false).asBool()) {
-				if (m_onSolutionAccepted) {
-					m_onSolutionAccepted(m_stale);
-				}
-			}
-			else {
-				if (m_onSolutionRejected) {
-					m_onSolutionRejected(m_stale);
-				}
-			}
-		}
-		break;
 	default:
 		string method, workattr;
 		unsigned index;
@@ -491,12 +516,13 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 
 		if (method == "mining.notify")
 		{
+			TraceSpan span("notify", "pool");
 			params = responseObject.get(workattr.c_str(), Json::Value::null);
 			if (params.isArray())
 			{
 				string job = params.get((Json::Value::ArrayIndex)0, "").asString();
-				if (m_response_pending)
-					m_stale = true;
+				for (auto& s: m_submits)
+					s.second = true;
 				if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM)
 				{
 					string sSeedHash = params.get(1, "").asString();
@@ -601,10 +627,10 @@ void EthStratumClient::hashrate_event_handler(const boost::system::error_code& e
 
 	if (m_connection.SecLevel() != SecureLevel::NONE)
 		async_write(*m_securesocket, m_requestBuffer,
-			boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error));
+			m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error))));
 	else
 		async_write(*m_nonsecuresocket, m_requestBuffer,
-			boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error));
+			m_strand.wrap(m_handlers.wrap(boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error))));
 }
 
 void EthStratumClient::work_timeout_handler(const boost::system::error_code& ec) {
@@ -622,6 +648,10 @@ void EthStratumClient::response_timeout_handler(const boost::system::error_code&
 }
 
 void EthStratumClient::submitHashrate(string const & rate) {
+	m_strand.dispatch(m_handlers.wrap([this, rate]() { sendHashrate(rate); }));
+}
+
+void EthStratumClient::sendHashrate(string const & rate) {
 	if (!m_submit_hashrate || m_linkdown) {
 		return;
 	}
@@ -629,43 +659,55 @@ void EthStratumClient::submitHashrate(string const & rate) {
 	m_rate = rate;
 	m_hashrate_event.cancel();
 	m_hashrate_event.expires_from_now(boost::posix_time::milliseconds(100));
-	m_hashrate_event.async_wait(boost::bind(&EthStratumClient::hashrate_event_handler, this, boost::asio::placeholders::error));
+	m_hashrate_event.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&EthStratumClient::hashrate_event_handler, this, boost::asio::placeholders::error))));
 }
 
-void EthStratumClient::submitSolution(Solution solution) {
+void EthStratumClient::submitSolution(Solution solution, unsigned _id) {
+	m_strand.dispatch(m_handlers.wrap([this, solution, _id]() { sendSolution(solution, _id); }));
+}
+
+void EthStratumClient::sendSolution(Solution const& solution, unsigned _id) {
 
 	string nonceHex = toHex(solution.nonce);
+	string const id = to_string(_id);
 	string json;
 
 	m_responsetimer.cancel();
 
 	switch (m_connection.Version()) {
 		case EthStratumClient::STRATUM:
-			json = "{\"id\": 4, \"method\": \"mining.submit\", \"params\": [\"" +
+			json = "{\"id\": " + id + ", \"method\": \"mining.submit\", \"params\": [\"" +
 				m_connection.User() + "\",\"" + solution.work.job.hex() + "\",\"0x" +
 				nonceHex + "\",\"0x" + solution.work.header.hex() + "\",\"0x" +
 				solution.mixHash.hex() + "\"]}\n";
 			break;
 		case EthStratumClient::ETHPROXY:
-			json = "{\"id\": 4, \"worker\":\"" +
+			json = "{\"id\": " + id + ", \"worker\":\"" +
 				m_worker + "\", \"method\": \"eth_submitWork\", \"params\": [\"0x" +
 				nonceHex + "\",\"0x" + solution.work.header.hex() + "\",\"0x" +
 				solution.mixHash.hex() + "\"]}\n";
 			break;
 		case EthStratumClient::ETHEREUMSTRATUM:
-			json = "{\"id\": 4, \"method\": \"mining.submit\", \"params\": [\"" +
+		{
+			// Less the extranonce of the job the nonce was found for, the pool may have
+			// set a newer one since.
+			size_t const exSize = solution.work.exSizeBits / 4;
+			json = "{\"id\": " + id + ", \"method\": \"mining.submit\", \"params\": [\"" +
 				m_connection.User() + "\",\"" + solution.work.job.hex().substr(0, solution.work.job_len) + "\",\"" +
-				nonceHex.substr(m_extraNonceHexSize, 16 - m_extraNonceHexSize) + "\"]}\n";
+				nonceHex.substr(exSize, 16 - exSize) + "\"]}\n";
 			break;
+		}
 	}
 	std::ostream os(&m_requestBuffer);
 	os << json;
-	m_stale = solution.stale;
+	m_submits[_id] = solution.stale;
 
 	async_write_with_response();
 
 	m_response_pending = true;
 	m_responsetimer.expires_from_now(boost::posix_time::seconds(2));
-	m_responsetimer.async_wait(boost::bind(&EthStratumClient::response_timeout_handler, this, boost::asio::placeholders::error));
+	m_responsetimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&EthStratumClient::response_timeout_handler, this, boost::asio::placeholders::error))));
 }
 
@@ -6,7 +6,9 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
 #include <json/json.h>
+#include <libdevcore/EventLoop.h>
 #include <libdevcore/Log.h>
+#include <libdevcore/Trace.h>
 #include <libdevcore/FixedHash.h>
 #include <libethcore/Farm.h>
 #include <libethcore/EthashAux.h>
@@ -33,13 +35,18 @@ public:
 	bool isConnected() { return m_connected.load(std::memory_order_relaxed) && m_authorized; }
 	
 	void submitHashrate(string const & rate);
-	void submitSolution(Solution solution);
+	void submitSolution(Solution solution, unsigned _id);
 
 	h256 currentHeaderHash() { return m_current.header; }
 	bool current() { return static_cast<bool>(m_current); }
 
 private:
 
+	void startConnect();
+	void closeSocket();
+	void sendSolution(Solution const& solution, unsigned _id);
+	void sendHashrate(string const& rate);
+
 	void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
 	void connect_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
 	void work_timeout_handler(const boost::system::error_code& ec);
@@ -63,15 +70,20 @@ private:
 
 	int m_worktimeout = 60;
 
-	std::mutex x_pending;
+	Mutex x_pending;
 	int m_pending;
 
 	WorkPackage m_current;
 
-	bool m_stale = false;
+	/// Submissions awaiting an answer by id, true once a newer job made them stale.
+	std::map<unsigned, bool> m_submits;
+
+	/// Start of the connection phase in progress, for the trace.
+	std::chrono::steady_clock::time_point m_phaseStarted;
+	void tracePhase(char const* _name);
 
-	std::thread m_serviceThread;  ///< The IO service thread.
-	boost::asio::io_service m_io_service;
+	/// Every handler and every public call runs on this strand of the shared loop.
+	boost::asio::io_service::strand m_strand;
 	boost::asio::ip::tcp::socket *m_socket;
 	// Use shared ptrs to avoid crashes due to async_writes
 	// see https://stackoverflow.com/questions/41526553/can-async-write-cause-segmentation-fault-when-this-is-deleted
@@ -104,4 +116,6 @@ private:
 	void processExtranonce(std::string& enonce);
 
 	bool m_linkdown = true;
+
+	PendingHandlers m_handlers;
 };
@@ -7,16 +7,24 @@ using namespace std::chrono;
 using namespace dev;
 using namespace eth;
 
-SimulateClient::SimulateClient(unsigned const & difficulty, unsigned const & block) : PoolClient(), Worker("simulator")
+SimulateClient::SimulateClient(unsigned const & difficulty, unsigned const & block) : PoolClient(),
+	m_strand(EventLoop::service()),
+	m_pollTimer(EventLoop::service())
 {
 	m_difficulty = difficulty -1;
 	m_block = block;
-	startWorking();
+
+	cout << "Preparing DAG for block #" << m_block << endl;
+	m_genesis.setNumber(m_block);
+	m_current = WorkPackage(m_genesis);
+	m_time = std::chrono::steady_clock::now();
+	m_strand.post(m_handlers.wrap([this]() { schedulePoll(0); }));
 }
 
 SimulateClient::~SimulateClient()
 {
-	
+	m_strand.post(m_handlers.wrap([this]() { m_pollTimer.cancel(); }));
+	m_handlers.wait();
 }
 
 void SimulateClient::connect()
@@ -45,66 +53,67 @@ void SimulateClient::submitHashrate(string const & rate)
 	cnote << "On difficulty" << m_difficulty << "for" << sec.count() << "seconds";
 }
 
-void SimulateClient::submitSolution(Solution solution)
+void SimulateClient::submitSolution(Solution solution, unsigned _id)
 {
 	m_uppDifficulty = true;
 	cnote << "Difficulty:" << m_difficulty;
-	if (EthashAux::eval(solution.work.epoch, solution.work.header, solution.nonce).value < solution.work.boundary)
+	if (EthashAux::evalProgPow(solution.work.epoch, solution.work.height, solution.work.header, solution.nonce).value < solution.work.boundary)
 	{
 		if (m_onSolutionAccepted) {
-			m_onSolutionAccepted(false);
+			m_onSolutionAccepted(false, _id);
 		}
 	}
 	else
 	{
 		if (m_onSolutionRejected) {
-			m_onSolutionRejected(false);
+			m_onSolutionRejected(false, _id);
 		}
 	}
 }
 
+void SimulateClient::schedulePoll(unsigned _ms)
+{
+	m_pollTimer.expires_from_now(boost::posix_time::milliseconds(_ms));
+	m_pollTimer.async_wait(m_strand.wrap(m_handlers.wrap(
+		boost::bind(&SimulateClient::poll, this, boost::asio::placeholders::error))));
+}
+
 // Handles all logic here
-void SimulateClient::workLoop()
+void SimulateClient::poll(const boost::system::error_code& ec)
 {
-	cout << "Preparing DAG for block #" << m_block << endl;
-	BlockHeader genesis;
-	genesis.setNumber(m_block);
-	WorkPackage current = WorkPackage(genesis);
+	if (ec)
+		return;
+
+	if (!m_connected) {
+		schedulePoll(5000);
+		return;
+	}
+	if (!m_uppDifficulty) {
+		schedulePoll(100);
+		return;
+	}
+	m_uppDifficulty = false;
+
+	auto sec = duration_cast<seconds>(steady_clock::now() - m_time);
+	cnote << "Took" << sec.count() << "seconds at" << m_difficulty << "difficulty to find solution";
+
+	if (sec.count() < 12) {
+		m_difficulty++;
+	}
+	if (sec.count() > 18) {
+		m_difficulty--;
+	}
+
+	cnote << "Now using difficulty " << m_difficulty;
 	m_time = std::chrono::steady_clock::now();
-	while (true)
-	{
-		if (m_connected) {
-			if (m_uppDifficulty) {
-				m_uppDifficulty = false;
-
-				auto sec = duration_cast<seconds>(steady_clock::now() - m_time);
-				cnote << "Took" << sec.count() << "seconds at" << m_difficulty << "difficulty to find solution";
-
-				if (sec.count() < 12) {
-					m_difficulty++;
-				}
-				if (sec.count() > 18) {
-					m_difficulty--;
-				}
-				
-				cnote << "Now using difficulty " << m_difficulty;
-				m_time = std::chrono::steady_clock::now();
-				if (m_onWorkReceived) {
-					genesis.setDifficulty(u256(1) << m_difficulty);
-					genesis.noteDirty();
-
-					current.header = h256::random();
-					current.boundary = genesis.boundary();
-
-					m_onWorkReceived(current);
-				}
-			}
-			else {
-				this_thread::sleep_for(chrono::milliseconds(100));
-			}
-		}
-		else {
-			this_thread::sleep_for(chrono::seconds(5));
-		}
+	if (m_onWorkReceived) {
+		m_genesis.setDifficulty(u256(1) << m_difficulty);
+		m_genesis.noteDirty();
+
+		m_current.header = h256::random();
+		m_current.boundary = m_genesis.boundary();
+
+		m_onWorkReceived(m_current);
 	}
+	schedulePoll(100);
 }
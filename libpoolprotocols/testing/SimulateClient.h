@@ -1,7 +1,8 @@
 #pragma once
 
 #include <iostream>
-#include <libdevcore/Worker.h>
+#include <boost/asio.hpp>
+#include <libdevcore/EventLoop.h>
 #include <libethcore/Farm.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Miner.h>
@@ -11,7 +12,7 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
-class SimulateClient : public PoolClient, Worker
+class SimulateClient : public PoolClient
 {
 public:
 	SimulateClient(unsigned const & difficulty, unsigned const & block);
@@ -23,15 +24,22 @@ public:
 	bool isConnected() override { return m_connected; }
 
 	void submitHashrate(string const & rate) override;
-	void submitSolution(Solution solution) override;
+	void submitSolution(Solution solution, unsigned _id) override;
 
 private:
-	void workLoop() override;
+	void schedulePoll(unsigned _ms);
+	void poll(const boost::system::error_code& ec);
 
-	bool m_uppDifficulty = false;
+	std::atomic<bool> m_uppDifficulty = {false};
 	unsigned m_difficulty;
 	unsigned m_block;
 	std::chrono::steady_clock::time_point m_time;
+	BlockHeader m_genesis;
+	WorkPackage m_current;
+
+	boost::asio::io_service::strand m_strand;
+	boost::asio::deadline_timer m_pollTimer;
+	PendingHandlers m_handlers;
 };
 
 
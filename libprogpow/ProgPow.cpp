@@ -1,11 +1,20 @@
 #include "ProgPow.h"
 
+#include <algorithm>
 #include <sstream>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 #define rnd() (kiss99(rnd_state))
-#define mix_src()   ("mix[" + std::to_string(rnd() % PROGPOW_REGS) + "]")
-#define mix_dst()   ("mix[" + std::to_string(mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS]) + "]")
-#define mix_cache() ("mix[" + std::to_string(mix_seq_cache[(mix_seq_cache_cnt++)%PROGPOW_REGS]) + "]")
+#define mix_dst()   (mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS])
+#define mix_cache() (mix_seq_cache[(mix_seq_cache_cnt++)%PROGPOW_REGS])
+#define mix_str(i)  ("mix[" + std::to_string(i) + "]")
+
+#define ROTL32(x, n) (((x) << ((n) % 32)) | ((x) >> ((32 - (n)) % 32)))
+#define ROTR32(x, n) (((x) >> ((n) % 32)) | ((x) << ((32 - (n)) % 32)))
 
 void swap(int &a, int &b)
 {
@@ -14,11 +23,12 @@ void swap(int &a, int &b)
     b = t;
 }
 
-std::string ProgPow::getKern(uint64_t block_number, kernel_t kern)
+ProgPow::program_t ProgPow::decode(uint64_t block_number)
 {
-    std::stringstream ret;
+    program_t prog;
 
     uint64_t prog_seed = block_number / PROGPOW_PERIOD;
+    prog.prog_seed = prog_seed;
 
     uint32_t seed0 = (uint32_t)prog_seed;
     uint32_t seed1 = prog_seed >> 32;
@@ -50,66 +60,160 @@ std::string ProgPow::getKern(uint64_t block_number, kernel_t kern)
         swap(mix_seq_cache[i], mix_seq_cache[j]);
     }
 
-	if (kern == KERNEL_CUDA)
+    // The draw order below is the program, it must never change
+    for (int i = 0; (i < PROGPOW_CNT_CACHE) || (i < PROGPOW_CNT_MATH); i++)
+    {
+        if (i < PROGPOW_CNT_CACHE)
+        {
+            // Cached memory access
+            // lanes access random locations
+            prog.cache[i].src = mix_cache();
+            prog.cache[i].dst = mix_dst();
+            prog.cache[i].merge = rnd();
+        }
+        if (i < PROGPOW_CNT_MATH)
+        {
+            // Random Math
+            // Generate 2 unique sources
+            int src_rnd = rnd() % ((PROGPOW_REGS - 1) * PROGPOW_REGS);
+            int src1 = src_rnd % PROGPOW_REGS; // 0 <= src1 < PROGPOW_REGS
+            int src2 = src_rnd / PROGPOW_REGS; // 0 <= src2 < PROGPOW_REGS - 1
+            if (src2 >= src1) ++src2; // src2 is now any reg other than src1
+            prog.math[i].src1 = src1;
+            prog.math[i].src2 = src2;
+            prog.math[i].math = rnd();
+            prog.math[i].dst = mix_dst();
+            prog.math[i].merge = rnd();
+        }
+    }
+    // Hard code mix[0] to guarantee the address for the global load depends on the result of the load
+    prog.dag[0].dst = 0;
+    prog.dag[0].merge = rnd();
+    for (int i = 1; i < PROGPOW_DAG_LOADS; i++)
     {
-        ret << "typedef unsigned int       uint32_t;\n";
-        ret << "typedef unsigned long long uint64_t;\n";
-        ret << "#define ROTL32(x,n) __funnelshift_l((x), (x), (n))\n";
-        ret << "#define ROTR32(x,n) __funnelshift_r((x), (x), (n))\n";
-        ret << "#define min(a,b) ((a<b) ? a : b)\n";
-        ret << "#define mul_hi(a, b) __umulhi(a, b)\n";
-        ret << "#define clz(a) __clz(a)\n";
-        ret << "#define popcount(a) __popc(a)\n";
-        ret << "\n";
+        prog.dag[i].dst = mix_dst();
+        prog.dag[i].merge = rnd();
     }
-    else
+
+    return prog;
+}
+
+// OpenCL definitions of progpow_shuffle(x, lane), the word 'x' of lane 'lane'
+// of the calling hash, for each sub-group path
+std::string ProgPow::subgroupPrelude()
+{
+    std::stringstream ret;
+    ret << "#define PROGPOW_SUBGROUP_NONE          " << SUBGROUP_NONE << "\n";
+    ret << "#define PROGPOW_SUBGROUP_INTEL         " << SUBGROUP_INTEL << "\n";
+    ret << "#define PROGPOW_SUBGROUP_KHR_SHUFFLE   " << SUBGROUP_KHR_SHUFFLE << "\n";
+    ret << "#define PROGPOW_SUBGROUP_KHR           " << SUBGROUP_KHR << "\n";
+    ret << "#define PROGPOW_SUBGROUP_AMD           " << SUBGROUP_AMD << "\n";
+    ret << "#ifndef PROGPOW_SUBGROUP\n";
+    ret << "#define PROGPOW_SUBGROUP PROGPOW_SUBGROUP_NONE\n";
+    ret << "#endif\n";
+    ret << "#if PROGPOW_SUBGROUP == PROGPOW_SUBGROUP_INTEL\n";
+    ret << "#pragma OPENCL EXTENSION cl_intel_subgroups : enable\n";
+    ret << "// the kernel requires sub-groups of PROGPOW_LANES, one hash each\n";
+    ret << "#define progpow_shuffle(x, lane) intel_sub_group_shuffle((uint32_t)(x), (lane))\n";
+    ret << "#elif PROGPOW_SUBGROUP == PROGPOW_SUBGROUP_KHR_SHUFFLE\n";
+    ret << "#pragma OPENCL EXTENSION cl_khr_subgroups : enable\n";
+    ret << "#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable\n";
+    ret << "#define progpow_shuffle(x, lane) sub_group_shuffle((uint32_t)(x), (get_sub_group_local_id() & ~(PROGPOW_LANES-1)) + (lane))\n";
+    ret << "#elif PROGPOW_SUBGROUP == PROGPOW_SUBGROUP_KHR\n";
+    ret << "#pragma OPENCL EXTENSION cl_khr_subgroups : enable\n";
+    ret << "// the source of a broadcast is uniform over the sub-group, one per hash it holds\n";
+    ret << "uint32_t progpow_shuffle(uint32_t x, uint32_t lane)\n";
+    ret << "{\n";
+    ret << "    uint32_t const base = get_sub_group_local_id() & ~(PROGPOW_LANES-1);\n";
+    ret << "    uint32_t r = 0;\n";
+    ret << "    for (uint32_t b = 0; b < get_sub_group_size(); b += PROGPOW_LANES)\n";
+    ret << "    {\n";
+    ret << "        uint32_t const v = sub_group_broadcast(x, b + lane);\n";
+    ret << "        if (b == base)\n";
+    ret << "            r = v;\n";
+    ret << "    }\n";
+    ret << "    return r;\n";
+    ret << "}\n";
+    ret << "#elif PROGPOW_SUBGROUP == PROGPOW_SUBGROUP_AMD\n";
+    ret << "// ds_bpermute addresses lanes of the wavefront in bytes, hashes are aligned to PROGPOW_LANES in it\n";
+    ret << "#define progpow_shuffle(x, lane) ((uint32_t)__builtin_amdgcn_ds_bpermute((int)(((get_local_id(0) & ~(PROGPOW_LANES-1)) + (lane)) << 2), (int)(x)))\n";
+    ret << "#endif\n";
+    ret << "#if PROGPOW_SUBGROUP\n";
+    ret << "#define progpow_shuffle64(x, lane) (((uint64_t)progpow_shuffle((uint32_t)((x) >> 32), lane) << 32) | progpow_shuffle((uint32_t)(x), lane))\n";
+    ret << "#endif\n";
+    ret << "\n";
+    return ret.str();
+}
+
+std::string ProgPow::getKern(uint64_t block_number, kernel_t kern)
+{
+	std::stringstream ret;
+
+	program_t const prog = decode(block_number);
+	uint64_t prog_seed = prog.prog_seed;
+
+	if (kern == KERNEL_CUDA)
+	{
+		ret << "typedef unsigned int       uint32_t;\n";
+		ret << "typedef unsigned long long uint64_t;\n";
+		ret << "#define ROTL32(x,n) __funnelshift_l((x), (x), (n))\n";
+		ret << "#define ROTR32(x,n) __funnelshift_r((x), (x), (n))\n";
+		ret << "#define min(a,b) ((a<b) ? a : b)\n";
+		ret << "#define mul_hi(a, b) __umulhi(a, b)\n";
+		ret << "#define clz(a) __clz(a)\n";
+		ret << "#define popcount(a) __popc(a)\n";
+		ret << "\n";
+	}
+	else
 	{
 		ret << "#ifndef GROUP_SIZE\n";
 		ret << "#define GROUP_SIZE 128\n";
 		ret << "#endif\n";
 		ret << "#define GROUP_SHARE (GROUP_SIZE / " << PROGPOW_LANES << ")\n";
-        ret << "\n";
-        ret << "typedef unsigned int       uint32_t;\n";
-        ret << "typedef unsigned long      uint64_t;\n";
-        ret << "#define ROTL32(x, n) rotate((x), (uint32_t)(n))\n";
-        ret << "#define ROTR32(x, n) rotate((x), (uint32_t)(32-n))\n";
-        ret << "\n";
+		ret << "\n";
+		ret << "typedef unsigned int       uint32_t;\n";
+		ret << "typedef unsigned long      uint64_t;\n";
+		ret << "#define ROTL32(x, n) rotate((x), (uint32_t)(n))\n";
+		ret << "#define ROTR32(x, n) rotate((x), (uint32_t)(32-n))\n";
+		ret << "\n";
 	}
 
-    ret << "#define PROGPOW_LANES           " << PROGPOW_LANES << "\n";
-    ret << "#define PROGPOW_REGS            " << PROGPOW_REGS << "\n";
-    ret << "#define PROGPOW_DAG_LOADS       " << PROGPOW_DAG_LOADS << "\n";
-    ret << "#define PROGPOW_CACHE_WORDS     " << PROGPOW_CACHE_BYTES / sizeof(uint32_t) << "\n";
-    ret << "#define PROGPOW_CNT_DAG         " << PROGPOW_CNT_DAG << "\n";
-    ret << "#define PROGPOW_CNT_MATH        " << PROGPOW_CNT_MATH << "\n";
-    ret << "\n";
+	ret << "#define PROGPOW_LANES           " << PROGPOW_LANES << "\n";
+	ret << "#define PROGPOW_REGS            " << PROGPOW_REGS << "\n";
+	ret << "#define PROGPOW_DAG_LOADS       " << PROGPOW_DAG_LOADS << "\n";
+	ret << "#define PROGPOW_CACHE_WORDS     " << PROGPOW_CACHE_BYTES / sizeof(uint32_t) << "\n";
+	ret << "#define PROGPOW_CNT_DAG         " << PROGPOW_CNT_DAG << "\n";
+	ret << "#define PROGPOW_CNT_MATH        " << PROGPOW_CNT_MATH << "\n";
+	ret << "\n";
+	if (kern == KERNEL_CL)
+		ret << subgroupPrelude();
 
 	if (kern == KERNEL_CUDA)
 	{
-        ret << "typedef struct __align__(PROGPOW_DAG_LOADS * 4) {uint32_t s[PROGPOW_DAG_LOADS];} dag_t;\n";
-        ret << "\n";
-        ret << "// Inner loop for prog_seed " << prog_seed << "\n";
-        ret << "__device__ __forceinline__ void progPowLoop(const uint32_t loop,\n";
-        ret << "        uint32_t mix[PROGPOW_REGS],\n";
-        ret << "        const dag_t *g_dag,\n";
-        ret << "        const uint32_t c_dag[PROGPOW_CACHE_WORDS],\n";
-        ret << "        const bool hack_false)\n";
+		ret << "typedef struct __align__(PROGPOW_DAG_LOADS * 4) {uint32_t s[PROGPOW_DAG_LOADS];} dag_t;\n";
+		ret << "\n";
+		ret << "// Inner loop for prog_seed " << prog_seed << "\n";
+		ret << "__device__ __forceinline__ void progPowLoop(const uint32_t loop,\n";
+		ret << "        uint32_t mix[PROGPOW_REGS],\n";
+		ret << "        const dag_t *g_dag,\n";
+		ret << "        const uint32_t c_dag[PROGPOW_CACHE_WORDS],\n";
+		ret << "        const bool hack_false)\n";
 	}
 	else
 	{
-        ret << "typedef struct __attribute__ ((aligned (PROGPOW_DAG_LOADS * 4))) {uint32_t s[PROGPOW_DAG_LOADS];} dag_t;\n";
-        ret << "\n";
-        ret << "// Inner loop for prog_seed " << prog_seed << "\n";
-        ret << "void progPowLoop(const uint32_t loop,\n";
-        ret << "        uint32_t mix[PROGPOW_REGS],\n";
-        ret << "        __global const dag_t *g_dag,\n";
-        ret << "        __local const uint32_t c_dag[PROGPOW_CACHE_WORDS],\n";
-        ret << "        __local uint64_t share[GROUP_SHARE],\n";
-        ret << "        const bool hack_false)\n";
+		ret << "typedef struct __attribute__ ((aligned (PROGPOW_DAG_LOADS * 4))) {uint32_t s[PROGPOW_DAG_LOADS];} dag_t;\n";
+		ret << "\n";
+		ret << "// Inner loop for prog_seed " << prog_seed << "\n";
+		ret << "void progPowLoop(const uint32_t loop,\n";
+		ret << "        uint32_t mix[PROGPOW_REGS],\n";
+		ret << "        __global const dag_t *g_dag,\n";
+		ret << "        __local const uint32_t c_dag[PROGPOW_CACHE_WORDS],\n";
+		ret << "        __local uint64_t share[GROUP_SHARE],\n";
+		ret << "        const bool hack_false)\n";
 	}
 	ret << "{\n";
 
-    ret << "dag_t data_dag;\n";
+	ret << "dag_t data_dag;\n";
 	ret << "uint32_t offset, data;\n";
 
 	if (kern == KERNEL_CUDA)
@@ -128,19 +232,27 @@ std::string ProgPow::getKern(uint64_t block_number, kernel_t kern)
 		ret << "offset = __shfl_sync(0xFFFFFFFF, mix[0], loop%PROGPOW_LANES, PROGPOW_LANES);\n";
 	else
 	{
+		ret << "#if PROGPOW_SUBGROUP\n";
+		ret << "offset = progpow_shuffle(mix[0], loop % PROGPOW_LANES);\n";
+		ret << "#else\n";
 		ret << "if(lane_id == (loop % PROGPOW_LANES))\n";
 		ret << "    share[group_id] = mix[0];\n";
 		ret << "barrier(CLK_LOCAL_MEM_FENCE);\n";
 		ret << "offset = share[group_id];\n";
+		// without lockstep lanes the next loop must not overwrite share before every lane read it
+		ret << "#ifdef PROGPOW_SHARE_FENCE\n";
+		ret << "barrier(CLK_LOCAL_MEM_FENCE);\n";
+		ret << "#endif\n";
+		ret << "#endif\n";
 	}
 	ret << "offset %= PROGPOW_DAG_ELEMENTS;\n";
 	ret << "offset = offset * PROGPOW_LANES + (lane_id ^ loop) % PROGPOW_LANES;\n";
-    ret << "data_dag = g_dag[offset];\n";
-    ret << "// hack to prevent compiler from reordering LD and usage\n";
-    if (kern == KERNEL_CUDA)
-        ret << "if (hack_false) __threadfence_block();\n";
-    else
-        ret << "if (hack_false) barrier(CLK_LOCAL_MEM_FENCE);\n";
+	ret << "data_dag = g_dag[offset];\n";
+	ret << "// hack to prevent compiler from reordering LD and usage\n";
+	if (kern == KERNEL_CUDA)
+		ret << "if (hack_false) __threadfence_block();\n";
+	else
+		ret << "if (hack_false) barrier(CLK_LOCAL_MEM_FENCE);\n";
 
 	for (int i = 0; (i < PROGPOW_CNT_CACHE) || (i < PROGPOW_CNT_MATH); i++)
 	{
@@ -148,52 +260,355 @@ std::string ProgPow::getKern(uint64_t block_number, kernel_t kern)
 		{
 			// Cached memory access
 			// lanes access random locations
-			std::string src = mix_cache();
-			std::string dest = mix_dst();
-			uint32_t    r = rnd();
+			cache_op_t const& op = prog.cache[i];
 			ret << "// cache load " << i << "\n";
-			ret << "offset = " << src << " % PROGPOW_CACHE_WORDS;\n";
+			ret << "offset = " << mix_str(op.src) << " % PROGPOW_CACHE_WORDS;\n";
 			ret << "data = c_dag[offset];\n";
-			ret << merge(dest, "data", r);
+			ret << merge(mix_str(op.dst), "data", op.merge);
 		}
 		if (i < PROGPOW_CNT_MATH)
 		{
 			// Random Math
-            // Generate 2 unique sources 
-            int src_rnd = rnd() % ((PROGPOW_REGS - 1) * PROGPOW_REGS);
-            int src1 = src_rnd % PROGPOW_REGS; // 0 <= src1 < PROGPOW_REGS
-            int src2 = src_rnd / PROGPOW_REGS; // 0 <= src2 < PROGPOW_REGS - 1
-            if (src2 >= src1) ++src2; // src2 is now any reg other than src1
-            std::string src1_str = "mix[" + std::to_string(src1) + "]";
-            std::string src2_str = "mix[" + std::to_string(src2) + "]";
-			uint32_t    r1 = rnd();
-            std::string dest = mix_dst();
-			uint32_t    r2 = rnd();
+			math_op_t const& op = prog.math[i];
 			ret << "// random math " << i << "\n";
-			ret << math("data", src1_str, src2_str, r1);
-			ret << merge(dest, "data", r2);
+			ret << math("data", mix_str(op.src1), mix_str(op.src2), op.math);
+			ret << merge(mix_str(op.dst), "data", op.merge);
 		}
 	}
 	// Consume the global load data at the very end of the loop, to allow fully latency hiding
 	ret << "// consume global load data\n";
-    ret << "// hack to prevent compiler from reordering LD and usage\n";
-    if (kern == KERNEL_CUDA)
-        ret << "if (hack_false) __threadfence_block();\n";
-    else
-        ret << "if (hack_false) barrier(CLK_LOCAL_MEM_FENCE);\n";
-    ret << merge("mix[0]", "data_dag.s[0]", rnd());
-    for (int i = 1; i < PROGPOW_DAG_LOADS; i++)
-    {
-        std::string dest = mix_dst();
-        uint32_t    r = rnd();
-        ret << merge(dest, "data_dag.s["+std::to_string(i)+"]", r);
-    }
+	ret << "// hack to prevent compiler from reordering LD and usage\n";
+	if (kern == KERNEL_CUDA)
+		ret << "if (hack_false) __threadfence_block();\n";
+	else
+		ret << "if (hack_false) barrier(CLK_LOCAL_MEM_FENCE);\n";
+	for (int i = 0; i < PROGPOW_DAG_LOADS; i++)
+		ret << merge(mix_str(prog.dag[i].dst), "data_dag.s["+std::to_string(i)+"]", prog.dag[i].merge);
 	ret << "}\n";
 	ret << "\n";
 
 	return ret.str();
 }
 
+std::string ProgPow::getHostKern(program_t const& prog)
+{
+    std::stringstream ret;
+
+    ret << "// ProgPoW loop for prog_seed " << prog.prog_seed << "\n";
+    ret << "#include <stdint.h>\n";
+    ret << "\n";
+    ret << "#define ROTL32(x, n) (((x) << ((n) % 32)) | ((x) >> ((32 - (n)) % 32)))\n";
+    ret << "#define ROTR32(x, n) (((x) >> ((n) % 32)) | ((x) << ((32 - (n)) % 32)))\n";
+    ret << "static inline uint32_t clz(uint32_t a) { return a ? (uint32_t)__builtin_clz(a) : 32; }\n";
+    ret << "static inline uint32_t popcount(uint32_t a) { return (uint32_t)__builtin_popcount(a); }\n";
+    ret << "static inline uint32_t mul_hi(uint32_t a, uint32_t b) { return (uint32_t)(((uint64_t)a * b) >> 32); }\n";
+    ret << "static inline uint32_t min(uint32_t a, uint32_t b) { return a < b ? a : b; }\n";
+    ret << "\n";
+    ret << "extern \"C\" const uint64_t progpow_prog_seed = " << prog.prog_seed << "ull;\n";
+    ret << "\n";
+    ret << "extern \"C\" void progpow_loop(const uint32_t loop,\n";
+    ret << "        uint32_t lanes[" << PROGPOW_LANES << "][" << PROGPOW_REGS << "],\n";
+    ret << "        const uint32_t* dag_line,\n";
+    ret << "        const uint32_t* c_dag)\n";
+    ret << "{\n";
+    ret << "for (uint32_t lane_id = 0; lane_id < " << PROGPOW_LANES << "; lane_id++)\n";
+    ret << "{\n";
+    ret << "uint32_t* const mix = lanes[lane_id];\n";
+    ret << "const uint32_t* const data_dag = dag_line + ((lane_id ^ loop) % " << PROGPOW_LANES << ") * "
+        << PROGPOW_DAG_LOADS << ";\n";
+    ret << "uint32_t data;\n";
+    for (int i = 0; (i < PROGPOW_CNT_CACHE) || (i < PROGPOW_CNT_MATH); i++)
+    {
+        if (i < PROGPOW_CNT_CACHE)
+        {
+            cache_op_t const& op = prog.cache[i];
+            ret << "// cache load " << i << "\n";
+            ret << "data = c_dag[" << mix_str(op.src) << " % " << PROGPOW_CACHE_BYTES / sizeof(uint32_t) << "];\n";
+            ret << merge(mix_str(op.dst), "data", op.merge);
+        }
+        if (i < PROGPOW_CNT_MATH)
+        {
+            math_op_t const& op = prog.math[i];
+            ret << "// random math " << i << "\n";
+            ret << math("data", mix_str(op.src1), mix_str(op.src2), op.math);
+            ret << merge(mix_str(op.dst), "data", op.merge);
+        }
+    }
+    ret << "// consume global load data\n";
+    for (int i = 0; i < PROGPOW_DAG_LOADS; i++)
+        ret << merge(mix_str(prog.dag[i].dst), "data_dag[" + std::to_string(i) + "]", prog.dag[i].merge);
+    ret << "}\n";
+    ret << "}\n";
+
+    return ret.str();
+}
+
+static const uint32_t keccakf_rndc[24] = {
+    0x00000001, 0x00008082, 0x0000808a, 0x80008000, 0x0000808b, 0x80000001,
+    0x80008081, 0x00008009, 0x0000008a, 0x00000088, 0x80008009, 0x8000000a,
+    0x8000808b, 0x0000008b, 0x00008089, 0x00008003, 0x00008002, 0x00000080,
+    0x0000800a, 0x8000000a, 0x80008081, 0x00008080, 0x80000001, 0x80008008
+};
+
+// Keccak-f[800] round with the VeriBlock state tweak, matching the kernels
+static void keccak_f800_round(uint32_t st[25], const int r)
+{
+    static const uint32_t keccakf_rotc[24] = {
+        1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+        27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44
+    };
+    static const uint32_t keccakf_piln[24] = {
+        10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+        15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1
+    };
+
+    uint32_t t, bc[5];
+    // Theta, over the VeriBlock column selection of the kernels
+    bc[0] = st[0] ^ st[6] ^ st[9] ^ st[12] ^ st[17];
+    bc[1] = st[8] ^ st[11] ^ st[14] ^ st[19] ^ st[23];
+    bc[2] = st[2] ^ st[7] ^ st[10] ^ st[18] ^ st[22];
+    bc[3] = st[4] ^ st[5] ^ st[15] ^ st[20] ^ st[24];
+    bc[4] = st[1] ^ st[3] ^ st[13] ^ st[16] ^ st[21];
+
+    for (int i = 0; i < 5; i++) {
+        t = bc[(i + 4) % 5] ^ ROTL32(bc[(i + 1) % 5], 1u);
+        for (uint32_t j = 0; j < 25; j += 5)
+            st[j + i] ^= t;
+    }
+
+    // Rho Pi
+    t = st[1];
+    for (int i = 0; i < 24; i++) {
+        uint32_t j = keccakf_piln[i];
+        bc[0] = st[j];
+        st[j] = ROTL32(t, keccakf_rotc[i]);
+        t = bc[0];
+    }
+
+    st[3] = st[3] ^ 0x79938B61;
+    st[10] = st[10] ^ ((st[19] & 0x000000FF) | (st[24] & 0x0000FF00) | (st[6] & 0x00FF0000) | (st[14] & 0xFF000000));
+
+    //  Chi
+    for (uint32_t j = 0; j < 25; j += 5) {
+        for (int i = 0; i < 5; i++)
+            bc[i] = st[j + i];
+        for (int i = 0; i < 5; i++)
+            st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+    }
+
+    //  Iota
+    st[0] ^= keccakf_rndc[r];
+}
+
+static uint32_t swab32(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+// Keccak - implemented as a variant of SHAKE
+// The width is 800, with a bitrate of 576, a capacity of 224, and no padding
+// Only need 64 bits of output for mining
+uint64_t ProgPow::keccak_f800(hash32_t const& header, uint64_t seed, hash32_t const& digest)
+{
+    uint32_t st[25];
+
+    for (int i = 0; i < 25; i++)
+        st[i] = 0;
+    for (int i = 0; i < 8; i++)
+        st[i] = header.uint32s[i];
+    st[8] = (uint32_t)seed;
+    st[9] = seed >> 32;
+    for (int i = 0; i < 8; i++)
+        st[10+i] = digest.uint32s[i];
+
+    for (int r = 0; r < 22; r++)
+        keccak_f800_round(st, r);
+
+    // Byte swap so byte 0 of hash is MSB of result
+    return (uint64_t)swab32(st[0]) << 32 | swab32(st[1]);
+}
+
+// keccak(header..nonce) followed by the 13 additional rounds of the search kernel
+uint64_t ProgPow::hashSeed(hash32_t const& header, uint64_t nonce)
+{
+    hash32_t digest;
+    for (int i = 0; i < 8; i++)
+        digest.uint32s[i] = 0;
+
+    uint64_t seed = keccak_f800(header, nonce, digest);
+    for (int i = 0; i < 13; i++)
+        seed = keccak_f800(digest, seed, digest);
+    return seed & 0x007FFFFFFFFFFFFF;
+}
+
+void ProgPow::fillMix(uint64_t seed, uint32_t lane_id, uint32_t mix[PROGPOW_REGS])
+{
+    // Use FNV to expand the per-warp seed to per-lane
+    // Use KISS to expand the per-lane seed to fill mix
+    uint32_t fnv_hash = 0x811c9dc5;
+    kiss99_t st;
+    st.z = fnv1a(fnv_hash, (uint32_t)seed);
+    st.w = fnv1a(fnv_hash, seed >> 32);
+    st.jsr = fnv1a(fnv_hash, lane_id);
+    st.jcong = fnv1a(fnv_hash, lane_id);
+    for (int i = 0; i < PROGPOW_REGS; i++)
+        mix[i] = kiss99(st);
+}
+
+// Index of the PROGPOW_LANES * PROGPOW_DAG_LOADS word line read by iteration 'loop'
+uint32_t ProgPow::dagLine(uint32_t const mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t loop, uint32_t dag_elements)
+{
+    return mix[loop % PROGPOW_LANES][0] % dag_elements;
+}
+
+// One iteration of progPowLoop for all lanes, 'dag_line' being the line selected by dagLine()
+void ProgPow::loop(program_t const& prog, uint32_t loop, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+    uint32_t const* dag_line, uint32_t const* c_dag)
+{
+    for (uint32_t l = 0; l < PROGPOW_LANES; l++)
+    {
+        uint32_t* m = mix[l];
+        uint32_t const* data_dag = dag_line + ((l ^ loop) % PROGPOW_LANES) * PROGPOW_DAG_LOADS;
+        for (int i = 0; (i < PROGPOW_CNT_CACHE) || (i < PROGPOW_CNT_MATH); i++)
+        {
+            if (i < PROGPOW_CNT_CACHE)
+            {
+                cache_op_t const& op = prog.cache[i];
+                merge(m[op.dst], c_dag[m[op.src] % (PROGPOW_CACHE_BYTES / sizeof(uint32_t))], op.merge);
+            }
+            if (i < PROGPOW_CNT_MATH)
+            {
+                math_op_t const& op = prog.math[i];
+                merge(m[op.dst], math(m[op.src1], m[op.src2], op.math), op.merge);
+            }
+        }
+        for (int i = 0; i < PROGPOW_DAG_LOADS; i++)
+            merge(m[prog.dag[i].dst], data_dag[i], prog.dag[i].merge);
+    }
+}
+
+ProgPow::hash32_t ProgPow::reduce(uint32_t const mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+    // Reduce mix data to a per-lane 32-bit digest
+    uint32_t digest_lane[PROGPOW_LANES];
+    for (int l = 0; l < PROGPOW_LANES; l++)
+    {
+        digest_lane[l] = 0x811c9dc5;
+        for (int i = 0; i < PROGPOW_REGS; i++)
+            fnv1a(digest_lane[l], mix[l][i]);
+    }
+
+    // Reduce all lanes to a single 256-bit digest
+    hash32_t digest;
+    for (int i = 0; i < 8; i++)
+        digest.uint32s[i] = 0x811c9dc5;
+    for (int l = 0; l < PROGPOW_LANES; l++)
+        fnv1a(digest.uint32s[l % 8], digest_lane[l]);
+    return digest;
+}
+
+// Returns the mix digest of 'nonce' and stores the 64-bit value the kernels compare
+// against the target in 'result'
+ProgPow::hash32_t ProgPow::hash(program_t const& prog, hash32_t const& header, uint64_t nonce, uint32_t dag_elements,
+    uint32_t const* c_dag, dag_loader_t const& load, uint64_t& result, loop_t jit)
+{
+    uint64_t const seed = hashSeed(header, nonce);
+
+    uint32_t mix[PROGPOW_LANES][PROGPOW_REGS];
+    for (uint32_t l = 0; l < PROGPOW_LANES; l++)
+        fillMix(seed, l, mix[l]);
+
+    uint32_t line[PROGPOW_LANES * PROGPOW_DAG_LOADS];
+    for (uint32_t l = 0; l < PROGPOW_CNT_DAG; l++)
+    {
+        load(dagLine(mix, l, dag_elements), line);
+        if (jit)
+            jit(l, mix, line, c_dag);
+        else
+            loop(prog, l, mix, line, c_dag);
+    }
+
+    hash32_t const digest = reduce(mix);
+    result = keccak_f800(header, seed, digest);
+    return digest;
+}
+
+const uint32_t ProgPow::MAX_INTERLEAVE;
+
+uint32_t ProgPow::search(program_t const& prog, hash32_t const& header, uint64_t start_nonce, uint32_t count,
+    uint64_t target, uint32_t interleave, uint32_t dag_elements, uint32_t const* dag, uint32_t const* c_dag,
+    uint64_t* found, uint32_t max_found, loop_t jit)
+{
+    struct state_t {
+        uint32_t mix[PROGPOW_LANES][PROGPOW_REGS];
+        uint64_t seed;
+        uint32_t line;
+    };
+    uint32_t const line_words = PROGPOW_LANES * PROGPOW_DAG_LOADS;
+
+    interleave = std::max<uint32_t>(1, std::min<uint32_t>(interleave, MAX_INTERLEAVE));
+    std::vector<state_t> states(interleave);
+    uint32_t found_count = 0;
+
+    for (uint32_t base = 0; base < count; base += interleave)
+    {
+        uint32_t const k = std::min(interleave, count - base);
+        for (uint32_t s = 0; s < k; s++)
+        {
+            state_t& st = states[s];
+            st.seed = hashSeed(header, start_nonce + base + s);
+            for (uint32_t l = 0; l < PROGPOW_LANES; l++)
+                fillMix(st.seed, l, st.mix[l]);
+            st.line = dagLine(st.mix, 0, dag_elements);
+            prefetchLine(dag + (uint64_t)st.line * line_words);
+        }
+
+        // Round robin over the states: by the time a state comes back, the line
+        // prefetched after its previous loop had k - 1 loops worth of time to arrive.
+        for (uint32_t l = 0; l < PROGPOW_CNT_DAG; l++)
+            for (uint32_t s = 0; s < k; s++)
+            {
+                state_t& st = states[s];
+                if (jit)
+                    jit(l, st.mix, dag + (uint64_t)st.line * line_words, c_dag);
+                else
+                    loop(prog, l, st.mix, dag + (uint64_t)st.line * line_words, c_dag);
+                if (l + 1 < PROGPOW_CNT_DAG)
+                {
+                    st.line = dagLine(st.mix, l + 1, dag_elements);
+                    prefetchLine(dag + (uint64_t)st.line * line_words);
+                }
+            }
+
+        for (uint32_t s = 0; s < k; s++)
+        {
+            state_t const& st = states[s];
+            if (keccak_f800(header, st.seed, reduce(st.mix)) < target)
+            {
+                if (found_count < max_found)
+                    found[found_count] = start_nonce + base + s;
+                found_count++;
+            }
+        }
+    }
+    return std::min(found_count, max_found);
+}
+
+void ProgPow::prefetchLine(uint32_t const* line)
+{
+    char const* p = reinterpret_cast<char const*>(line);
+    for (uint32_t i = 0; i < PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t); i += 64)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(p + i, 0, 0);
+#elif defined(_M_X64) || defined(_M_IX86)
+        _mm_prefetch(p + i, _MM_HINT_NTA);
+#else
+        (void)p;
+#endif
+    }
+}
+
 // Merge new data from b into the value in a
 // Assuming A has high entropy only do ops that retain entropy, even if B is low entropy
 // (IE don't do A&B)
@@ -229,6 +644,52 @@ std::string ProgPow::math(std::string d, std::string a, std::string b, uint32_t
     return "#error\n";
 }
 
+void ProgPow::merge(uint32_t &a, uint32_t b, uint32_t r)
+{
+	switch (r % 4)
+	{
+	case 0: a = ROTR32(a, ((r >> 16) % 31) + 1) ^ b; break;
+	case 1: a = ROTL32(a, ((r >> 16) % 31) + 1) ^ b; break;
+	case 2: a = (a * 33) + b; break;
+	case 3: a = (a ^ b) * 33; break;
+	}
+}
+
+// Portable equivalents of the clz() and popcount() kernel builtins
+static uint32_t clz32(uint32_t a)
+{
+	uint32_t n = 32;
+	for (; a; a >>= 1)
+		n--;
+	return n;
+}
+
+static uint32_t popcount32(uint32_t a)
+{
+	a = a - ((a >> 1) & 0x55555555);
+	a = (a & 0x33333333) + ((a >> 2) & 0x33333333);
+	return (((a + (a >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+uint32_t ProgPow::math(uint32_t a, uint32_t b, uint32_t r)
+{
+	switch (r % 11)
+	{
+	case 0: return ROTL32(a, b);
+	case 1: return a & b;
+	case 2: return a + b;
+	case 3: return popcount32(a) + popcount32(b);
+	case 4: return clz32(a) + clz32(b);
+	case 5: return ROTR32(a, b);
+	case 6: return (uint32_t)(((uint64_t)a * b) >> 32);
+	case 7: return a | b;
+	case 8: return a * b;
+	case 9: return a ^ b;
+	case 10: return a < b ? a : b;
+	}
+	return 0;
+}
+
 uint32_t ProgPow::fnv1a(uint32_t &h, uint32_t d)
 {
 	return h = (h ^ d) * 0x1000193;
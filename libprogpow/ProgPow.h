@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
 #include <string>
 
 // blocks before changing the random program
@@ -19,6 +20,8 @@
 #define PROGPOW_CNT_CACHE       11
 // random math instructions per loop
 #define PROGPOW_CNT_MATH        20
+// VeriBlock offset applied to the block height before deriving the period and DAG
+#define PROGPOW_BLOCK_OFFSET    2584000
 
 class ProgPow
 {
@@ -28,10 +31,85 @@ public:
 		KERNEL_CL
 	} kernel_t;
 
-	static std::string getKern(uint64_t seed, kernel_t kern);
+	// How the lanes of a hash exchange values in the OpenCL kernel, selected
+	// with PROGPOW_SUBGROUP when the source is built. Anything but
+	// SUBGROUP_NONE avoids the __local share and its barriers.
+	typedef enum {
+		SUBGROUP_NONE,          // __local memory and barriers
+		SUBGROUP_INTEL,         // cl_intel_subgroups shuffles, sub-groups of 16
+		SUBGROUP_KHR_SHUFFLE,   // cl_khr_subgroup_shuffle
+		SUBGROUP_KHR,           // cl_khr_subgroups broadcasts
+		SUBGROUP_AMD            // ds_bpermute of the AMD LLVM compiler
+	} subgroup_t;
+
+	typedef struct {
+		uint32_t uint32s[32 / sizeof(uint32_t)];
+	} hash32_t;
+
+	// The random program of one period, decoded from the KISS99 stream in the
+	// same order the kernels are generated, so host code can execute it.
+	typedef struct {
+		uint8_t src, dst;
+		uint32_t merge;
+	} cache_op_t;
+	typedef struct {
+		uint8_t src1, src2, dst;
+		uint32_t math, merge;
+	} math_op_t;
+	typedef struct {
+		uint8_t dst;
+		uint32_t merge;
+	} dag_op_t;
+	typedef struct {
+		uint64_t prog_seed;
+		cache_op_t cache[PROGPOW_CNT_CACHE];
+		math_op_t math[PROGPOW_CNT_MATH];
+		dag_op_t dag[PROGPOW_DAG_LOADS];
+	} program_t;
+
+	// Copies the PROGPOW_LANES * PROGPOW_DAG_LOADS words of DAG line 'line' into 'words'
+	typedef std::function<void(uint32_t line, uint32_t* words)> dag_loader_t;
+
+	// loop() of one program compiled for the host, see ProgPowJit
+	typedef void (*loop_t)(uint32_t loop, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+		uint32_t const* dag_line, uint32_t const* c_dag);
+
+	static program_t decode(uint64_t block_number);
+	static std::string getKern(uint64_t block_number, kernel_t kern);
+	// C++ source of loop() for 'prog' with its registers, rotations and operations
+	// resolved, exporting progpow_loop and progpow_prog_seed
+	static std::string getHostKern(program_t const& prog);
+
+	// Host implementation of the search kernel, one nonce at a time.
+	static uint64_t keccak_f800(hash32_t const& header, uint64_t seed, hash32_t const& digest);
+	static uint64_t hashSeed(hash32_t const& header, uint64_t nonce);
+	static void fillMix(uint64_t seed, uint32_t lane_id, uint32_t mix[PROGPOW_REGS]);
+	static uint32_t dagLine(uint32_t const mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t loop, uint32_t dag_elements);
+	static void loop(program_t const& prog, uint32_t loop, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+		uint32_t const* dag_line, uint32_t const* c_dag);
+	static hash32_t reduce(uint32_t const mix[PROGPOW_LANES][PROGPOW_REGS]);
+	// 'jit', when given, is the compiled loop() of 'prog'
+	static hash32_t hash(program_t const& prog, hash32_t const& header, uint64_t nonce, uint32_t dag_elements,
+		uint32_t const* c_dag, dag_loader_t const& load, uint64_t& result, loop_t jit = nullptr);
+
+	// Host search of 'count' nonces from 'start_nonce' over a full DAG of 'dag_elements' lines,
+	// keeping 'interleave' hashes in flight: the next DAG line of each one is prefetched while
+	// the loops of the others run, hiding the latency of the dependent loads.
+	// Nonces whose result is below 'target' are stored in 'found', up to 'max_found', and
+	// their number is returned.
+	static uint32_t search(program_t const& prog, hash32_t const& header, uint64_t start_nonce, uint32_t count,
+		uint64_t target, uint32_t interleave, uint32_t dag_elements, uint32_t const* dag, uint32_t const* c_dag,
+		uint64_t* found, uint32_t max_found, loop_t jit = nullptr);
+	// Upper bound of the interleave accepted by search()
+	static const uint32_t MAX_INTERLEAVE = 16;
+
 private:
+    static std::string subgroupPrelude();
     static std::string math(std::string d, std::string a, std::string b, uint32_t r);
     static std::string merge(std::string a, std::string b, uint32_t r);
+    static uint32_t math(uint32_t a, uint32_t b, uint32_t r);
+    static void merge(uint32_t &a, uint32_t b, uint32_t r);
+    static void prefetchLine(uint32_t const* line);
 
     static uint32_t fnv1a(uint32_t &h, uint32_t d);
     // KISS99 is simple, fast, and passes the TestU01 suite
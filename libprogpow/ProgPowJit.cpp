@@ -0,0 +1,257 @@
+#include "ProgPowJit.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+struct Entry
+{
+    bool building = true;
+    ProgPowJit::kernel_ptr kernel;
+};
+
+struct State
+{
+    std::mutex x_state;
+    std::atomic<bool> enabled = {false};
+    std::string compiler;
+    std::string dir;
+    ProgPowJit::log_t log;
+    std::map<uint64_t, Entry> entries;
+};
+
+// Never destroyed, builds may finish while the process exits
+State& state()
+{
+    static State* s = new State;
+    return *s;
+}
+
+void log(std::string const& _msg)
+{
+    if (state().log)
+        state().log(_msg);
+}
+
+std::string defaultDir()
+{
+    if (char const* xdg = std::getenv("XDG_CACHE_HOME"))
+        if (*xdg)
+            return std::string(xdg) + "/ethminer";
+    if (char const* home = std::getenv("HOME"))
+        if (*home)
+            return std::string(home) + "/.cache/ethminer";
+    // No shared fallback, whoever can write there could have us load their code
+    return std::string();
+}
+
+// Creates the cache directory, usable only when private to this user since
+// the libraries found there are loaded.
+bool makeDirs(std::string const& _dir)
+{
+#ifndef _WIN32
+    if (_dir.empty())
+        return false;
+    for (size_t p = _dir.find('/', 1); ; p = _dir.find('/', p + 1))
+    {
+        std::string const part = _dir.substr(0, p);
+        if (::mkdir(part.c_str(), 0700) != 0 && errno != EEXIST)
+            return false;
+        if (p == std::string::npos)
+            break;
+    }
+    struct stat st;
+    return ::stat(_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::geteuid() &&
+        !(st.st_mode & (S_IWGRP | S_IWOTH));
+#else
+    (void)_dir;
+    return false;
+#endif
+}
+
+}
+
+const unsigned ProgPowJit::MAX_LOADED;
+const unsigned ProgPowJit::SOURCE_VERSION;
+
+ProgPowJit::Kernel::~Kernel()
+{
+#ifndef _WIN32
+    dlclose(m_handle);
+#endif
+}
+
+void ProgPowJit::configure(std::string const& compiler, std::string const& cache_dir, log_t const& log)
+{
+    State& s = state();
+    std::lock_guard<std::mutex> l(s.x_state);
+    s.log = log;
+#ifdef _WIN32
+    (void)compiler;
+    (void)cache_dir;
+    if (log)
+        log("CPU kernel builds are not supported on this platform");
+#else
+    s.compiler = compiler;
+    s.dir = cache_dir.empty() ? defaultDir() : cache_dir;
+    if (!makeDirs(s.dir))
+    {
+        if (log)
+            log(s.dir.empty() ? std::string("No private cache directory, CPU kernels are not built") :
+                "Cannot create " + s.dir + " or it is not private to this user, CPU kernels are not built");
+        return;
+    }
+    s.enabled = !compiler.empty();
+#endif
+}
+
+bool ProgPowJit::enabled()
+{
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+ProgPowJit::kernel_ptr ProgPowJit::get(uint64_t prog_seed)
+{
+    State& s = state();
+    if (!enabled())
+        return nullptr;
+
+    std::lock_guard<std::mutex> l(s.x_state);
+    auto it = s.entries.find(prog_seed);
+    if (it != s.entries.end())
+        return it->second.kernel;
+
+    s.entries[prog_seed] = Entry();
+    // Periods only move forward, drop the oldest ones done building.
+    for (auto e = s.entries.begin(); s.entries.size() > MAX_LOADED && e != s.entries.end();)
+        if (!e->second.building && e->first != prog_seed)
+            e = s.entries.erase(e);
+        else
+            ++e;
+
+    std::thread([prog_seed]() {
+        kernel_ptr kernel = build(prog_seed);
+        State& s = state();
+        std::lock_guard<std::mutex> l(s.x_state);
+        auto it = s.entries.find(prog_seed);
+        if (it != s.entries.end())
+        {
+            it->second.building = false;
+            it->second.kernel = kernel;
+        }
+    }).detach();
+    return nullptr;
+}
+
+ProgPowJit::kernel_ptr ProgPowJit::build(uint64_t prog_seed)
+{
+#ifdef _WIN32
+    (void)prog_seed;
+    return nullptr;
+#else
+    State& s = state();
+    std::string compiler, dir;
+    {
+        std::lock_guard<std::mutex> l(s.x_state);
+        compiler = s.compiler;
+        dir = s.dir;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    std::string const base = dir + "/progpow-v" + std::to_string(SOURCE_VERSION) + "-" + std::to_string(prog_seed);
+    std::string const object = base + ".so";
+    bool const cached = ::access(object.c_str(), R_OK) == 0;
+    if (!cached)
+    {
+        std::string const source = base + ".cpp";
+        std::string const output = base + ".log";
+        {
+            std::ofstream out(source);
+            out << ProgPow::getHostKern(ProgPow::decode(prog_seed * PROGPOW_PERIOD));
+            if (!out)
+            {
+                log("Cannot write " + source);
+                return nullptr;
+            }
+        }
+        // Built under a name of its own, then renamed: other processes sharing the
+        // cache only ever see whole objects.
+        std::string const temp = object + "." + std::to_string(::getpid()) + ".tmp";
+        std::string const cmd = compiler + " -O3 -march=native -shared -fPIC -o '" + temp + "' '" + source + "' > '" +
+            output + "' 2>&1";
+        if (std::system(cmd.c_str()) != 0 || std::rename(temp.c_str(), object.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            log("CPU kernel build of period " + std::to_string(prog_seed) + " failed, see " + output);
+            return nullptr;
+        }
+        std::remove(source.c_str());
+        std::remove(output.c_str());
+    }
+
+    void* handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+    {
+        log("Cannot load " + object + ": " + dlerror());
+        return nullptr;
+    }
+    auto loop = reinterpret_cast<ProgPow::loop_t>(dlsym(handle, "progpow_loop"));
+    auto seed = reinterpret_cast<uint64_t const*>(dlsym(handle, "progpow_prog_seed"));
+    kernel_ptr kernel(new Kernel(handle, loop));
+    if (!loop || !seed || *seed != prog_seed || !check(prog_seed, loop))
+    {
+        // A broken object would be loaded again by every later run.
+        std::remove(object.c_str());
+        log("CPU kernel of period " + std::to_string(prog_seed) + " does not match, removed " + object);
+        return nullptr;
+    }
+
+    auto const ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    log("CPU kernel of period " + std::to_string(prog_seed) + (cached ? " loaded" : " built") + " in " +
+        std::to_string(ms) + " ms");
+    return kernel;
+#endif
+}
+
+// Runs a few loops of the compiled and the interpreted program on the same input.
+bool ProgPowJit::check(uint64_t prog_seed, ProgPow::loop_t loop)
+{
+    ProgPow::program_t const prog = ProgPow::decode(prog_seed * PROGPOW_PERIOD);
+
+    std::vector<uint32_t> c_dag(PROGPOW_CACHE_BYTES / sizeof(uint32_t));
+    uint32_t line[PROGPOW_LANES * PROGPOW_DAG_LOADS];
+    uint32_t h = 0x811c9dc5;
+    for (uint32_t i = 0; i < c_dag.size(); i++)
+        c_dag[i] = h = (h ^ i) * 0x1000193;
+    for (uint32_t i = 0; i < PROGPOW_LANES * PROGPOW_DAG_LOADS; i++)
+        line[i] = h = (h ^ i) * 0x1000193;
+
+    uint32_t expected[PROGPOW_LANES][PROGPOW_REGS];
+    uint32_t actual[PROGPOW_LANES][PROGPOW_REGS];
+    for (uint32_t l = 0; l < PROGPOW_LANES; l++)
+        ProgPow::fillMix(prog_seed, l, expected[l]);
+    std::memcpy(actual, expected, sizeof(actual));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        ProgPow::loop(prog, i, expected, line, c_dag.data());
+        loop(i, actual, line, c_dag.data());
+    }
+    return std::memcmp(expected, actual, sizeof(actual)) == 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "ProgPow.h"
+
+// Host compiled ProgPoW loops. The source of ProgPow::getHostKern is built with
+// the system compiler into one shared object per prog_seed, kept in a cache
+// directory and loaded with dlopen. Builds run in the background, callers use
+// ProgPow::loop until theirs is loaded.
+class ProgPowJit
+{
+public:
+    // One loaded program, unloaded with its last reference
+    class Kernel
+    {
+    public:
+        Kernel(void* handle, ProgPow::loop_t loop): loop(loop), m_handle(handle) {}
+        ~Kernel();
+
+        ProgPow::loop_t const loop;
+
+    private:
+        Kernel(Kernel const&) = delete;
+        Kernel& operator=(Kernel const&) = delete;
+
+        void* m_handle;
+    };
+    typedef std::shared_ptr<Kernel const> kernel_ptr;
+    typedef std::function<void(std::string const&)> log_t;
+
+    // Programs kept loaded, besides those still referenced
+    static const unsigned MAX_LOADED = 4;
+    // Part of the cached object names, bumped when the generated source changes
+    static const unsigned SOURCE_VERSION = 1;
+
+    // Enables the builds with 'compiler' into 'cache_dir', ~/.cache/ethminer when empty.
+    // Stays disabled when the directory is not private to this user.
+    // 'log' hears about builds and failures, from the building thread.
+    static void configure(std::string const& compiler, std::string const& cache_dir, log_t const& log);
+    static bool enabled();
+
+    // The loop of 'prog_seed', nullptr while it is built or when the build failed.
+    // The first call for a prog_seed starts its build.
+    static kernel_ptr get(uint64_t prog_seed);
+    // Starts the build of 'prog_seed' ahead of its use
+    static void prepare(uint64_t prog_seed) { get(prog_seed); }
+
+private:
+    static kernel_ptr build(uint64_t prog_seed);
+    static bool check(uint64_t prog_seed, ProgPow::loop_t loop);
+};
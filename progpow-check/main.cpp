@@ -0,0 +1,466 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file main.cpp
+ * Cross-backend consistency check of the ProgPoW search kernels.
+ *
+ * For random periods, hashes a range of nonces with the host reference engine,
+ * the interleaved CPU miner search and the OpenCL kernel generated for the
+ * period, over a random synthetic DAG, and reports every divergence. Any
+ * OpenCL device works, POCL on the host included, so the generated source is
+ * checked without a GPU.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libprogpow/ProgPow.h>
+
+#if ETH_ETHASHCL
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS true
+#define CL_HPP_ENABLE_EXCEPTIONS true
+#define CL_HPP_CL_1_2_DEFAULT_BUILD true
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#include <libethash-cl/CL/cl2.hpp>
+#include "CLMiner_kernel.h"
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+
+/// Words the kernel writes per nonce under PROGPOW_CHECK: the digest, then the result.
+unsigned const c_checkWords = 10;
+unsigned const c_maxReport = 8;
+
+struct Options
+{
+	unsigned periods = 1000;
+	unsigned nonces = 256;
+	unsigned dagMB = 64;
+	unsigned platform = 0;
+	unsigned device = 0;
+	unsigned localWork = 128;
+	uint64_t seed = 0;
+	bool cl = true;
+	bool shareFence = true;
+	unsigned subgroup = ProgPow::SUBGROUP_NONE;
+};
+
+/// Reference values of one nonce.
+struct Reference
+{
+	ProgPow::hash32_t digest;
+	uint64_t result;
+};
+
+struct Totals
+{
+	uint64_t hashes = 0;
+	uint64_t mismatches = 0;
+	double hostSeconds = 0;
+	double searchSeconds = 0;
+	double clSeconds = 0;
+	double buildSeconds = 0;
+};
+
+void usage()
+{
+	cout
+		<< "Usage progpow-check [OPTIONS]" << endl
+		<< "Compares the host ProgPoW engine, the CPU miner search and the generated OpenCL kernel." << endl
+		<< endl
+		<< "Options:" << endl
+		<< "    --periods <n> Random periods to check (default: 1000)." << endl
+		<< "    --nonces <n> Nonces hashed per period, rounded up to the work group size (default: 256)." << endl
+		<< "    --dag-mb <n> Size of the random synthetic DAG in MB (default: 64)." << endl
+		<< "    --seed <n> Seed of the periods, headers, nonces and DAG (default: random)." << endl
+		<< "    --no-cl Only compare the host engines." << endl
+#if ETH_ETHASHCL
+		<< "    --platform <n> OpenCL platform (default: 0)." << endl
+		<< "    --device <n> OpenCL device of the platform, of any type (default: 0)." << endl
+		<< "    --local-work <n> Work group size, a multiple of 16 (default: 128)." << endl
+		<< "    --no-share-fence Build the kernel as for GPUs even on CPU devices." << endl
+		<< "    --subgroup <n> Lane exchange of the kernel, as ProgPow::subgroup_t (default: 0, local memory)." << endl
+		<< "        1: cl_intel_subgroups, 2: cl_khr_subgroup_shuffle, 3: cl_khr_subgroups, 4: amdgcn ds_bpermute" << endl
+#endif
+		<< "    -h,--help Show this help message and exit." << endl
+		;
+}
+
+/// Hashes @a _count nonces from @a _start with ProgPow::hash on every hardware thread.
+vector<Reference> reference(ProgPow::program_t const& _prog, ProgPow::hash32_t const& _header, uint64_t _start,
+	unsigned _count, vector<uint32_t> const& _dag, uint32_t _elements)
+{
+	vector<Reference> refs(_count);
+	unsigned const threads = std::max(1u, std::min(thread::hardware_concurrency(), _count));
+	ProgPow::dag_loader_t const load = [&](uint32_t _line, uint32_t* _words) {
+		memcpy(_words, &_dag[(size_t)_line * PROGPOW_LANES * PROGPOW_DAG_LOADS],
+			PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t));
+	};
+
+	vector<thread> workers;
+	for (unsigned t = 0; t < threads; t++)
+		workers.emplace_back([&, t]() {
+			for (unsigned i = t; i < _count; i += threads)
+				refs[i].digest = ProgPow::hash(_prog, _header, _start + i, _elements, _dag.data(), load, refs[i].result);
+		});
+	for (auto& w: workers)
+		w.join();
+	return refs;
+}
+
+/// Checks that the CPU miner search finds exactly the nonces whose reference result is below the target.
+unsigned checkSearch(ProgPow::program_t const& _prog, ProgPow::hash32_t const& _header, uint64_t _start,
+	vector<Reference> const& _refs, vector<uint32_t> const& _dag, uint32_t _elements, uint64_t _target, unsigned _interleave)
+{
+	vector<uint64_t> expected;
+	for (unsigned i = 0; i < _refs.size(); i++)
+		if (_refs[i].result < _target)
+			expected.push_back(_start + i);
+
+	vector<uint64_t> found(_refs.size());
+	uint32_t const count = ProgPow::search(_prog, _header, _start, (uint32_t)_refs.size(), _target, _interleave,
+		_elements, _dag.data(), _dag.data(), found.data(), (uint32_t)found.size());
+	found.resize(count);
+	sort(found.begin(), found.end());
+
+	vector<uint64_t> diff;
+	set_symmetric_difference(expected.begin(), expected.end(), found.begin(), found.end(), back_inserter(diff));
+	for (unsigned i = 0; i < diff.size() && i < c_maxReport; i++)
+		cout << "  search (interleave " << _interleave << ") disagrees on nonce " << diff[i] << endl;
+	return (unsigned)diff.size();
+}
+
+#if ETH_ETHASHCL
+
+void addDefinition(string& _source, char const* _id, uint64_t _value)
+{
+	_source.insert(0, "#define " + string(_id) + " " + to_string(_value) + "u\n");
+}
+
+/// Platform id as CLMiner derives it, selecting the kernel variant.
+unsigned platformId(cl::Platform const& _platform)
+{
+	string const name = _platform.getInfo<CL_PLATFORM_NAME>();
+	if (name == "NVIDIA CUDA")
+		return 1;
+	if (name == "AMD Accelerated Parallel Processing")
+		return 2;
+	if (name == "Clover")
+		return 3;
+	return 0;
+}
+
+string toHex(ProgPow::hash32_t const& _h)
+{
+	ostringstream out;
+	out << hex << setfill('0');
+	for (uint32_t w: _h.uint32s)
+		out << setw(8) << w;
+	return out.str();
+}
+
+/// Reports the nonces of @a _got that differ from the reference, returns their number.
+unsigned compare(char const* _backend, uint64_t _start, vector<Reference> const& _refs, vector<Reference> const& _got)
+{
+	unsigned bad = 0;
+	for (unsigned i = 0; i < _refs.size(); i++)
+	{
+		if (!memcmp(&_refs[i].digest, &_got[i].digest, sizeof(ProgPow::hash32_t)) && _refs[i].result == _got[i].result)
+			continue;
+		if (bad++ < c_maxReport)
+			cout << "  " << _backend << " nonce " << _start + i << ": digest " << toHex(_got[i].digest)
+				<< " result " << hex << _got[i].result << ", host " << toHex(_refs[i].digest)
+				<< " result " << _refs[i].result << dec << endl;
+	}
+	return bad;
+}
+
+class ClBackend
+{
+public:
+	ClBackend(Options const& _options, vector<uint32_t> const& _dag, uint32_t _elements):
+		m_options(_options), m_elements(_elements)
+	{
+		vector<cl::Platform> platforms;
+		cl::Platform::get(&platforms);
+		if (_options.platform >= platforms.size())
+			throw runtime_error("no OpenCL platform " + to_string(_options.platform));
+		m_platformId = platformId(platforms[_options.platform]);
+
+		// Any device type: the point is to run on CPU implementations too.
+		vector<cl::Device> devices;
+		platforms[_options.platform].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		if (_options.device >= devices.size())
+			throw runtime_error("no OpenCL device " + to_string(_options.device));
+		m_device = devices[_options.device];
+		m_lockstep = m_device.getInfo<CL_DEVICE_TYPE>() != CL_DEVICE_TYPE_CPU || !_options.shareFence;
+		cout << "OpenCL device: " << platforms[_options.platform].getInfo<CL_PLATFORM_NAME>() << " / "
+			<< m_device.getInfo<CL_DEVICE_NAME>() << (m_lockstep ? "" : " (share fence)") << endl;
+
+		m_context = cl::Context(vector<cl::Device>(1, m_device));
+		m_queue = cl::CommandQueue(m_context, m_device);
+		m_dag = cl::Buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			_dag.size() * sizeof(uint32_t), const_cast<uint32_t*>(_dag.data()));
+		m_header = cl::Buffer(m_context, CL_MEM_READ_ONLY, sizeof(ProgPow::hash32_t));
+		m_output = cl::Buffer(m_context, CL_MEM_READ_WRITE, sizeof(uint32_t) * 64);
+		m_check = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, sizeof(uint32_t) * c_checkWords * _options.nonces);
+	}
+
+	/// Builds the kernel of @a _block as CLMiner does, plus PROGPOW_CHECK.
+	double build(uint64_t _block)
+	{
+		auto const start = steady_clock::now();
+		string code = ProgPow::getKern(_block, ProgPow::KERNEL_CL);
+		code += string(CLMiner_kernel, sizeof(CLMiner_kernel));
+		addDefinition(code, "GROUP_SIZE", m_options.localWork);
+		addDefinition(code, "PROGPOW_DAG_BYTES", (uint64_t)m_elements * PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t));
+		addDefinition(code, "PROGPOW_DAG_ELEMENTS", m_elements);
+		addDefinition(code, "MAX_OUTPUTS", 63);
+		addDefinition(code, "PLATFORM", m_platformId);
+		addDefinition(code, "PROGPOW_CHECK", 1);
+		if (!m_lockstep)
+			addDefinition(code, "PROGPOW_SHARE_FENCE", 1);
+		addDefinition(code, "PROGPOW_SUBGROUP", m_options.subgroup);
+		// The cl_khr_subgroups built-ins are OpenCL C 2.0
+		bool const khr = m_options.subgroup == ProgPow::SUBGROUP_KHR || m_options.subgroup == ProgPow::SUBGROUP_KHR_SHUFFLE;
+
+		cl::Program program(m_context, cl::Program::Sources{{code.data(), code.size()}});
+		try
+		{
+			program.build({m_device}, khr ? "-cl-std=CL2.0" : "");
+		}
+		catch (cl::Error const&)
+		{
+			cout << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device) << endl;
+			throw;
+		}
+		m_kernel = cl::Kernel(program, "ethash_search");
+		return duration<double>(steady_clock::now() - start).count();
+	}
+
+	/// Runs the search over @a _count nonces from @a _start, returning the seconds spent in the kernel.
+	double run(ProgPow::hash32_t const& _header, uint64_t _start, unsigned _count, vector<Reference>& _out)
+	{
+		uint32_t const zero = 0;
+		m_queue.enqueueWriteBuffer(m_header, CL_TRUE, 0, sizeof(_header), &_header);
+		m_queue.enqueueWriteBuffer(m_output, CL_TRUE, 0, sizeof(zero), &zero);
+		m_kernel.setArg(0, m_output);
+		m_kernel.setArg(1, m_header);
+		m_kernel.setArg(2, m_dag);
+		m_kernel.setArg(3, (cl_ulong)_start);
+		m_kernel.setArg(4, (cl_ulong)0);
+		m_kernel.setArg(5, (cl_uint)0);
+		m_kernel.setArg(6, m_check);
+
+		auto const start = steady_clock::now();
+		m_queue.enqueueNDRangeKernel(m_kernel, cl::NullRange, _count, m_options.localWork);
+		m_queue.finish();
+		double const seconds = duration<double>(steady_clock::now() - start).count();
+
+		vector<uint32_t> words(c_checkWords * _count);
+		m_queue.enqueueReadBuffer(m_check, CL_TRUE, 0, words.size() * sizeof(uint32_t), words.data());
+		_out.resize(_count);
+		for (unsigned i = 0; i < _count; i++)
+		{
+			memcpy(_out[i].digest.uint32s, &words[i * c_checkWords], sizeof(ProgPow::hash32_t));
+			_out[i].result = (uint64_t)words[i * c_checkWords + 9] << 32 | words[i * c_checkWords + 8];
+		}
+		return seconds;
+	}
+
+private:
+	Options const& m_options;
+	uint32_t m_elements;
+	unsigned m_platformId = 0;
+	bool m_lockstep = true;
+	cl::Device m_device;
+	cl::Context m_context;
+	cl::CommandQueue m_queue;
+	cl::Buffer m_dag;
+	cl::Buffer m_header;
+	cl::Buffer m_output;
+	cl::Buffer m_check;
+	cl::Kernel m_kernel;
+};
+
+#endif
+
+bool parse(int _argc, char** _argv, Options& _o)
+{
+	for (int i = 1; i < _argc; i++)
+	{
+		string const arg = _argv[i];
+		bool const hasValue = i + 1 < _argc;
+		try
+		{
+			if (arg == "--periods" && hasValue)
+				_o.periods = stoul(_argv[++i]);
+			else if (arg == "--nonces" && hasValue)
+				_o.nonces = stoul(_argv[++i]);
+			else if (arg == "--dag-mb" && hasValue)
+				_o.dagMB = stoul(_argv[++i]);
+			else if (arg == "--seed" && hasValue)
+				_o.seed = stoull(_argv[++i]);
+			else if (arg == "--no-cl")
+				_o.cl = false;
+#if ETH_ETHASHCL
+			else if (arg == "--platform" && hasValue)
+				_o.platform = stoul(_argv[++i]);
+			else if (arg == "--device" && hasValue)
+				_o.device = stoul(_argv[++i]);
+			else if (arg == "--local-work" && hasValue)
+				_o.localWork = stoul(_argv[++i]);
+			else if (arg == "--no-share-fence")
+				_o.shareFence = false;
+			else if (arg == "--subgroup" && hasValue)
+			{
+				_o.subgroup = stoul(_argv[++i]);
+				if (_o.subgroup > ProgPow::SUBGROUP_AMD)
+					throw invalid_argument(arg);
+			}
+#endif
+			else if (arg == "-h" || arg == "--help")
+			{
+				usage();
+				exit(0);
+			}
+			else
+			{
+				cerr << "Invalid argument: " << arg << endl;
+				return false;
+			}
+		}
+		catch (...)
+		{
+			cerr << "Bad " << arg << " option: " << _argv[i] << endl;
+			return false;
+		}
+	}
+	if (_o.localWork == 0 || _o.localWork % PROGPOW_LANES || _o.dagMB == 0 || _o.nonces == 0)
+	{
+		cerr << "Bad --local-work, --dag-mb or --nonces" << endl;
+		return false;
+	}
+	// The kernel hashes whole groups.
+	_o.nonces = (_o.nonces + _o.localWork - 1) / _o.localWork * _o.localWork;
+	return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse(argc, argv, options))
+		return 2;
+	if (!options.seed)
+		options.seed = random_device()();
+
+	mt19937_64 rng(options.seed);
+	uint32_t const elements = (uint32_t)((uint64_t)options.dagMB * 1024 * 1024 / (PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t)));
+	vector<uint32_t> dag((size_t)elements * PROGPOW_LANES * PROGPOW_DAG_LOADS);
+	for (auto& w: dag)
+		w = (uint32_t)rng();
+	cout << "Seed " << options.seed << ", " << options.periods << " periods of " << options.nonces
+		<< " nonces over a " << options.dagMB << " MB DAG" << endl;
+
+#if ETH_ETHASHCL
+	unique_ptr<ClBackend> cl;
+	if (options.cl)
+	{
+		try
+		{
+			cl.reset(new ClBackend(options, dag, elements));
+		}
+		catch (std::exception const& _e)
+		{
+			cerr << "OpenCL setup failed: " << _e.what() << endl;
+			return 2;
+		}
+	}
+#endif
+
+	Totals totals;
+	for (unsigned p = 0; p < options.periods; p++)
+	{
+		uint64_t const block = rng() % (1ull << 40);
+		ProgPow::program_t const prog = ProgPow::decode(block);
+		ProgPow::hash32_t header;
+		for (auto& w: header.uint32s)
+			w = (uint32_t)rng();
+		uint64_t const start = rng();
+
+		auto t = steady_clock::now();
+		vector<Reference> const refs = reference(prog, header, start, options.nonces, dag, elements);
+		totals.hostSeconds += duration<double>(steady_clock::now() - t).count();
+		totals.hashes += options.nonces;
+
+		// Half of the nonces pass, and every interleave gets its turn.
+		t = steady_clock::now();
+		unsigned bad = checkSearch(prog, header, start, refs, dag, elements, 1ull << 63,
+			1 + p % ProgPow::MAX_INTERLEAVE);
+		totals.searchSeconds += duration<double>(steady_clock::now() - t).count();
+
+#if ETH_ETHASHCL
+		if (cl)
+		{
+			try
+			{
+				vector<Reference> got;
+				totals.buildSeconds += cl->build(block);
+				totals.clSeconds += cl->run(header, start, options.nonces, got);
+				bad += compare("OpenCL", start, refs, got);
+			}
+			catch (std::exception const& _e)
+			{
+				cout << "  OpenCL failed: " << _e.what() << endl;
+				bad += options.nonces;
+			}
+		}
+#endif
+
+		totals.mismatches += bad;
+		if (bad)
+			cout << "Block " << block << " (prog_seed " << prog.prog_seed << "): " << bad << " mismatches" << endl;
+		else if ((p + 1) % 100 == 0)
+			cout << p + 1 << " periods checked" << endl;
+	}
+
+	auto const rate = [&](double _seconds) { return (uint64_t)(totals.hashes / std::max(_seconds, 1e-9)); };
+	cout << totals.hashes << " hashes, " << totals.mismatches << " mismatches" << endl
+		<< "  host:   " << rate(totals.hostSeconds) << " H/s on " << std::max(1u, thread::hardware_concurrency()) << " threads" << endl
+		<< "  search: " << rate(totals.searchSeconds) << " H/s on 1 thread" << endl;
+#if ETH_ETHASHCL
+	if (cl)
+		cout << "  OpenCL: " << rate(totals.clSeconds) << " H/s, "
+			<< fixed << setprecision(1) << totals.buildSeconds * 1000 / options.periods << " ms per kernel build" << endl;
+#endif
+	return totals.mismatches ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Check.h
+ * The checks of the unit tests, which return checkFailures() from main.
+ */
+
+#pragma once
+
+#include <iostream>
+
+namespace dev
+{
+namespace test
+{
+
+inline int& checkFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+}
+}
+
+/// Reports @a _cond where it fails and goes on with the test.
+#define CHECK(_cond) \
+	do { \
+		if (!(_cond)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #_cond << std::endl; \
+			++dev::test::checkFailures(); \
+		} \
+	} while (false)
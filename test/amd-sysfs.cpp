@@ -0,0 +1,141 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file amd-sysfs.cpp
+ * The AMD sysfs sensors read from a fake /sys tree: card and hwmon lookup,
+ * values parsed from the files kept open, and a refresh picking up changes.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libhwmon/wrapamdsysfs.h>
+
+#include "Check.h"
+
+using namespace std;
+
+namespace
+{
+
+string s_root;
+
+/// Writes @a _content to @a _path below the fake root, making its directories.
+void put(string const& _path, string const& _content)
+{
+	string const path = s_root + "/" + _path;
+	for (size_t slash = path.find('/', s_root.size() + 1); slash != string::npos; slash = path.find('/', slash + 1))
+		mkdir(path.substr(0, slash).c_str(), 0755);
+	ofstream(path, ios::binary | ios::trunc) << _content;
+}
+
+int removeEntry(char const* _path, struct stat const*, int, struct FTW*)
+{
+	return remove(_path);
+}
+
+void makeTree()
+{
+	// Not AMD, skipped.
+	put("class/drm/card0/device/vendor", "0x10de\n");
+	// A connector beside the cards, not a card.
+	put("class/drm/card1-DP-1/status", "disconnected\n");
+
+	// The lowest hwmon of a card is the one read.
+	put("class/drm/card1/device/vendor", "0x1002\n");
+	put("class/drm/card1/device/uevent", "DRIVER=amdgpu\nPCI_SLOT_NAME=0000:03:00.0\n");
+	put("class/drm/card1/device/hwmon/hwmon5/temp1_input", "99000\n");
+	put("class/drm/card1/device/hwmon/hwmon3/temp1_input", "65000\n");
+	put("class/drm/card1/device/hwmon/hwmon3/pwm1", "128\n");
+	put("class/drm/card1/device/hwmon/hwmon3/pwm1_max", "255\n");
+	put("class/drm/card1/device/hwmon/hwmon3/pwm1_min", "0\n");
+	// Longer than the first read buffer, the power line last.
+	put("kernel/debug/dri/1/amdgpu_pm_info",
+		string(5000, ' ') + "\nGFX Clocks and Power:\n\t300 MHz (MCLK)\n\t87.25 W (average GPU)\n");
+
+	// No power info, a fan range not from 0.
+	put("class/drm/card2/device/vendor", "0x1002\n");
+	put("class/drm/card2/device/uevent", "PCI_SLOT_NAME=0000:04:00.0\n");
+	put("class/drm/card2/device/hwmon/hwmon7/temp1_input", "51500\n");
+	put("class/drm/card2/device/hwmon/hwmon7/pwm1", "75\n");
+	put("class/drm/card2/device/hwmon/hwmon7/pwm1_max", "150\n");
+	put("class/drm/card2/device/hwmon/hwmon7/pwm1_min", "50\n");
+}
+
+}
+
+int main()
+{
+	char root[] = "/tmp/amd-sysfs-XXXXXX";
+	if (!mkdtemp(root))
+		return 1;
+	s_root = root;
+	makeTree();
+
+	wrap_amdsysfs_handle* h = wrap_amdsysfs_create_at(root);
+	CHECK(h);
+	if (h)
+	{
+		int count = 0;
+		wrap_amdsysfs_get_gpucount(h, &count);
+		CHECK(count == 2);
+
+		char pci[13] = {};
+		CHECK(wrap_amdsysfs_get_gpu_pci_id(h, 0, pci, sizeof(pci) - 1) == 0);
+		CHECK(string(pci) == "0000:03:00.0");
+
+		unsigned temp = 0;
+		unsigned fan = 0;
+		unsigned mw = 0;
+		CHECK(wrap_amdsysfs_get_tempC(h, 0, &temp) == 0);
+		CHECK(temp == 65);
+		CHECK(wrap_amdsysfs_get_fanpcnt(h, 0, &fan) == 0);
+		CHECK(fan == 50);
+		CHECK(wrap_amdsysfs_get_power_usage(h, 0, &mw) == 0);
+		CHECK(mw == 87250);
+
+		CHECK(wrap_amdsysfs_get_tempC(h, 1, &temp) == 0);
+		CHECK(temp == 51);
+		CHECK(wrap_amdsysfs_get_fanpcnt(h, 1, &fan) == 0);
+		CHECK(fan == 25);
+		CHECK(wrap_amdsysfs_get_power_usage(h, 1, &mw) == -1);
+
+		// Rewritten in place, read again through the open files.
+		put("class/drm/card1/device/hwmon/hwmon3/temp1_input", "71000\n");
+		put("class/drm/card1/device/hwmon/hwmon3/pwm1", "255\n");
+		put("kernel/debug/dri/1/amdgpu_pm_info", "\t120 W (average GPU)\n");
+		wrap_amdsysfs_refresh(h, 1);
+		CHECK(wrap_amdsysfs_get_tempC(h, 0, &temp) == 0);
+		CHECK(temp == 71);
+		CHECK(wrap_amdsysfs_get_fanpcnt(h, 0, &fan) == 0);
+		CHECK(fan == 100);
+		CHECK(wrap_amdsysfs_get_power_usage(h, 0, &mw) == 0);
+		CHECK(mw == 120000);
+
+		wrap_amdsysfs_destroy(h);
+	}
+
+	// No drm class at all.
+	CHECK(!wrap_amdsysfs_create_at((s_root + "/none").c_str()));
+
+	nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return dev::test::checkFailures();
+}
@@ -0,0 +1,152 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file nonce-cursor.cpp
+ * Leases of the per-job nonce cursor: no nonce twice, the end of the space
+ * and the pool extranonce kept in front of every nonce.
+ */
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libethcore/Farm.h>
+
+#include "Check.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+typedef vector<pair<uint64_t, uint64_t>> Leases;	///< Start and count.
+
+/// Leases until the space is used up, as a miner of @a _granularity would.
+Leases leaseAll(NonceCursor& _nonces, uint64_t _count, uint64_t _granularity)
+{
+	Leases leases;
+	uint64_t start = 0;
+	while (uint64_t const count = _nonces.lease(_count, _granularity, start))
+		leases.emplace_back(start, count);
+	return leases;
+}
+
+void testNoOverlap()
+{
+	uint64_t const base = 0x1234500000ull;
+	unsigned const bits = 24;
+	NonceCursor nonces(base, bits);
+
+	// Miners of different launch sizes leasing at once.
+	unsigned const threads = 8;
+	vector<Leases> leases(threads);
+	vector<thread> miners;
+	for (unsigned i = 0; i < threads; i++)
+		miners.emplace_back([&, i]() { leases[i] = leaseAll(nonces, 256 << (i % 4), 64); });
+	for (auto& m: miners)
+		m.join();
+
+	Leases all;
+	for (auto const& l: leases)
+		all.insert(all.end(), l.begin(), l.end());
+	sort(all.begin(), all.end());
+	CHECK(!all.empty());
+	uint64_t next = base;
+	uint64_t searched = 0;
+	for (auto const& l: all)
+	{
+		CHECK(l.first >= next);
+		CHECK(l.second % 64 == 0);
+		next = l.first + l.second;
+		searched += l.second;
+	}
+	CHECK(next <= base + (1ull << bits));
+	// Only the leases crossing the end lose nonces, less than a launch each.
+	CHECK(searched > (1ull << bits) - threads * 2048);
+}
+
+void testExhaustion()
+{
+	NonceCursor nonces(0, 10);
+	uint64_t start = 0;
+	CHECK(nonces.lease(768, 256, start) == 768);
+	CHECK(start == 0);
+	// Cut to the granularity at the end of the space.
+	CHECK(nonces.lease(768, 256, start) == 256);
+	CHECK(start == 768);
+	CHECK(nonces.lease(768, 256, start) == 0);
+	CHECK(nonces.lease(1, 1, start) == 0);
+	CHECK(nonces.leased() >= 1024);
+	CHECK(nonces.takeExhausted());
+	CHECK(!nonces.takeExhausted());
+
+	// Unbounded from 64 bits.
+	NonceCursor wide(0, 64);
+	CHECK(wide.lease(1ull << 40, 1, start) == 1ull << 40);
+	CHECK(wide.lease(1ull << 40, 1, start) == 1ull << 40);
+	CHECK(start == 1ull << 40);
+}
+
+void testExtranonce()
+{
+	// A pool extranonce of "abcd", as the stratum client hands it on.
+	WorkPackage wp;
+	wp.startNonce = 0xabcd000000000000ull;
+	wp.exSizeBits = 16;
+	auto nonces = Farm::nonceSpace(wp, 0x0123456789abcdefull);
+	for (unsigned i = 0; i < 1000; i++)
+	{
+		uint64_t start = 0;
+		uint64_t const count = nonces->lease(1 << 20, 256, start);
+		CHECK(count == 1 << 20);
+		CHECK(start >> 48 == 0xabcd);
+		CHECK((start + count - 1) >> 48 == 0xabcd);
+	}
+
+	// The whole space below a long extranonce keeps it.
+	wp.startNonce = 0xabcdef0123456700ull;
+	wp.exSizeBits = 56;
+	nonces = Farm::nonceSpace(wp, 0);
+	Leases const leases = leaseAll(*nonces, 16, 1);
+	uint64_t searched = 0;
+	for (auto const& l: leases)
+	{
+		CHECK(l.first >> 8 == 0xabcdef01234567ull);
+		CHECK((l.first + l.second - 1) >> 8 == 0xabcdef01234567ull);
+		searched += l.second;
+	}
+	CHECK(searched == 256);
+
+	// Without one, the nonces stay below Farm::c_nonceBits.
+	wp.exSizeBits = -1;
+	nonces = Farm::nonceSpace(wp, ~0ull);
+	uint64_t start = 0;
+	CHECK(nonces->lease(1 << 20, 1, start) == 1 << 20);
+	CHECK((start + (1ull << (Farm::c_nonceBits - 1)) - 1) >> Farm::c_nonceBits == 0);
+}
+
+}
+
+int main()
+{
+	testNoOverlap();
+	testExhaustion();
+	testExtranonce();
+	return dev::test::checkFailures();
+}
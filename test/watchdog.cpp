@@ -0,0 +1,182 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file watchdog.cpp
+ * The watchdog escalation on fake miners, on a clock of its own: kick,
+ * reinit, restart, one stall time apart, and a refused restart retried.
+ */
+
+#include <string>
+#include <vector>
+
+#include <libethcore/Watchdog.h>
+
+#include "Check.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+typedef chrono::steady_clock Clock;
+
+/// Records what the watchdog does. Miners hash on every tick unless stalled,
+/// a restart gives one that hashes again.
+class FakeMiners: public MinerControl
+{
+public:
+	explicit FakeMiners(unsigned _count): miners(_count), stalled(_count)
+	{
+		for (auto& m: miners)
+			m.batchMs = 50;
+	}
+
+	vector<MinerHealth> health() const override { return miners; }
+	void kick(unsigned _index) override { actions += "k" + to_string(_index); }
+	void reinit(unsigned _index) override { actions += "i" + to_string(_index); }
+	bool restart(unsigned _index) override
+	{
+		actions += (refuse ? "R" : "r") + to_string(_index);
+		if (refuse)
+			return false;
+		stalled[_index] = false;
+		miners[_index].lastProgress = now;
+		return true;
+	}
+
+	/// Ticks @a _dog every 100 ms of fake time for @a _ms.
+	void run(Watchdog& _dog, unsigned _ms)
+	{
+		for (unsigned t = 0; t < _ms; t += 100)
+		{
+			now += chrono::milliseconds(100);
+			for (unsigned i = 0; i < miners.size(); i++)
+				if (!stalled[i])
+					miners[i].lastProgress = now;
+			_dog.tick(now);
+		}
+	}
+
+	vector<MinerHealth> miners;
+	vector<bool> stalled;
+	string actions;
+	bool refuse = false;
+	Clock::time_point now;
+};
+
+WatchdogSettings settings()
+{
+	WatchdogSettings s;
+	s.factor = 20;
+	s.minStallMs = 1000;
+	return s;
+}
+
+void testEscalation()
+{
+	FakeMiners miners(2);
+	Watchdog dog(miners, settings());
+
+	miners.run(dog, 1000);
+	CHECK(miners.actions.empty());
+
+	// Stalled once 1 s without hashes, then one step per stall time.
+	miners.stalled[0] = true;
+	miners.run(dog, 1000);
+	CHECK(miners.actions.empty());
+	miners.run(dog, 100);
+	CHECK(miners.actions == "k0");
+	miners.run(dog, 1000);
+	CHECK(miners.actions == "k0");
+	miners.run(dog, 100);
+	CHECK(miners.actions == "k0i0");
+	miners.run(dog, 1100);
+	CHECK(miners.actions == "k0i0r0");
+	CHECK(dog.devices()[0].kicks == 1);
+	CHECK(dog.devices()[0].reinits == 1);
+	CHECK(dog.devices()[0].restarts == 1);
+	CHECK(dog.devices()[0].recoveries == 0);
+	CHECK(dog.devices()[0].level == 0);
+	CHECK(dog.devices()[1].stalls == 0);
+
+	// The new miner hashes, nothing more happens.
+	miners.run(dog, 5000);
+	CHECK(miners.actions == "k0i0r0");
+	CHECK(dog.devices()[0].stalls == 1);
+}
+
+void testRefusedRestart()
+{
+	FakeMiners miners(1);
+	Watchdog dog(miners, settings());
+
+	// Refused while another restart runs, retried one stall time later each.
+	miners.stalled[0] = true;
+	miners.refuse = true;
+	miners.run(dog, 3300);
+	CHECK(miners.actions == "k0i0R0");
+	miners.run(dog, 1000);
+	CHECK(miners.actions == "k0i0R0");
+	miners.run(dog, 100);
+	CHECK(miners.actions == "k0i0R0R0");
+	CHECK(dog.devices()[0].level == 3);
+
+	miners.refuse = false;
+	miners.run(dog, 1100);
+	CHECK(miners.actions == "k0i0R0R0r0");
+	CHECK(dog.devices()[0].restarts == 3);
+	CHECK(dog.devices()[0].level == 0);
+	CHECK(dog.devices()[0].stalls == 1);
+}
+
+void testRecoveryAndIdle()
+{
+	FakeMiners miners(2);
+	Watchdog dog(miners, settings());
+
+	// A slow miner stalls after factor batch times, past minStallMs.
+	miners.miners[0].batchMs = 200;
+	miners.stalled[0] = true;
+	// An idle miner is left alone however long.
+	miners.miners[1].idle = true;
+	miners.stalled[1] = true;
+	miners.run(dog, 4000);
+	CHECK(miners.actions.empty());
+	miners.run(dog, 100);
+	CHECK(miners.actions == "k0");
+
+	// Hashes again after the kick.
+	miners.stalled[0] = false;
+	miners.run(dog, 100);
+	CHECK(dog.devices()[0].recoveries == 1);
+	CHECK(dog.devices()[0].level == 0);
+	miners.run(dog, 10000);
+	CHECK(miners.actions == "k0");
+	CHECK(dog.devices()[1].stalls == 0);
+	CHECK(dog.devices()[1].recoveries == 0);
+}
+
+}
+
+int main()
+{
+	testEscalation();
+	testRefusedRestart();
+	testRecoveryAndIdle();
+	return dev::test::checkFailures();
+}